@@ -0,0 +1,77 @@
+/*
+ *  IXBase64Bench.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ *
+ *  The Sec-WebSocket-Accept key of each handshake (sha1, then base64), and
+ *  the base64 codec of ixcrypto, when it is built (with ws or the tests).
+ */
+
+#include "IXBench.h"
+#include <ixwebsocket/libwshandshake.hpp>
+
+#ifdef IXWEBSOCKET_BENCH_IXCRYPTO
+#include <ixcrypto/IXBase64.h>
+#endif
+
+using namespace ix;
+
+IX_BENCHMARK(WebSocketHandshakeAcceptKey)
+{
+    const std::string key("dGhlIHNhbXBsZSBub25jZQ==");
+    char output[29] = {};
+
+    while (state.keepRunning())
+    {
+        WebSocketHandshakeKeyGen::generate(key, output);
+        bench::doNotOptimize(output[0]);
+    }
+
+    state.setItemsProcessed(state.iterations());
+    if (std::string(output) != "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=") state.setLabel("mismatch");
+}
+
+#ifdef IXWEBSOCKET_BENCH_IXCRYPTO
+namespace
+{
+    std::string makeBinary(size_t size)
+    {
+        std::string data(size, '\0');
+        for (size_t i = 0; i < size; ++i)
+        {
+            data[i] = (char) ((i * 7919) & 0xff);
+        }
+        return data;
+    }
+} // namespace
+
+IX_BENCHMARK(Base64Encode16K)
+{
+    std::string data = makeBinary(16 * 1024);
+    std::string encoded;
+
+    while (state.keepRunning())
+    {
+        encoded = base64_encode(data, data.size());
+        bench::doNotOptimize(encoded);
+    }
+
+    state.setBytesProcessed(state.iterations() * data.size());
+}
+
+IX_BENCHMARK(Base64Decode16K)
+{
+    std::string data = makeBinary(16 * 1024);
+    std::string encoded = base64_encode(data, data.size());
+    std::string decoded;
+
+    while (state.keepRunning())
+    {
+        decoded = base64_decode(encoded);
+        bench::doNotOptimize(decoded);
+    }
+
+    state.setBytesProcessed(state.iterations() * data.size());
+    if (decoded != data) state.setLabel("mismatch");
+}
+#endif
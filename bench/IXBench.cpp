@@ -0,0 +1,382 @@
+/*
+ *  IXBench.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ */
+
+#include "IXBench.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <ixwebsocket/IXWebSocketVersion.h>
+#include <new>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+    std::atomic<uint64_t> allocationCount(0);
+} // namespace
+
+// Count the allocations of the whole process, the other forms of new and
+// delete forward to these two
+void* operator new(size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+
+    void* ptr = std::malloc(size == 0 ? 1 : size);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+namespace ix
+{
+    namespace bench
+    {
+        BenchState::BenchState(uint64_t iterations)
+            : _iterations(iterations)
+            , _remaining(iterations)
+            , _started(false)
+            , _paused(false)
+            , _elapsed(Clock::duration::zero())
+            , _bytes(0)
+            , _items(0)
+        {
+            ;
+        }
+
+        bool BenchState::keepRunning()
+        {
+            if (!_started)
+            {
+                _started = true;
+                _start = Clock::now();
+            }
+
+            if (_remaining == 0)
+            {
+                if (!_paused)
+                {
+                    _elapsed += Clock::now() - _start;
+                    _paused = true;
+                }
+                return false;
+            }
+
+            --_remaining;
+            return true;
+        }
+
+        void BenchState::pauseTiming()
+        {
+            if (_started && !_paused)
+            {
+                _elapsed += Clock::now() - _start;
+                _paused = true;
+            }
+        }
+
+        void BenchState::resumeTiming()
+        {
+            if (_paused)
+            {
+                _start = Clock::now();
+                _paused = false;
+            }
+        }
+
+        uint64_t BenchState::iterations() const
+        {
+            return _iterations;
+        }
+
+        double BenchState::elapsedSeconds() const
+        {
+            return std::chrono::duration<double>(_elapsed).count();
+        }
+
+        void BenchState::setBytesProcessed(uint64_t bytes)
+        {
+            _bytes = bytes;
+        }
+
+        void BenchState::setItemsProcessed(uint64_t items)
+        {
+            _items = items;
+        }
+
+        uint64_t BenchState::getBytesProcessed() const
+        {
+            return _bytes;
+        }
+
+        uint64_t BenchState::getItemsProcessed() const
+        {
+            return _items;
+        }
+
+        void BenchState::setLabel(const std::string& label)
+        {
+            _label = label;
+        }
+
+        const std::string& BenchState::getLabel() const
+        {
+            return _label;
+        }
+
+        uint64_t getAllocationCount()
+        {
+            return allocationCount.load(std::memory_order_relaxed);
+        }
+
+        namespace
+        {
+            struct Benchmark
+            {
+                std::string name;
+                BenchFunction function;
+            };
+
+            struct Result
+            {
+                std::string name;
+                uint64_t iterations;
+                double nsPerIteration;
+                double bytesPerSecond;
+                double itemsPerSecond;
+                std::string label;
+            };
+
+            std::vector<Benchmark>& getRegistry()
+            {
+                static std::vector<Benchmark> registry;
+                return registry;
+            }
+
+            std::string formatDuration(double seconds)
+            {
+                std::stringstream ss;
+                ss << std::fixed << std::setprecision(1);
+
+                if (seconds < 1e-6)
+                    ss << seconds * 1e9 << " ns";
+                else if (seconds < 1e-3)
+                    ss << seconds * 1e6 << " us";
+                else if (seconds < 1)
+                    ss << seconds * 1e3 << " ms";
+                else
+                    ss << seconds << " s";
+
+                return ss.str();
+            }
+
+            std::string formatRate(double rate, const std::string& unit)
+            {
+                std::stringstream ss;
+                ss << std::fixed << std::setprecision(2);
+
+                if (rate >= 1e9)
+                    ss << rate / 1e9 << " G";
+                else if (rate >= 1e6)
+                    ss << rate / 1e6 << " M";
+                else if (rate >= 1e3)
+                    ss << rate / 1e3 << " k";
+                else
+                    ss << rate << " ";
+
+                ss << unit << "/s";
+                return ss.str();
+            }
+
+            std::string escapeJson(const std::string& str)
+            {
+                std::stringstream ss;
+                for (char c : str)
+                {
+                    if (c == '"' || c == '\\')
+                        ss << '\\' << c;
+                    else if ((unsigned char) c < 0x20)
+                        ss << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int) c
+                           << std::dec;
+                    else
+                        ss << c;
+                }
+                return ss.str();
+            }
+
+            // One object per benchmark, so that runs of two commits can be compared
+            bool writeJson(const std::string& path,
+                           const std::vector<Result>& results,
+                           double minTime)
+            {
+                std::ofstream out(path);
+                if (!out) return false;
+
+                out << std::setprecision(10);
+                out << "{\n";
+                out << "  \"version\": \"" << IX_WEBSOCKET_VERSION << "\",\n";
+                out << "  \"min_time\": " << minTime << ",\n";
+                out << "  \"benchmarks\": [";
+
+                for (size_t i = 0; i < results.size(); ++i)
+                {
+                    const Result& result = results[i];
+                    out << (i == 0 ? "\n" : ",\n");
+                    out << "    {\"name\": \"" << escapeJson(result.name) << "\", "
+                        << "\"iterations\": " << result.iterations << ", "
+                        << "\"ns_per_iteration\": " << result.nsPerIteration << ", "
+                        << "\"bytes_per_second\": " << result.bytesPerSecond << ", "
+                        << "\"items_per_second\": " << result.itemsPerSecond << ", "
+                        << "\"label\": \"" << escapeJson(result.label) << "\"}";
+                }
+
+                out << "\n  ]\n}\n";
+                return out.good();
+            }
+
+            void usage(const char* program)
+            {
+                std::cerr << "Usage: " << program
+                          << " [-f filter] [--min-time seconds] [--json path] [--list]"
+                          << std::endl;
+            }
+        } // namespace
+
+        bool registerBenchmark(const std::string& name, const BenchFunction& function)
+        {
+            getRegistry().push_back({name, function});
+            return true;
+        }
+
+        int runBenchmarks(int argc, char** argv)
+        {
+            std::string filter;
+            std::string jsonPath;
+            double minTime = 0.5;
+            bool list = false;
+
+            for (int i = 1; i < argc; ++i)
+            {
+                if ((strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "--filter") == 0) &&
+                    i + 1 < argc)
+                {
+                    filter = argv[++i];
+                }
+                else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc)
+                {
+                    minTime = std::max(0.0, atof(argv[++i]));
+                }
+                else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+                {
+                    jsonPath = argv[++i];
+                }
+                else if (strcmp(argv[i], "--list") == 0)
+                {
+                    list = true;
+                }
+                else
+                {
+                    usage(argv[0]);
+                    return 1;
+                }
+            }
+
+            auto benchmarks = getRegistry();
+            std::sort(benchmarks.begin(),
+                      benchmarks.end(),
+                      [](const Benchmark& a, const Benchmark& b) { return a.name < b.name; });
+
+            std::vector<Result> results;
+
+            for (auto&& benchmark : benchmarks)
+            {
+                if (!filter.empty() && benchmark.name.find(filter) == std::string::npos)
+                {
+                    continue;
+                }
+
+                if (list)
+                {
+                    std::cout << benchmark.name << std::endl;
+                    continue;
+                }
+
+                // Grow the iteration count until the timed loop runs for at least minTime
+                uint64_t iterations = 1;
+                while (true)
+                {
+                    BenchState state(iterations);
+                    benchmark.function(state);
+
+                    double elapsed = state.elapsedSeconds();
+                    bool done = elapsed >= minTime || iterations >= (1ull << 40);
+
+                    if (done)
+                    {
+                        double bytesPerSecond =
+                            elapsed > 0 ? state.getBytesProcessed() / elapsed : 0;
+                        double itemsPerSecond =
+                            elapsed > 0 ? state.getItemsProcessed() / elapsed : 0;
+                        results.push_back({benchmark.name,
+                                           iterations,
+                                           elapsed * 1e9 / iterations,
+                                           bytesPerSecond,
+                                           itemsPerSecond,
+                                           state.getLabel()});
+
+                        std::cout << std::left << std::setw(40) << benchmark.name << std::right
+                                  << std::setw(14) << iterations << std::setw(14)
+                                  << formatDuration(elapsed / iterations);
+
+                        if (bytesPerSecond != 0)
+                        {
+                            std::cout << std::setw(16) << formatRate(bytesPerSecond, "B");
+                        }
+                        if (itemsPerSecond != 0)
+                        {
+                            std::cout << std::setw(18) << formatRate(itemsPerSecond, "items");
+                        }
+                        if (!state.getLabel().empty())
+                        {
+                            std::cout << "  " << state.getLabel();
+                        }
+                        std::cout << std::endl;
+                        break;
+                    }
+
+                    // Aim a bit above the minimum time, at most 10x more iterations per round
+                    double multiplier = 10;
+                    if (elapsed > 0)
+                    {
+                        multiplier = std::min(10.0, std::max(1.5, 1.4 * minTime / elapsed));
+                    }
+                    iterations = static_cast<uint64_t>(iterations * multiplier) + 1;
+                }
+            }
+
+            if (!jsonPath.empty() && !writeJson(jsonPath, results, minTime))
+            {
+                std::cerr << "Cannot write " << jsonPath << std::endl;
+                return 1;
+            }
+
+            return 0;
+        }
+    } // namespace bench
+} // namespace ix
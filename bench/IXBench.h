@@ -0,0 +1,91 @@
+/*
+ *  IXBench.h
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ *
+ *  Minimal benchmark harness. A benchmark is a function receiving a BenchState,
+ *  doing its setup, then looping while state.keepRunning() returns true.
+ *  The runner calls it with an increasing number of iterations until the
+ *  timed loop lasts long enough to be meaningful.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <stdint.h>
+#include <string>
+
+namespace ix
+{
+    namespace bench
+    {
+        class BenchState
+        {
+        public:
+            BenchState(uint64_t iterations);
+
+            // Returns true while there are iterations left. The timer starts
+            // on the first call, so setup done before the loop is not measured.
+            bool keepRunning();
+
+            // Exclude some work from the measurement
+            void pauseTiming();
+            void resumeTiming();
+
+            uint64_t iterations() const;
+            double elapsedSeconds() const;
+
+            // Used to report throughput, in bytes and items per second
+            void setBytesProcessed(uint64_t bytes);
+            void setItemsProcessed(uint64_t items);
+            uint64_t getBytesProcessed() const;
+            uint64_t getItemsProcessed() const;
+
+            // Free form text appended to the report line (ratio, errors, etc...)
+            void setLabel(const std::string& label);
+            const std::string& getLabel() const;
+
+        private:
+            using Clock = std::chrono::steady_clock;
+
+            uint64_t _iterations;
+            uint64_t _remaining;
+            bool _started;
+            bool _paused;
+            Clock::time_point _start;
+            Clock::duration _elapsed;
+            uint64_t _bytes;
+            uint64_t _items;
+            std::string _label;
+        };
+
+        using BenchFunction = std::function<void(BenchState&)>;
+
+        bool registerBenchmark(const std::string& name, const BenchFunction& function);
+        int runBenchmarks(int argc, char** argv);
+
+        // Number of operator new calls made by the process so far
+        uint64_t getAllocationCount();
+
+        // Prevent the compiler from optimizing away a computed value
+        template<typename T>
+        inline void doNotOptimize(const T& value)
+        {
+#if defined(__GNUC__) || defined(__clang__)
+            asm volatile("" : : "r,m"(value) : "memory");
+#else
+            static volatile const void* sink;
+            sink = &value;
+#endif
+        }
+    } // namespace bench
+} // namespace ix
+
+#define IX_BENCH_CONCAT_IMPL(a, b) a##b
+#define IX_BENCH_CONCAT(a, b) IX_BENCH_CONCAT_IMPL(a, b)
+
+#define IX_BENCHMARK(name)                                                                   \
+    static void name(ix::bench::BenchState& state);                                          \
+    static bool IX_BENCH_CONCAT(name, _registered) = ix::bench::registerBenchmark(#name, name); \
+    static void name(ix::bench::BenchState& state)
@@ -0,0 +1,79 @@
+/*
+ *  IXBenchSocket.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ */
+
+#include "IXBenchSocket.h"
+
+#include <ixwebsocket/IXSocketFactory.h>
+#include <ixwebsocket/IXSocketTLSOptions.h>
+#include <ixwebsocket/IXWebSocketMask.h>
+
+namespace ix
+{
+    namespace bench
+    {
+        std::shared_ptr<Socket> connectRawClient(int port)
+        {
+            std::string errMsg;
+            SocketTLSOptions tlsOptions;
+            auto socket = createSocket(false, -1, errMsg, tlsOptions);
+            if (!socket) return nullptr;
+
+            auto isCancellationRequested = []() -> bool { return false; };
+            if (!socket->connect("127.0.0.1", port, errMsg, isCancellationRequested))
+            {
+                return nullptr;
+            }
+
+            socket->writeBytes("GET / HTTP/1.1\r\n"
+                               "Upgrade: websocket\r\n"
+                               "Connection: Upgrade\r\n"
+                               "Sec-WebSocket-Version: 13\r\n"
+                               "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                               "\r\n",
+                               isCancellationRequested);
+
+            while (true)
+            {
+                auto line = socket->readLine(isCancellationRequested);
+                if (!line.first) return nullptr;
+                if (line.second == "\r\n") break;
+            }
+
+            return socket;
+        }
+
+        void appendClientFrame(std::string& frames, uint8_t opcode, const std::string& payload)
+        {
+            const uint8_t maskingKey[4] = {0x12, 0x34, 0x56, 0x78};
+            uint64_t size = payload.size();
+
+            frames += (char) (0x80 | opcode);
+            if (size < 126)
+            {
+                frames += (char) (0x80 | size);
+            }
+            else if (size < 65536)
+            {
+                frames += (char) (0x80 | 126);
+                frames += (char) (size >> 8);
+                frames += (char) (size & 0xff);
+            }
+            else
+            {
+                frames += (char) (0x80 | 127);
+                for (int shift = 56; shift >= 0; shift -= 8)
+                {
+                    frames += (char) ((size >> shift) & 0xff);
+                }
+            }
+            frames.append((const char*) maskingKey, 4);
+
+            size_t begin = frames.size();
+            frames += payload;
+            applyWebSocketMask((uint8_t*) &frames[begin], payload.size(), maskingKey);
+        }
+    } // namespace bench
+} // namespace ix
@@ -0,0 +1,27 @@
+/*
+ *  IXBenchSocket.h
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ *
+ *  Raw socket peers for the benchmarks of a server connection, so that only
+ *  the server side is measured.
+ */
+
+#pragma once
+
+#include <ixwebsocket/IXSocket.h>
+#include <memory>
+#include <stdint.h>
+#include <string>
+
+namespace ix
+{
+    namespace bench
+    {
+        // Connects to a local WebSocket server and completes the upgrade
+        std::shared_ptr<Socket> connectRawClient(int port);
+
+        // Appends a masked, final client frame with that opcode
+        void appendClientFrame(std::string& frames, uint8_t opcode, const std::string& payload);
+    } // namespace bench
+} // namespace ix
@@ -0,0 +1,137 @@
+/*
+ *  IXHttpParsingBench.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ *
+ *  Parsing done for each connection: the headers of an upgrade request, read
+ *  from a socket, its url, and the header lookups of the handshake.
+ */
+
+#include "IXBench.h"
+#include <ixwebsocket/IXSocket.h>
+#include <ixwebsocket/IXUrlParser.h>
+#include <ixwebsocket/IXWebSocketHttpHeaders.h>
+#include <memory>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#endif
+
+using namespace ix;
+
+namespace
+{
+    const std::string kRequestHeaders("Host: example.com:8443\r\n"
+                                      "User-Agent: ixwebsocket/8.3.0 linux\r\n"
+                                      "Accept: */*\r\n"
+                                      "Accept-Encoding: gzip, deflate\r\n"
+                                      "Origin: https://example.com\r\n"
+                                      "Upgrade: websocket\r\n"
+                                      "Connection: Upgrade\r\n"
+                                      "Sec-WebSocket-Version: 13\r\n"
+                                      "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                                      "Sec-WebSocket-Extensions: permessage-deflate; "
+                                      "client_max_window_bits\r\n"
+                                      "Sec-WebSocket-Protocol: chat\r\n"
+                                      "Cookie: session=0123456789abcdef\r\n"
+                                      "\r\n");
+
+    WebSocketHttpHeaders makeHeaders()
+    {
+        WebSocketHttpHeaders headers;
+        headers["Host"] = "example.com:8443";
+        headers["User-Agent"] = "ixwebsocket/8.3.0 linux";
+        headers["Accept"] = "*/*";
+        headers["Accept-Encoding"] = "gzip, deflate";
+        headers["Origin"] = "https://example.com";
+        headers["Upgrade"] = "websocket";
+        headers["Connection"] = "Upgrade";
+        headers["Sec-WebSocket-Version"] = "13";
+        headers["Sec-WebSocket-Key"] = "dGhlIHNhbXBsZSBub25jZQ==";
+        headers["Sec-WebSocket-Extensions"] = "permessage-deflate; client_max_window_bits";
+        headers["Sec-WebSocket-Protocol"] = "chat";
+        headers["Cookie"] = "session=0123456789abcdef";
+        return headers;
+    }
+} // namespace
+
+#ifndef _WIN32
+// Headers are read one byte at a time, so this counts the socket reads
+IX_BENCHMARK(ParseHttpHeaders)
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+    {
+        state.setLabel("cannot create socket pair");
+        while (state.keepRunning())
+            ;
+        return;
+    }
+
+    Socket writer(fds[0]);
+    auto reader = std::make_shared<Socket>(fds[1]);
+    auto isCancellationRequested = []() -> bool { return false; };
+    bool success = true;
+
+    while (state.keepRunning())
+    {
+        state.pauseTiming();
+        success = writer.writeBytes(kRequestHeaders, isCancellationRequested) && success;
+        state.resumeTiming();
+
+        auto headers = parseHttpHeaders(reader, isCancellationRequested);
+        success = headers.first && headers.second.size() == 12 && success;
+        bench::doNotOptimize(headers);
+    }
+
+    state.setBytesProcessed(state.iterations() * kRequestHeaders.size());
+    state.setItemsProcessed(state.iterations());
+    if (!success) state.setLabel("parse error");
+}
+#endif
+
+IX_BENCHMARK(UrlParserParse)
+{
+    const std::string url("wss://example.com:8443/chat/room?user=1234&token=abcdef0123456789");
+    std::string protocol, host, path, query;
+    int port = 0;
+    bool success = true;
+
+    while (state.keepRunning())
+    {
+        success = UrlParser::parse(url, protocol, host, path, query, port) && success;
+        bench::doNotOptimize(port);
+    }
+
+    state.setItemsProcessed(state.iterations());
+    if (!success || port != 8443) state.setLabel("parse error");
+}
+
+// The lookups of a server handshake, with the case of the request
+IX_BENCHMARK(WebSocketHttpHeadersLookup)
+{
+    const char* names[] = {"upgrade",
+                           "connection",
+                           "sec-websocket-version",
+                           "sec-websocket-key",
+                           "sec-websocket-extensions",
+                           "sec-websocket-protocol"};
+    const size_t count = sizeof(names) / sizeof(names[0]);
+
+    WebSocketHttpHeaders headers = makeHeaders();
+    std::vector<std::string> keys(names, names + count);
+    size_t found = 0;
+
+    while (state.keepRunning())
+    {
+        for (auto&& key : keys)
+        {
+            found += headers.find(key) != headers.end() ? 1 : 0;
+        }
+        bench::doNotOptimize(found);
+    }
+
+    state.setItemsProcessed(state.iterations() * count);
+    if (found != state.iterations() * count) state.setLabel("missing");
+}
@@ -0,0 +1,98 @@
+/*
+ *  IXHttpRouterBench.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ *
+ *  Match cost of the http router with thousands of registered routes.
+ */
+
+#include "IXBench.h"
+#include <ixwebsocket/IXHttpRouter.h>
+#include <sstream>
+#include <vector>
+
+using namespace ix;
+
+namespace
+{
+    const int kResources = 1000;
+
+    // Register 4 routes per resource: 4000 routes in total
+    void buildRouter(HttpRouter& router)
+    {
+        HttpRouter::Handler handler =
+            [](HttpRequestPtr, const HttpRouteParams&, std::shared_ptr<ConnectionState>)
+            -> HttpResponsePtr { return nullptr; };
+
+        for (int i = 0; i < kResources; ++i)
+        {
+            std::stringstream ss;
+            ss << "/api/v1/resource" << i;
+            std::string base = ss.str();
+
+            router.addRoute("GET", base, handler);
+            router.addRoute("GET", base + "/:id", handler);
+            router.addRoute("POST", base + "/:id/items/:item", handler);
+            router.addRoute("GET", base + "/static/*path", handler);
+        }
+
+        router.compile();
+    }
+
+    std::vector<std::string> buildPaths()
+    {
+        std::vector<std::string> paths;
+        for (int i = 0; i < kResources; i += 7)
+        {
+            std::stringstream ss;
+            ss << "/api/v1/resource" << i;
+            paths.push_back(ss.str());
+            paths.push_back(ss.str() + "/12345");
+            paths.push_back(ss.str() + "/static/css/main.css");
+        }
+        return paths;
+    }
+
+    void benchMatch(bench::BenchState& state, const std::vector<std::string>& paths)
+    {
+        HttpRouter router;
+        buildRouter(router);
+
+        HttpRouteParams params;
+        std::string method("GET");
+        size_t i = 0;
+
+        while (state.keepRunning())
+        {
+            const std::string& path = paths[i++ % paths.size()];
+            bool methodNotAllowed = false;
+            params.clear();
+            auto handler =
+                router.match(method, path.c_str(), path.size(), params, methodNotAllowed);
+            bench::doNotOptimize(handler);
+        }
+
+        state.setItemsProcessed(state.iterations());
+    }
+} // namespace
+
+IX_BENCHMARK(HttpRouterMatch)
+{
+    benchMatch(state, buildPaths());
+}
+
+IX_BENCHMARK(HttpRouterMatchNotFound)
+{
+    std::vector<std::string> paths = {"/api/v2/resource1", "/api/v1/resource99999/x/y/z"};
+    benchMatch(state, paths);
+}
+
+IX_BENCHMARK(HttpRouterCompile)
+{
+    while (state.keepRunning())
+    {
+        HttpRouter router;
+        buildRouter(router);
+        bench::doNotOptimize(router);
+    }
+}
@@ -0,0 +1,103 @@
+/*
+ *  IXHttpServerBench.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ *
+ *  Requests per second served by HttpServer on the loopback interface.
+ *  Each request uses a new connection, as HttpServer closes it after responding.
+ */
+
+#include "IXBench.h"
+#include "IXGetFreePort.h"
+#include <ixwebsocket/IXHttpServer.h>
+#include <ixwebsocket/IXSocket.h>
+#include <ixwebsocket/IXSocketFactory.h>
+#include <ixwebsocket/IXSocketTLSOptions.h>
+#include <stdlib.h>
+
+using namespace ix;
+
+namespace
+{
+    bool doRequest(int port, const std::string& request, size_t& bytes)
+    {
+        std::string errMsg;
+        SocketTLSOptions tlsOptions;
+        auto socket = createSocket(false, -1, errMsg, tlsOptions);
+        if (!socket) return false;
+
+        auto isCancellationRequested = []() -> bool { return false; };
+        if (!socket->connect("127.0.0.1", port, errMsg, isCancellationRequested)) return false;
+        if (!socket->writeBytes(request, isCancellationRequested)) return false;
+
+        // Status line and headers
+        size_t contentLength = 0;
+        while (true)
+        {
+            auto line = socket->readLine(isCancellationRequested);
+            if (!line.first) return false;
+            bytes += line.second.size();
+
+            if (line.second == "\r\n") break;
+            if (line.second.compare(0, 16, "Content-Length: ") == 0)
+            {
+                contentLength = (size_t) atoi(line.second.c_str() + 16);
+            }
+        }
+
+        auto payload = socket->readBytes(contentLength, nullptr, isCancellationRequested);
+        bytes += payload.second.size();
+        return payload.first;
+    }
+
+    void benchRequests(bench::BenchState& state, const std::string& body)
+    {
+        int port = getFreePort();
+        HttpServer server(port, "127.0.0.1");
+        server.setOnConnectionCallback(
+            [body](HttpRequestPtr, std::shared_ptr<ConnectionState>) -> HttpResponsePtr {
+                WebSocketHttpHeaders headers;
+                headers["Content-Type"] = "text/plain";
+                headers["Server"] = "ixwebsocket_bench";
+                return std::make_shared<HttpResponse>(200, "OK", HttpErrorCode::Ok, headers, body);
+            });
+
+        if (!server.listen().first)
+        {
+            state.setLabel("cannot listen");
+            while (state.keepRunning())
+                ;
+            return;
+        }
+        server.start();
+
+        std::string request("GET / HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+        size_t bytes = 0;
+        uint64_t errors = 0;
+
+        while (state.keepRunning())
+        {
+            if (!doRequest(port, request, bytes)) errors++;
+        }
+
+        state.pauseTiming();
+        server.stop();
+
+        state.setItemsProcessed(state.iterations() - errors);
+        state.setBytesProcessed(bytes);
+        if (errors != 0)
+        {
+            state.setLabel(std::to_string(errors) + " errors");
+        }
+    }
+} // namespace
+
+IX_BENCHMARK(HttpServerRequestSmall)
+{
+    benchRequests(state, "hello world");
+}
+
+IX_BENCHMARK(HttpServerRequest16k)
+{
+    benchRequests(state, std::string(16 * 1024, 'a'));
+}
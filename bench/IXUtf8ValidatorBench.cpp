@@ -0,0 +1,51 @@
+/*
+ *  IXUtf8ValidatorBench.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ *
+ *  Validation throughput of text messages, ascii only and with multi byte
+ *  characters (2, 3 and 4 bytes long).
+ */
+
+#include "IXBench.h"
+#include <ixwebsocket/IXUtf8Validator.h>
+
+using namespace ix;
+
+namespace
+{
+    std::string makeText(size_t size, const std::string& pattern)
+    {
+        std::string text;
+        while (text.size() + pattern.size() <= size)
+        {
+            text += pattern;
+        }
+        return text;
+    }
+
+    void benchValidateUtf8(bench::BenchState& state, const std::string& text)
+    {
+        bool valid = true;
+
+        while (state.keepRunning())
+        {
+            valid = validateUtf8(text) && valid;
+            bench::doNotOptimize(valid);
+        }
+
+        state.setBytesProcessed(state.iterations() * text.size());
+        if (!valid) state.setLabel("invalid");
+    }
+} // namespace
+
+IX_BENCHMARK(ValidateUtf8Ascii64K)
+{
+    benchValidateUtf8(state, makeText(64 * 1024, "{\"id\":42,\"action\":\"view\"},"));
+}
+
+IX_BENCHMARK(ValidateUtf8MultiByte64K)
+{
+    // é (2 bytes), € (3 bytes) and 😀 (4 bytes) among ascii
+    benchValidateUtf8(state, makeText(64 * 1024, "caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80 "));
+}
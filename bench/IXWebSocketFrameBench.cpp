@@ -0,0 +1,262 @@
+/*
+ *  IXWebSocketFrameBench.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ *
+ *  Framing of a server connection, with a raw socket as the peer.
+ *
+ *  Encode: binary messages sent by the server, which frames them and writes
+ *  them to the socket on the sending thread (a blocking send). The timed
+ *  section lasts until the peer read every frame.
+ *
+ *  Decode: masked binary frames written by the peer, read, unmasked and
+ *  dispatched to the message callback by the connection thread. The timed
+ *  section lasts until the callback saw every message.
+ *
+ *  Mask: the XOR applied to every payload a client sends or a server receives.
+ */
+
+#include "IXBench.h"
+#include "IXBenchSocket.h"
+#include "IXGetFreePort.h"
+#include <algorithm>
+#include <atomic>
+#include <ixwebsocket/IXWebSocket.h>
+#include <ixwebsocket/IXWebSocketMask.h>
+#include <ixwebsocket/IXWebSocketServer.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace ix;
+
+namespace
+{
+    // Starts the server and connects a raw peer. The server connection is
+    // open when this returns a socket.
+    std::shared_ptr<Socket> connectPeer(WebSocketServer& server,
+                                        int port,
+                                        std::mutex& mutex,
+                                        std::shared_ptr<WebSocket>& connection,
+                                        const OnMessageCallback& onMessageCallback)
+    {
+        server.disablePerMessageDeflate();
+        server.setOnConnectionCallback(
+            [&mutex, &connection, onMessageCallback](std::shared_ptr<WebSocket> webSocket,
+                                                     std::shared_ptr<ConnectionState>) {
+                webSocket->setOnMessageCallback(onMessageCallback);
+
+                std::lock_guard<std::mutex> lock(mutex);
+                connection = webSocket;
+            });
+
+        if (!server.listen().first) return nullptr;
+        server.start();
+
+        auto socket = bench::connectRawClient(port);
+        if (!socket) return nullptr;
+
+        while (true)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (connection && connection->getReadyState() == ReadyState::Open) break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        return socket;
+    }
+
+    void benchFrameEncode(bench::BenchState& state, size_t size)
+    {
+        int port = getFreePort();
+        WebSocketServer server(port, "127.0.0.1");
+        std::mutex mutex;
+        std::shared_ptr<WebSocket> connection;
+        auto socket =
+            connectPeer(server, port, mutex, connection, [](const WebSocketMessagePtr&) {});
+
+        if (!socket)
+        {
+            state.setLabel("cannot connect");
+            while (state.keepRunning())
+                ;
+            server.stop();
+            return;
+        }
+
+        uint64_t total = state.iterations();
+        uint64_t wireBytesSent = connection->getStats().wireBytesSent;
+        std::atomic<uint64_t> expected(UINT64_MAX);
+        std::atomic<uint64_t> received(0);
+        std::string message(size, 'x');
+
+        // Drain the peer while the server sends. Large messages are split in
+        // several frames, so the bytes to read are known once they are sent.
+        std::thread reader([&socket, &received, &expected]() {
+            std::vector<char> buffer(1 << 16);
+            int idle = 0;
+
+            while (received < expected && idle < 1000)
+            {
+                if (socket->isReadyToRead(10) != PollResultType::ReadyForRead)
+                {
+                    idle++;
+                    continue;
+                }
+
+                idle = 0;
+                ssize_t ret = socket->recv(&buffer[0], buffer.size());
+                if (ret <= 0 && !Socket::isWaitNeeded()) break;
+                if (ret > 0) received += (uint64_t) ret;
+            }
+        });
+
+        // Starts the timer, the whole workload runs in this first iteration
+        state.keepRunning();
+
+        for (uint64_t i = 0; i < total; ++i)
+        {
+            connection->sendBinary(message);
+        }
+        expected = connection->getStats().wireBytesSent - wireBytesSent;
+        reader.join();
+
+        while (state.keepRunning())
+            ;
+
+        state.setItemsProcessed(total);
+        state.setBytesProcessed(total * size);
+        if (received != expected) state.setLabel("incomplete");
+
+        socket->close();
+        server.stop();
+    }
+
+    void benchFrameDecode(bench::BenchState& state, size_t size)
+    {
+        std::atomic<uint64_t> received(0);
+
+        int port = getFreePort();
+        WebSocketServer server(port, "127.0.0.1");
+        std::mutex mutex;
+        std::shared_ptr<WebSocket> connection;
+        auto socket = connectPeer(
+            server, port, mutex, connection, [&received](const WebSocketMessagePtr& msg) {
+                if (msg->type == WebSocketMessageType::Message) received++;
+            });
+
+        if (!socket)
+        {
+            state.setLabel("cannot connect");
+            while (state.keepRunning())
+                ;
+            server.stop();
+            return;
+        }
+
+        // Small frames are written about 64 KB at a time
+        std::string frame;
+        bench::appendClientFrame(frame, 0x2, std::string(size, 'x'));
+
+        size_t framesPerBatch = std::max((size_t) 1, (size_t) 65536 / frame.size());
+        std::string batch;
+        for (size_t i = 0; i < framesPerBatch; ++i)
+        {
+            batch += frame;
+        }
+
+        uint64_t total = state.iterations();
+        auto isCancellationRequested = []() -> bool { return false; };
+
+        // Starts the timer, the whole workload runs in this first iteration
+        state.keepRunning();
+
+        uint64_t written = 0;
+        while (written + framesPerBatch <= total)
+        {
+            socket->writeBytes(batch, isCancellationRequested);
+            written += framesPerBatch;
+        }
+        for (; written < total; ++written)
+        {
+            socket->writeBytes(frame, isCancellationRequested);
+        }
+
+        // Wait for the callback, or until it stops receiving for a while
+        uint64_t last = 0;
+        int idle = 0;
+        while (received < total && idle < 10000)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            uint64_t count = received;
+            idle = (count == last) ? idle + 1 : 0;
+            last = count;
+        }
+
+        while (state.keepRunning())
+            ;
+
+        state.setItemsProcessed(total);
+        state.setBytesProcessed(total * size);
+        if (received != total) state.setLabel("incomplete");
+
+        socket->close();
+        server.stop();
+    }
+
+    void benchMask(bench::BenchState& state, size_t size)
+    {
+        const uint8_t maskingKey[4] = {0x12, 0x34, 0x56, 0x78};
+        std::vector<uint8_t> payload(size, 'x');
+
+        while (state.keepRunning())
+        {
+            applyWebSocketMask(payload.data(), payload.size(), maskingKey);
+            bench::doNotOptimize(payload);
+        }
+
+        state.setBytesProcessed(state.iterations() * size);
+    }
+} // namespace
+
+IX_BENCHMARK(WebSocketFrameEncode64)
+{
+    benchFrameEncode(state, 64);
+}
+
+IX_BENCHMARK(WebSocketFrameEncode16K)
+{
+    benchFrameEncode(state, 16 * 1024);
+}
+
+IX_BENCHMARK(WebSocketFrameEncode1M)
+{
+    benchFrameEncode(state, 1024 * 1024);
+}
+
+IX_BENCHMARK(WebSocketFrameDecode64)
+{
+    benchFrameDecode(state, 64);
+}
+
+IX_BENCHMARK(WebSocketFrameDecode16K)
+{
+    benchFrameDecode(state, 16 * 1024);
+}
+
+IX_BENCHMARK(WebSocketFrameDecode1M)
+{
+    benchFrameDecode(state, 1024 * 1024);
+}
+
+IX_BENCHMARK(WebSocketMask1K)
+{
+    benchMask(state, 1024);
+}
+
+IX_BENCHMARK(WebSocketMask64K)
+{
+    benchMask(state, 64 * 1024);
+}
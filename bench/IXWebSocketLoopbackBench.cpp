@@ -0,0 +1,159 @@
+/*
+ *  IXWebSocketLoopbackBench.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ *
+ *  End to end throughput over loopback: a client WebSocket sends binary
+ *  messages to an echo server, keeping a fixed number of them in flight. The
+ *  timed section lasts until every echo was received, so both sides frame,
+ *  mask, unmask and (for the deflate variant) compress and inflate each
+ *  message twice.
+ */
+
+#include "IXBench.h"
+#include "IXGetFreePort.h"
+#include <algorithm>
+#include <atomic>
+#include <ixwebsocket/IXWebSocket.h>
+#include <ixwebsocket/IXWebSocketServer.h>
+#include <sstream>
+#include <thread>
+
+using namespace ix;
+
+namespace
+{
+    const uint64_t kInFlight = 64;
+
+    // Compressible, but not a single repeated byte
+    std::string makeMessage(size_t size)
+    {
+        std::string message;
+        for (int i = 0; message.size() < size; ++i)
+        {
+            message += "{\"id\":" + std::to_string(i) + ",\"value\":" +
+                       std::to_string((i * 7919) % 1000) + "},";
+        }
+        message.resize(size);
+        return message;
+    }
+
+    void benchLoopbackEcho(bench::BenchState& state, size_t size, bool deflate)
+    {
+        int port = getFreePort();
+        WebSocketServer server(port, "127.0.0.1");
+        if (!deflate) server.disablePerMessageDeflate();
+
+        server.setOnConnectionCallback(
+            [](std::shared_ptr<WebSocket> webSocket, std::shared_ptr<ConnectionState>) {
+                std::weak_ptr<WebSocket> weak(webSocket);
+                webSocket->setOnMessageCallback([weak](const WebSocketMessagePtr& msg) {
+                    auto ws = weak.lock();
+                    if (ws && msg->type == WebSocketMessageType::Message)
+                    {
+                        ws->send(msg->str, msg->binary);
+                    }
+                });
+            });
+
+        if (!server.listen().first)
+        {
+            state.setLabel("cannot listen");
+            while (state.keepRunning())
+                ;
+            return;
+        }
+        server.start();
+
+        uint64_t total = state.iterations();
+        std::atomic<uint64_t> sent(0);
+        std::atomic<uint64_t> received(0);
+        std::atomic<bool> open(false);
+        std::string message = makeMessage(size);
+
+        // Runs on the client thread: each echo lets one more message go
+        WebSocket webSocket;
+        std::stringstream ss;
+        ss << "ws://127.0.0.1:" << port << "/";
+        webSocket.setUrl(ss.str());
+        if (deflate) webSocket.enablePerMessageDeflate();
+        webSocket.setOnMessageCallback(
+            [&webSocket, &message, &sent, &received, &open, total](const WebSocketMessagePtr& msg) {
+                if (msg->type == WebSocketMessageType::Open)
+                {
+                    open = true;
+                }
+                else if (msg->type == WebSocketMessageType::Message)
+                {
+                    received++;
+                    if (sent < total)
+                    {
+                        sent++;
+                        webSocket.sendBinary(message);
+                    }
+                }
+            });
+        webSocket.start();
+
+        for (int i = 0; i < 5000 && !open; ++i)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        if (!open)
+        {
+            state.setLabel("cannot connect");
+            while (state.keepRunning())
+                ;
+            webSocket.stop();
+            server.stop();
+            return;
+        }
+
+        // Starts the timer, the whole workload runs in this first iteration
+        state.keepRunning();
+
+        uint64_t window = std::min(kInFlight, total);
+        sent += window;
+        for (uint64_t i = 0; i < window; ++i)
+        {
+            webSocket.sendBinary(message);
+        }
+
+        // Wait for the echoes, or until they stop coming for a while
+        uint64_t last = 0;
+        int idle = 0;
+        while (received < total && idle < 10000)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            uint64_t count = received;
+            idle = (count == last) ? idle + 1 : 0;
+            last = count;
+        }
+
+        while (state.keepRunning())
+            ;
+
+        state.setItemsProcessed(total);
+        state.setBytesProcessed(total * size);
+        if (received != total) state.setLabel("incomplete");
+
+        webSocket.stop();
+        server.stop();
+    }
+} // namespace
+
+IX_BENCHMARK(WebSocketLoopbackEcho64)
+{
+    benchLoopbackEcho(state, 64, false);
+}
+
+IX_BENCHMARK(WebSocketLoopbackEcho16K)
+{
+    benchLoopbackEcho(state, 16 * 1024, false);
+}
+
+IX_BENCHMARK(WebSocketLoopbackEchoDeflate16K)
+{
+    benchLoopbackEcho(state, 16 * 1024, true);
+}
@@ -0,0 +1,292 @@
+/*
+ *  IXWebSocketPerMessageDeflateBench.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ *
+ *  Inflate throughput, in uncompressed bytes per second, of messages compressed
+ *  without context takeover, as a server receives them. The output string is
+ *  reused from one message to the next, like the transport does. The label
+ *  reports the allocations made per message.
+ *
+ *  The codecs are compared on the same json messages, compress and inflate
+ *  throughputs in uncompressed bytes per second, the label reports the ratio.
+ *
+ *  Round trips compress then inflate a cycle of different messages, with the
+ *  codecs or with context takeover (the default options, zlib only).
+ */
+
+#include "IXBench.h"
+#include <algorithm>
+#include <iomanip>
+#include <ixwebsocket/IXWebSocketPerMessageDeflate.h>
+#include <ixwebsocket/IXWebSocketPerMessageDeflateOptions.h>
+#include <sstream>
+#include <vector>
+
+using namespace ix;
+
+namespace
+{
+    // Looks like a stream of json events
+    std::string makeMessage(size_t size)
+    {
+        std::stringstream ss;
+        for (int i = 0; ss.tellp() < (std::streampos) size; ++i)
+        {
+            ss << "{\"id\":" << i << ",\"user\":\"user" << (i * 7919) % 1000
+               << "\",\"action\":\"" << (i % 3 == 0 ? "click" : "view") << "\",\"value\":" << i * 31
+               << "},";
+        }
+        return ss.str().substr(0, size);
+    }
+
+    WebSocketPerMessageDeflateOptions makeOptions(PerMessageDeflateCodec codec,
+                                                  int compressionLevel)
+    {
+        WebSocketPerMessageDeflateOptions options(true, true);
+        options.setCodec(codec);
+        options.setCompressionLevel(compressionLevel);
+        return options;
+    }
+
+    void setRatioLabel(bench::BenchState& state,
+                       const std::string& message,
+                       const std::string& compressed,
+                       bool success)
+    {
+        std::stringstream ss;
+        ss << "ratio " << std::fixed << std::setprecision(2)
+           << (double) message.size() / compressed.size();
+        if (!success) ss << ", mismatch";
+        state.setLabel(ss.str());
+    }
+
+    void benchCompress(bench::BenchState& state,
+                       PerMessageDeflateCodec codec,
+                       int compressionLevel,
+                       size_t size)
+    {
+        WebSocketPerMessageDeflate sender;
+        WebSocketPerMessageDeflate receiver;
+        std::string message = makeMessage(size);
+        std::string compressed;
+        std::string out;
+
+        bool success = sender.init(makeOptions(codec, compressionLevel), false) &&
+                       receiver.init(WebSocketPerMessageDeflateOptions(true, true), true);
+
+        while (state.keepRunning())
+        {
+            compressed.clear();
+            success = sender.compress(message, compressed) && success;
+            bench::doNotOptimize(compressed);
+        }
+
+        state.setBytesProcessed(state.iterations() * message.size());
+        state.setItemsProcessed(state.iterations());
+
+        success = success && receiver.decompress(compressed, out) && out == message;
+        setRatioLabel(state, message, compressed, success);
+    }
+
+    void benchCodecInflate(bench::BenchState& state,
+                           PerMessageDeflateCodec codec,
+                           int compressionLevel,
+                           size_t size)
+    {
+        WebSocketPerMessageDeflate sender;
+        WebSocketPerMessageDeflate receiver;
+        std::string message = makeMessage(size);
+        std::string compressed;
+        std::string out;
+
+        bool success = sender.init(makeOptions(codec, compressionLevel), false) &&
+                       receiver.init(WebSocketPerMessageDeflateOptions(true, true), true) &&
+                       sender.compress(message, compressed);
+
+        while (state.keepRunning())
+        {
+            out.clear();
+            success = receiver.decompress(compressed, out) && success;
+            bench::doNotOptimize(out);
+        }
+
+        state.setBytesProcessed(state.iterations() * message.size());
+        state.setItemsProcessed(state.iterations());
+        setRatioLabel(state, message, compressed, success && out == message);
+    }
+
+    void benchRoundTrip(bench::BenchState& state,
+                        const WebSocketPerMessageDeflateOptions& options,
+                        size_t size)
+    {
+        // More than a window of data, so takeover cannot just repeat a message
+        const size_t count = std::max((size_t) 16, (size_t) 65536 / size);
+
+        WebSocketPerMessageDeflate sender;
+        WebSocketPerMessageDeflate receiver;
+        std::string stream = makeMessage(count * size);
+        std::vector<std::string> messages;
+        for (size_t i = 0; i < count; ++i)
+        {
+            messages.push_back(stream.substr(i * size, size));
+        }
+        std::string compressed;
+        std::string out;
+
+        bool success = sender.init(options, false) && receiver.init(options, true);
+        uint64_t compressedBytes = 0;
+        size_t i = 0;
+
+        while (state.keepRunning())
+        {
+            const std::string& message = messages[i++ % count];
+            compressed.clear();
+            out.clear();
+            success = sender.compress(message, compressed) &&
+                      receiver.decompress(compressed, out) && out == message && success;
+            compressedBytes += compressed.size();
+            bench::doNotOptimize(out);
+        }
+
+        state.setBytesProcessed(state.iterations() * size);
+        state.setItemsProcessed(state.iterations());
+
+        std::stringstream ss;
+        ss << "ratio " << std::fixed << std::setprecision(2)
+           << (double) (state.iterations() * size) / std::max(compressedBytes, (uint64_t) 1);
+        if (!success) ss << ", mismatch";
+        state.setLabel(ss.str());
+    }
+
+    void benchInflate(bench::BenchState& state, size_t size)
+    {
+        WebSocketPerMessageDeflateOptions options(true, true);
+
+        WebSocketPerMessageDeflate sender;
+        WebSocketPerMessageDeflate receiver;
+        std::string message = makeMessage(size);
+        std::string compressed;
+
+        if (!sender.init(options, false) || !receiver.init(options, true) ||
+            !sender.compress(message, compressed))
+        {
+            state.setLabel("cannot compress");
+            while (state.keepRunning())
+                ;
+            return;
+        }
+
+        std::string out;
+        bool success = true;
+        uint64_t allocations = bench::getAllocationCount();
+
+        while (state.keepRunning())
+        {
+            out.clear();
+            success = receiver.decompress(compressed, out) && success;
+            bench::doNotOptimize(out);
+        }
+
+        allocations = bench::getAllocationCount() - allocations;
+
+        state.setBytesProcessed(state.iterations() * message.size());
+        state.setItemsProcessed(state.iterations());
+
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(2) << (double) allocations / state.iterations()
+           << " allocs/msg";
+        if (!success || out != message) ss << ", mismatch";
+        state.setLabel(ss.str());
+    }
+} // namespace
+
+IX_BENCHMARK(PerMessageDeflateInflate1K)
+{
+    benchInflate(state, 1024);
+}
+
+IX_BENCHMARK(PerMessageDeflateInflate16K)
+{
+    benchInflate(state, 16 * 1024);
+}
+
+IX_BENCHMARK(PerMessageDeflateInflate256K)
+{
+    benchInflate(state, 256 * 1024);
+}
+
+IX_BENCHMARK(PerMessageDeflateCompressZlib1K)
+{
+    benchCompress(state, PerMessageDeflateCodec::Zlib, -1, 1024);
+}
+
+IX_BENCHMARK(PerMessageDeflateCompressZlib64K)
+{
+    benchCompress(state, PerMessageDeflateCodec::Zlib, -1, 64 * 1024);
+}
+
+IX_BENCHMARK(PerMessageDeflateCompressZlibLevel1_1K)
+{
+    benchCompress(state, PerMessageDeflateCodec::Zlib, 1, 1024);
+}
+
+IX_BENCHMARK(PerMessageDeflateCompressZlibLevel1_64K)
+{
+    benchCompress(state, PerMessageDeflateCodec::Zlib, 1, 64 * 1024);
+}
+
+IX_BENCHMARK(PerMessageDeflateCompressFast1K)
+{
+    benchCompress(state, PerMessageDeflateCodec::Fast, -1, 1024);
+}
+
+IX_BENCHMARK(PerMessageDeflateCompressFast64K)
+{
+    benchCompress(state, PerMessageDeflateCodec::Fast, -1, 64 * 1024);
+}
+
+IX_BENCHMARK(PerMessageDeflateInflateZlib64K)
+{
+    benchCodecInflate(state, PerMessageDeflateCodec::Zlib, -1, 64 * 1024);
+}
+
+IX_BENCHMARK(PerMessageDeflateInflateZlibLevel1_64K)
+{
+    benchCodecInflate(state, PerMessageDeflateCodec::Zlib, 1, 64 * 1024);
+}
+
+IX_BENCHMARK(PerMessageDeflateInflateFast64K)
+{
+    benchCodecInflate(state, PerMessageDeflateCodec::Fast, -1, 64 * 1024);
+}
+
+IX_BENCHMARK(PerMessageDeflateRoundTripTakeover1K)
+{
+    benchRoundTrip(state, WebSocketPerMessageDeflateOptions(true), 1024);
+}
+
+IX_BENCHMARK(PerMessageDeflateRoundTripTakeover64K)
+{
+    benchRoundTrip(state, WebSocketPerMessageDeflateOptions(true), 64 * 1024);
+}
+
+IX_BENCHMARK(PerMessageDeflateRoundTripZlib1K)
+{
+    benchRoundTrip(state, makeOptions(PerMessageDeflateCodec::Zlib, -1), 1024);
+}
+
+IX_BENCHMARK(PerMessageDeflateRoundTripZlib64K)
+{
+    benchRoundTrip(state, makeOptions(PerMessageDeflateCodec::Zlib, -1), 64 * 1024);
+}
+
+IX_BENCHMARK(PerMessageDeflateRoundTripFast1K)
+{
+    benchRoundTrip(state, makeOptions(PerMessageDeflateCodec::Fast, -1), 1024);
+}
+
+IX_BENCHMARK(PerMessageDeflateRoundTripFast64K)
+{
+    benchRoundTrip(state, makeOptions(PerMessageDeflateCodec::Fast, -1), 64 * 1024);
+}
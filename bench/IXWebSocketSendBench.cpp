@@ -0,0 +1,200 @@
+/*
+ *  IXWebSocketSendBench.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ *
+ *  Messages per second published to a single server connection by 1 to 32
+ *  threads at once. The peer is a raw socket which only counts bytes, and the
+ *  timed section lasts until it read every frame, so this measures the
+ *  producers and the connection thread writing to the socket.
+ *
+ *  The batch variants publish the same messages through sendBatch, the
+ *  coalesced ones with write coalescing enabled on the server.
+ */
+
+#include "IXBench.h"
+#include "IXBenchSocket.h"
+#include "IXGetFreePort.h"
+#include <algorithm>
+#include <atomic>
+#include <ixwebsocket/IXSetThreadName.h>
+#include <ixwebsocket/IXSocket.h>
+#include <ixwebsocket/IXWebSocket.h>
+#include <ixwebsocket/IXWebSocketServer.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace ix;
+
+namespace
+{
+    const size_t kMessageSize = 64;
+
+    // Unmasked server frame: 2 bytes header, then the payload
+    const size_t kFrameSize = 2 + kMessageSize;
+
+    void benchSendContention(bench::BenchState& state,
+                             int producers,
+                             size_t batchSize = 1,
+                             bool coalesce = false)
+    {
+        int port = getFreePort();
+        WebSocketServer server(port, "127.0.0.1");
+        server.disableBlockingSend();
+        server.disablePerMessageDeflate();
+        if (coalesce) server.enableWriteCoalescing();
+
+        std::mutex mutex;
+        std::shared_ptr<WebSocket> connection;
+
+        server.setOnConnectionCallback(
+            [&mutex, &connection](std::shared_ptr<WebSocket> webSocket,
+                                  std::shared_ptr<ConnectionState>) {
+                webSocket->setOnMessageCallback([](const WebSocketMessagePtr&) {});
+
+                std::lock_guard<std::mutex> lock(mutex);
+                connection = webSocket;
+            });
+
+        std::shared_ptr<Socket> socket;
+        if (server.listen().first)
+        {
+            server.start();
+            socket = bench::connectRawClient(port);
+        }
+
+        if (!socket)
+        {
+            state.setLabel("cannot connect");
+            while (state.keepRunning())
+                ;
+            server.stop();
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            while (connection->getReadyState() != ReadyState::Open)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+
+        uint64_t total = state.iterations();
+        std::string message(kMessageSize, 'x');
+
+        // Starts the timer, the whole workload runs in this first iteration
+        state.keepRunning();
+
+        std::vector<std::thread> threads;
+        for (int i = 0; i < producers; ++i)
+        {
+            uint64_t count = total / producers + ((uint64_t) i < total % producers ? 1 : 0);
+
+            threads.emplace_back([&connection, &message, count, batchSize]() {
+                setThreadName("bench producer");
+                if (batchSize == 1)
+                {
+                    for (uint64_t j = 0; j < count; ++j)
+                    {
+                        connection->sendBinary(message);
+                    }
+                    return;
+                }
+
+                std::vector<WebSocketBatchMessage> batch(batchSize, {message, true});
+                for (uint64_t j = 0; j < count; j += batchSize)
+                {
+                    batch.resize(std::min((uint64_t) batchSize, count - j), {message, true});
+                    connection->sendBatch(batch);
+                }
+            });
+        }
+
+        // Read until every frame arrived, or until the server stops sending for a while
+        uint64_t expected = total * kFrameSize;
+        uint64_t received = 0;
+        int idle = 0;
+        std::vector<char> buffer(1 << 16);
+
+        while (received < expected && idle < 1000)
+        {
+            if (socket->isReadyToRead(10) != PollResultType::ReadyForRead)
+            {
+                idle++;
+                continue;
+            }
+
+            idle = 0;
+            ssize_t ret = socket->recv(&buffer[0], buffer.size());
+            if (ret <= 0 && !Socket::isWaitNeeded()) break;
+            if (ret > 0) received += (uint64_t) ret;
+        }
+
+        for (auto&& thread : threads)
+        {
+            thread.join();
+        }
+
+        while (state.keepRunning())
+            ;
+
+        state.setItemsProcessed(total);
+        state.setBytesProcessed(total * kMessageSize);
+        if (received != expected) state.setLabel("incomplete");
+
+        socket->close();
+        server.stop();
+    }
+} // namespace
+
+IX_BENCHMARK(WebSocketSendContention1)
+{
+    benchSendContention(state, 1);
+}
+
+IX_BENCHMARK(WebSocketSendContention2)
+{
+    benchSendContention(state, 2);
+}
+
+IX_BENCHMARK(WebSocketSendContention4)
+{
+    benchSendContention(state, 4);
+}
+
+IX_BENCHMARK(WebSocketSendContention8)
+{
+    benchSendContention(state, 8);
+}
+
+IX_BENCHMARK(WebSocketSendContention16)
+{
+    benchSendContention(state, 16);
+}
+
+IX_BENCHMARK(WebSocketSendContention32)
+{
+    benchSendContention(state, 32);
+}
+
+IX_BENCHMARK(WebSocketSendBatch16)
+{
+    benchSendContention(state, 1, 16);
+}
+
+IX_BENCHMARK(WebSocketSendBatch256)
+{
+    benchSendContention(state, 1, 256);
+}
+
+IX_BENCHMARK(WebSocketSendCoalesced1)
+{
+    benchSendContention(state, 1, 1, true);
+}
+
+IX_BENCHMARK(WebSocketSendCoalesced8)
+{
+    benchSendContention(state, 8, 1, true);
+}
@@ -0,0 +1,26 @@
+/*
+ *  bench_runner.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone. All rights reserved.
+ */
+
+#include "IXBench.h"
+#include <ixwebsocket/IXNetSystem.h>
+
+#ifndef _WIN32
+#include <signal.h>
+#endif
+
+int main(int argc, char** argv)
+{
+    ix::initNetSystem();
+
+#ifndef _WIN32
+    signal(SIGPIPE, SIG_IGN);
+#endif
+
+    int ret = ix::bench::runBenchmarks(argc, argv);
+
+    ix::uninitNetSystem();
+    return ret;
+}
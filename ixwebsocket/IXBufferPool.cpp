@@ -0,0 +1,144 @@
+/*
+ *  IXBufferPool.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ */
+
+#include "IXBufferPool.h"
+
+#include <atomic>
+
+namespace
+{
+    std::atomic<size_t> gAcquiredCount(0);
+} // namespace
+
+namespace ix
+{
+    const size_t BufferPool::kDefaultBufferSize(1 << 15);
+    const size_t BufferPool::kDefaultMaxFreeBuffers(64);
+
+    PooledBuffer::PooledBuffer()
+        : _pool(nullptr)
+        , _size(0)
+    {
+        ;
+    }
+
+    PooledBuffer::PooledBuffer(BufferPool* pool, std::unique_ptr<uint8_t[]> data, size_t size)
+        : _pool(pool)
+        , _data(std::move(data))
+        , _size(size)
+    {
+        ;
+    }
+
+    PooledBuffer::~PooledBuffer()
+    {
+        reset();
+    }
+
+    PooledBuffer::PooledBuffer(PooledBuffer&& other)
+        : _pool(other._pool)
+        , _data(std::move(other._data))
+        , _size(other._size)
+    {
+        other._pool = nullptr;
+        other._size = 0;
+    }
+
+    PooledBuffer& PooledBuffer::operator=(PooledBuffer&& other)
+    {
+        if (this != &other)
+        {
+            reset();
+            _pool = other._pool;
+            _data = std::move(other._data);
+            _size = other._size;
+            other._pool = nullptr;
+            other._size = 0;
+        }
+        return *this;
+    }
+
+    uint8_t* PooledBuffer::data() const
+    {
+        return _data.get();
+    }
+
+    size_t PooledBuffer::size() const
+    {
+        return _size;
+    }
+
+    void PooledBuffer::reset()
+    {
+        if (_pool && _data)
+        {
+            _pool->release(std::move(_data));
+        }
+        _pool = nullptr;
+        _data.reset();
+        _size = 0;
+    }
+
+    BufferPool::BufferPool(size_t bufferSize, size_t maxFreeBuffers)
+        : _bufferSize(bufferSize)
+        , _maxFreeBuffers(maxFreeBuffers)
+    {
+        ;
+    }
+
+    PooledBuffer BufferPool::acquire()
+    {
+        std::unique_ptr<uint8_t[]> data;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!_freeBuffers.empty())
+            {
+                data = std::move(_freeBuffers.back());
+                _freeBuffers.pop_back();
+            }
+        }
+
+        // Not value initialized, pages are only touched once data is written to them
+        if (!data) data.reset(new uint8_t[_bufferSize]);
+
+        gAcquiredCount++;
+        return PooledBuffer(this, std::move(data), _bufferSize);
+    }
+
+    void BufferPool::release(std::unique_ptr<uint8_t[]> data)
+    {
+        gAcquiredCount--;
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_freeBuffers.size() < _maxFreeBuffers)
+        {
+            _freeBuffers.push_back(std::move(data));
+        }
+    }
+
+    size_t BufferPool::getBufferSize() const
+    {
+        return _bufferSize;
+    }
+
+    size_t BufferPool::getFreeCount() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _freeBuffers.size();
+    }
+
+    size_t BufferPool::getAcquiredCount()
+    {
+        return gAcquiredCount;
+    }
+
+    BufferPool& BufferPool::getDefault()
+    {
+        // Never destroyed, connections may give buffers back during exit
+        static BufferPool* bufferPool = new BufferPool();
+        return *bufferPool;
+    }
+} // namespace ix
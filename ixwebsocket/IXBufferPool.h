@@ -0,0 +1,81 @@
+/*
+ *  IXBufferPool.h
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ *
+ *  Pool of fixed size scratch buffers, shared by all the connections. A
+ *  connection only holds a buffer while it reads or (de)compresses data, so
+ *  idle connections do not cost a buffer each. Up to maxFreeBuffers released
+ *  buffers are kept for reuse, the others are freed.
+ */
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace ix
+{
+    class BufferPool;
+
+    // Gives its buffer back to the pool when destroyed
+    class PooledBuffer
+    {
+    public:
+        PooledBuffer();
+        PooledBuffer(BufferPool* pool, std::unique_ptr<uint8_t[]> data, size_t size);
+        ~PooledBuffer();
+
+        PooledBuffer(PooledBuffer&& other);
+        PooledBuffer& operator=(PooledBuffer&& other);
+        PooledBuffer(const PooledBuffer&) = delete;
+        PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+        uint8_t* data() const;
+        size_t size() const;
+
+        void reset();
+
+    private:
+        BufferPool* _pool;
+        std::unique_ptr<uint8_t[]> _data;
+        size_t _size;
+    };
+
+    class BufferPool
+    {
+    public:
+        BufferPool(size_t bufferSize = BufferPool::kDefaultBufferSize,
+                   size_t maxFreeBuffers = BufferPool::kDefaultMaxFreeBuffers);
+
+        BufferPool(const BufferPool&) = delete;
+        BufferPool& operator=(const BufferPool&) = delete;
+
+        PooledBuffer acquire();
+
+        size_t getBufferSize() const;
+        size_t getFreeCount() const;
+
+        // Buffers currently acquired, from all the pools
+        static size_t getAcquiredCount();
+
+        // Read and compression buffers of the connections
+        static BufferPool& getDefault();
+
+        const static size_t kDefaultBufferSize;
+        const static size_t kDefaultMaxFreeBuffers;
+
+    private:
+        friend class PooledBuffer;
+        void release(std::unique_ptr<uint8_t[]> data);
+
+        size_t _bufferSize;
+        size_t _maxFreeBuffers;
+
+        mutable std::mutex _mutex;
+        std::vector<std::unique_ptr<uint8_t[]>> _freeBuffers;
+    };
+} // namespace ix
@@ -0,0 +1,78 @@
+/*
+ *  IXConnectionTimings.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ */
+
+#include "IXConnectionTimings.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <utility>
+
+namespace ix
+{
+    ConnectionTimings::ConnectionTimings()
+        : startUs(0)
+        , dnsLookupUs(0)
+        , connectUs(0)
+        , tlsHandshakeUs(0)
+        , requestSentUs(0)
+        , firstByteUs(0)
+        , doneUs(0)
+    {
+        ;
+    }
+
+    uint64_t ConnectionTimings::now()
+    {
+        auto now = std::chrono::steady_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+    }
+
+    uint64_t ConnectionTimings::getElapsedUs(uint64_t timestampUs) const
+    {
+        return (timestampUs >= startUs && startUs != 0) ? timestampUs - startUs : 0;
+    }
+
+    std::string ConnectionTimings::format(const std::string& writeOut) const
+    {
+        const std::pair<std::string, uint64_t> variables[] = {
+            {"%{time_namelookup}", dnsLookupUs},
+            {"%{time_connect}", connectUs},
+            {"%{time_appconnect}", tlsHandshakeUs},
+            {"%{time_pretransfer}", requestSentUs},
+            {"%{time_starttransfer}", firstByteUs},
+            {"%{time_total}", doneUs},
+        };
+
+        std::string out;
+        size_t i = 0;
+        while (i < writeOut.size())
+        {
+            if (writeOut.compare(i, 2, "\\n") == 0)
+            {
+                out += '\n';
+                i += 2;
+                continue;
+            }
+
+            bool replaced = false;
+            for (auto&& variable : variables)
+            {
+                if (writeOut.compare(i, variable.first.size(), variable.first) != 0) continue;
+
+                char seconds[32];
+                snprintf(seconds, sizeof(seconds), "%.6f", getElapsedUs(variable.second) / 1e6);
+                out += seconds;
+                i += variable.first.size();
+                replaced = true;
+                break;
+            }
+
+            if (!replaced) out += writeOut[i++];
+        }
+
+        return out;
+    }
+} // namespace ix
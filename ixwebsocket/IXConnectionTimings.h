@@ -0,0 +1,45 @@
+/*
+ *  IXConnectionTimings.h
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+namespace ix
+{
+    // Monotonic timestamps in microseconds (steady clock) taken at the end of
+    // each phase of a connection. A phase which did not happen, such as the TLS
+    // handshake of a ws:// or http:// url, or one after a failure, stays at 0.
+    struct ConnectionTimings
+    {
+        ConnectionTimings();
+
+        static uint64_t now();
+
+        // Microseconds from start to that timestamp, 0 when it was not taken.
+        // Applied to each field, this gives the cumulative times of curl -w
+        // (time_namelookup, time_connect, time_appconnect, ...).
+        uint64_t getElapsedUs(uint64_t timestampUs) const;
+
+        // Replaces the curl -w variables %{time_namelookup}, %{time_connect},
+        // %{time_appconnect}, %{time_pretransfer}, %{time_starttransfer} and
+        // %{time_total} with those times in seconds, and \n with a new line.
+        // Pretransfer is taken once the request is written.
+        std::string format(const std::string& writeOut) const;
+
+        uint64_t startUs;
+        uint64_t dnsLookupUs;
+        uint64_t connectUs;
+        uint64_t tlsHandshakeUs;
+
+        // HTTP request or upgrade written, status line received, and response
+        // headers (WebSocket) or body (HTTP) read
+        uint64_t requestSentUs;
+        uint64_t firstByteUs;
+        uint64_t doneUs;
+    };
+} // namespace ix
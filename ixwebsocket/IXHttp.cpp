@@ -13,6 +13,8 @@
 
 namespace ix
 {
+    const int Http::kDefaultRequestTimeoutSecs(5);
+
     std::string Http::trim(const std::string& str)
     {
         std::string out;
@@ -92,14 +94,13 @@ namespace ix
         return std::make_tuple(method, requestUri, httpVersion);
     }
 
-    std::tuple<bool, std::string, HttpRequestPtr> Http::parseRequest(std::shared_ptr<Socket> socket)
+    std::tuple<bool, std::string, HttpRequestPtr> Http::parseRequest(std::shared_ptr<Socket> socket,
+                                                                     int timeoutSecs)
     {
         HttpRequestPtr httpRequest;
 
         std::atomic<bool> requestInitCancellation(false);
 
-        int timeoutSecs = 5; // FIXME
-
         auto isCancellationRequested =
             makeCancellationRequestWithTimeout(timeoutSecs, requestInitCancellation);
 
@@ -135,33 +136,42 @@ namespace ix
 
     bool Http::sendResponse(HttpResponsePtr response, std::shared_ptr<Socket> socket)
     {
-        // Write the response to the socket
-        std::stringstream ss;
-        ss << "HTTP/1.1 ";
-        ss << response->statusCode;
-        ss << " ";
-        ss << response->description;
-        ss << "\r\n";
-
-        if (!socket->writeBytes(ss.str(), nullptr))
-        {
-            return false;
-        }
-
-        // Write headers
-        ss.str("");
-        ss << "Content-Length: " << response->payload.size() << "\r\n";
+        // Format the status line and the headers in a single buffer, and send it
+        // along with the payload in one gather write, so that small responses
+        // go out in a single packet.
+        std::string statusCode = std::to_string(response->statusCode);
+        std::string contentLength = std::to_string(response->payload.size());
+
+        size_t size = 9 + statusCode.size() + 1 + response->description.size() + 2;
+        size += 16 + contentLength.size() + 2;
         for (auto&& it : response->headers)
         {
-            ss << it.first << ": " << it.second << "\r\n";
+            size += it.first.size() + 2 + it.second.size() + 2;
         }
-        ss << "\r\n";
+        size += 2;
 
-        if (!socket->writeBytes(ss.str(), nullptr))
+        std::string header;
+        header.reserve(size);
+
+        header += "HTTP/1.1 ";
+        header += statusCode;
+        header += ' ';
+        header += response->description;
+        header += "\r\n";
+
+        header += "Content-Length: ";
+        header += contentLength;
+        header += "\r\n";
+
+        for (auto&& it : response->headers)
         {
-            return false;
+            header += it.first;
+            header += ": ";
+            header += it.second;
+            header += "\r\n";
         }
+        header += "\r\n";
 
-        return response->payload.empty() ? true : socket->writeBytes(response->payload, nullptr);
+        return socket->writeBytes(header, response->payload, nullptr);
     }
 } // namespace ix
@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include "IXConnectionTimings.h"
 #include "IXProgressCallback.h"
 #include "IXWebSocketHttpHeaders.h"
 #include <tuple>
@@ -44,6 +45,9 @@ namespace ix
         uint64_t uploadSize;
         uint64_t downloadSize;
 
+        // Client side, time spent in each phase of the request
+        ConnectionTimings timings;
+
         HttpResponse(int s = 0,
                      const std::string& des = std::string(),
                      const HttpErrorCode& c = HttpErrorCode::Ok,
@@ -51,7 +55,8 @@ namespace ix
                      const std::string& p = std::string(),
                      const std::string& e = std::string(),
                      uint64_t u = 0,
-                     uint64_t d = 0)
+                     uint64_t d = 0,
+                     const ConnectionTimings& t = ConnectionTimings())
             : statusCode(s)
             , description(des)
             , errorCode(c)
@@ -60,6 +65,7 @@ namespace ix
             , errorMsg(e)
             , uploadSize(u)
             , downloadSize(d)
+            , timings(t)
         {
             ;
         }
@@ -115,12 +121,14 @@ namespace ix
     {
     public:
         static std::tuple<bool, std::string, HttpRequestPtr> parseRequest(
-            std::shared_ptr<Socket> socket);
+            std::shared_ptr<Socket> socket, int timeoutSecs = kDefaultRequestTimeoutSecs);
         static bool sendResponse(HttpResponsePtr response, std::shared_ptr<Socket> socket);
 
         static std::pair<std::string, int> parseStatusLine(const std::string& line);
         static std::tuple<std::string, std::string, std::string> parseRequestLine(
             const std::string& line);
         static std::string trim(const std::string& str);
+
+        const static int kDefaultRequestTimeoutSecs;
     };
 } // namespace ix
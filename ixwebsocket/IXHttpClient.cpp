@@ -124,6 +124,7 @@ namespace ix
 
         uint64_t uploadSize = 0;
         uint64_t downloadSize = 0;
+        ConnectionTimings timings;
         int code = 0;
         WebSocketHttpHeaders headers;
         std::string payload;
@@ -143,7 +144,8 @@ namespace ix
                                                   payload,
                                                   ss.str(),
                                                   uploadSize,
-                                                  downloadSize);
+                                                  downloadSize,
+                                                  timings);
         }
 
         bool tls = protocol == "https";
@@ -159,7 +161,8 @@ namespace ix
                                                   payload,
                                                   errorMsg,
                                                   uploadSize,
-                                                  downloadSize);
+                                                  downloadSize,
+                                                  timings);
         }
 
         // Build request string
@@ -227,6 +230,7 @@ namespace ix
             makeCancellationRequestWithTimeout(args->connectTimeout, requestInitCancellation);
 
         bool success = _socket->connect(host, port, errMsg, isCancellationRequested);
+        timings = _socket->getConnectionTimings();
         if (!success)
         {
             std::stringstream ss;
@@ -238,7 +242,8 @@ namespace ix
                                                   payload,
                                                   ss.str(),
                                                   uploadSize,
-                                                  downloadSize);
+                                                  downloadSize,
+                                                  timings);
         }
 
         // Make a new cancellation object dealing with transfer timeout
@@ -268,10 +273,12 @@ namespace ix
                                                   payload,
                                                   errorMsg,
                                                   uploadSize,
-                                                  downloadSize);
+                                                  downloadSize,
+                                                  timings);
         }
 
         uploadSize = req.size();
+        timings.requestSentUs = ConnectionTimings::now();
 
         auto lineResult = _socket->readLine(isCancellationRequested);
         auto lineValid = lineResult.first;
@@ -287,9 +294,12 @@ namespace ix
                                                   payload,
                                                   errorMsg,
                                                   uploadSize,
-                                                  downloadSize);
+                                                  downloadSize,
+                                                  timings);
         }
 
+        timings.firstByteUs = ConnectionTimings::now();
+
         if (args->verbose)
         {
             std::stringstream ss;
@@ -307,7 +317,8 @@ namespace ix
                                                   payload,
                                                   errorMsg,
                                                   uploadSize,
-                                                  downloadSize);
+                                                  downloadSize,
+                                                  timings);
         }
 
         auto result = parseHttpHeaders(_socket, isCancellationRequested);
@@ -324,7 +335,8 @@ namespace ix
                                                   payload,
                                                   errorMsg,
                                                   uploadSize,
-                                                  downloadSize);
+                                                  downloadSize,
+                                                  timings);
         }
 
         // Redirect ?
@@ -340,7 +352,8 @@ namespace ix
                                                       payload,
                                                       errorMsg,
                                                       uploadSize,
-                                                      downloadSize);
+                                                      downloadSize,
+                                                      timings);
             }
 
             if (redirects >= args->maxRedirects)
@@ -354,7 +367,8 @@ namespace ix
                                                       payload,
                                                       ss.str(),
                                                       uploadSize,
-                                                      downloadSize);
+                                                      downloadSize,
+                                                      timings);
             }
 
             // Recurse
@@ -364,6 +378,7 @@ namespace ix
 
         if (verb == "HEAD")
         {
+            timings.doneUs = ConnectionTimings::now();
             return std::make_shared<HttpResponse>(code,
                                                   description,
                                                   HttpErrorCode::Ok,
@@ -371,7 +386,8 @@ namespace ix
                                                   payload,
                                                   std::string(),
                                                   uploadSize,
-                                                  downloadSize);
+                                                  downloadSize,
+                                                  timings);
         }
 
         // Parse response:
@@ -396,7 +412,8 @@ namespace ix
                                                       payload,
                                                       errorMsg,
                                                       uploadSize,
-                                                      downloadSize);
+                                                      downloadSize,
+                                                      timings);
             }
             payload += chunkResult.second;
         }
@@ -419,7 +436,8 @@ namespace ix
                                                           payload,
                                                           errorMsg,
                                                           uploadSize,
-                                                          downloadSize);
+                                                          downloadSize,
+                                                          timings);
                 }
 
                 uint64_t chunkSize;
@@ -449,7 +467,8 @@ namespace ix
                                                           payload,
                                                           errorMsg,
                                                           uploadSize,
-                                                          downloadSize);
+                                                          downloadSize,
+                                                          timings);
                 }
                 payload += chunkResult.second;
 
@@ -465,7 +484,8 @@ namespace ix
                                                           payload,
                                                           errorMsg,
                                                           uploadSize,
-                                                          downloadSize);
+                                                          downloadSize,
+                                                          timings);
                 }
 
                 if (chunkSize == 0) break;
@@ -485,7 +505,8 @@ namespace ix
                                                   payload,
                                                   errorMsg,
                                                   uploadSize,
-                                                  downloadSize);
+                                                  downloadSize,
+                                                  timings);
         }
 
         downloadSize = payload.size();
@@ -504,11 +525,14 @@ namespace ix
                                                       payload,
                                                       errorMsg,
                                                       uploadSize,
-                                                      downloadSize);
+                                                      downloadSize,
+                                                      timings);
             }
             payload = decompressedPayload;
         }
 
+        timings.doneUs = ConnectionTimings::now();
+
         return std::make_shared<HttpResponse>(code,
                                               description,
                                               HttpErrorCode::Ok,
@@ -516,7 +540,8 @@ namespace ix
                                               payload,
                                               std::string(),
                                               uploadSize,
-                                              downloadSize);
+                                              downloadSize,
+                                              timings);
     }
 
     HttpResponsePtr HttpClient::get(const std::string& url, HttpRequestArgsPtr args)
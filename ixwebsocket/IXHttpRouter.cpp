@@ -0,0 +1,532 @@
+/*
+ *  IXHttpRouter.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ */
+
+#include "IXHttpRouter.h"
+
+#include "IXConnectionState.h"
+#include <algorithm>
+#include <map>
+#include <string.h>
+
+namespace ix
+{
+    //
+    // Route parameters
+    //
+    constexpr size_t HttpRouteParams::kMaxParams;
+    constexpr size_t HttpRouter::kMaxSegments;
+
+    HttpRouteParams::HttpRouteParams()
+        : _size(0)
+    {
+        ;
+    }
+
+    size_t HttpRouteParams::size() const
+    {
+        return _size;
+    }
+
+    bool HttpRouteParams::get(const std::string& name, const char*& data, size_t& length) const
+    {
+        for (size_t i = 0; i < _size; ++i)
+        {
+            if (*_params[i].name == name)
+            {
+                data = _params[i].data;
+                length = _params[i].length;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    std::string HttpRouteParams::get(const std::string& name) const
+    {
+        const char* data = nullptr;
+        size_t length = 0;
+
+        if (!get(name, data, length)) return std::string();
+
+        return std::string(data, length);
+    }
+
+    const std::string& HttpRouteParams::getName(size_t i) const
+    {
+        return *_params[i].name;
+    }
+
+    std::string HttpRouteParams::getValue(size_t i) const
+    {
+        return std::string(_params[i].data, _params[i].length);
+    }
+
+    void HttpRouteParams::clear()
+    {
+        _size = 0;
+    }
+
+    bool HttpRouteParams::push(const std::string* name, const char* data, size_t length)
+    {
+        if (_size == kMaxParams) return false;
+
+        _params[_size].name = name;
+        _params[_size].data = data;
+        _params[_size].length = length;
+        _size++;
+
+        return true;
+    }
+
+    void HttpRouteParams::pop()
+    {
+        if (_size > 0) _size--;
+    }
+
+    //
+    // Router
+    //
+
+    // Uncompressed trie used while routes are being registered. One node per
+    // character for static parts of a pattern, one node per parameter or wildcard.
+    struct HttpRouter::BuildNode
+    {
+        std::map<char, std::unique_ptr<BuildNode>> children;
+        std::unique_ptr<BuildNode> param;
+        std::unique_ptr<BuildNode> wildcard;
+        std::string name;
+        std::vector<Route> routes;
+    };
+
+    HttpRouter::HttpRouter()
+        : _root(new BuildNode())
+        , _routesCount(0)
+        , _compiled(false)
+    {
+        setNotFoundHandler([](HttpRequestPtr /*request*/,
+                              const HttpRouteParams& /*params*/,
+                              std::shared_ptr<ConnectionState> /*connectionState*/) {
+            return std::make_shared<HttpResponse>(
+                404, "Not Found", HttpErrorCode::Ok, WebSocketHttpHeaders(), std::string());
+        });
+    }
+
+    HttpRouter::~HttpRouter()
+    {
+        ;
+    }
+
+    void HttpRouter::setNotFoundHandler(const Handler& handler)
+    {
+        _notFoundHandler = handler;
+    }
+
+    size_t HttpRouter::getRoutesCount() const
+    {
+        return _routesCount;
+    }
+
+    bool HttpRouter::addRoute(const std::string& method,
+                              const std::string& pattern,
+                              const Handler& handler)
+    {
+        if (pattern.empty() || pattern[0] != '/' || method.empty() || !handler) return false;
+        if ((size_t) std::count(pattern.begin(), pattern.end(), '/') > kMaxSegments) return false;
+
+        BuildNode* node = _root.get();
+        size_t i = 0;
+
+        while (i < pattern.size())
+        {
+            char c = pattern[i];
+            bool segmentStart = i > 0 && pattern[i - 1] == '/';
+
+            if (segmentStart && c == ':')
+            {
+                size_t end = pattern.find('/', i);
+                if (end == std::string::npos) end = pattern.size();
+
+                std::string name = pattern.substr(i + 1, end - i - 1);
+                if (name.empty()) return false;
+
+                if (!node->param)
+                {
+                    node->param.reset(new BuildNode());
+                    node->param->name = name;
+                }
+                else if (node->param->name != name)
+                {
+                    return false;
+                }
+
+                node = node->param.get();
+                i = end;
+            }
+            else if (segmentStart && c == '*')
+            {
+                std::string name = pattern.substr(i + 1);
+                if (name.find('/') != std::string::npos) return false;
+
+                if (!node->wildcard)
+                {
+                    node->wildcard.reset(new BuildNode());
+                    node->wildcard->name = name;
+                }
+                else if (node->wildcard->name != name)
+                {
+                    return false;
+                }
+
+                node = node->wildcard.get();
+                i = pattern.size();
+            }
+            else
+            {
+                auto& child = node->children[c];
+                if (!child) child.reset(new BuildNode());
+
+                node = child.get();
+                i++;
+            }
+        }
+
+        for (auto&& route : node->routes)
+        {
+            if (route.method == method) return false;
+        }
+
+        node->routes.push_back({method, handler});
+        _routesCount++;
+        _compiled = false;
+
+        return true;
+    }
+
+    void HttpRouter::compile()
+    {
+        _nodes.clear();
+        _children.clear();
+        _childrenFirstBytes.clear();
+        _nodeRoutes.clear();
+        _names.clear();
+        _labels.clear();
+        _methods.clear();
+
+        compileNode(_root.get(), NodeKind::Static, std::string());
+
+        for (auto&& route : _nodeRoutes)
+        {
+            if (route.method != "*") _methods.push_back(route.method);
+        }
+        std::sort(_methods.begin(), _methods.end());
+        _methods.erase(std::unique(_methods.begin(), _methods.end()), _methods.end());
+
+        _compiled = true;
+    }
+
+    int32_t HttpRouter::compileStaticChild(const BuildNode* node, char c)
+    {
+        // Merge chains of nodes with a single static child into one label
+        std::string label(1, c);
+
+        while (node->routes.empty() && !node->param && !node->wildcard &&
+               node->children.size() == 1)
+        {
+            auto it = node->children.begin();
+            label += it->first;
+            node = it->second.get();
+        }
+
+        return compileNode(node, NodeKind::Static, label);
+    }
+
+    int32_t HttpRouter::compileNode(const BuildNode* node,
+                                    NodeKind kind,
+                                    const std::string& label)
+    {
+        int32_t index = (int32_t) _nodes.size();
+
+        Node compiled;
+        compiled.kind = kind;
+        compiled.labelOffset = (uint32_t) _labels.size();
+        compiled.labelLength = (uint32_t) label.size();
+        compiled.childrenOffset = 0;
+        compiled.childrenCount = 0;
+        compiled.paramChild = -1;
+        compiled.wildcardChild = -1;
+        compiled.nameIndex = -1;
+        compiled.routesOffset = (uint32_t) _nodeRoutes.size();
+        compiled.routesCount = (uint32_t) node->routes.size();
+
+        if (kind != NodeKind::Static)
+        {
+            compiled.nameIndex = (int32_t) _names.size();
+            _names.push_back(node->name);
+        }
+
+        _labels += label;
+        _nodeRoutes.insert(_nodeRoutes.end(), node->routes.begin(), node->routes.end());
+        _nodes.push_back(compiled);
+
+        // Children are compiled depth first, so gather their indexes before
+        // storing them contiguously. std::map keeps them sorted by first byte.
+        std::vector<uint32_t> children;
+        std::vector<char> firstBytes;
+        for (auto&& it : node->children)
+        {
+            children.push_back((uint32_t) compileStaticChild(it.second.get(), it.first));
+            firstBytes.push_back(it.first);
+        }
+
+        int32_t paramChild = -1;
+        if (node->param)
+        {
+            paramChild = compileNode(node->param.get(), NodeKind::Param, std::string());
+        }
+
+        int32_t wildcardChild = -1;
+        if (node->wildcard)
+        {
+            wildcardChild = compileNode(node->wildcard.get(), NodeKind::Wildcard, std::string());
+        }
+
+        // _nodes might have been reallocated, so index instead of keeping a reference
+        _nodes[index].childrenOffset = (uint32_t) _children.size();
+        _nodes[index].childrenCount = (uint32_t) children.size();
+        _nodes[index].paramChild = paramChild;
+        _nodes[index].wildcardChild = wildcardChild;
+
+        _children.insert(_children.end(), children.begin(), children.end());
+        _childrenFirstBytes.insert(_childrenFirstBytes.end(), firstBytes.begin(), firstBytes.end());
+
+        return index;
+    }
+
+    const HttpRouter::Handler* HttpRouter::findRoute(const Node& node,
+                                                     const std::string& method) const
+    {
+        const Handler* anyMethodHandler = nullptr;
+
+        for (uint32_t i = 0; i < node.routesCount; ++i)
+        {
+            const Route& route = _nodeRoutes[node.routesOffset + i];
+            if (route.method == method)
+            {
+                return &route.handler;
+            }
+            else if (route.method == "*")
+            {
+                anyMethodHandler = &route.handler;
+            }
+        }
+
+        return anyMethodHandler;
+    }
+
+    const HttpRouter::Handler* HttpRouter::match(const std::string& method,
+                                                 const char* path,
+                                                 size_t length,
+                                                 HttpRouteParams& params,
+                                                 bool& methodNotAllowed) const
+    {
+        params.clear();
+        methodNotAllowed = false;
+
+        if (!_compiled || _nodes.empty()) return nullptr;
+
+        const Handler* handler = nullptr;
+        if (!matchNode(0, method, path, length, 0, params, handler, methodNotAllowed))
+        {
+            params.clear();
+            return nullptr;
+        }
+
+        methodNotAllowed = false;
+        return handler;
+    }
+
+    bool HttpRouter::matchNode(int32_t nodeIndex,
+                               const std::string& method,
+                               const char* path,
+                               size_t length,
+                               size_t pos,
+                               HttpRouteParams& params,
+                               const Handler*& handler,
+                               bool& methodNotAllowed) const
+    {
+        const Node& node = _nodes[nodeIndex];
+
+        switch (node.kind)
+        {
+            case NodeKind::Static:
+            {
+                if (length - pos < node.labelLength) return false;
+                if (memcmp(path + pos, _labels.data() + node.labelOffset, node.labelLength) != 0)
+                {
+                    return false;
+                }
+
+                return matchChildren(node,
+                                     method,
+                                     path,
+                                     length,
+                                     pos + node.labelLength,
+                                     params,
+                                     handler,
+                                     methodNotAllowed);
+            }
+
+            case NodeKind::Param:
+            {
+                // A parameter spans a whole, non empty, segment
+                const char* end = (const char*) memchr(path + pos, '/', length - pos);
+                size_t segmentEnd = (end == nullptr) ? length : (size_t)(end - path);
+                if (segmentEnd == pos) return false;
+
+                if (!params.push(&_names[node.nameIndex], path + pos, segmentEnd - pos))
+                {
+                    return false;
+                }
+
+                if (matchChildren(
+                        node, method, path, length, segmentEnd, params, handler, methodNotAllowed))
+                {
+                    return true;
+                }
+
+                params.pop();
+                return false;
+            }
+
+            case NodeKind::Wildcard:
+            {
+                // A wildcard captures the rest of the path, which can be empty
+                if (!params.push(&_names[node.nameIndex], path + pos, length - pos))
+                {
+                    return false;
+                }
+
+                handler = findRoute(node, method);
+                if (handler != nullptr) return true;
+
+                if (node.routesCount != 0) methodNotAllowed = true;
+
+                params.pop();
+                return false;
+            }
+        }
+
+        return false;
+    }
+
+    bool HttpRouter::matchChildren(const Node& node,
+                                   const std::string& method,
+                                   const char* path,
+                                   size_t length,
+                                   size_t pos,
+                                   HttpRouteParams& params,
+                                   const Handler*& handler,
+                                   bool& methodNotAllowed) const
+    {
+        if (pos == length)
+        {
+            handler = findRoute(node, method);
+            if (handler != nullptr) return true;
+
+            if (node.routesCount != 0) methodNotAllowed = true;
+        }
+        else if (node.childrenCount != 0)
+        {
+            // Static children have priority over parameters and wildcards
+            auto begin = _childrenFirstBytes.begin() + node.childrenOffset;
+            auto end = begin + node.childrenCount;
+            auto it = std::lower_bound(begin, end, path[pos]);
+
+            if (it != end && *it == path[pos])
+            {
+                uint32_t child = _children[node.childrenOffset + (it - begin)];
+                if (matchNode(child, method, path, length, pos, params, handler, methodNotAllowed))
+                {
+                    return true;
+                }
+            }
+        }
+
+        if (node.paramChild != -1 && pos < length && path[pos] != '/')
+        {
+            if (matchNode(node.paramChild,
+                          method,
+                          path,
+                          length,
+                          pos,
+                          params,
+                          handler,
+                          methodNotAllowed))
+            {
+                return true;
+            }
+        }
+
+        if (node.wildcardChild != -1)
+        {
+            if (matchNode(node.wildcardChild,
+                          method,
+                          path,
+                          length,
+                          pos,
+                          params,
+                          handler,
+                          methodNotAllowed))
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    HttpResponsePtr HttpRouter::handleRequest(HttpRequestPtr request,
+                                              std::shared_ptr<ConnectionState> connectionState)
+    {
+        // Ignore the query string
+        const std::string& uri = request->uri;
+        size_t length = uri.find('?');
+        if (length == std::string::npos) length = uri.size();
+
+        HttpRouteParams params;
+        bool methodNotAllowed = false;
+        const Handler* handler =
+            match(request->method, uri.data(), length, params, methodNotAllowed);
+
+        if (handler != nullptr)
+        {
+            return (*handler)(request, params, connectionState);
+        }
+
+        if (methodNotAllowed)
+        {
+            // List the methods for which the path matches a route
+            std::string allow;
+            for (auto&& method : _methods)
+            {
+                if (match(method, uri.data(), length, params, methodNotAllowed) == nullptr)
+                {
+                    continue;
+                }
+                if (!allow.empty()) allow += ", ";
+                allow += method;
+            }
+
+            WebSocketHttpHeaders headers;
+            headers["Allow"] = allow;
+            return std::make_shared<HttpResponse>(
+                405, "Method Not Allowed", HttpErrorCode::Ok, headers, std::string());
+        }
+
+        return _notFoundHandler(request, params, connectionState);
+    }
+} // namespace ix
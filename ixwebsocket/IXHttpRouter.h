@@ -0,0 +1,190 @@
+/*
+ *  IXHttpRouter.h
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ *
+ *  Map (method, path pattern) pairs to request handlers.
+ *
+ *  Patterns are made of static segments, named parameters (:id) and an optional
+ *  trailing wildcard (*path) which captures the rest of the path:
+ *
+ *    /users
+ *    /users/:id
+ *
+ *  Routes are first collected in a character trie, then compiled into a flat
+ *  radix trie (chains of single child nodes are merged). Matching tries static
+ *  children first, then the parameter, then the wildcard. Every node has a single
+ *  parent and consumes a fixed part of the path, so a match visits each node at
+ *  most once: it is linear in the length of the path when it does not backtrack,
+ *  and bounded by the size of the trie when it does. Parameter values point into
+ *  the request uri and are stored in a fixed size array, so matching does not
+ *  allocate.
+ */
+
+#pragma once
+
+#include "IXHttp.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ix
+{
+    class ConnectionState;
+
+    class HttpRouteParams
+    {
+    public:
+        HttpRouteParams();
+
+        // Number of parameters captured while matching a path
+        size_t size() const;
+
+        // Access the raw bytes of a parameter value, without copying.
+        // Returns false if no parameter with that name was captured.
+        bool get(const std::string& name, const char*& data, size_t& length) const;
+
+        // Convenience accessor, which copies the value into a string.
+        std::string get(const std::string& name) const;
+
+        const std::string& getName(size_t i) const;
+        std::string getValue(size_t i) const;
+
+        void clear();
+        bool push(const std::string* name, const char* data, size_t length);
+        void pop();
+
+        static constexpr size_t kMaxParams = 16;
+
+    private:
+        struct Param
+        {
+            const std::string* name;
+            const char* data;
+            size_t length;
+        };
+
+        Param _params[kMaxParams];
+        size_t _size;
+    };
+
+    class HttpRouter
+    {
+    public:
+        using Handler = std::function<HttpResponsePtr(
+            HttpRequestPtr, const HttpRouteParams&, std::shared_ptr<ConnectionState>)>;
+
+        HttpRouter();
+        ~HttpRouter();
+
+        // Register a handler. Returns false if the pattern is malformed, has more
+        // than kMaxSegments segments, or if it conflicts with an already registered
+        // pattern (two different parameter names at the same position, or a
+        // wildcard which is not last). Method "*" matches any method.
+        bool addRoute(const std::string& method, const std::string& pattern, const Handler& handler);
+
+        // Handler invoked when no route matches. Defaults to a 404 response.
+        void setNotFoundHandler(const Handler& handler);
+
+        // Build the matching trie. Must be called after the last call to addRoute,
+        // and before serving requests. HttpServer::setRouter does it.
+        void compile();
+
+        // Lookup a handler. Returns nullptr if nothing matches. When the path
+        // matches but the method does not, methodNotAllowed is set to true.
+        const Handler* match(const std::string& method,
+                             const char* path,
+                             size_t length,
+                             HttpRouteParams& params,
+                             bool& methodNotAllowed) const;
+
+        HttpResponsePtr handleRequest(HttpRequestPtr request,
+                                      std::shared_ptr<ConnectionState> connectionState);
+
+        size_t getRoutesCount() const;
+
+        // Bounds the recursion depth of matching
+        static constexpr size_t kMaxSegments = 64;
+
+    private:
+        struct BuildNode;
+
+        enum class NodeKind : uint8_t
+        {
+            Static,
+            Param,
+            Wildcard
+        };
+
+        struct Node
+        {
+            NodeKind kind;
+
+            // Static label matched by this node. Empty for parameter and wildcard nodes.
+            uint32_t labelOffset;
+            uint32_t labelLength;
+
+            // Static children, stored contiguously in _children, sorted by first label byte
+            uint32_t childrenOffset;
+            uint32_t childrenCount;
+
+            // Dynamic children, -1 if absent
+            int32_t paramChild;
+            int32_t wildcardChild;
+
+            // Name of the parameter or wildcard captured by this node
+            int32_t nameIndex;
+
+            // Routes terminating at this node, stored contiguously in _nodeRoutes
+            uint32_t routesOffset;
+            uint32_t routesCount;
+        };
+
+        struct Route
+        {
+            std::string method;
+            Handler handler;
+        };
+
+        int32_t compileNode(const BuildNode* node, NodeKind kind, const std::string& label);
+        int32_t compileStaticChild(const BuildNode* node, char c);
+
+        bool matchNode(int32_t nodeIndex,
+                       const std::string& method,
+                       const char* path,
+                       size_t length,
+                       size_t pos,
+                       HttpRouteParams& params,
+                       const Handler*& handler,
+                       bool& methodNotAllowed) const;
+
+        bool matchChildren(const Node& node,
+                           const std::string& method,
+                           const char* path,
+                           size_t length,
+                           size_t pos,
+                           HttpRouteParams& params,
+                           const Handler*& handler,
+                           bool& methodNotAllowed) const;
+
+        const Handler* findRoute(const Node& node, const std::string& method) const;
+
+        std::unique_ptr<BuildNode> _root;
+        size_t _routesCount;
+        bool _compiled;
+
+        // Compiled trie
+        std::vector<Node> _nodes;
+        std::vector<uint32_t> _children;
+        std::vector<char> _childrenFirstBytes;
+        std::vector<Route> _nodeRoutes;
+        std::vector<std::string> _names;
+        std::string _labels;
+
+        // Methods of the routes, listed by 405 responses
+        std::vector<std::string> _methods;
+
+        Handler _notFoundHandler;
+    };
+} // namespace ix
@@ -46,6 +46,9 @@ namespace ix
         int port, const std::string& host, int backlog, size_t maxConnections, int addressFamily)
         : SocketServer(port, host, backlog, maxConnections, addressFamily)
         , _connectedClientsCount(0)
+        , _activeConnections(nullptr)
+        , _requestErrors(nullptr)
+        , _responseBytes(nullptr)
     {
         setDefaultConnectionCallback();
     }
@@ -69,25 +72,80 @@ namespace ix
         _onConnectionCallback = callback;
     }
 
+    void HttpServer::setRouter(std::shared_ptr<HttpRouter> router)
+    {
+        router->compile();
+
+        setOnConnectionCallback(
+            [router](HttpRequestPtr request,
+                     std::shared_ptr<ConnectionState> connectionState) -> HttpResponsePtr {
+                return router->handleRequest(request, connectionState);
+            });
+    }
+
     void HttpServer::handleConnection(std::shared_ptr<Socket> socket,
                                       std::shared_ptr<ConnectionState> connectionState)
     {
         _connectedClientsCount++;
+        if (_activeConnections) _activeConnections->increment(1);
 
         auto ret = Http::parseRequest(socket);
         // FIXME: handle errors in parseRequest
 
         if (std::get<0>(ret))
         {
-            auto response = _onConnectionCallback(std::get<2>(ret), connectionState);
+            auto request = std::get<2>(ret);
+            auto response = getMetricsResponse(request);
+            if (!response) response = _onConnectionCallback(request, connectionState);
+
             if (!Http::sendResponse(response, socket))
             {
                 logError("Cannot send response");
             }
+            countRequestMetrics(response);
+        }
+        else if (_requestErrors)
+        {
+            _requestErrors->increment();
         }
         connectionState->setTerminated();
 
         _connectedClientsCount--;
+        if (_activeConnections) _activeConnections->increment(-1);
+    }
+
+    void HttpServer::setMetricsRegistry(std::shared_ptr<MetricsRegistry> registry)
+    {
+        SocketServer::setMetricsRegistry(registry);
+        _activeConnections = nullptr;
+        _requestErrors = nullptr;
+        _responseBytes = nullptr;
+        _requests.reset();
+        if (!registry) return;
+
+        std::string labels = getMetricsLabels();
+        _activeConnections = &registry->gauge(
+            "ixwebsocket_http_server_active_connections", "Connections being served", labels);
+        _requestErrors = &registry->counter("ixwebsocket_http_server_request_errors_total",
+                                            "Connections which did not send a valid request",
+                                            labels);
+        _responseBytes = &registry->counter("ixwebsocket_http_server_response_bytes_total",
+                                            "Payload bytes of the responses",
+                                            labels);
+        _requests.reset(new MetricsByCode(*registry,
+                                          "ixwebsocket_http_server_requests_total",
+                                          "Requests served, by status code",
+                                          labels,
+                                          100,
+                                          600));
+    }
+
+    void HttpServer::countRequestMetrics(HttpResponsePtr response)
+    {
+        if (!_requests) return;
+
+        _requests->counter(response->statusCode).increment();
+        _responseBytes->increment(response->payload.size());
     }
 
     size_t HttpServer::getConnectedClientsCount()
@@ -7,6 +7,7 @@
 #pragma once
 
 #include "IXHttp.h"
+#include "IXHttpRouter.h"
 #include "IXSocketServer.h"
 #include "IXWebSocket.h"
 #include <functional>
@@ -35,18 +36,33 @@ namespace ix
 
         void setOnConnectionCallback(const OnConnectionCallback& callback);
 
+        // Dispatch requests through a router instead of a single callback.
+        // Routes must all be registered before calling this.
+        void setRouter(std::shared_ptr<HttpRouter> router);
+
         void makeRedirectServer(const std::string& redirectUrl);
 
+        // Also exports the active connections, the requests by status code,
+        // the request errors and the response bytes
+        void setMetricsRegistry(std::shared_ptr<MetricsRegistry> registry) final;
+
     private:
         // Member variables
         OnConnectionCallback _onConnectionCallback;
         std::atomic<int> _connectedClientsCount;
 
+        // Found once in the registry, nullptr without one
+        Metric* _activeConnections;
+        Metric* _requestErrors;
+        Metric* _responseBytes;
+        std::unique_ptr<MetricsByCode> _requests;
+
         // Methods
         virtual void handleConnection(std::shared_ptr<Socket>,
                                       std::shared_ptr<ConnectionState> connectionState) final;
         virtual size_t getConnectedClientsCount() final;
 
         void setDefaultConnectionCallback();
+        void countRequestMetrics(HttpResponsePtr response);
     };
 } // namespace ix
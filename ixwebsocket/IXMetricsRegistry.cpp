@@ -0,0 +1,181 @@
+/*
+ *  IXMetricsRegistry.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ */
+
+#include "IXMetricsRegistry.h"
+
+#include "IXUserAgent.h"
+#include <sstream>
+
+namespace
+{
+    // HELP lines escape backslashes and new lines
+    std::string escapeHelp(const std::string& help)
+    {
+        std::string escaped;
+        for (char c : help)
+        {
+            if (c == '\\')
+                escaped += "\\\\";
+            else if (c == '\n')
+                escaped += "\\n";
+            else
+                escaped += c;
+        }
+        return escaped;
+    }
+} // namespace
+
+namespace ix
+{
+    const std::string MetricsRegistry::kContentType("text/plain; version=0.0.4");
+
+    Metric::Metric()
+        : _value(0)
+    {
+        ;
+    }
+
+    void Metric::increment(int64_t value)
+    {
+        _value.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    void Metric::set(int64_t value)
+    {
+        _value.store(value, std::memory_order_relaxed);
+    }
+
+    int64_t Metric::get() const
+    {
+        return _value.load(std::memory_order_relaxed);
+    }
+
+    Metric& MetricsRegistry::counter(const std::string& name,
+                                     const std::string& help,
+                                     const std::string& labels)
+    {
+        return getMetric(MetricType::Counter, name, help, labels);
+    }
+
+    Metric& MetricsRegistry::gauge(const std::string& name,
+                                   const std::string& help,
+                                   const std::string& labels)
+    {
+        return getMetric(MetricType::Gauge, name, help, labels);
+    }
+
+    Metric& MetricsRegistry::getMetric(MetricType type,
+                                       const std::string& name,
+                                       const std::string& help,
+                                       const std::string& labels)
+    {
+        std::lock_guard<std::mutex> lock(_familiesMutex);
+
+        auto it = _families.find(name);
+        if (it == _families.end())
+        {
+            Family family;
+            family.type = type;
+            family.help = help;
+            it = _families.emplace(name, std::move(family)).first;
+        }
+
+        auto& metric = it->second.metrics[labels];
+        if (!metric) metric.reset(new Metric());
+        return *metric;
+    }
+
+    void MetricsRegistry::setCollector(const void* owner, const std::function<void()>& collector)
+    {
+        std::lock_guard<std::mutex> lock(_collectorsMutex);
+        _collectors[owner] = collector;
+    }
+
+    void MetricsRegistry::removeCollector(const void* owner)
+    {
+        // Waits for a serialization running that collector
+        std::lock_guard<std::mutex> lock(_collectorsMutex);
+        _collectors.erase(owner);
+    }
+
+    std::string MetricsRegistry::serialize()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_collectorsMutex);
+            for (auto&& it : _collectors)
+            {
+                it.second();
+            }
+        }
+
+        std::stringstream ss;
+        std::lock_guard<std::mutex> lock(_familiesMutex);
+
+        for (auto&& it : _families)
+        {
+            const std::string& name = it.first;
+            const Family& family = it.second;
+
+            ss << "# HELP " << name << " " << escapeHelp(family.help) << "\n";
+            ss << "# TYPE " << name << " "
+               << (family.type == MetricType::Counter ? "counter" : "gauge") << "\n";
+
+            for (auto&& metric : family.metrics)
+            {
+                ss << name;
+                if (!metric.first.empty()) ss << "{" << metric.first << "}";
+                ss << " " << metric.second->get() << "\n";
+            }
+        }
+
+        return ss.str();
+    }
+
+    HttpResponsePtr MetricsRegistry::createHttpResponse()
+    {
+        WebSocketHttpHeaders headers;
+        headers["Server"] = userAgent();
+        headers["Content-Type"] = kContentType;
+
+        return std::make_shared<HttpResponse>(200, "OK", HttpErrorCode::Ok, headers, serialize());
+    }
+
+    MetricsByCode::MetricsByCode(MetricsRegistry& registry,
+                                 const std::string& name,
+                                 const std::string& help,
+                                 const std::string& labels,
+                                 int minCode,
+                                 int maxCode)
+        : _registry(registry)
+        , _name(name)
+        , _help(help)
+        , _labels(labels.empty() ? labels : labels + ",")
+        , _minCode(minCode)
+        , _maxCode(maxCode)
+        , _metrics(new std::atomic<Metric*>[maxCode - minCode])
+    {
+        for (int i = 0; i < _maxCode - _minCode; ++i)
+        {
+            _metrics[i] = nullptr;
+        }
+    }
+
+    Metric& MetricsByCode::counter(int code)
+    {
+        bool cached = code >= _minCode && code < _maxCode;
+        if (cached)
+        {
+            Metric* metric = _metrics[code - _minCode].load(std::memory_order_acquire);
+            if (metric) return *metric;
+        }
+
+        // Threads racing on a new code find the same metric
+        Metric& metric =
+            _registry.counter(_name, _help, _labels + "code=\"" + std::to_string(code) + "\"");
+        if (cached) _metrics[code - _minCode].store(&metric, std::memory_order_release);
+        return metric;
+    }
+} // namespace ix
@@ -0,0 +1,118 @@
+/*
+ *  IXMetricsRegistry.h
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ *
+ *  Counters and gauges exported in the Prometheus text format.
+ *
+ *  A metric is found by its name and labels (such as code="1000", without the
+ *  braces) and created on first use. Finding it takes a lock, so hot paths
+ *  keep the returned reference, which stays valid as long as the registry;
+ *  updating it is a single atomic operation.
+ *
+ *  Values kept elsewhere (such as the WebSocketServer stats) are copied into
+ *  metrics by collectors, which run before each serialization.
+ *
+ *  Counters labeled by a code (an HTTP status, a close code) go through a
+ *  MetricsByCode, which finds each code once and then reads it from a table.
+ */
+
+#pragma once
+
+#include "IXHttp.h"
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+
+namespace ix
+{
+    class Metric
+    {
+    public:
+        Metric();
+
+        void increment(int64_t value = 1);
+        void set(int64_t value);
+        int64_t get() const;
+
+    private:
+        std::atomic<int64_t> _value;
+    };
+
+    enum class MetricType
+    {
+        Counter,
+        Gauge
+    };
+
+    class MetricsRegistry
+    {
+    public:
+        // A name keeps the type and help of its first use
+        Metric& counter(const std::string& name,
+                        const std::string& help,
+                        const std::string& labels = std::string());
+        Metric& gauge(const std::string& name,
+                      const std::string& help,
+                      const std::string& labels = std::string());
+
+        // One collector per owner, which must remove it before going away.
+        // Collectors can find and update metrics, not add or remove collectors.
+        void setCollector(const void* owner, const std::function<void()>& collector);
+        void removeCollector(const void* owner);
+
+        // Runs the collectors, then formats the metrics sorted by name
+        std::string serialize();
+
+        // 200 response with the serialized metrics, for a metrics endpoint
+        HttpResponsePtr createHttpResponse();
+
+        const static std::string kContentType;
+
+    private:
+        struct Family
+        {
+            MetricType type;
+            std::string help;
+            std::map<std::string, std::unique_ptr<Metric>> metrics;
+        };
+
+        Metric& getMetric(MetricType type,
+                          const std::string& name,
+                          const std::string& help,
+                          const std::string& labels);
+
+        std::mutex _familiesMutex;
+        std::map<std::string, Family> _families;
+
+        std::mutex _collectorsMutex;
+        std::map<const void*, std::function<void()>> _collectors;
+    };
+
+    class MetricsByCode
+    {
+    public:
+        // Codes in [minCode, maxCode) are cached, others are found each time
+        MetricsByCode(MetricsRegistry& registry,
+                      const std::string& name,
+                      const std::string& help,
+                      const std::string& labels,
+                      int minCode,
+                      int maxCode);
+
+        Metric& counter(int code);
+
+    private:
+        MetricsRegistry& _registry;
+        std::string _name;
+        std::string _help;
+        std::string _labels;
+        int _minCode;
+        int _maxCode;
+        std::unique_ptr<std::atomic<Metric*>[]> _metrics;
+    };
+} // namespace ix
@@ -0,0 +1,89 @@
+/*
+ *  IXMpscQueue.h
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ *
+ *  Unbounded multi-producer single-consumer queue (Dmitry Vyukov's algorithm).
+ *
+ *  push never blocks and never waits for other producers: it is a single atomic
+ *  exchange followed by a store. pop must only be called from one thread at a
+ *  time. A push which is in progress can make pop report an empty queue,
+ *  producers are expected to signal the consumer after pushing.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+namespace ix
+{
+    template<typename T>
+    class MpscQueue
+    {
+    public:
+        MpscQueue()
+            : _head(new Node())
+            , _tail(_head.load())
+        {
+            ;
+        }
+
+        ~MpscQueue()
+        {
+            T value;
+            while (pop(value))
+            {
+                ;
+            }
+            delete _tail;
+        }
+
+        MpscQueue(const MpscQueue&) = delete;
+        MpscQueue& operator=(const MpscQueue&) = delete;
+
+        void push(T&& value)
+        {
+            Node* node = new Node(std::move(value));
+            Node* prev = _head.exchange(node, std::memory_order_acq_rel);
+            prev->next.store(node, std::memory_order_release);
+        }
+
+        bool pop(T& value)
+        {
+            Node* tail = _tail;
+            Node* next = tail->next.load(std::memory_order_acquire);
+            if (next == nullptr) return false;
+
+            // next becomes the new stub node
+            value = std::move(next->value);
+            _tail = next;
+            delete tail;
+            return true;
+        }
+
+    private:
+        struct Node
+        {
+            Node()
+                : next(nullptr)
+            {
+                ;
+            }
+
+            explicit Node(T&& v)
+                : next(nullptr)
+                , value(std::move(v))
+            {
+                ;
+            }
+
+            std::atomic<Node*> next;
+            T value;
+        };
+
+        // Producers push at the head, the consumer pops at the tail
+        std::atomic<Node*> _head;
+        Node* _tail;
+    };
+} // namespace ix
@@ -9,6 +9,7 @@
 namespace ix
 {
     SelectInterrupt::SelectInterrupt()
+        : _pendingCodes(0)
     {
         ;
     }
@@ -42,4 +43,14 @@ namespace ix
     {
         return -1;
     }
+
+    bool SelectInterrupt::setPending(uint64_t value)
+    {
+        return _pendingCodes.fetch_or(value, std::memory_order_acq_rel) == 0;
+    }
+
+    uint64_t SelectInterrupt::takePending()
+    {
+        return _pendingCodes.exchange(0, std::memory_order_acq_rel);
+    }
 } // namespace ix
@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <stdint.h>
 #include <string>
 
@@ -23,5 +24,17 @@ namespace ix
         virtual bool clear();
         virtual uint64_t read();
         virtual int getFd() const;
+
+    protected:
+        // Codes are bit flags which are or-ed together until the next read, so
+        // only the first notify after a read needs to write to the fd.
+        // Returns true when the caller must write to the fd.
+        bool setPending(uint64_t value);
+
+        // Returns the codes notified since the last call and resets them
+        uint64_t takePending();
+
+    private:
+        std::atomic<uint64_t> _pendingCodes;
     };
 } // namespace ix
@@ -83,6 +83,9 @@ namespace ix
 
         if (fd == -1) return false;
 
+        // A wake up is already pending, it will report this code too
+        if (!setPending(value)) return true;
+
         // we should write 8 bytes for an uint64_t
         return write(fd, &value, sizeof(value)) == 8;
     }
@@ -92,9 +95,12 @@ namespace ix
     {
         int fd = _eventfd;
 
+        // Drain the fd before taking the codes, so that a notify racing with
+        // us either is returned now or writes to the fd again
         uint64_t value = 0;
-        ::read(fd, &value, sizeof(value));
-        return value;
+        if (::read(fd, &value, sizeof(value)) != 8) return 0;
+
+        return takePending();
     }
 
     bool SelectInterruptEventFd::clear()
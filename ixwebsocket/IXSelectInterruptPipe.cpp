@@ -115,6 +115,9 @@ namespace ix
         int fd = _fildes[kPipeWriteIndex];
         if (fd == -1) return false;
 
+        // A wake up is already pending, it will report this code too
+        if (!setPending(value)) return true;
+
         // we should write 8 bytes for an uint64_t
         return write(fd, &value, sizeof(value)) == 8;
     }
@@ -126,10 +129,12 @@ namespace ix
 
         int fd = _fildes[kPipeReadIndex];
 
+        // Drain the pipe before taking the codes, so that a notify racing with
+        // us either is returned now or writes to the pipe again
         uint64_t value = 0;
-        ::read(fd, &value, sizeof(value));
+        if (::read(fd, &value, sizeof(value)) != 8) return 0;
 
-        return value;
+        return takePending();
     }
 
     bool SelectInterruptPipe::clear()
@@ -6,6 +6,7 @@
 
 #include "IXSocket.h"
 
+#include "IXBufferPool.h"
 #include "IXNetSystem.h"
 #include "IXSelectInterrupt.h"
 #include "IXSelectInterruptFactory.h"
@@ -19,6 +20,10 @@
 #include <string.h>
 #include <sys/types.h>
 
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
 #ifdef min
 #undef min
 #endif
@@ -29,7 +34,7 @@ namespace ix
     const int Socket::kDefaultPollTimeout = kDefaultPollNoTimeout;
     const uint64_t Socket::kSendRequest = 1;
     const uint64_t Socket::kCloseRequest = 2;
-    constexpr size_t Socket::kChunkSize;
+    const uint64_t Socket::kTimerRequest = 4;
 
     Socket::Socket(int fd)
         : _sockfd(fd)
@@ -46,7 +51,8 @@ namespace ix
     PollResultType Socket::poll(bool readyToRead,
                                 int timeoutMs,
                                 int sockfd,
-                                std::shared_ptr<SelectInterrupt> selectInterrupt)
+                                std::shared_ptr<SelectInterrupt> selectInterrupt,
+                                bool readyToWrite)
     {
         //
         // We used to use ::select to poll but on Android 9 we get large fds out of
@@ -63,6 +69,10 @@ namespace ix
 
         fds[0].fd = sockfd;
         fds[0].events = (readyToRead) ? POLLIN : POLLOUT;
+        if (readyToWrite)
+        {
+            fds[0].events |= POLLOUT;
+        }
 
         // this is ignored by poll, but our select based poll wrapper on Windows needs it
         fds[0].events |= POLLERR;
@@ -96,19 +106,34 @@ namespace ix
         {
             uint64_t value = selectInterrupt->read();
 
-            if (value == kSendRequest)
+            // Codes are coalesced into bit flags, a close request wins over a
+            // send request as the socket is about to be closed
+            if (value & kCloseRequest)
+            {
+                pollResult = PollResultType::CloseRequest;
+            }
+            else if (value & kSendRequest)
             {
                 pollResult = PollResultType::SendRequest;
             }
-            else if (value == kCloseRequest)
+            else if (value & kTimerRequest)
             {
-                pollResult = PollResultType::CloseRequest;
+                pollResult = PollResultType::Timeout;
             }
         }
+        else if (sockfd != -1 && readyToRead && readyToWrite && fds[0].revents & POLLIN &&
+                 fds[0].revents & POLLOUT)
+        {
+            pollResult = PollResultType::ReadyForReadAndWrite;
+        }
         else if (sockfd != -1 && readyToRead && fds[0].revents & POLLIN)
         {
             pollResult = PollResultType::ReadyForRead;
         }
+        else if (sockfd != -1 && readyToRead && readyToWrite && fds[0].revents & POLLOUT)
+        {
+            pollResult = PollResultType::ReadyForWrite;
+        }
         else if (sockfd != -1 && !readyToRead && fds[0].revents & POLLOUT)
         {
             pollResult = PollResultType::ReadyForWrite;
@@ -166,12 +191,34 @@ namespace ix
         return poll(readyToRead, timeoutMs, _sockfd, _selectInterrupt);
     }
 
+    PollResultType Socket::isReadyToReadOrWrite(int timeoutMs)
+    {
+        if (_sockfd == -1)
+        {
+            return PollResultType::Error;
+        }
+
+        bool readyToRead = true;
+        bool readyToWrite = true;
+        return poll(readyToRead, timeoutMs, _sockfd, _selectInterrupt, readyToWrite);
+    }
+
     // Wake up from poll/select by writing to the pipe which is watched by select
     bool Socket::wakeUpFromPoll(uint64_t wakeUpCode)
     {
         return _selectInterrupt->notify(wakeUpCode);
     }
 
+    int Socket::getFd() const
+    {
+        return _sockfd;
+    }
+
+    int Socket::getInterruptFd() const
+    {
+        return _selectInterrupt->getFd();
+    }
+
     bool Socket::accept(std::string& errMsg)
     {
         if (_sockfd == -1)
@@ -191,10 +238,16 @@ namespace ix
 
         if (!_selectInterrupt->clear()) return false;
 
-        _sockfd = SocketConnect::connect(host, port, errMsg, isCancellationRequested);
+        _sockfd = SocketConnect::connect(
+            host, port, errMsg, isCancellationRequested, &_connectionTimings);
         return _sockfd != -1;
     }
 
+    ConnectionTimings Socket::getConnectionTimings() const
+    {
+        return _connectionTimings;
+    }
+
     void Socket::close()
     {
         std::lock_guard<std::mutex> lock(_socketMutex);
@@ -220,6 +273,45 @@ namespace ix
         return send((char*) &buffer[0], buffer.size());
     }
 
+    ssize_t Socket::sendv(const char* buffer1,
+                          size_t length1,
+                          const char* buffer2,
+                          size_t length2)
+    {
+#ifdef _WIN32
+        WSABUF buffers[2];
+        buffers[0].buf = (CHAR*) buffer1;
+        buffers[0].len = (ULONG) length1;
+        buffers[1].buf = (CHAR*) buffer2;
+        buffers[1].len = (ULONG) length2;
+
+        DWORD sent = 0;
+        if (WSASend(_sockfd, buffers, 2, &sent, 0, nullptr, nullptr) == SOCKET_ERROR)
+        {
+            return -1;
+        }
+        return (ssize_t) sent;
+#else
+        struct iovec iov[2];
+        iov[0].iov_base = (void*) buffer1;
+        iov[0].iov_len = length1;
+        iov[1].iov_base = (void*) buffer2;
+        iov[1].iov_len = length2;
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = 2;
+
+        int flags = 0;
+#ifdef MSG_NOSIGNAL
+        flags = MSG_NOSIGNAL;
+#endif
+
+        return ::sendmsg(_sockfd, &msg, flags);
+#endif
+    }
+
     ssize_t Socket::recv(void* buffer, size_t length)
     {
         int flags = 0;
@@ -308,6 +400,52 @@ namespace ix
         }
     }
 
+    bool Socket::writeBytes(const std::string& header,
+                            const std::string& payload,
+                            const CancellationRequest& isCancellationRequested)
+    {
+        size_t offset = 0;
+        size_t total = header.size() + payload.size();
+
+        while (offset < total)
+        {
+            if (isCancellationRequested && isCancellationRequested()) return false;
+
+            // Send what is left of the header along with the payload, then what
+            // is left of the payload if the first write was partial.
+            ssize_t ret;
+            if (offset < header.size())
+            {
+                ret = sendv(&header[offset],
+                            header.size() - offset,
+                            payload.data(),
+                            payload.size());
+            }
+            else
+            {
+                ret = send((char*) &payload[offset - header.size()], total - offset);
+            }
+
+            // We wrote some bytes, as needed, all good.
+            if (ret > 0)
+            {
+                offset += (size_t) ret;
+            }
+            // There is possibly something to be writen, try again
+            else if (ret < 0 && Socket::isWaitNeeded())
+            {
+                continue;
+            }
+            // There was an error during the write, abort
+            else
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
     bool Socket::readByte(void* buffer, const CancellationRequest& isCancellationRequested)
     {
         while (true)
@@ -366,10 +504,7 @@ namespace ix
         const OnProgressCallback& onProgressCallback,
         const CancellationRequest& isCancellationRequested)
     {
-        if (_readBuffer.empty())
-        {
-            _readBuffer.resize(kChunkSize);
-        }
+        PooledBuffer readBuffer = BufferPool::getDefault().acquire();
 
         std::vector<uint8_t> output;
         while (output.size() != length)
@@ -379,12 +514,12 @@ namespace ix
                 return std::make_pair(false, std::string());
             }
 
-            size_t size = std::min(kChunkSize, length - output.size());
-            ssize_t ret = recv((char*) &_readBuffer[0], size);
+            size_t size = std::min(readBuffer.size(), length - output.size());
+            ssize_t ret = recv((char*) readBuffer.data(), size);
 
             if (ret > 0)
             {
-                output.insert(output.end(), _readBuffer.begin(), _readBuffer.begin() + ret);
+                output.insert(output.end(), readBuffer.data(), readBuffer.data() + ret);
             }
             else if (ret <= 0 && !Socket::isWaitNeeded())
             {
@@ -33,6 +33,7 @@ typedef SSIZE_T ssize_t;
 #endif
 
 #include "IXCancellationRequest.h"
+#include "IXConnectionTimings.h"
 #include "IXProgressCallback.h"
 
 namespace ix
@@ -46,7 +47,8 @@ namespace ix
         Timeout = 2,
         Error = 3,
         SendRequest = 4,
-        CloseRequest = 5
+        CloseRequest = 5,
+        ReadyForReadAndWrite = 6
     };
 
     class Socket
@@ -60,9 +62,18 @@ namespace ix
         PollResultType poll(int timeoutMs = kDefaultPollTimeout);
         bool wakeUpFromPoll(uint64_t wakeUpCode);
 
+        // For a reactor watching many sockets: the socket, and the select
+        // interrupt which is readable after wakeUpFromPoll (-1 when there is none)
+        int getFd() const;
+        int getInterruptFd() const;
+
         PollResultType isReadyToWrite(int timeoutMs);
         PollResultType isReadyToRead(int timeoutMs);
 
+        // Wait for incoming data and for room in the send buffer at the same time.
+        // ReadyForReadAndWrite is returned when both are true.
+        PollResultType isReadyToReadOrWrite(int timeoutMs);
+
         // Virtual methods
         virtual bool accept(std::string& errMsg);
 
@@ -72,14 +83,27 @@ namespace ix
                              const CancellationRequest& isCancellationRequested);
         virtual void close();
 
+        // Phases of the last connect, up to the TLS handshake
+        ConnectionTimings getConnectionTimings() const;
+
         virtual ssize_t send(char* buffer, size_t length);
         ssize_t send(const std::string& buffer);
         virtual ssize_t recv(void* buffer, size_t length);
 
+        // Gather write of two buffers with a single system call (writev).
+        // Returns the number of bytes written, counted across both buffers.
+        virtual ssize_t sendv(const char* buffer1,
+                              size_t length1,
+                              const char* buffer2,
+                              size_t length2);
+
         // Blocking and cancellable versions, working with socket that can be set
         // to non blocking mode. Used during HTTP upgrade.
         bool readByte(void* buffer, const CancellationRequest& isCancellationRequested);
         bool writeBytes(const std::string& str, const CancellationRequest& isCancellationRequested);
+        bool writeBytes(const std::string& header,
+                        const std::string& payload,
+                        const CancellationRequest& isCancellationRequested);
 
         std::pair<bool, std::string> readLine(const CancellationRequest& isCancellationRequested);
         std::pair<bool, std::string> readBytes(size_t length,
@@ -93,25 +117,25 @@ namespace ix
         static PollResultType poll(bool readyToRead,
                                    int timeoutMs,
                                    int sockfd,
-                                   std::shared_ptr<SelectInterrupt> selectInterrupt = nullptr);
+                                   std::shared_ptr<SelectInterrupt> selectInterrupt = nullptr,
+                                   bool readyToWrite = false);
 
 
-        // Used as special codes for pipe communication
+        // Used as special codes for pipe communication, they are bit flags
+        // which can be combined when several wake ups are coalesced
         static const uint64_t kSendRequest;
         static const uint64_t kCloseRequest;
+        static const uint64_t kTimerRequest;
 
     protected:
         std::atomic<int> _sockfd;
         std::mutex _socketMutex;
+        ConnectionTimings _connectionTimings;
 
     private:
         static const int kDefaultPollTimeout;
         static const int kDefaultPollNoTimeout;
 
-        // Buffer for reading from our socket. That buffer is never resized.
-        std::vector<uint8_t> _readBuffer;
-        static constexpr size_t kChunkSize = 1 << 15;
-
         std::shared_ptr<SelectInterrupt> _selectInterrupt;
     };
 } // namespace ix
@@ -174,7 +174,8 @@ namespace ix
         {
             std::lock_guard<std::mutex> lock(_mutex);
 
-            _sockfd = SocketConnect::connect(host, port, errMsg, isCancellationRequested);
+            _sockfd = SocketConnect::connect(
+                host, port, errMsg, isCancellationRequested, &_connectionTimings);
             if (_sockfd == -1) return false;
 
             _sslContext = SSLCreateContext(kCFAllocatorDefault, kSSLClientSide, kSSLStreamType);
@@ -220,6 +221,7 @@ namespace ix
             return false;
         }
 
+        _connectionTimings.tlsHandshakeUs = ConnectionTimings::now();
         return true;
     }
 
@@ -266,6 +268,17 @@ namespace ix
     }
 
     // No wait support
+    ssize_t SocketAppleSSL::sendv(const char* buffer1,
+                                  size_t length1,
+                                  const char* buffer2,
+                                  size_t length2)
+    {
+        // TLS records are written from a single buffer. Write the first one,
+        // Socket::writeBytes calls us again with what is left.
+        if (length1 == 0) return send(const_cast<char*>(buffer2), length2);
+        return send(const_cast<char*>(buffer1), length1);
+    }
+
     ssize_t SocketAppleSSL::recv(void* buf, size_t nbyte)
     {
         OSStatus status = errSSLWouldBlock;
@@ -96,8 +96,15 @@ namespace ix
     int SocketConnect::connect(const std::string& hostname,
                                int port,
                                std::string& errMsg,
-                               const CancellationRequest& isCancellationRequested)
+                               const CancellationRequest& isCancellationRequested,
+                               ConnectionTimings* timings)
     {
+        if (timings)
+        {
+            *timings = ConnectionTimings();
+            timings->startUs = ConnectionTimings::now();
+        }
+
         //
         // First do DNS resolution
         //
@@ -108,6 +115,8 @@ namespace ix
             return -1;
         }
 
+        if (timings) timings->dnsLookupUs = ConnectionTimings::now();
+
         int sockfd = -1;
 
         // iterate through the records to find a working peer
@@ -125,6 +134,8 @@ namespace ix
         }
 
         freeaddrinfo(res);
+
+        if (timings && sockfd != -1) timings->connectUs = ConnectionTimings::now();
         return sockfd;
     }
 
@@ -7,6 +7,7 @@
 #pragma once
 
 #include "IXCancellationRequest.h"
+#include "IXConnectionTimings.h"
 #include <string>
 
 struct addrinfo;
@@ -16,10 +17,13 @@ namespace ix
     class SocketConnect
     {
     public:
+        // When timings is set, it is reset and receives the start, DNS lookup
+        // and connect timestamps
         static int connect(const std::string& hostname,
                            int port,
                            std::string& errMsg,
-                           const CancellationRequest& isCancellationRequested);
+                           const CancellationRequest& isCancellationRequested,
+                           ConnectionTimings* timings = nullptr);
 
         static void configure(int sockfd);
 
@@ -178,7 +178,8 @@ namespace ix
     {
         {
             std::lock_guard<std::mutex> lock(_mutex);
-            _sockfd = SocketConnect::connect(host, port, errMsg, isCancellationRequested);
+            _sockfd = SocketConnect::connect(
+                host, port, errMsg, isCancellationRequested, &_connectionTimings);
             if (_sockfd == -1) return false;
         }
 
@@ -211,6 +212,7 @@ namespace ix
             return false;
         }
 
+        _connectionTimings.tlsHandshakeUs = ConnectionTimings::now();
         return true;
     }
 
@@ -249,6 +251,17 @@ namespace ix
         }
     }
 
+    ssize_t SocketMbedTLS::sendv(const char* buffer1,
+                                 size_t length1,
+                                 const char* buffer2,
+                                 size_t length2)
+    {
+        // TLS records are written from a single buffer. Write the first one,
+        // Socket::writeBytes calls us again with what is left.
+        if (length1 == 0) return send(const_cast<char*>(buffer2), length2);
+        return send(const_cast<char*>(buffer1), length1);
+    }
+
     ssize_t SocketMbedTLS::recv(void* buf, size_t nbyte)
     {
         while (true)
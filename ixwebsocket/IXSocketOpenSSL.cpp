@@ -542,7 +542,8 @@ namespace ix
                 return false;
             }
 
-            _sockfd = SocketConnect::connect(host, port, errMsg, isCancellationRequested);
+            _sockfd = SocketConnect::connect(
+                host, port, errMsg, isCancellationRequested, &_connectionTimings);
             if (_sockfd == -1) return false;
 
             _ssl_context = openSSLCreateContext(errMsg);
@@ -586,6 +587,7 @@ namespace ix
             return false;
         }
 
+        _connectionTimings.tlsHandshakeUs = ConnectionTimings::now();
         return true;
     }
 
@@ -635,6 +637,17 @@ namespace ix
         }
     }
 
+    ssize_t SocketOpenSSL::sendv(const char* buffer1,
+                                 size_t length1,
+                                 const char* buffer2,
+                                 size_t length2)
+    {
+        // TLS records are written from a single buffer. Write the first one,
+        // Socket::writeBytes calls us again with what is left.
+        if (length1 == 0) return send(const_cast<char*>(buffer2), length2);
+        return send(const_cast<char*>(buffer1), length1);
+    }
+
     ssize_t SocketOpenSSL::recv(void* buf, size_t nbyte)
     {
         while (true)
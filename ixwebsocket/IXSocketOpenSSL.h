@@ -33,6 +33,10 @@ namespace ix
         virtual void close() final;
 
         virtual ssize_t send(char* buffer, size_t length) final;
+        virtual ssize_t sendv(const char* buffer1,
+                              size_t length1,
+                              const char* buffer2,
+                              size_t length2) final;
         virtual ssize_t recv(void* buffer, size_t length) final;
 
     private:
@@ -11,6 +11,7 @@
 #include "IXSocket.h"
 #include "IXSocketConnect.h"
 #include "IXSocketFactory.h"
+#include "IXTrace.h"
 #include <assert.h>
 #include <sstream>
 #include <stdio.h>
@@ -35,6 +36,7 @@ namespace ix
         , _stop(false)
         , _stopGc(false)
         , _connectionStateFactory(&ConnectionState::createConnectionState)
+        , _acceptedConnections(nullptr)
     {
     }
 
@@ -292,6 +294,8 @@ namespace ix
                 continue;
             }
 
+            IX_TRACE2(accept, clientFd, _port);
+
             if (getConnectedClientsCount() >= _maxConnections)
             {
                 std::stringstream ss;
@@ -300,6 +304,7 @@ namespace ix
                 logError(ss.str());
 
                 Socket::closeSocket(clientFd);
+                countRejectedConnection("max_connections");
 
                 continue;
             }
@@ -321,6 +326,7 @@ namespace ix
             {
                 logError("SocketServer::run() cannot create socket: " + errorMsg);
                 Socket::closeSocket(clientFd);
+                countRejectedConnection("socket");
                 continue;
             }
 
@@ -331,9 +337,12 @@ namespace ix
             {
                 logError("SocketServer::run() tls accept failed: " + errorMsg);
                 Socket::closeSocket(clientFd);
+                countRejectedConnection("tls");
                 continue;
             }
 
+            if (_acceptedConnections) _acceptedConnections->increment();
+
             // Launch the handleConnection work asynchronously in its own thread.
             std::lock_guard<std::mutex> lock(_connectionsThreadsMutex);
             _connectionsThreads.push_back(std::make_pair(
@@ -342,6 +351,29 @@ namespace ix
         }
     }
 
+    void SocketServer::detachConnectionThread()
+    {
+        std::lock_guard<std::mutex> lock(_connectionsThreadsMutex);
+        auto id = std::this_thread::get_id();
+
+        for (auto it = _connectionsThreads.begin(); it != _connectionsThreads.end(); ++it)
+        {
+            if (it->second.get_id() == id)
+            {
+                it->second.detach();
+                _connectionsThreads.erase(it);
+                return;
+            }
+        }
+    }
+
+    void SocketServer::startConnectionThread(std::shared_ptr<ConnectionState> connectionState,
+                                             const std::function<void()>& task)
+    {
+        std::lock_guard<std::mutex> lock(_connectionsThreadsMutex);
+        _connectionsThreads.push_back(std::make_pair(connectionState, std::thread(task)));
+    }
+
     size_t SocketServer::getConnectionsThreadsCount()
     {
         std::lock_guard<std::mutex> lock(_connectionsThreadsMutex);
@@ -373,4 +405,51 @@ namespace ix
     {
         _socketTLSOptions = socketTLSOptions;
     }
+
+    void SocketServer::setMetricsRegistry(std::shared_ptr<MetricsRegistry> registry)
+    {
+        _metricsRegistry = registry;
+        _acceptedConnections = nullptr;
+        if (!_metricsRegistry) return;
+
+        _acceptedConnections = &_metricsRegistry->counter(
+            "ixwebsocket_server_connections_accepted_total",
+            "Connections accepted by the server, before any handshake",
+            getMetricsLabels());
+    }
+
+    void SocketServer::setMetricsPath(const std::string& path)
+    {
+        _metricsPath = path;
+    }
+
+    std::string SocketServer::getMetricsLabels(const std::string& extraLabels) const
+    {
+        std::string labels = "port=\"" + std::to_string(_port) + "\"";
+        if (!extraLabels.empty()) labels += "," + extraLabels;
+        return labels;
+    }
+
+    HttpResponsePtr SocketServer::getMetricsResponse(HttpRequestPtr request)
+    {
+        if (!_metricsRegistry || _metricsPath.empty()) return nullptr;
+
+        // The query string, if any, is ignored
+        const std::string& uri = request->uri;
+        if (uri.compare(0, uri.find('?'), _metricsPath) != 0) return nullptr;
+
+        return _metricsRegistry->createHttpResponse();
+    }
+
+    void SocketServer::countRejectedConnection(const std::string& reason)
+    {
+        if (!_metricsRegistry) return;
+
+        _metricsRegistry
+            ->counter("ixwebsocket_server_connections_rejected_total",
+                      "Connections closed right after accept: too many clients, or a "
+                      "socket or TLS error",
+                      getMetricsLabels("reason=\"" + reason + "\""))
+            .increment();
+    }
 } // namespace ix
@@ -7,6 +7,8 @@
 #pragma once
 
 #include "IXConnectionState.h"
+#include "IXHttp.h"
+#include "IXMetricsRegistry.h"
 #include "IXSocketTLSOptions.h"
 #include <atomic>
 #include <condition_variable>
@@ -58,6 +60,15 @@ namespace ix
 
         void setTLSOptions(const SocketTLSOptions& socketTLSOptions);
 
+        // Record the accepted and rejected connections, and the activity of
+        // the derived server, in that registry. Metrics are labeled with the
+        // port, so that servers can share a registry. Call it before start.
+        virtual void setMetricsRegistry(std::shared_ptr<MetricsRegistry> registry);
+
+        // Serve the registry in the Prometheus text format at that path (such
+        // as /metrics) of this server. Empty, the default, disables it.
+        void setMetricsPath(const std::string& path);
+
     protected:
         // Logging
         void logError(const std::string& str);
@@ -65,6 +76,21 @@ namespace ix
 
         void stopAcceptingConnections();
 
+        // A connection thread can let go of its connection, and exit without
+        // being joined. Another thread picks the connection up later.
+        void detachConnectionThread();
+        void startConnectionThread(std::shared_ptr<ConnectionState> connectionState,
+                                   const std::function<void()>& task);
+
+        // Labels of the metrics of this server, followed by extraLabels
+        std::string getMetricsLabels(const std::string& extraLabels = std::string()) const;
+
+        // The metrics, when request is for the metrics path, nullptr otherwise
+        HttpResponsePtr getMetricsResponse(HttpRequestPtr request);
+
+        std::shared_ptr<MetricsRegistry> _metricsRegistry;
+        std::string _metricsPath;
+
     private:
         // Member variables
         int _port;
@@ -110,5 +136,8 @@ namespace ix
         size_t getConnectionsThreadsCount();
 
         SocketTLSOptions _socketTLSOptions;
+
+        Metric* _acceptedConnections;
+        void countRejectedConnection(const std::string& reason);
     };
 } // namespace ix
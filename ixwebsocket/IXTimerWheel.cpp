@@ -0,0 +1,225 @@
+/*
+ *  IXTimerWheel.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ */
+
+#include "IXTimerWheel.h"
+
+#include "IXSetThreadName.h"
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+namespace
+{
+    // Set on a wheel thread whose wheel was stopped by one of its callbacks,
+    // maybe while being destroyed. That thread must not touch the wheel again.
+    thread_local bool stoppedByCallback = false;
+} // namespace
+
+namespace ix
+{
+    const int TimerWheel::kDefaultTickMs(10);
+
+    TimerWheel::TimerWheel(int tickMs, bool background)
+        : _tickMs(tickMs > 0 ? tickMs : kDefaultTickMs)
+        , _background(background)
+        , _currentTick(0)
+        , _nextId(1)
+        , _stop(false)
+    {
+        ;
+    }
+
+    TimerWheel::~TimerWheel()
+    {
+        stop();
+    }
+
+    TimerWheel::TimerId TimerWheel::schedule(int delayMs, const OnTimerCallback& callback)
+    {
+        // Round up, plus one tick as the current tick is already partly elapsed
+        uint64_t ticks = (delayMs > 0) ? (uint64_t)(delayMs + _tickMs - 1) / _tickMs : 0;
+
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        std::list<Timer> pending;
+        pending.push_back(Timer {_nextId++, _currentTick + ticks + 1, 0, 0, callback});
+
+        auto it = pending.begin();
+        _timers[it->id] = it;
+        place(pending, it);
+
+        // Starts the thread, or starts it again after stop()
+        if (_background && !_thread.joinable())
+        {
+            _stop = false;
+            _thread = std::thread(&TimerWheel::run, this);
+        }
+        _condition.notify_one();
+
+        return it->id;
+    }
+
+    bool TimerWheel::cancel(TimerId id)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        auto found = _timers.find(id);
+        if (found == _timers.end()) return false;
+
+        auto it = found->second;
+        _slots[it->level][it->slot].erase(it);
+        _timers.erase(found);
+        return true;
+    }
+
+    size_t TimerWheel::size() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _timers.size();
+    }
+
+    void TimerWheel::place(std::list<Timer>& from, std::list<Timer>::iterator it)
+    {
+        uint64_t delta = (it->expires > _currentTick) ? it->expires - _currentTick : 0;
+
+        // Timers beyond the range of the wheel wait in the last level, and
+        // are placed again when their slot comes up
+        int level = 0;
+        while (level < kLevels - 1 && delta >= ((uint64_t) 1 << (kSlotBits * (level + 1))))
+        {
+            level++;
+        }
+
+        uint64_t maxDelta = ((uint64_t) 1 << (kSlotBits * kLevels)) - 1;
+        uint64_t expires = _currentTick + std::min(delta, maxDelta);
+
+        it->level = level;
+        it->slot = (int) ((expires >> (kSlotBits * level)) & (kSlots - 1));
+
+        // Splicing keeps the iterator stored in _timers valid
+        auto& slot = _slots[it->level][it->slot];
+        slot.splice(slot.end(), from, it);
+    }
+
+    void TimerWheel::cascade(int level)
+    {
+        int index = (int) ((_currentTick >> (kSlotBits * level)) & (kSlots - 1));
+
+        std::list<Timer> timers;
+        timers.swap(_slots[level][index]);
+
+        while (!timers.empty())
+        {
+            place(timers, timers.begin());
+        }
+    }
+
+    void TimerWheel::advance(uint64_t ticks)
+    {
+        std::vector<OnTimerCallback> callbacks;
+
+        for (uint64_t i = 0; i < ticks; ++i)
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+
+                if (_timers.empty())
+                {
+                    _currentTick += ticks - i;
+                    return;
+                }
+
+                _currentTick++;
+
+                // Bring the timers of the next range down a level when a lower
+                // level wraps around
+                for (int level = 1; level < kLevels; ++level)
+                {
+                    if ((_currentTick & (((uint64_t) 1 << (kSlotBits * level)) - 1)) != 0) break;
+                    cascade(level);
+                }
+
+                auto& slot = _slots[0][_currentTick & (kSlots - 1)];
+                for (auto&& timer : slot)
+                {
+                    callbacks.push_back(std::move(timer.callback));
+                    _timers.erase(timer.id);
+                }
+                slot.clear();
+            }
+
+            // Timers scheduled by the callbacks start from this tick
+            for (auto&& callback : callbacks)
+            {
+                if (callback) callback();
+                if (stoppedByCallback) return;
+            }
+            callbacks.clear();
+        }
+    }
+
+    void TimerWheel::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _condition.notify_one();
+
+        if (!_thread.joinable()) return;
+
+        if (_thread.get_id() == std::this_thread::get_id())
+        {
+            // From a callback, which may be releasing the last reference to
+            // the wheel: the thread ends once it returns
+            stoppedByCallback = true;
+            _thread.detach();
+        }
+        else
+        {
+            _thread.join();
+        }
+    }
+
+    void TimerWheel::run()
+    {
+        setThreadName("TimerWheel");
+
+        auto tick = std::chrono::milliseconds(_tickMs);
+        auto next = std::chrono::steady_clock::now() + tick;
+
+        while (true)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (_stop) break;
+
+            // Do not tick while there is nothing to expire
+            if (_timers.empty())
+            {
+                _condition.wait(lock, [this] { return _stop || !_timers.empty(); });
+                next = std::chrono::steady_clock::now() + tick;
+                continue;
+            }
+
+            if (_condition.wait_until(lock, next, [this] { return _stop; })) break;
+            lock.unlock();
+
+            // Catch up on the ticks missed while callbacks were running
+            auto now = std::chrono::steady_clock::now();
+            uint64_t ticks = 1 + (uint64_t)((now - next) / tick);
+            next += ticks * tick;
+
+            advance(ticks);
+            if (stoppedByCallback) return;
+        }
+    }
+
+    std::shared_ptr<TimerWheel> TimerWheel::getDefault()
+    {
+        static std::shared_ptr<TimerWheel> timerWheel = std::make_shared<TimerWheel>();
+        return timerWheel;
+    }
+} // namespace ix
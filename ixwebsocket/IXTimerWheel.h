@@ -0,0 +1,95 @@
+/*
+ *  IXTimerWheel.h
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ *
+ *  Hierarchical timer wheel (4 levels of 64 slots). Scheduling, cancelling and
+ *  expiring a timer are O(1), and a tick only looks at one slot, however many
+ *  timers are pending. Each level covers 64 times the range of the previous
+ *  one; timers move down a level when the slot holding them comes up.
+ *
+ *  Callbacks run on the wheel thread, without any lock held. They may schedule
+ *  or cancel timers, but should be short as they delay the other timers.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <unordered_map>
+
+namespace ix
+{
+    class TimerWheel
+    {
+    public:
+        using TimerId = uint64_t;
+        using OnTimerCallback = std::function<void()>;
+
+        // With background set, a thread moves the wheel forward in real time,
+        // started on the first schedule. Otherwise the owner calls advance().
+        TimerWheel(int tickMs = TimerWheel::kDefaultTickMs, bool background = true);
+        ~TimerWheel();
+
+        TimerWheel(const TimerWheel&) = delete;
+        TimerWheel& operator=(const TimerWheel&) = delete;
+
+        // The callback runs once, after at least delayMs and at most one tick
+        // later. Timer ids are never 0.
+        TimerId schedule(int delayMs, const OnTimerCallback& callback);
+
+        // Returns false when the timer already fired or was cancelled
+        bool cancel(TimerId id);
+
+        size_t size() const;
+
+        // Move the wheel forward and run the callbacks of the expired timers
+        void advance(uint64_t ticks);
+
+        // Stops the thread, the next schedule starts it again. Callbacks may
+        // stop or destroy the wheel, the thread then ends after them.
+        void stop();
+
+        // Shared by the connections which were not given a wheel
+        static std::shared_ptr<TimerWheel> getDefault();
+
+        const static int kDefaultTickMs;
+
+    private:
+        struct Timer
+        {
+            TimerId id;
+            uint64_t expires;
+            int level;
+            int slot;
+            OnTimerCallback callback;
+        };
+
+        void place(std::list<Timer>& from, std::list<Timer>::iterator it);
+        void cascade(int level);
+        void run();
+
+        static const int kLevels = 4;
+        static const int kSlotBits = 6;
+        static const int kSlots = 1 << kSlotBits;
+
+        int _tickMs;
+        bool _background;
+
+        mutable std::mutex _mutex;
+        std::list<Timer> _slots[kLevels][kSlots];
+        std::unordered_map<TimerId, std::list<Timer>::iterator> _timers;
+        uint64_t _currentTick;
+        TimerId _nextId;
+
+        std::thread _thread;
+        std::condition_variable _condition;
+        bool _stop;
+    };
+} // namespace ix
@@ -0,0 +1,56 @@
+/*
+ *  IXTrace.h
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ *
+ *  Static tracepoints (USDT) of the ixwebsocket provider, for bpftrace, perf
+ *  or SystemTap. They are built with -DUSE_USDT=ON on Linux (which needs
+ *  sys/sdt.h, from systemtap-sdt-dev), and compile to nothing otherwise: the
+ *  arguments are not even evaluated. An enabled probe which is not attached
+ *  costs a nop.
+ *
+ *  Probes and arguments, a transport or deflate pointer identifies a connection:
+ *
+ *    accept(fd, port)
+ *    handshake_start(transport, server)
+ *    handshake_end(transport, server, success, httpStatus)
+ *    frame_received(transport, opcode, payloadSize, fin)
+ *    message_emitted(transport, kind, size)
+ *    send_enqueued(transport, wireSize, control)
+ *    bytes_flushed(transport, bytes, control)
+ *    message_sent(transport, payloadSize, latencyUs)
+ *    close(transport, code, remote)
+ *    compress_start(deflate, size)
+ *    compress_end(deflate, size, compressedSize, success)
+ *    decompress_start(deflate, compressedSize)
+ *    decompress_end(deflate, compressedSize, size, success)
+ *
+ *  Sample scripts are in tools/bpftrace.
+ */
+
+#pragma once
+
+#ifdef IXWEBSOCKET_USE_USDT
+
+#include <sys/sdt.h>
+
+#define IX_TRACE2(name, a1, a2) DTRACE_PROBE2(ixwebsocket, name, a1, a2)
+#define IX_TRACE3(name, a1, a2, a3) DTRACE_PROBE3(ixwebsocket, name, a1, a2, a3)
+#define IX_TRACE4(name, a1, a2, a3, a4) DTRACE_PROBE4(ixwebsocket, name, a1, a2, a3, a4)
+
+#else
+
+#define IX_TRACE2(name, a1, a2)                                                                    \
+    do                                                                                             \
+    {                                                                                              \
+    } while (0)
+#define IX_TRACE3(name, a1, a2, a3)                                                                \
+    do                                                                                             \
+    {                                                                                              \
+    } while (0)
+#define IX_TRACE4(name, a1, a2, a3, a4)                                                            \
+    do                                                                                             \
+    {                                                                                              \
+    } while (0)
+
+#endif
@@ -29,10 +29,16 @@ namespace ix
         , _maxWaitBetweenReconnectionRetries(kDefaultMaxWaitBetweenReconnectionRetries)
         , _handshakeTimeoutSecs(kDefaultHandShakeTimeoutSecs)
         , _enablePong(kDefaultEnablePong)
+        , _blockingSend(true)
         , _pingIntervalSecs(kDefaultPingIntervalSecs)
     {
         _ws.setOnCloseCallback(
             [this](uint16_t code, const std::string& reason, size_t wireSize, bool remote) {
+                {
+                    std::lock_guard<std::mutex> lock(_closeInfoMutex);
+                    _closeInfo = WebSocketCloseInfo(code, reason, remote);
+                }
+
                 _onMessageCallback(
                     std::make_shared<WebSocketMessage>(WebSocketMessageType::Close,
                                                        "",
@@ -96,6 +102,18 @@ namespace ix
         return _pingIntervalSecs;
     }
 
+    void WebSocket::enableBlockingSend()
+    {
+        std::lock_guard<std::mutex> lock(_configMutex);
+        _blockingSend = true;
+    }
+
+    void WebSocket::disableBlockingSend()
+    {
+        std::lock_guard<std::mutex> lock(_configMutex);
+        _blockingSend = false;
+    }
+
     void WebSocket::enablePong()
     {
         std::lock_guard<std::mutex> lock(_configMutex);
@@ -143,6 +161,10 @@ namespace ix
 
     void WebSocket::stop(uint16_t code, const std::string& reason)
     {
+        // The close can complete before _stop is set, do not reconnect meanwhile
+        bool automaticReconnection = _automaticReconnection;
+        _automaticReconnection = false;
+
         close(code, reason);
 
         if (_thread.joinable())
@@ -154,6 +176,8 @@ namespace ix
             _thread.join();
             _stop = false;
         }
+
+        _automaticReconnection = automaticReconnection;
     }
 
     WebSocketInitResult WebSocket::connect(int timeoutSecs)
@@ -200,7 +224,7 @@ namespace ix
             "",
             0,
             WebSocketErrorInfo(),
-            WebSocketOpenInfo(status.uri, status.headers, status.protocol),
+            WebSocketOpenInfo(status.uri, status.headers, status.protocol, status.timings),
             WebSocketCloseInfo()));
 
         if (_pingIntervalSecs > 0)
@@ -212,7 +236,9 @@ namespace ix
         return status;
     }
 
-    WebSocketInitResult WebSocket::connectToSocket(std::shared_ptr<Socket> socket, int timeoutSecs)
+    WebSocketInitResult WebSocket::connectToSocket(std::shared_ptr<Socket> socket,
+                                                   int timeoutSecs,
+                                                   HttpRequestPtr request)
     {
         {
             std::lock_guard<std::mutex> lock(_configMutex);
@@ -222,12 +248,17 @@ namespace ix
                           _pingIntervalSecs);
         }
 
-        WebSocketInitResult status = _ws.connectToSocket(socket, timeoutSecs);
+        WebSocketInitResult status = _ws.connectToSocket(socket, timeoutSecs, request);
         if (!status.success)
         {
             return status;
         }
 
+        {
+            std::lock_guard<std::mutex> lock(_configMutex);
+            _ws.setBlockingSend(_blockingSend);
+        }
+
         _onMessageCallback(
             std::make_shared<WebSocketMessage>(WebSocketMessageType::Open,
                                                "",
@@ -400,6 +431,9 @@ namespace ix
 
                     WebSocket::invokeTrafficTrackerCallback(wireSize, true);
                 });
+
+            // The server hands idle connections over to its hibernation reactor
+            if (_ws.isHibernationRequested()) break;
         }
     }
 
@@ -428,27 +462,37 @@ namespace ix
 
     WebSocketSendInfo WebSocket::send(const std::string& data,
                                       bool binary,
-                                      const OnProgressCallback& onProgressCallback)
+                                      const OnProgressCallback& onProgressCallback,
+                                      const OnSendCompleteCallback& onSendCompleteCallback,
+                                      bool compress)
     {
-        return (binary) ? sendBinary(data, onProgressCallback) : sendText(data, onProgressCallback);
+        return (binary) ? sendBinary(data, onProgressCallback, onSendCompleteCallback, compress)
+                        : sendText(data, onProgressCallback, onSendCompleteCallback, compress);
     }
 
     WebSocketSendInfo WebSocket::sendBinary(const std::string& text,
-                                            const OnProgressCallback& onProgressCallback)
+                                            const OnProgressCallback& onProgressCallback,
+                                            const OnSendCompleteCallback& onSendCompleteCallback,
+                                            bool compress)
     {
-        return sendMessage(text, SendMessageKind::Binary, onProgressCallback);
+        return sendMessage(
+            text, SendMessageKind::Binary, onProgressCallback, onSendCompleteCallback, compress);
     }
 
     WebSocketSendInfo WebSocket::sendText(const std::string& text,
-                                          const OnProgressCallback& onProgressCallback)
+                                          const OnProgressCallback& onProgressCallback,
+                                          const OnSendCompleteCallback& onSendCompleteCallback,
+                                          bool compress)
     {
         if (!validateUtf8(text))
         {
             close(WebSocketCloseConstants::kInvalidFramePayloadData,
                   WebSocketCloseConstants::kInvalidFramePayloadDataMessage);
+            if (onSendCompleteCallback) onSendCompleteCallback(false);
             return false;
         }
-        return sendMessage(text, SendMessageKind::Text, onProgressCallback);
+        return sendMessage(
+            text, SendMessageKind::Text, onProgressCallback, onSendCompleteCallback, compress);
     }
 
     WebSocketSendInfo WebSocket::ping(const std::string& text)
@@ -460,11 +504,44 @@ namespace ix
         return sendMessage(text, SendMessageKind::Ping);
     }
 
+    WebSocketSendInfo WebSocket::sendBatch(const std::vector<WebSocketBatchMessage>& messages,
+                                           const OnSendCompleteCallback& onSendCompleteCallback)
+    {
+        for (auto&& message : messages)
+        {
+            if (!message.binary && !validateUtf8(message.data))
+            {
+                close(WebSocketCloseConstants::kInvalidFramePayloadData,
+                      WebSocketCloseConstants::kInvalidFramePayloadDataMessage);
+                if (onSendCompleteCallback) onSendCompleteCallback(false);
+                return false;
+            }
+        }
+
+        if (!isConnected())
+        {
+            if (onSendCompleteCallback) onSendCompleteCallback(false);
+            return WebSocketSendInfo(false);
+        }
+
+        WebSocketSendInfo webSocketSendInfo = _ws.sendBatch(messages, onSendCompleteCallback);
+
+        WebSocket::invokeTrafficTrackerCallback(webSocketSendInfo.wireSize, false);
+
+        return webSocketSendInfo;
+    }
+
     WebSocketSendInfo WebSocket::sendMessage(const std::string& text,
                                              SendMessageKind sendMessageKind,
-                                             const OnProgressCallback& onProgressCallback)
+                                             const OnProgressCallback& onProgressCallback,
+                                             const OnSendCompleteCallback& onSendCompleteCallback,
+                                             bool compress)
     {
-        if (!isConnected()) return WebSocketSendInfo(false);
+        if (!isConnected())
+        {
+            if (onSendCompleteCallback) onSendCompleteCallback(false);
+            return WebSocketSendInfo(false);
+        }
 
         //
         // It is OK to read and write on the same socket in 2 different threads.
@@ -475,20 +552,24 @@ namespace ix
         // with battery life), and use the system select call to notify us when
         // incoming messages are arriving / there's data to be received.
         //
-        std::lock_guard<std::mutex> lock(_writeMutex);
+        // No lock is taken here, the transport queue accepts messages from
+        // many threads at once.
+        //
         WebSocketSendInfo webSocketSendInfo;
 
         switch (sendMessageKind)
         {
             case SendMessageKind::Text:
             {
-                webSocketSendInfo = _ws.sendText(text, onProgressCallback);
+                webSocketSendInfo =
+                    _ws.sendText(text, onProgressCallback, onSendCompleteCallback, compress);
             }
             break;
 
             case SendMessageKind::Binary:
             {
-                webSocketSendInfo = _ws.sendBinary(text, onProgressCallback);
+                webSocketSendInfo =
+                    _ws.sendBinary(text, onProgressCallback, onSendCompleteCallback, compress);
             }
             break;
 
@@ -548,6 +629,98 @@ namespace ix
         return _ws.bufferedAmount();
     }
 
+    void WebSocket::setSendBufferWatermarks(size_t lowWatermark, size_t highWatermark)
+    {
+        _ws.setSendBufferWatermarks(lowWatermark, highWatermark);
+    }
+
+    void WebSocket::setOnSendBufferWatermarkCallback(const OnSendBufferWatermarkCallback& callback)
+    {
+        _ws.setOnSendBufferWatermarkCallback(callback);
+    }
+
+    void WebSocket::setMaxBufferedAmount(size_t maxBufferedAmount, SendBufferPolicy policy)
+    {
+        _ws.setMaxBufferedAmount(maxBufferedAmount, policy);
+    }
+
+    uint64_t WebSocket::getDroppedMessagesCount() const
+    {
+        return _ws.getDroppedMessagesCount();
+    }
+
+    void WebSocket::enableWriteCoalescing(int windowUs, size_t maxBytes)
+    {
+        _ws.setWriteCoalescing(windowUs, maxBytes);
+    }
+
+    void WebSocket::disableWriteCoalescing()
+    {
+        _ws.setWriteCoalescing(0, WebSocketTransport::kDefaultWriteCoalescingMaxBytes);
+    }
+
+    void WebSocket::enableCompressionOffload(size_t minSize,
+                                             std::shared_ptr<WorkerPool> workerPool)
+    {
+        _ws.setCompressionOffload(minSize, workerPool);
+    }
+
+    void WebSocket::disableCompressionOffload()
+    {
+        _ws.setCompressionOffload(0, nullptr);
+    }
+
+    void WebSocket::setTimerWheel(std::shared_ptr<TimerWheel> timerWheel)
+    {
+        _ws.setTimerWheel(timerWheel);
+    }
+
+    void WebSocket::setIdleTimeout(int idleTimeoutSecs)
+    {
+        _ws.setIdleTimeout(idleTimeoutSecs);
+    }
+
+    uint64_t WebSocket::getIdleDisconnectsCount() const
+    {
+        return _ws.getIdleDisconnectsCount();
+    }
+
+    WebSocketStats WebSocket::getStats() const
+    {
+        return _ws.getStats();
+    }
+
+    WebSocketCloseInfo WebSocket::getCloseInfo() const
+    {
+        std::lock_guard<std::mutex> lock(_closeInfoMutex);
+        return _closeInfo;
+    }
+
+    void WebSocket::setHibernationTimeout(int hibernationTimeoutSecs)
+    {
+        _ws.setHibernationTimeout(hibernationTimeoutSecs);
+    }
+
+    bool WebSocket::isHibernationRequested() const
+    {
+        return _ws.isHibernationRequested();
+    }
+
+    void WebSocket::resumeFromHibernation()
+    {
+        _ws.resumeFromHibernation();
+    }
+
+    int WebSocket::getSocketFd() const
+    {
+        return _ws.getSocketFd();
+    }
+
+    int WebSocket::getInterruptFd() const
+    {
+        return _ws.getInterruptFd();
+    }
+
     void WebSocket::addSubProtocol(const std::string& subProtocol)
     {
         std::lock_guard<std::mutex> lock(_configMutex);
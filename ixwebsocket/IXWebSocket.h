@@ -11,7 +11,9 @@
 
 #include "IXProgressCallback.h"
 #include "IXSocketTLSOptions.h"
+#include "IXWebSocketBatchMessage.h"
 #include "IXWebSocketCloseConstants.h"
+#include "IXWebSocketCloseInfo.h"
 #include "IXWebSocketErrorInfo.h"
 #include "IXWebSocketHttpHeaders.h"
 #include "IXWebSocketMessage.h"
@@ -59,6 +61,12 @@ namespace ix
         void disablePerMessageDeflate();
         void addSubProtocol(const std::string& subProtocol);
 
+        // Server side connections wait until a message is written to the socket
+        // before returning from send. When disabled, send queues the message and
+        // returns right away; use the send complete callback to track delivery.
+        void enableBlockingSend();
+        void disableBlockingSend();
+
         // Run asynchronously, by calling start and stop.
         void start();
 
@@ -70,16 +78,29 @@ namespace ix
         WebSocketInitResult connect(int timeoutSecs);
         void run();
 
-        // send is in text mode by default
+        // send is in text mode by default. Clear compress to skip permessage-deflate
+        // for data which would not shrink, such as images.
         WebSocketSendInfo send(const std::string& data,
                                bool binary = false,
-                               const OnProgressCallback& onProgressCallback = nullptr);
-        WebSocketSendInfo sendBinary(const std::string& text,
-                                     const OnProgressCallback& onProgressCallback = nullptr);
+                               const OnProgressCallback& onProgressCallback = nullptr,
+                               const OnSendCompleteCallback& onSendCompleteCallback = nullptr,
+                               bool compress = true);
+        WebSocketSendInfo sendBinary(
+            const std::string& text,
+            const OnProgressCallback& onProgressCallback = nullptr,
+            const OnSendCompleteCallback& onSendCompleteCallback = nullptr,
+            bool compress = true);
         WebSocketSendInfo sendText(const std::string& text,
-                                   const OnProgressCallback& onProgressCallback = nullptr);
+                                   const OnProgressCallback& onProgressCallback = nullptr,
+                                   const OnSendCompleteCallback& onSendCompleteCallback = nullptr,
+                                   bool compress = true);
         WebSocketSendInfo ping(const std::string& text);
 
+        // Send many messages with a single queue push and socket write. The
+        // callback reports the whole batch.
+        WebSocketSendInfo sendBatch(const std::vector<WebSocketBatchMessage>& messages,
+                                    const OnSendCompleteCallback& onSendCompleteCallback = nullptr);
+
         void close(uint16_t code = WebSocketCloseConstants::kNormalClosureCode,
                    const std::string& reason = WebSocketCloseConstants::kNormalClosureMessage);
 
@@ -95,6 +116,51 @@ namespace ix
         int getPingInterval() const;
         size_t bufferedAmount() const;
 
+        // The watermark callback fires when the buffered amount goes above the
+        // high watermark, and again when it drains back to the low watermark.
+        void setSendBufferWatermarks(size_t lowWatermark, size_t highWatermark);
+        void setOnSendBufferWatermarkCallback(const OnSendBufferWatermarkCallback& callback);
+
+        // Cap the send buffer. Text and binary messages which would grow it past
+        // the cap are handled according to the policy. 0 means unlimited.
+        void setMaxBufferedAmount(size_t maxBufferedAmount,
+                                  SendBufferPolicy policy = SendBufferPolicy::Block);
+        uint64_t getDroppedMessagesCount() const;
+
+        // Hold text and binary messages for up to windowUs microseconds, or until
+        // maxBytes are buffered, and write them with a single send. Fewer, larger
+        // TCP segments for many small messages, at the cost of that much latency.
+        // Blocking sends and control frames are written right away.
+        void enableWriteCoalescing(
+            int windowUs = WebSocketTransport::kDefaultWriteCoalescingWindowUs,
+            size_t maxBytes = WebSocketTransport::kDefaultWriteCoalescingMaxBytes);
+        void disableWriteCoalescing();
+
+        // Compress text and binary messages of at least minSize bytes on a shared
+        // worker pool instead of the sending thread. send returns once the message
+        // is handed over, with a wire size of 0; use the send complete callback to
+        // learn the outcome. Messages are still sent in order.
+        void enableCompressionOffload(
+            size_t minSize = WebSocketTransport::kDefaultCompressionOffloadMinSize,
+            std::shared_ptr<WorkerPool> workerPool = WorkerPool::getDefault());
+        void disableCompressionOffload();
+
+        // Heartbeats and close timeouts are scheduled on a timer wheel shared by
+        // many connections. Servers give their own to their clients.
+        void setTimerWheel(std::shared_ptr<TimerWheel> timerWheel);
+
+        // Close the connection with code 1001 when no text or binary message and
+        // no pong were received for idleTimeoutSecs. 0, the default, disables it.
+        void setIdleTimeout(int idleTimeoutSecs);
+        uint64_t getIdleDisconnectsCount() const;
+
+        // Messages, bytes, frames and latencies of this connection, kept across
+        // reconnections. Unlike the traffic tracker, it is per connection.
+        WebSocketStats getStats() const;
+
+        // Code, reason and side of the last close, code 0 before the first one
+        WebSocketCloseInfo getCloseInfo() const;
+
         void enableAutomaticReconnection();
         void disableAutomaticReconnection();
         bool isAutomaticReconnectionEnabled() const;
@@ -103,9 +169,12 @@ namespace ix
         const std::vector<std::string>& getSubProtocols();
 
     private:
-        WebSocketSendInfo sendMessage(const std::string& text,
-                                      SendMessageKind sendMessageKind,
-                                      const OnProgressCallback& callback = nullptr);
+        WebSocketSendInfo sendMessage(
+            const std::string& text,
+            SendMessageKind sendMessageKind,
+            const OnProgressCallback& callback = nullptr,
+            const OnSendCompleteCallback& onSendCompleteCallback = nullptr,
+            bool compress = true);
 
         bool isConnected() const;
         bool isClosing() const;
@@ -113,7 +182,16 @@ namespace ix
         static void invokeTrafficTrackerCallback(size_t size, bool incoming);
 
         // Server
-        WebSocketInitResult connectToSocket(std::shared_ptr<Socket>, int timeoutSecs);
+        WebSocketInitResult connectToSocket(std::shared_ptr<Socket>,
+                                            int timeoutSecs,
+                                            HttpRequestPtr request = nullptr);
+
+        // Server, run() returns when the connection asks to hibernate
+        void setHibernationTimeout(int hibernationTimeoutSecs);
+        bool isHibernationRequested() const;
+        void resumeFromHibernation();
+        int getSocketFd() const;
+        int getInterruptFd() const;
 
         WebSocketTransport _ws;
 
@@ -129,9 +207,11 @@ namespace ix
         OnMessageCallback _onMessageCallback;
         static OnTrafficTrackerCallback _onTrafficTrackerCallback;
 
+        WebSocketCloseInfo _closeInfo;
+        mutable std::mutex _closeInfoMutex;
+
         std::atomic<bool> _stop;
         std::thread _thread;
-        std::mutex _writeMutex;
 
         // Automatic reconnection
         std::atomic<bool> _automaticReconnection;
@@ -149,6 +229,9 @@ namespace ix
         bool _enablePong;
         static const bool kDefaultEnablePong;
 
+        // Only used by server connections, client connections never block on send
+        bool _blockingSend;
+
         // Optional ping and pong timeout
         int _pingIntervalSecs;
         int _pingTimeoutSecs;
@@ -0,0 +1,31 @@
+/*
+ *  IXWebSocketBatchMessage.h
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <string>
+
+namespace ix
+{
+    // One message of a batch given to WebSocket::sendBatch. compress can be
+    // cleared for data which would not shrink, such as images.
+    struct WebSocketBatchMessage
+    {
+        std::string data;
+        bool binary;
+        bool compress;
+
+        WebSocketBatchMessage(const std::string& d = std::string(),
+                              bool b = false,
+                              bool c = true)
+            : data(d)
+            , binary(b)
+            , compress(c)
+        {
+            ;
+        }
+    };
+} // namespace ix
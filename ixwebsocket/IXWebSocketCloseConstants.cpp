@@ -9,11 +9,13 @@
 namespace ix
 {
     const uint16_t WebSocketCloseConstants::kNormalClosureCode(1000);
+    const uint16_t WebSocketCloseConstants::kGoingAwayCode(1001);
     const uint16_t WebSocketCloseConstants::kInternalErrorCode(1011);
     const uint16_t WebSocketCloseConstants::kAbnormalCloseCode(1006);
     const uint16_t WebSocketCloseConstants::kInvalidFramePayloadData(1007);
     const uint16_t WebSocketCloseConstants::kProtocolErrorCode(1002);
     const uint16_t WebSocketCloseConstants::kNoStatusCodeErrorCode(1005);
+    const uint16_t WebSocketCloseConstants::kPolicyViolationCode(1008);
 
     const std::string WebSocketCloseConstants::kNormalClosureMessage("Normal closure");
     const std::string WebSocketCloseConstants::kInternalErrorMessage("Internal error");
@@ -33,4 +35,6 @@ namespace ix
     const std::string WebSocketCloseConstants::kInvalidFramePayloadDataMessage(
         "Invalid frame payload data");
     const std::string WebSocketCloseConstants::kInvalidCloseCodeMessage("Invalid close code");
+    const std::string WebSocketCloseConstants::kSendBufferFullMessage("Send buffer limit exceeded");
+    const std::string WebSocketCloseConstants::kIdleTimeoutMessage("Idle timeout");
 } // namespace ix
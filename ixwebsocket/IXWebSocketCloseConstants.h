@@ -14,11 +14,13 @@ namespace ix
     struct WebSocketCloseConstants
     {
         static const uint16_t kNormalClosureCode;
+        static const uint16_t kGoingAwayCode;
         static const uint16_t kInternalErrorCode;
         static const uint16_t kAbnormalCloseCode;
         static const uint16_t kProtocolErrorCode;
         static const uint16_t kNoStatusCodeErrorCode;
         static const uint16_t kInvalidFramePayloadData;
+        static const uint16_t kPolicyViolationCode;
 
         static const std::string kNormalClosureMessage;
         static const std::string kInternalErrorMessage;
@@ -33,5 +35,7 @@ namespace ix
         static const std::string kProtocolErrorCodeContinuationOpCodeOutOfSequence;
         static const std::string kInvalidFramePayloadDataMessage;
         static const std::string kInvalidCloseCodeMessage;
+        static const std::string kSendBufferFullMessage;
+        static const std::string kIdleTimeoutMessage;
     };
 } // namespace ix
@@ -16,6 +16,21 @@
 #include <random>
 #include <sstream>
 
+namespace
+{
+    // The negotiated parameters come from the peer header, our zlib settings
+    // are local and never sent
+    ix::WebSocketPerMessageDeflateOptions withCompressionSettings(
+        ix::WebSocketPerMessageDeflateOptions negotiated,
+        const ix::WebSocketPerMessageDeflateOptions& local)
+    {
+        negotiated.setCompressionLevel(local.getCompressionLevel());
+        negotiated.setMemLevel(local.getMemLevel());
+        negotiated.setStrategy(local.getStrategy());
+        negotiated.setCodec(local.getCodec());
+        return negotiated;
+    }
+} // namespace
 
 namespace ix
 {
@@ -100,6 +115,7 @@ namespace ix
 
         std::string errMsg;
         bool success = _socket->connect(host, port, errMsg, isCancellationRequested);
+        _connectionTimings = _socket->getConnectionTimings();
         if (!success)
         {
             std::stringstream ss;
@@ -148,6 +164,7 @@ namespace ix
             return WebSocketInitResult(
                 false, 0, std::string("Failed sending GET request to ") + url);
         }
+        _connectionTimings.requestSentUs = ConnectionTimings::now();
 
         // Read HTTP status line
         auto lineResult = _socket->readLine(isCancellationRequested);
@@ -159,6 +176,7 @@ namespace ix
             return WebSocketInitResult(
                 false, 0, std::string("Failed reading HTTP status line from ") + url);
         }
+        _connectionTimings.firstByteUs = ConnectionTimings::now();
 
         // Validate status
         auto statusLine = Http::parseStatusLine(line);
@@ -230,39 +248,75 @@ namespace ix
                 _enablePerMessageDeflate = false;
             }
             // Otherwise try to initialize the deflate engine (zlib)
-            else if (!_perMessageDeflate.init(webSocketPerMessageDeflateOptions))
+            else if (!_perMessageDeflate.init(
+                         withCompressionSettings(webSocketPerMessageDeflateOptions,
+                                                 _perMessageDeflateOptions),
+                         false))
             {
                 return WebSocketInitResult(
                     false, 0, "Failed to initialize per message deflate engine");
             }
         }
 
+        _connectionTimings.doneUs = ConnectionTimings::now();
         return WebSocketInitResult(true, status, "", headers, path);
     }
 
-    WebSocketInitResult WebSocketHandshake::serverHandshake(int timeoutSecs)
+    const ConnectionTimings& WebSocketHandshake::getConnectionTimings() const
+    {
+        return _connectionTimings;
+    }
+
+    WebSocketInitResult WebSocketHandshake::serverHandshake(int timeoutSecs,
+                                                            HttpRequestPtr request)
     {
         _requestInitCancellation = false;
 
         auto isCancellationRequested =
             makeCancellationRequestWithTimeout(timeoutSecs, _requestInitCancellation);
 
-        // Read first line
-        auto lineResult = _socket->readLine(isCancellationRequested);
-        auto lineValid = lineResult.first;
-        auto line = lineResult.second;
+        std::string method;
+        std::string uri;
+        std::string httpVersion;
+        WebSocketHttpHeaders headers;
 
-        if (!lineValid)
+        if (request)
         {
-            return sendErrorResponse(400, "Error reading HTTP request line");
+            method = request->method;
+            uri = request->uri;
+            httpVersion = request->version;
+            headers = request->headers;
         }
+        else
+        {
+            // Read first line
+            auto lineResult = _socket->readLine(isCancellationRequested);
+            auto lineValid = lineResult.first;
+            auto line = lineResult.second;
 
-        // Validate request line (GET /foo HTTP/1.1\r\n)
-        auto requestLine = Http::parseRequestLine(line);
-        auto method = std::get<0>(requestLine);
-        auto uri = std::get<1>(requestLine);
-        auto httpVersion = std::get<2>(requestLine);
+            if (!lineValid)
+            {
+                return sendErrorResponse(400, "Error reading HTTP request line");
+            }
+
+            // Parse request line (GET /foo HTTP/1.1\r\n)
+            auto requestLine = Http::parseRequestLine(line);
+            method = std::get<0>(requestLine);
+            uri = std::get<1>(requestLine);
+            httpVersion = std::get<2>(requestLine);
 
+            // Retrieve HTTP headers
+            auto result = parseHttpHeaders(_socket, isCancellationRequested);
+            auto headersValid = result.first;
+            headers = result.second;
+
+            if (!headersValid)
+            {
+                return sendErrorResponse(400, "Error parsing HTTP headers");
+            }
+        }
+
+        // Validate request line (GET /foo HTTP/1.1\r\n)
         if (method != "GET")
         {
             return sendErrorResponse(400, "Invalid HTTP method, need GET, got " + method);
@@ -274,16 +328,7 @@ namespace ix
                                      "Invalid HTTP version, need HTTP/1.1, got: " + httpVersion);
         }
 
-        // Retrieve and validate HTTP headers
-        auto result = parseHttpHeaders(_socket, isCancellationRequested);
-        auto headersValid = result.first;
-        auto headers = result.second;
-
-        if (!headersValid)
-        {
-            return sendErrorResponse(400, "Error parsing HTTP headers");
-        }
-
+        // Validate HTTP headers
         if (headers.find("sec-websocket-key") == headers.end())
         {
             return sendErrorResponse(400, "Missing Sec-WebSocket-Key value");
@@ -341,7 +386,10 @@ namespace ix
         {
             _enablePerMessageDeflate = true;
 
-            if (!_perMessageDeflate.init(webSocketPerMessageDeflateOptions))
+            if (!_perMessageDeflate.init(
+                    withCompressionSettings(webSocketPerMessageDeflateOptions,
+                                            _perMessageDeflateOptions),
+                    true))
             {
                 return WebSocketInitResult(
                     false, 0, "Failed to initialize per message deflate engine");
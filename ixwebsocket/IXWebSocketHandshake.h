@@ -7,6 +7,8 @@
 #pragma once
 
 #include "IXCancellationRequest.h"
+#include "IXConnectionTimings.h"
+#include "IXHttp.h"
 #include "IXSocket.h"
 #include "IXWebSocketHttpHeaders.h"
 #include "IXWebSocketInitResult.h"
@@ -35,7 +37,14 @@ namespace ix
                                             int port,
                                             int timeoutSecs);
 
-        WebSocketInitResult serverHandshake(int timeoutSecs);
+        // Phases of the last client handshake, also set when it failed
+        const ConnectionTimings& getConnectionTimings() const;
+
+        // When request is set, the request line and headers were already read
+        // from the socket (by a server which also serves plain HTTP), and are
+        // not read again.
+        WebSocketInitResult serverHandshake(int timeoutSecs,
+                                            HttpRequestPtr request = nullptr);
 
     private:
         std::string genRandomString(const int len);
@@ -50,5 +59,6 @@ namespace ix
         WebSocketPerMessageDeflate& _perMessageDeflate;
         WebSocketPerMessageDeflateOptions& _perMessageDeflateOptions;
         std::atomic<bool>& _enablePerMessageDeflate;
+        ConnectionTimings _connectionTimings;
     };
 } // namespace ix
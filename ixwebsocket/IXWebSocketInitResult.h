@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include "IXConnectionTimings.h"
 #include "IXWebSocketHttpHeaders.h"
 
 namespace ix
@@ -19,6 +20,9 @@ namespace ix
         std::string uri;
         std::string protocol;
 
+        // Time spent in DNS lookup, connect, TLS and upgrade (client only)
+        ConnectionTimings timings;
+
         WebSocketInitResult(bool s = false,
                             int status = 0,
                             const std::string& e = std::string(),
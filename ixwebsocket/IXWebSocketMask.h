@@ -0,0 +1,23 @@
+/*
+ *  IXWebSocketMask.h
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace ix
+{
+    // XOR a frame payload with its masking key, see RFC 6455 section 5.3.
+    // Applying the same key twice restores the payload.
+    inline void applyWebSocketMask(uint8_t* data, size_t size, const uint8_t maskingKey[4])
+    {
+        for (size_t i = 0; i != size; ++i)
+        {
+            data[i] ^= maskingKey[i & 0x3];
+        }
+    }
+} // namespace ix
@@ -6,6 +6,8 @@
 
 #pragma once
 
+#include "IXConnectionTimings.h"
+
 namespace ix
 {
     struct WebSocketOpenInfo
@@ -13,13 +15,16 @@ namespace ix
         std::string uri;
         WebSocketHttpHeaders headers;
         std::string protocol;
+        ConnectionTimings timings;
 
         WebSocketOpenInfo(const std::string& u = std::string(),
                           const WebSocketHttpHeaders& h = WebSocketHttpHeaders(),
-                          const std::string& p = std::string())
+                          const std::string& p = std::string(),
+                          const ConnectionTimings& t = ConnectionTimings())
             : uri(u)
             , headers(h)
             , protocol(p)
+            , timings(t)
         {
             ;
         }
@@ -33,7 +33,7 @@
  *
  *  - Reused zlib compression + decompression bits.
  *  - Refactored to have 2 class for compression and decompression, to allow multi-threading
- *    and make sure that _compressBuffer is not shared between threads.
+ *    and make sure that the compression buffers are not shared between threads.
  *  - Original code wasn't working for some reason, I had to add checks
  *    for the presence of the kEmptyUncompressedBlock at the end of buffer so that servers
  *    would start accepting receiving/decoding compressed messages. Original code was probably
@@ -48,14 +48,85 @@
 
 #include "IXWebSocketPerMessageDeflate.h"
 
+#include "IXTrace.h"
 #include "IXWebSocketPerMessageDeflateCodec.h"
+#include "IXWebSocketPerMessageDeflateFastCodec.h"
 #include "IXWebSocketPerMessageDeflateOptions.h"
+#include <map>
+#include <tuple>
+
+namespace
+{
+    using CompressorKey = std::tuple<ix::PerMessageDeflateCodec, uint8_t, int, int, int>;
+
+    // Streams without context between messages, shared by the connections
+    // which send or receive on the calling thread
+    ix::WebSocketPerMessageDeflateCompressor* getSharedCompressor(ix::PerMessageDeflateCodec codec,
+                                                                  uint8_t deflateBits,
+                                                                  int compressionLevel,
+                                                                  int memLevel,
+                                                                  int strategy)
+    {
+        thread_local std::map<CompressorKey,
+                              std::unique_ptr<ix::WebSocketPerMessageDeflateCompressor>>
+            compressors;
+
+        auto key = std::make_tuple(codec, deflateBits, compressionLevel, memLevel, strategy);
+        auto it = compressors.find(key);
+        if (it != compressors.end()) return it->second.get();
+
+        std::unique_ptr<ix::WebSocketPerMessageDeflateCompressor> compressor;
+        if (codec == ix::PerMessageDeflateCodec::Fast)
+        {
+            auto fastCompressor = std::make_unique<ix::WebSocketPerMessageDeflateFastCompressor>();
+            if (!fastCompressor->init(deflateBits)) return nullptr;
+            compressor = std::move(fastCompressor);
+        }
+        else
+        {
+            // Full flushes leave the stream without context after each message
+            auto zlibCompressor = std::make_unique<ix::WebSocketPerMessageDeflateZlibCompressor>();
+            if (!zlibCompressor->init(deflateBits, true, compressionLevel, memLevel, strategy))
+            {
+                return nullptr;
+            }
+            compressor = std::move(zlibCompressor);
+        }
+
+        return compressors.emplace(key, std::move(compressor)).first->second.get();
+    }
+
+    ix::WebSocketPerMessageDeflateDecompressor* getSharedDecompressor(uint8_t inflateBits)
+    {
+        thread_local std::map<uint8_t, std::unique_ptr<ix::WebSocketPerMessageDeflateDecompressor>>
+            decompressors;
+
+        auto it = decompressors.find(inflateBits);
+        if (it != decompressors.end())
+        {
+            // The last message may come from another connection
+            return it->second->reset() ? it->second.get() : nullptr;
+        }
+
+        auto decompressor = std::make_unique<ix::WebSocketPerMessageDeflateZlibDecompressor>();
+        if (!decompressor->init(inflateBits, true)) return nullptr;
+
+        return decompressors.emplace(inflateBits, std::move(decompressor)).first->second.get();
+    }
+} // namespace
 
 namespace ix
 {
     WebSocketPerMessageDeflate::WebSocketPerMessageDeflate()
-        : _compressor(std::make_unique<WebSocketPerMessageDeflateCompressor>())
-        , _decompressor(std::make_unique<WebSocketPerMessageDeflateDecompressor>())
+        : _deflateBits(0)
+        , _inflateBits(0)
+        , _clientNoContextTakeover(false)
+        , _serverNoContextTakeover(false)
+        , _peerNoContextTakeover(false)
+        , _compressionLevel(WebSocketPerMessageDeflateOptions::kDefaultCompressionLevel)
+        , _memLevel(WebSocketPerMessageDeflateOptions::kDefaultMemLevel)
+        , _strategy(WebSocketPerMessageDeflateOptions::kDefaultStrategy)
+        , _codec(PerMessageDeflateCodec::Zlib)
     {
         ;
     }
@@ -66,25 +137,101 @@ namespace ix
     }
 
     bool WebSocketPerMessageDeflate::init(
-        const WebSocketPerMessageDeflateOptions& perMessageDeflateOptions)
+        const WebSocketPerMessageDeflateOptions& perMessageDeflateOptions, bool server)
+    {
+        _clientNoContextTakeover = perMessageDeflateOptions.getClientNoContextTakeover();
+        _serverNoContextTakeover = perMessageDeflateOptions.getServerNoContextTakeover();
+
+        // The peer does not reference the previous messages in the next one
+        _peerNoContextTakeover = server ? _clientNoContextTakeover : _serverNoContextTakeover;
+
+        _deflateBits = perMessageDeflateOptions.getClientMaxWindowBits();
+        _inflateBits = perMessageDeflateOptions.getServerMaxWindowBits();
+
+        _compressionLevel = perMessageDeflateOptions.getCompressionLevel();
+        _memLevel = perMessageDeflateOptions.getMemLevel();
+        _strategy = perMessageDeflateOptions.getStrategy();
+        _codec = perMessageDeflateOptions.getCodec();
+
+        _compressor.reset();
+        _decompressor.reset();
+
+        // Report bad settings now rather than on the first message
+        return getCompressor() != nullptr && getDecompressor() != nullptr;
+    }
+
+    bool WebSocketPerMessageDeflate::initCompressor()
+    {
+        // Keeping the context is only supported by zlib
+        auto compressor = std::make_unique<WebSocketPerMessageDeflateZlibCompressor>();
+        if (!compressor->init(
+                _deflateBits, _clientNoContextTakeover, _compressionLevel, _memLevel, _strategy))
+        {
+            return false;
+        }
+
+        _compressor = std::move(compressor);
+        return true;
+    }
+
+    bool WebSocketPerMessageDeflate::initDecompressor()
     {
-        bool clientNoContextTakeover = perMessageDeflateOptions.getClientNoContextTakeover();
+        auto decompressor = std::make_unique<WebSocketPerMessageDeflateZlibDecompressor>();
+        if (!decompressor->init(_inflateBits, _clientNoContextTakeover)) return false;
 
-        uint8_t deflateBits = perMessageDeflateOptions.getClientMaxWindowBits();
-        uint8_t inflateBits = perMessageDeflateOptions.getServerMaxWindowBits();
+        _decompressor = std::move(decompressor);
+        return true;
+    }
+
+    WebSocketPerMessageDeflateCompressor* WebSocketPerMessageDeflate::getCompressor()
+    {
+        // Our compressor flushes its context after each message with that option
+        if (_clientNoContextTakeover)
+        {
+            return getSharedCompressor(
+                _codec, _deflateBits, _compressionLevel, _memLevel, _strategy);
+        }
 
-        return _compressor->init(deflateBits, clientNoContextTakeover) &&
-               _decompressor->init(inflateBits, clientNoContextTakeover);
+        if (!_compressor && !initCompressor()) return nullptr;
+        return _compressor.get();
+    }
+
+    WebSocketPerMessageDeflateDecompressor* WebSocketPerMessageDeflate::getDecompressor()
+    {
+        if (_peerNoContextTakeover)
+        {
+            return getSharedDecompressor(_inflateBits);
+        }
+
+        if (!_decompressor && !initDecompressor()) return nullptr;
+        return _decompressor.get();
+    }
+
+    bool WebSocketPerMessageDeflate::keepsCompressionContext() const
+    {
+        return !_clientNoContextTakeover;
     }
 
     bool WebSocketPerMessageDeflate::compress(const std::string& in, std::string& out)
     {
-        return _compressor->compress(in, out);
+        auto compressor = getCompressor();
+        if (!compressor) return false;
+
+        IX_TRACE2(compress_start, this, in.size());
+        bool success = compressor->compress(in, out);
+        IX_TRACE4(compress_end, this, in.size(), out.size(), success);
+        return success;
     }
 
     bool WebSocketPerMessageDeflate::decompress(const std::string& in, std::string& out)
     {
-        return _decompressor->decompress(in, out);
+        auto decompressor = getDecompressor();
+        if (!decompressor) return false;
+
+        IX_TRACE2(decompress_start, this, in.size());
+        bool success = decompressor->decompress(in, out);
+        IX_TRACE4(decompress_end, this, in.size(), out.size(), success);
+        return success;
     }
 
 } // namespace ix
@@ -35,6 +35,7 @@
 #pragma once
 
 #include <memory>
+#include <stdint.h>
 #include <string>
 
 namespace ix
@@ -42,6 +43,7 @@ namespace ix
     class WebSocketPerMessageDeflateOptions;
     class WebSocketPerMessageDeflateCompressor;
     class WebSocketPerMessageDeflateDecompressor;
+    enum class PerMessageDeflateCodec;
 
     class WebSocketPerMessageDeflate
     {
@@ -49,12 +51,35 @@ namespace ix
         WebSocketPerMessageDeflate();
         ~WebSocketPerMessageDeflate();
 
-        bool init(const WebSocketPerMessageDeflateOptions& perMessageDeflateOptions);
+        // server tells which end of the connection we are. The zlib streams which
+        // carry no context from one message to the next are not owned by the
+        // connection, they are shared with the other connections of the thread.
+        bool init(const WebSocketPerMessageDeflateOptions& perMessageDeflateOptions,
+                  bool server);
         bool compress(const std::string& in, std::string& out);
         bool decompress(const std::string& in, std::string& out);
 
+        // Whether a compressed message depends on the ones compressed before it
+        bool keepsCompressionContext() const;
+
     private:
+        bool initCompressor();
+        bool initDecompressor();
+
+        WebSocketPerMessageDeflateCompressor* getCompressor();
+        WebSocketPerMessageDeflateDecompressor* getDecompressor();
+
         std::unique_ptr<WebSocketPerMessageDeflateCompressor> _compressor;
         std::unique_ptr<WebSocketPerMessageDeflateDecompressor> _decompressor;
+
+        uint8_t _deflateBits;
+        uint8_t _inflateBits;
+        bool _clientNoContextTakeover;
+        bool _serverNoContextTakeover;
+        bool _peerNoContextTakeover;
+        int _compressionLevel;
+        int _memLevel;
+        int _strategy;
+        PerMessageDeflateCodec _codec;
     };
 } // namespace ix
@@ -6,7 +6,9 @@
 
 #include "IXWebSocketPerMessageDeflateCodec.h"
 
+#include "IXBufferPool.h"
 #include "IXWebSocketPerMessageDeflateOptions.h"
+#include <algorithm>
 #include <cassert>
 #include <string.h>
 
@@ -17,7 +19,14 @@ namespace
     // look like an empty string.
     const std::string kEmptyUncompressedBlock = std::string("\x00\x00\xff\xff", 4);
 
-    const int kBufferSize = 1 << 14;
+    // Typical for text, adjusted after each message within these bounds
+    const double kInitialExpansionRatio = 4.0;
+    const double kMinExpansionRatio = 1.0;
+    const double kMaxExpansionRatio = 16.0;
+
+    // The pre-sized buffer is zero filled, so a message cannot make it grow
+    // by more than this past its compressed size; the loop doubles it after
+    const size_t kMaxEstimateSlack = 64 * 1024;
 } // namespace
 
 namespace ix
@@ -25,8 +34,7 @@ namespace ix
     //
     // Compressor
     //
-    WebSocketPerMessageDeflateCompressor::WebSocketPerMessageDeflateCompressor()
-        : _compressBufferSize(kBufferSize)
+    WebSocketPerMessageDeflateZlibCompressor::WebSocketPerMessageDeflateZlibCompressor()
     {
         memset(&_deflateState, 0, sizeof(_deflateState));
 
@@ -35,38 +43,40 @@ namespace ix
         _deflateState.opaque = Z_NULL;
     }
 
-    WebSocketPerMessageDeflateCompressor::~WebSocketPerMessageDeflateCompressor()
+    WebSocketPerMessageDeflateZlibCompressor::~WebSocketPerMessageDeflateZlibCompressor()
     {
         deflateEnd(&_deflateState);
     }
 
-    bool WebSocketPerMessageDeflateCompressor::init(uint8_t deflateBits,
-                                                    bool clientNoContextTakeOver)
+    bool WebSocketPerMessageDeflateZlibCompressor::init(uint8_t deflateBits,
+                                                        bool clientNoContextTakeOver,
+                                                        int compressionLevel,
+                                                        int memLevel,
+                                                        int strategy)
     {
         int ret = deflateInit2(&_deflateState,
-                               Z_DEFAULT_COMPRESSION,
+                               compressionLevel,
                                Z_DEFLATED,
                                -1 * deflateBits,
-                               4, // memory level 1-9
-                               Z_DEFAULT_STRATEGY);
+                               memLevel,
+                               strategy);
 
         if (ret != Z_OK) return false;
 
-        _compressBuffer = std::make_unique<unsigned char[]>(_compressBufferSize);
-
         _flush = (clientNoContextTakeOver) ? Z_FULL_FLUSH : Z_SYNC_FLUSH;
 
         return true;
     }
 
-    bool WebSocketPerMessageDeflateCompressor::endsWith(const std::string& value,
-                                                        const std::string& ending)
+    bool WebSocketPerMessageDeflateZlibCompressor::endsWith(const std::string& value,
+                                                            const std::string& ending)
     {
         if (ending.size() > value.size()) return false;
         return std::equal(ending.rbegin(), ending.rend(), value.rbegin());
     }
 
-    bool WebSocketPerMessageDeflateCompressor::compress(const std::string& in, std::string& out)
+    bool WebSocketPerMessageDeflateZlibCompressor::compress(const std::string& in,
+                                                            std::string& out)
     {
         //
         // 7.2.1.  Compression
@@ -89,25 +99,29 @@ namespace ix
 
         if (in.empty())
         {
-            uint8_t buf[6] = {0x02, 0x00, 0x00, 0x00, 0xff, 0xff};
-            out.append((char*) (buf), 6);
+            // An empty fixed block, the empty stored block which would follow
+            // is removed as in step 3
+            uint8_t buf[2] = {0x02, 0x00};
+            out.append((char*) (buf), 2);
             return true;
         }
 
         _deflateState.avail_in = (uInt) in.size();
         _deflateState.next_in = (Bytef*) in.data();
 
+        // Output to a pooled buffer, only held while compressing
+        PooledBuffer compressBuffer = BufferPool::getDefault().acquire();
+
         do
         {
-            // Output to local buffer
-            _deflateState.avail_out = (uInt) _compressBufferSize;
-            _deflateState.next_out = _compressBuffer.get();
+            _deflateState.avail_out = (uInt) compressBuffer.size();
+            _deflateState.next_out = compressBuffer.data();
 
             deflate(&_deflateState, _flush);
 
-            output = _compressBufferSize - _deflateState.avail_out;
+            output = compressBuffer.size() - _deflateState.avail_out;
 
-            out.append((char*) (_compressBuffer.get()), output);
+            out.append((char*) (compressBuffer.data()), output);
         } while (_deflateState.avail_out == 0);
 
         if (endsWith(out, kEmptyUncompressedBlock))
@@ -121,8 +135,7 @@ namespace ix
     //
     // Decompressor
     //
-    WebSocketPerMessageDeflateDecompressor::WebSocketPerMessageDeflateDecompressor()
-        : _compressBufferSize(kBufferSize)
+    WebSocketPerMessageDeflateZlibDecompressor::WebSocketPerMessageDeflateZlibDecompressor()
     {
         memset(&_inflateState, 0, sizeof(_inflateState));
 
@@ -131,28 +144,29 @@ namespace ix
         _inflateState.opaque = Z_NULL;
         _inflateState.avail_in = 0;
         _inflateState.next_in = Z_NULL;
+
+        _expansionRatio = kInitialExpansionRatio;
     }
 
-    WebSocketPerMessageDeflateDecompressor::~WebSocketPerMessageDeflateDecompressor()
+    WebSocketPerMessageDeflateZlibDecompressor::~WebSocketPerMessageDeflateZlibDecompressor()
     {
         inflateEnd(&_inflateState);
     }
 
-    bool WebSocketPerMessageDeflateDecompressor::init(uint8_t inflateBits,
-                                                      bool clientNoContextTakeOver)
+    bool WebSocketPerMessageDeflateZlibDecompressor::init(uint8_t inflateBits,
+                                                          bool clientNoContextTakeOver)
     {
         int ret = inflateInit2(&_inflateState, -1 * inflateBits);
 
         if (ret != Z_OK) return false;
 
-        _compressBuffer = std::make_unique<unsigned char[]>(_compressBufferSize);
-
         _flush = (clientNoContextTakeOver) ? Z_FULL_FLUSH : Z_SYNC_FLUSH;
 
         return true;
     }
 
-    bool WebSocketPerMessageDeflateDecompressor::decompress(const std::string& in, std::string& out)
+    bool WebSocketPerMessageDeflateZlibDecompressor::decompress(const std::string& in,
+                                                                std::string& out)
     {
         //
         // 7.2.2.  Decompression
@@ -164,28 +178,77 @@ namespace ix
         //
         //    2.  Decompress the resulting data using DEFLATE.
         //
-        std::string inFixed(in);
-        inFixed += kEmptyUncompressedBlock;
+        // The trailer is fed to zlib after the payload rather than appended to
+        // a copy of it, and we inflate straight into out.
+        _inflateState.avail_in = (uInt) in.size();
+        _inflateState.next_in = (Bytef*) in.data();
+        bool trailerFed = false;
+
+        size_t offset = out.size();
+        size_t produced = 0;
+        size_t estimate = (size_t)(in.size() * _expansionRatio * 1.25) + 64;
+        estimate = std::min(estimate, in.size() + kMaxEstimateSlack);
+        out.resize(offset + estimate);
+
+        while (true)
+        {
+            if (_inflateState.avail_in == 0 && !trailerFed)
+            {
+                _inflateState.avail_in = (uInt) kEmptyUncompressedBlock.size();
+                _inflateState.next_in = (Bytef*) kEmptyUncompressedBlock.data();
+                trailerFed = true;
+            }
 
-        _inflateState.avail_in = (uInt) inFixed.size();
-        _inflateState.next_in = (unsigned char*) (const_cast<char*>(inFixed.data()));
+            if (offset + produced == out.size())
+            {
+                out.resize(offset + 2 * (out.size() - offset));
+            }
 
-        do
-        {
-            _inflateState.avail_out = (uInt) _compressBufferSize;
-            _inflateState.next_out = _compressBuffer.get();
+            size_t available = out.size() - offset - produced;
+            _inflateState.avail_out = (uInt) available;
+            _inflateState.next_out = (Bytef*) &out[offset + produced];
 
             int ret = inflate(&_inflateState, Z_SYNC_FLUSH);
 
             if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR)
             {
+                out.resize(offset);
                 return false; // zlib error
             }
 
-            out.append(reinterpret_cast<char*>(_compressBuffer.get()),
-                       _compressBufferSize - _inflateState.avail_out);
-        } while (_inflateState.avail_out == 0);
+            produced += available - _inflateState.avail_out;
+
+            // The peer ended the deflate stream (BFINAL), the next message starts a new one
+            if (ret == Z_STREAM_END)
+            {
+                inflateReset(&_inflateState);
+                break;
+            }
+
+            // Everything was consumed and zlib had room left, so nothing is pending
+            if (trailerFed && _inflateState.avail_in == 0 && _inflateState.avail_out != 0)
+            {
+                break;
+            }
+        }
+
+        out.resize(offset + produced);
+
+        if (!in.empty())
+        {
+            double ratio = (double) produced / in.size();
+            _expansionRatio = (_expansionRatio + ratio) / 2;
+            _expansionRatio = std::max(kMinExpansionRatio, _expansionRatio);
+            _expansionRatio = std::min(kMaxExpansionRatio, _expansionRatio);
+        }
 
         return true;
     }
+
+    bool WebSocketPerMessageDeflateZlibDecompressor::reset()
+    {
+        // The window memory is kept but marked empty, a back reference to the
+        // previous messages is then a data error
+        return inflateReset(&_inflateState) == Z_OK;
+    }
 } // namespace ix
@@ -12,38 +12,66 @@
 
 namespace ix
 {
+    // Codecs produce and consume the payload of compressed messages, the
+    // trailing empty stored block (00 00 ff ff) removed as in RFC 7692 7.2
     class WebSocketPerMessageDeflateCompressor
     {
     public:
-        WebSocketPerMessageDeflateCompressor();
-        ~WebSocketPerMessageDeflateCompressor();
+        virtual ~WebSocketPerMessageDeflateCompressor() = default;
 
-        bool init(uint8_t deflateBits, bool clientNoContextTakeOver);
-        bool compress(const std::string& in, std::string& out);
+        // Appends the compressed message to out
+        virtual bool compress(const std::string& in, std::string& out) = 0;
+    };
+
+    class WebSocketPerMessageDeflateDecompressor
+    {
+    public:
+        virtual ~WebSocketPerMessageDeflateDecompressor() = default;
+
+        // Appends the decompressed message to out
+        virtual bool decompress(const std::string& in, std::string& out) = 0;
+
+        // Forget the previous messages, before inflating one from another connection
+        virtual bool reset() = 0;
+    };
+
+    class WebSocketPerMessageDeflateZlibCompressor : public WebSocketPerMessageDeflateCompressor
+    {
+    public:
+        WebSocketPerMessageDeflateZlibCompressor();
+        ~WebSocketPerMessageDeflateZlibCompressor() override;
+
+        bool init(uint8_t deflateBits,
+                  bool clientNoContextTakeOver,
+                  int compressionLevel,
+                  int memLevel,
+                  int strategy);
+        bool compress(const std::string& in, std::string& out) override;
 
     private:
         static bool endsWith(const std::string& value, const std::string& ending);
 
         int _flush;
-        size_t _compressBufferSize;
-        std::unique_ptr<unsigned char[]> _compressBuffer;
         z_stream _deflateState;
     };
 
-    class WebSocketPerMessageDeflateDecompressor
+    class WebSocketPerMessageDeflateZlibDecompressor : public WebSocketPerMessageDeflateDecompressor
     {
     public:
-        WebSocketPerMessageDeflateDecompressor();
-        ~WebSocketPerMessageDeflateDecompressor();
+        WebSocketPerMessageDeflateZlibDecompressor();
+        ~WebSocketPerMessageDeflateZlibDecompressor() override;
 
         bool init(uint8_t inflateBits, bool clientNoContextTakeOver);
-        bool decompress(const std::string& in, std::string& out);
+        bool decompress(const std::string& in, std::string& out) override;
+        bool reset() override;
 
     private:
         int _flush;
-        size_t _compressBufferSize;
-        std::unique_ptr<unsigned char[]> _compressBuffer;
         z_stream _inflateState;
+
+        // Running estimate of the output to input size ratio, used to size the
+        // output buffer before inflating
+        double _expansionRatio;
     };
 
 } // namespace ix
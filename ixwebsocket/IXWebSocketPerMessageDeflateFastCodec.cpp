@@ -0,0 +1,325 @@
+/*
+ *  IXWebSocketPerMessageDeflateFastCodec.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ */
+
+#include "IXWebSocketPerMessageDeflateFastCodec.h"
+
+#include <algorithm>
+#include <string.h>
+
+namespace
+{
+    const int kHashBits = 14;
+    const size_t kMinMatch = 4;
+    const size_t kMaxMatch = 258;
+    const size_t kMaxStoredBlockSize = 65535;
+
+    // RFC 1951 3.2.5, symbols 257-285 and distance codes 0-29
+    const uint32_t kLengthBase[29] = {3,  4,  5,  6,  7,  8,  9,  10,  11,  13,
+                                      15, 17, 19, 23, 27, 31, 35, 43,  51,  59,
+                                      67, 83, 99, 115, 131, 163, 195, 227, 258};
+    const uint32_t kLengthExtraBits[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                           2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    const uint32_t kDistanceBase[30] = {1,    2,    3,    4,    5,    7,     9,     13,
+                                        17,   25,   33,   49,   65,   97,    129,   193,
+                                        257,  385,  513,  769,  1025, 1537,  2049,  3073,
+                                        4097, 6145, 8193, 12289, 16385, 24577};
+    const uint32_t kDistanceExtraBits[30] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                             6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+    struct Code
+    {
+        uint32_t bits;
+        uint32_t length;
+    };
+
+    uint32_t reverseBits(uint32_t code, uint32_t length)
+    {
+        uint32_t reversed = 0;
+        for (uint32_t i = 0; i < length; ++i)
+        {
+            reversed = (reversed << 1) | ((code >> i) & 1);
+        }
+        return reversed;
+    }
+
+    // Fixed Huffman codes of RFC 1951 3.2.6, bit reversed since they are
+    // packed starting with their most significant bit. Lengths are stored
+    // with their extra bits.
+    struct FixedCodes
+    {
+        FixedCodes()
+        {
+            for (uint32_t i = 0; i < 288; ++i)
+            {
+                if (i < 144)
+                    literals[i] = {reverseBits(0x30 + i, 8), 8};
+                else if (i < 256)
+                    literals[i] = {reverseBits(0x190 + i - 144, 9), 9};
+                else if (i < 280)
+                    literals[i] = {reverseBits(i - 256, 7), 7};
+                else
+                    literals[i] = {reverseBits(0xc0 + i - 280, 8), 8};
+            }
+
+            uint32_t lengthSymbol = 0;
+            for (uint32_t length = 3; length <= kMaxMatch; ++length)
+            {
+                while (lengthSymbol < 28 && kLengthBase[lengthSymbol + 1] <= length)
+                    ++lengthSymbol;
+
+                const Code& code = literals[257 + lengthSymbol];
+                uint32_t extra = length - kLengthBase[lengthSymbol];
+                lengths[length] = {code.bits | (extra << code.length),
+                                   code.length + kLengthExtraBits[lengthSymbol]};
+            }
+
+            // Same layout as zlib _dist_code, distances above 256 by steps of 128
+            for (uint32_t symbol = 0; symbol < 30; ++symbol)
+            {
+                distanceCodes[symbol] = reverseBits(symbol, 5);
+
+                uint32_t first = kDistanceBase[symbol] - 1;
+                uint32_t last = first + (1u << kDistanceExtraBits[symbol]);
+                for (uint32_t distance = first; distance < last; ++distance)
+                {
+                    if (distance < 256)
+                        distanceSymbols[distance] = (uint8_t) symbol;
+                    else
+                        distanceSymbols[256 + (distance >> 7)] = (uint8_t) symbol;
+                }
+            }
+        }
+
+        Code literals[288];
+        Code lengths[kMaxMatch + 1];
+        uint32_t distanceCodes[30];
+        uint8_t distanceSymbols[512];
+    };
+
+    const FixedCodes kFixedCodes;
+
+    class BitWriter
+    {
+    public:
+        BitWriter(uint8_t* out)
+            : _start(out)
+            , _out(out)
+            , _bits(0)
+            , _count(0)
+        {
+            ;
+        }
+
+        void write(uint32_t bits, uint32_t length)
+        {
+            _bits |= (uint64_t) bits << _count;
+            _count += length;
+
+            if (_count >= 32)
+            {
+                _out[0] = (uint8_t) _bits;
+                _out[1] = (uint8_t)(_bits >> 8);
+                _out[2] = (uint8_t)(_bits >> 16);
+                _out[3] = (uint8_t)(_bits >> 24);
+                _out += 4;
+                _bits >>= 32;
+                _count -= 32;
+            }
+        }
+
+        void writeLiteral(uint8_t literal)
+        {
+            const Code& code = kFixedCodes.literals[literal];
+            write(code.bits, code.length);
+        }
+
+        void writeMatch(size_t length, size_t distance)
+        {
+            const Code& code = kFixedCodes.lengths[length];
+            write(code.bits, code.length);
+
+            size_t d = distance - 1;
+            uint32_t symbol = kFixedCodes.distanceSymbols[d < 256 ? d : 256 + (d >> 7)];
+            write(kFixedCodes.distanceCodes[symbol] |
+                      (uint32_t)((distance - kDistanceBase[symbol]) << 5),
+                  5 + kDistanceExtraBits[symbol]);
+        }
+
+        // Pads the last byte with zeros and returns the size written
+        size_t finish()
+        {
+            while (_count > 0)
+            {
+                *_out++ = (uint8_t) _bits;
+                _bits >>= 8;
+                _count = (_count > 8) ? _count - 8 : 0;
+            }
+            return _out - _start;
+        }
+
+    private:
+        uint8_t* _start;
+        uint8_t* _out;
+        uint64_t _bits;
+        uint32_t _count;
+    };
+
+    uint32_t read32(const uint8_t* p)
+    {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    uint32_t hash(uint32_t value)
+    {
+        return (value * 2654435761u) >> (32 - kHashBits);
+    }
+} // namespace
+
+namespace ix
+{
+    WebSocketPerMessageDeflateFastCompressor::WebSocketPerMessageDeflateFastCompressor()
+        : _base(1)
+        , _maxDistance(0)
+    {
+        ;
+    }
+
+    bool WebSocketPerMessageDeflateFastCompressor::init(uint8_t deflateBits)
+    {
+        if (deflateBits < 8 || deflateBits > 15) return false;
+
+        // The peer inflates with a window of that size
+        _maxDistance = (size_t) 1 << deflateBits;
+        _hashTable.assign((size_t) 1 << kHashBits, 0);
+        _base = 1;
+
+        return true;
+    }
+
+    bool WebSocketPerMessageDeflateFastCompressor::compress(const std::string& in,
+                                                            std::string& out)
+    {
+        // Same as the zlib compressor, the output ends with the header of an
+        // empty stored block whose 00 00 ff ff is removed (RFC 7692 7.2.1)
+        if (_hashTable.empty()) return false;
+
+        size_t size = in.size();
+        size_t offset = out.size();
+        const uint8_t* src = (const uint8_t*) in.data();
+
+        // 9 bits per byte at most with the fixed codes
+        out.resize(offset + size + size / 8 + 16);
+        uint8_t* dst = (uint8_t*) &out[offset];
+
+        size_t stored = size + 5 * ((size + kMaxStoredBlockSize - 1) / kMaxStoredBlockSize) + 1;
+        size_t written = (size < UINT32_MAX / 2) ? compressBlock(src, size, dst) : stored + 1;
+
+        if (written > stored)
+        {
+            written = storeBlocks(src, size, dst);
+        }
+
+        out.resize(offset + written);
+        return true;
+    }
+
+    size_t WebSocketPerMessageDeflateFastCompressor::compressBlock(const uint8_t* in,
+                                                                   size_t size,
+                                                                   uint8_t* out)
+    {
+        if (size >= UINT32_MAX - _base)
+        {
+            std::fill(_hashTable.begin(), _hashTable.end(), 0);
+            _base = 1;
+        }
+
+        // Positions before base belong to the previous messages
+        const uint32_t base = _base;
+        _base += (uint32_t) size;
+
+        BitWriter writer(out);
+        writer.write(2, 3); // BFINAL 0, BTYPE 01 for the fixed codes
+
+        size_t i = 0;
+        size_t last = (size >= kMinMatch) ? size - kMinMatch + 1 : 0;
+
+        while (i < last)
+        {
+            uint32_t value = read32(in + i);
+            uint32_t& entry = _hashTable[hash(value)];
+            uint32_t candidate = entry;
+            entry = base + (uint32_t) i;
+
+            if (candidate >= base)
+            {
+                size_t previous = candidate - base;
+                size_t distance = i - previous;
+
+                if (distance <= _maxDistance && read32(in + previous) == value)
+                {
+                    size_t maxLength = std::min(kMaxMatch, size - i);
+                    size_t length = kMinMatch;
+                    while (length < maxLength && in[previous + length] == in[i + length])
+                        ++length;
+
+                    writer.writeMatch(length, distance);
+
+                    // Index the matched positions, the next matches often start there
+                    size_t end = i + length;
+                    for (++i; i < end && i < last; ++i)
+                    {
+                        _hashTable[hash(read32(in + i))] = base + (uint32_t) i;
+                    }
+                    i = end;
+                    continue;
+                }
+            }
+
+            writer.writeLiteral(in[i]);
+            ++i;
+        }
+
+        for (; i < size; ++i)
+        {
+            writer.writeLiteral(in[i]);
+        }
+
+        // End of block, then the header of the empty stored block
+        const Code& endOfBlock = kFixedCodes.literals[256];
+        writer.write(endOfBlock.bits, endOfBlock.length);
+        writer.write(0, 3);
+
+        return writer.finish();
+    }
+
+    size_t WebSocketPerMessageDeflateFastCompressor::storeBlocks(const uint8_t* in,
+                                                                 size_t size,
+                                                                 uint8_t* out)
+    {
+        uint8_t* p = out;
+
+        for (size_t i = 0; i < size;)
+        {
+            size_t length = std::min(kMaxStoredBlockSize, size - i);
+
+            // BFINAL 0 and BTYPE 00, padded to the byte, then LEN and NLEN
+            *p++ = 0;
+            *p++ = (uint8_t) length;
+            *p++ = (uint8_t)(length >> 8);
+            *p++ = (uint8_t) ~length;
+            *p++ = (uint8_t)(~length >> 8);
+
+            memcpy(p, in + i, length);
+            p += length;
+            i += length;
+        }
+
+        *p++ = 0;
+        return p - out;
+    }
+} // namespace ix
@@ -0,0 +1,40 @@
+/*
+ *  IXWebSocketPerMessageDeflateFastCodec.h
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ *
+ *  One-shot deflate encoder for messages sent without context takeover.
+ *  Matches are found with a single probe hash table and written as one
+ *  block with the fixed Huffman codes of RFC 1951, which zlib and every
+ *  other inflater decode. Incompressible messages fall back to stored
+ *  blocks. It trades some ratio for speed against zlib.
+ */
+
+#pragma once
+
+#include "IXWebSocketPerMessageDeflateCodec.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace ix
+{
+    class WebSocketPerMessageDeflateFastCompressor : public WebSocketPerMessageDeflateCompressor
+    {
+    public:
+        WebSocketPerMessageDeflateFastCompressor();
+
+        bool init(uint8_t deflateBits);
+        bool compress(const std::string& in, std::string& out) override;
+
+    private:
+        size_t compressBlock(const uint8_t* in, size_t size, uint8_t* out);
+        size_t storeBlocks(const uint8_t* in, size_t size, uint8_t* out);
+
+        // Position of the last occurrence of each hashed 4 bytes sequence,
+        // offset by _base so that entries of the previous messages are ignored
+        std::vector<uint32_t> _hashTable;
+        uint32_t _base;
+        size_t _maxDistance;
+    };
+} // namespace ix
@@ -21,6 +21,12 @@ namespace ix
     static const int minClientMaxWindowBits = 8;
     static const int maxClientMaxWindowBits = 15;
 
+    // Z_DEFAULT_COMPRESSION and Z_DEFAULT_STRATEGY
+    const int WebSocketPerMessageDeflateOptions::kDefaultCompressionLevel = -1;
+    const int WebSocketPerMessageDeflateOptions::kDefaultMemLevel = 4;
+    const int WebSocketPerMessageDeflateOptions::kDefaultStrategy = 0;
+    const size_t WebSocketPerMessageDeflateOptions::kDefaultMinCompressionSize = 0;
+
     WebSocketPerMessageDeflateOptions::WebSocketPerMessageDeflateOptions(
         bool enabled,
         bool clientNoContextTakeover,
@@ -33,6 +39,11 @@ namespace ix
         _serverNoContextTakeover = serverNoContextTakeover;
         _clientMaxWindowBits = clientMaxWindowBits;
         _serverMaxWindowBits = serverMaxWindowBits;
+        _compressionLevel = kDefaultCompressionLevel;
+        _memLevel = kDefaultMemLevel;
+        _strategy = kDefaultStrategy;
+        _codec = PerMessageDeflateCodec::Zlib;
+        _minCompressionSize = kDefaultMinCompressionSize;
 
         sanitizeClientMaxWindowBits();
     }
@@ -60,6 +71,11 @@ namespace ix
         _serverNoContextTakeover = false;
         _clientMaxWindowBits = kDefaultClientMaxWindowBits;
         _serverMaxWindowBits = kDefaultServerMaxWindowBits;
+        _compressionLevel = kDefaultCompressionLevel;
+        _memLevel = kDefaultMemLevel;
+        _strategy = kDefaultStrategy;
+        _codec = PerMessageDeflateCodec::Zlib;
+        _minCompressionSize = kDefaultMinCompressionSize;
 
         // Split by ;
         std::string token;
@@ -165,6 +181,56 @@ namespace ix
         return _serverMaxWindowBits;
     }
 
+    void WebSocketPerMessageDeflateOptions::setCompressionLevel(int compressionLevel)
+    {
+        _compressionLevel = compressionLevel;
+    }
+
+    void WebSocketPerMessageDeflateOptions::setMemLevel(int memLevel)
+    {
+        _memLevel = memLevel;
+    }
+
+    void WebSocketPerMessageDeflateOptions::setStrategy(int strategy)
+    {
+        _strategy = strategy;
+    }
+
+    int WebSocketPerMessageDeflateOptions::getCompressionLevel() const
+    {
+        return _compressionLevel;
+    }
+
+    int WebSocketPerMessageDeflateOptions::getMemLevel() const
+    {
+        return _memLevel;
+    }
+
+    int WebSocketPerMessageDeflateOptions::getStrategy() const
+    {
+        return _strategy;
+    }
+
+    void WebSocketPerMessageDeflateOptions::setCodec(PerMessageDeflateCodec codec)
+    {
+        _codec = codec;
+    }
+
+    PerMessageDeflateCodec WebSocketPerMessageDeflateOptions::getCodec() const
+    {
+        return _codec;
+    }
+
+    void WebSocketPerMessageDeflateOptions::setMinCompressionSize(size_t minCompressionSize)
+    {
+        _minCompressionSize = minCompressionSize;
+    }
+
+    size_t WebSocketPerMessageDeflateOptions::getMinCompressionSize() const
+    {
+        return _minCompressionSize;
+    }
+
     bool WebSocketPerMessageDeflateOptions::startsWith(const std::string& str,
                                                        const std::string& start)
     {
@@ -10,6 +10,14 @@
 
 namespace ix
 {
+    enum class PerMessageDeflateCodec
+    {
+        Zlib,
+        // In-tree one-shot deflate, faster with a lower ratio. Only used when
+        // our compressor keeps no context between messages, zlib otherwise.
+        Fast
+    };
+
     class WebSocketPerMessageDeflateOptions
     {
     public:
@@ -29,11 +37,33 @@ namespace ix
         uint8_t getServerMaxWindowBits() const;
         uint8_t getClientMaxWindowBits() const;
 
+        // Settings of our zlib compressor, they are not negotiated with the peer.
+        // Level is 0-9 (-1 for the zlib default), memLevel is 1-9 and strategy
+        // is one of the zlib strategies.
+        void setCompressionLevel(int compressionLevel);
+        void setMemLevel(int memLevel);
+        void setStrategy(int strategy);
+        int getCompressionLevel() const;
+        int getMemLevel() const;
+        int getStrategy() const;
+
+        // Implementation of our compressor, also local
+        void setCodec(PerMessageDeflateCodec codec);
+        PerMessageDeflateCodec getCodec() const;
+
+        // Text and binary messages smaller than that are sent uncompressed
+        void setMinCompressionSize(size_t minCompressionSize);
+        size_t getMinCompressionSize() const;
+
         static bool startsWith(const std::string& str, const std::string& start);
         static std::string removeSpaces(const std::string& str);
 
         static uint8_t const kDefaultClientMaxWindowBits;
         static uint8_t const kDefaultServerMaxWindowBits;
+        static int const kDefaultCompressionLevel;
+        static int const kDefaultMemLevel;
+        static int const kDefaultStrategy;
+        static size_t const kDefaultMinCompressionSize;
 
     private:
         bool _enabled;
@@ -41,6 +71,11 @@ namespace ix
         bool _serverNoContextTakeover;
         int _clientMaxWindowBits;
         int _serverMaxWindowBits;
+        int _compressionLevel;
+        int _memLevel;
+        int _strategy;
+        PerMessageDeflateCodec _codec;
+        size_t _minCompressionSize;
 
         void sanitizeClientMaxWindowBits();
     };
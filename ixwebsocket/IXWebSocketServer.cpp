@@ -7,18 +7,41 @@
 #include "IXWebSocketServer.h"
 
 #include "IXNetSystem.h"
+#include "IXSelectInterrupt.h"
+#include "IXSelectInterruptFactory.h"
 #include "IXSetThreadName.h"
 #include "IXSocketConnect.h"
+#include "IXUserAgent.h"
 #include "IXWebSocket.h"
 #include "IXWebSocketTransport.h"
+#include <algorithm>
 #include <future>
 #include <sstream>
 #include <string.h>
 
+namespace
+{
+    bool isWebSocketUpgrade(ix::HttpRequestPtr request)
+    {
+        auto it = request->headers.find("Upgrade");
+        if (it == request->headers.end()) return false;
+
+        // tolower is only defined for the values of unsigned char
+        const std::string& upgrade = it->second;
+        std::string expected("websocket");
+        return std::equal(upgrade.begin(),
+                          upgrade.end(),
+                          expected.begin(),
+                          expected.end(),
+                          [](char a, char b) { return ::tolower((unsigned char) a) == b; });
+    }
+} // namespace
+
 namespace ix
 {
     const int WebSocketServer::kDefaultHandShakeTimeoutSecs(3); // 3 seconds
     const bool WebSocketServer::kDefaultEnablePong(true);
+    const int WebSocketServer::kDefaultHibernationTimeoutSecs(30);
 
     WebSocketServer::WebSocketServer(int port,
                                      const std::string& host,
@@ -30,11 +53,23 @@ namespace ix
         , _handshakeTimeoutSecs(handshakeTimeoutSecs)
         , _enablePong(kDefaultEnablePong)
         , _enablePerMessageDeflate(true)
+        , _blockingSend(true)
+        , _writeCoalescingWindowUs(0)
+        , _writeCoalescingMaxBytes(WebSocketTransport::kDefaultWriteCoalescingMaxBytes)
+        , _compressionOffloadMinSize(0)
+        , _timerWheel(std::make_shared<TimerWheel>())
+        , _idleTimeoutSecs(0)
+        , _idleDisconnects(0)
+        , _hibernationTimeoutSecs(0)
+        , _stopHibernation(false)
+        , _handshakeFailures(nullptr)
     {
     }
 
     WebSocketServer::~WebSocketServer()
     {
+        if (_metricsRegistry) _metricsRegistry->removeCollector(this);
+
         stop();
     }
 
@@ -42,6 +77,9 @@ namespace ix
     {
         stopAcceptingConnections();
 
+        // Hibernated clients get a thread back to go through their close handshake
+        stopHibernation();
+
         auto clients = getClients();
         for (auto client : clients)
         {
@@ -49,6 +87,10 @@ namespace ix
         }
 
         SocketServer::stop();
+        _timerWheel->stop();
+
+        std::lock_guard<std::mutex> lock(_hibernationMutex);
+        _stopHibernation = false;
     }
 
     void WebSocketServer::enablePong()
@@ -66,20 +108,135 @@ namespace ix
         _enablePerMessageDeflate = false;
     }
 
+    void WebSocketServer::enableBlockingSend()
+    {
+        _blockingSend = true;
+    }
+
+    void WebSocketServer::disableBlockingSend()
+    {
+        _blockingSend = false;
+    }
+
+    void WebSocketServer::enableWriteCoalescing(int windowUs, size_t maxBytes)
+    {
+        _writeCoalescingWindowUs = windowUs;
+        _writeCoalescingMaxBytes = maxBytes;
+    }
+
+    void WebSocketServer::disableWriteCoalescing()
+    {
+        _writeCoalescingWindowUs = 0;
+    }
+
+    void WebSocketServer::enableCompressionOffload(size_t minSize,
+                                                   std::shared_ptr<WorkerPool> workerPool)
+    {
+        _compressionOffloadMinSize = minSize;
+        _compressionWorkerPool = workerPool;
+    }
+
+    void WebSocketServer::disableCompressionOffload()
+    {
+        _compressionOffloadMinSize = 0;
+        _compressionWorkerPool.reset();
+    }
+
+    void WebSocketServer::setIdleTimeout(int idleTimeoutSecs)
+    {
+        _idleTimeoutSecs = idleTimeoutSecs;
+    }
+
+    void WebSocketServer::enableHibernation(int hibernationTimeoutSecs)
+    {
+        _hibernationTimeoutSecs = hibernationTimeoutSecs;
+    }
+
+    void WebSocketServer::disableHibernation()
+    {
+        _hibernationTimeoutSecs = 0;
+    }
+
     void WebSocketServer::setOnConnectionCallback(const OnConnectionCallback& callback)
     {
         _onConnectionCallback = callback;
     }
 
+    void WebSocketServer::setOnHttpRequestCallback(const OnHttpRequestCallback& callback)
+    {
+        _onHttpRequestCallback = callback;
+    }
+
+    void WebSocketServer::setHttpRouter(std::shared_ptr<HttpRouter> router)
+    {
+        router->compile();
+
+        setOnHttpRequestCallback(
+            [router](HttpRequestPtr request,
+                     std::shared_ptr<ConnectionState> connectionState) -> HttpResponsePtr {
+                return router->handleRequest(request, connectionState);
+            });
+    }
+
     void WebSocketServer::handleConnection(std::shared_ptr<Socket> socket,
                                            std::shared_ptr<ConnectionState> connectionState)
     {
         setThreadName("WebSocketServer::" + connectionState->getId());
 
+        if (!_onHttpRequestCallback && _metricsPath.empty())
+        {
+            // WebSocket only server, the handshake reads the request itself
+            handleUpgrade(socket, connectionState, nullptr);
+            return;
+        }
+
+        auto ret = Http::parseRequest(socket, _handshakeTimeoutSecs);
+        if (!std::get<0>(ret))
+        {
+            logError("WebSocketServer::handleConnection() " + std::get<1>(ret));
+            if (_handshakeFailures) _handshakeFailures->increment();
+
+            // Same answer as the handshake gives when it reads the request
+            WebSocketHttpHeaders headers;
+            headers["Server"] = userAgent();
+            Http::sendResponse(std::make_shared<HttpResponse>(
+                                   400, "Bad Request", HttpErrorCode::Ok, headers, std::string()),
+                               socket);
+
+            connectionState->setTerminated();
+            return;
+        }
+
+        auto request = std::get<2>(ret);
+        auto response = getMetricsResponse(request);
+
+        // Without a callback, other requests fail the handshake
+        if (!response && (isWebSocketUpgrade(request) || !_onHttpRequestCallback))
+        {
+            handleUpgrade(socket, connectionState, request);
+            return;
+        }
+
+        if (!response) response = _onHttpRequestCallback(request, connectionState);
+        if (!Http::sendResponse(response, socket))
+        {
+            logError("WebSocketServer::handleConnection() Cannot send response");
+        }
+
+        connectionState->setTerminated();
+    }
+
+    void WebSocketServer::handleUpgrade(std::shared_ptr<Socket> socket,
+                                        std::shared_ptr<ConnectionState> connectionState,
+                                        HttpRequestPtr request)
+    {
         auto webSocket = std::make_shared<WebSocket>();
         _onConnectionCallback(webSocket, connectionState);
 
         webSocket->disableAutomaticReconnection();
+        webSocket->setTimerWheel(_timerWheel);
+        webSocket->setIdleTimeout(_idleTimeoutSecs);
+        webSocket->setHibernationTimeout(_hibernationTimeoutSecs);
 
         if (_enablePong)
         {
@@ -90,30 +247,74 @@ namespace ix
             webSocket->disablePong();
         }
 
+        if (!_blockingSend)
+        {
+            webSocket->disableBlockingSend();
+        }
+
+        if (_writeCoalescingWindowUs > 0)
+        {
+            webSocket->enableWriteCoalescing(_writeCoalescingWindowUs, _writeCoalescingMaxBytes);
+        }
+
+        if (_compressionOffloadMinSize > 0)
+        {
+            webSocket->enableCompressionOffload(_compressionOffloadMinSize,
+                                                _compressionWorkerPool);
+        }
+
         // Add this client to our client set
         {
             std::lock_guard<std::mutex> lock(_clientsMutex);
-            _clients.insert(webSocket);
+            _clients.emplace(webSocket, connectionState);
         }
 
-        auto status = webSocket->connectToSocket(socket, _handshakeTimeoutSecs);
+        auto status = webSocket->connectToSocket(socket, _handshakeTimeoutSecs, request);
         if (status.success)
         {
-            // Process incoming messages and execute callbacks
-            // until the connection is closed
-            webSocket->run();
+            runClient(webSocket, connectionState);
+            return;
         }
-        else
+
+        std::stringstream ss;
+        ss << "WebSocketServer::handleConnection() HTTP status: " << status.http_status
+           << " error: " << status.errorStr;
+        logError(ss.str());
+        if (_handshakeFailures) _handshakeFailures->increment();
+
+        removeClient(webSocket, connectionState);
+    }
+
+    void WebSocketServer::runClient(std::shared_ptr<WebSocket> webSocket,
+                                    std::shared_ptr<ConnectionState> connectionState)
+    {
+        // Process incoming messages and execute callbacks until the connection
+        // is closed, or until it is handed over to the hibernation thread
+        while (true)
         {
-            std::stringstream ss;
-            ss << "WebSocketServer::handleConnection() HTTP status: " << status.http_status
-               << " error: " << status.errorStr;
-            logError(ss.str());
+            webSocket->run();
+            if (!webSocket->isHibernationRequested()) break;
+
+            {
+                std::lock_guard<std::mutex> lock(_hibernationMutex);
+                if (hibernate(webSocket, connectionState)) return;
+            }
+            webSocket->resumeFromHibernation();
         }
 
+        if (_closeCodes) _closeCodes->counter(webSocket->getCloseInfo().code).increment();
+
+        removeClient(webSocket, connectionState);
+    }
+
+    void WebSocketServer::removeClient(std::shared_ptr<WebSocket> webSocket,
+                                       std::shared_ptr<ConnectionState> connectionState)
+    {
         // Remove this client from our client set
         {
             std::lock_guard<std::mutex> lock(_clientsMutex);
+            _idleDisconnects += webSocket->getIdleDisconnectsCount();
+            _removedClientsStats.add(webSocket->getStats());
             if (_clients.erase(webSocket) != 1)
             {
                 logError("Cannot delete client");
@@ -123,10 +324,244 @@ namespace ix
         connectionState->setTerminated();
     }
 
+    bool WebSocketServer::hibernate(std::shared_ptr<WebSocket> webSocket,
+                                    std::shared_ptr<ConnectionState> connectionState)
+    {
+        // Without select interrupts, sends and timers could not wake up a hibernated client
+        if (_stopHibernation || webSocket->getInterruptFd() == -1) return false;
+
+        if (!_hibernationThread.joinable())
+        {
+            std::string errorMsg;
+            _hibernationInterrupt = createSelectInterrupt();
+            if (!_hibernationInterrupt->init(errorMsg) || _hibernationInterrupt->getFd() == -1)
+            {
+                return false;
+            }
+            _hibernationThread = std::thread(&WebSocketServer::runHibernation, this);
+        }
+
+        _hibernatedClients.emplace(webSocket, connectionState);
+        _hibernationInterrupt->notify(Socket::kSendRequest);
+
+        // This thread exits right after, without anything left to do
+        detachConnectionThread();
+        return true;
+    }
+
+    void WebSocketServer::resume(std::shared_ptr<WebSocket> webSocket,
+                                 std::shared_ptr<ConnectionState> connectionState)
+    {
+        webSocket->resumeFromHibernation();
+
+        startConnectionThread(connectionState, [this, webSocket, connectionState]() {
+            setThreadName("WebSocketServer::" + connectionState->getId());
+            runClient(webSocket, connectionState);
+        });
+    }
+
+    void WebSocketServer::runHibernation()
+    {
+        setThreadName("WebSocketServer::hibernation");
+
+        std::vector<struct pollfd> fds;
+        std::vector<std::shared_ptr<WebSocket>> clients;
+
+        while (true)
+        {
+            {
+                std::lock_guard<std::mutex> lock(_hibernationMutex);
+                if (_stopHibernation) break;
+
+                // Our own interrupt first, then each client socket and select interrupt
+                fds.clear();
+                clients.clear();
+
+                struct pollfd fd;
+                memset(&fd, 0, sizeof(fd));
+                fd.events = POLLIN;
+
+                fd.fd = _hibernationInterrupt->getFd();
+                fds.push_back(fd);
+                clients.push_back(nullptr);
+
+                for (auto&& it : _hibernatedClients)
+                {
+                    fd.fd = it.first->getSocketFd();
+                    fds.push_back(fd);
+                    clients.push_back(it.first);
+
+                    fd.fd = it.first->getInterruptFd();
+                    fds.push_back(fd);
+                    clients.push_back(it.first);
+                }
+            }
+
+            int ret = ix::poll(&fds[0], (nfds_t) fds.size(), -1);
+            if (ret <= 0) continue;
+
+            if (fds[0].revents & POLLIN)
+            {
+                _hibernationInterrupt->read();
+            }
+
+            // The select interrupts are not read, the connection threads do it
+            std::set<std::shared_ptr<WebSocket>> ready;
+            for (size_t i = 1; i < fds.size(); ++i)
+            {
+                if (fds[i].revents != 0) ready.insert(clients[i]);
+            }
+
+            std::lock_guard<std::mutex> lock(_hibernationMutex);
+            for (auto&& webSocket : ready)
+            {
+                auto it = _hibernatedClients.find(webSocket);
+                if (it == _hibernatedClients.end()) continue;
+
+                auto connectionState = it->second;
+                _hibernatedClients.erase(it);
+                resume(webSocket, connectionState);
+            }
+        }
+    }
+
+    void WebSocketServer::stopHibernation()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_hibernationMutex);
+            _stopHibernation = true;
+
+            for (auto&& it : _hibernatedClients)
+            {
+                resume(it.first, it.second);
+            }
+            _hibernatedClients.clear();
+
+            if (_hibernationInterrupt)
+            {
+                _hibernationInterrupt->notify(Socket::kCloseRequest);
+            }
+        }
+
+        if (_hibernationThread.joinable())
+        {
+            _hibernationThread.join();
+        }
+    }
+
     std::set<std::shared_ptr<WebSocket>> WebSocketServer::getClients()
     {
         std::lock_guard<std::mutex> lock(_clientsMutex);
-        return _clients;
+
+        std::set<std::shared_ptr<WebSocket>> clients;
+        for (auto&& it : _clients)
+        {
+            clients.insert(it.first);
+        }
+        return clients;
+    }
+
+    WebSocketServerStats WebSocketServer::getStats(bool includeConnections)
+    {
+        WebSocketServerStats stats;
+        {
+            std::lock_guard<std::mutex> lock(_hibernationMutex);
+            stats.hibernatedClients = _hibernatedClients.size();
+        }
+
+        std::lock_guard<std::mutex> lock(_clientsMutex);
+
+        stats.connectedClients = _clients.size();
+        stats.bufferedAmount = 0;
+        stats.idleDisconnects = _idleDisconnects;
+        stats.totals = _removedClientsStats;
+
+        if (includeConnections) stats.connections.reserve(_clients.size());
+
+        for (auto&& it : _clients)
+        {
+            WebSocketConnectionStats connectionStats;
+            connectionStats.id = it.second->getId();
+            connectionStats.bufferedAmount = it.first->bufferedAmount();
+            connectionStats.droppedMessages = it.first->getDroppedMessagesCount();
+            connectionStats.stats = it.first->getStats();
+
+            stats.bufferedAmount += connectionStats.bufferedAmount;
+            stats.idleDisconnects += it.first->getIdleDisconnectsCount();
+            stats.totals.add(connectionStats.stats);
+
+            if (includeConnections) stats.connections.push_back(std::move(connectionStats));
+        }
+
+        return stats;
+    }
+
+    void WebSocketServer::setMetricsRegistry(std::shared_ptr<MetricsRegistry> registry)
+    {
+        if (_metricsRegistry) _metricsRegistry->removeCollector(this);
+
+        SocketServer::setMetricsRegistry(registry);
+        _handshakeFailures = nullptr;
+        _closeCodes.reset();
+        if (!registry) return;
+
+        _handshakeFailures = &registry->counter(
+            "ixwebsocket_server_handshake_failures_total",
+            "Connections which failed the HTTP upgrade, or sent an invalid request",
+            getMetricsLabels());
+
+        // Close codes are in [1000, 5000), see RFC 6455 section 7.4.2
+        _closeCodes.reset(new MetricsByCode(*registry,
+                                            "ixwebsocket_server_close_codes_total",
+                                            "Closed client connections by close code",
+                                            getMetricsLabels(),
+                                            1000,
+                                            5000));
+
+        registry->setCollector(this, [this]() { collectMetrics(); });
+    }
+
+    void WebSocketServer::collectMetrics()
+    {
+        WebSocketServerStats stats = getStats(false);
+        MetricsRegistry& registry = *_metricsRegistry;
+
+        std::string labels = getMetricsLabels();
+        std::string sent = getMetricsLabels("direction=\"sent\"");
+        std::string received = getMetricsLabels("direction=\"received\"");
+
+        registry.gauge("ixwebsocket_server_active_connections", "Connected clients", labels)
+            .set(stats.connectedClients);
+        registry.gauge("ixwebsocket_server_hibernated_connections", "Hibernated clients", labels)
+            .set(stats.hibernatedClients);
+        registry
+            .gauge("ixwebsocket_server_send_queue_bytes",
+                   "Bytes queued for the connected clients and not written yet",
+                   labels)
+            .set(stats.bufferedAmount);
+        registry
+            .counter("ixwebsocket_server_idle_disconnects_total",
+                     "Clients closed by the idle timeout",
+                     labels)
+            .set(stats.idleDisconnects);
+
+        const std::string messagesHelp("Text and binary messages");
+        registry.counter("ixwebsocket_server_messages_total", messagesHelp, sent)
+            .set(stats.totals.messagesSent);
+        registry.counter("ixwebsocket_server_messages_total", messagesHelp, received)
+            .set(stats.totals.messagesReceived);
+
+        const std::string bytesHelp("Payload bytes of the text and binary messages");
+        registry.counter("ixwebsocket_server_bytes_total", bytesHelp, sent)
+            .set(stats.totals.bytesSent);
+        registry.counter("ixwebsocket_server_bytes_total", bytesHelp, received)
+            .set(stats.totals.bytesReceived);
+
+        const std::string wireBytesHelp("Bytes written to and read from the sockets");
+        registry.counter("ixwebsocket_server_wire_bytes_total", wireBytesHelp, sent)
+            .set(stats.totals.wireBytesSent);
+        registry.counter("ixwebsocket_server_wire_bytes_total", wireBytesHelp, received)
+            .set(stats.totals.wireBytesReceived);
     }
 
     size_t WebSocketServer::getConnectedClientsCount()
@@ -6,24 +6,52 @@
 
 #pragma once
 
+#include "IXHttp.h"
+#include "IXHttpRouter.h"
 #include "IXSocketServer.h"
 #include "IXWebSocket.h"
 #include <condition_variable>
 #include <functional>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <set>
 #include <string>
 #include <thread>
 #include <utility> // pair
+#include <vector>
 
 namespace ix
 {
+    struct WebSocketConnectionStats
+    {
+        std::string id;
+        size_t bufferedAmount;
+        uint64_t droppedMessages;
+        WebSocketStats stats;
+    };
+
+    struct WebSocketServerStats
+    {
+        size_t connectedClients;
+        size_t bufferedAmount;
+        uint64_t idleDisconnects;
+        size_t hibernatedClients;
+        std::vector<WebSocketConnectionStats> connections;
+
+        // Sum of the stats of the connected clients and of those which are gone
+        WebSocketStats totals;
+    };
+
+    class SelectInterrupt;
+
     class WebSocketServer final : public SocketServer
     {
     public:
         using OnConnectionCallback =
             std::function<void(std::shared_ptr<WebSocket>, std::shared_ptr<ConnectionState>)>;
+        using OnHttpRequestCallback =
+            std::function<HttpResponsePtr(HttpRequestPtr, std::shared_ptr<ConnectionState>)>;
 
         WebSocketServer(int port = SocketServer::kDefaultPort,
                         const std::string& host = SocketServer::kDefaultHost,
@@ -38,23 +66,97 @@ namespace ix
         void disablePong();
         void disablePerMessageDeflate();
 
+        // By default a send to a client returns once the message is written to
+        // the socket, which lets a slow client stall the sending thread. When
+        // disabled, messages are queued and written by the client connection thread.
+        void enableBlockingSend();
+        void disableBlockingSend();
+
+        // Write the small messages sent to a client within a short window together,
+        // see WebSocket::enableWriteCoalescing. Disabled by default.
+        void enableWriteCoalescing(
+            int windowUs = WebSocketTransport::kDefaultWriteCoalescingWindowUs,
+            size_t maxBytes = WebSocketTransport::kDefaultWriteCoalescingMaxBytes);
+        void disableWriteCoalescing();
+
+        // Compress the large messages sent to clients on a shared worker pool,
+        // see WebSocket::enableCompressionOffload. Disabled by default.
+        void enableCompressionOffload(
+            size_t minSize = WebSocketTransport::kDefaultCompressionOffloadMinSize,
+            std::shared_ptr<WorkerPool> workerPool = WorkerPool::getDefault());
+        void disableCompressionOffload();
+
+        // Close the clients which did not send a message or a pong for that long,
+        // with code 1001. The deadlines of all the clients share one timer wheel.
+        // 0, the default, disables it.
+        void setIdleTimeout(int idleTimeoutSecs);
+
+        // Clients with nothing to read, write or schedule for that long release
+        // their thread. A single thread watches their sockets, and gives them a
+        // thread again once there is something to do. Disabled by default.
+        void enableHibernation(
+            int hibernationTimeoutSecs = WebSocketServer::kDefaultHibernationTimeoutSecs);
+        void disableHibernation();
+
         void setOnConnectionCallback(const OnConnectionCallback& callback);
 
+        // Serve plain HTTP requests on the same port. The first request of a
+        // connection is parsed once; WebSocket upgrade requests go through the
+        // handshake with the already parsed headers, others to this callback.
+        void setOnHttpRequestCallback(const OnHttpRequestCallback& callback);
+
+        // Same as above, dispatching plain HTTP requests through a router.
+        void setHttpRouter(std::shared_ptr<HttpRouter> router);
+
         // Get all the connected clients
         std::set<std::shared_ptr<WebSocket>> getClients();
 
+        // Buffered bytes, dropped messages and traffic of each connected client,
+        // to spot slow consumers. includeConnections false only fills in the totals.
+        WebSocketServerStats getStats(bool includeConnections = true);
+
+        // Also exports the handshake failures, close codes, and at each
+        // serialization the traffic and send queue of the clients
+        void setMetricsRegistry(std::shared_ptr<MetricsRegistry> registry) final;
+
         const static int kDefaultHandShakeTimeoutSecs;
+        const static int kDefaultHibernationTimeoutSecs;
 
     private:
         // Member variables
         int _handshakeTimeoutSecs;
         bool _enablePong;
         bool _enablePerMessageDeflate;
+        bool _blockingSend;
+        int _writeCoalescingWindowUs;
+        size_t _writeCoalescingMaxBytes;
+        size_t _compressionOffloadMinSize;
+        std::shared_ptr<WorkerPool> _compressionWorkerPool;
+
+        // Deadlines of all the client connections
+        std::shared_ptr<TimerWheel> _timerWheel;
+        int _idleTimeoutSecs;
+
+        // Idle disconnects and stats of the clients which are gone, guarded by _clientsMutex
+        uint64_t _idleDisconnects;
+        WebSocketStats _removedClientsStats;
+
+        // Hibernated clients, watched by the hibernation thread
+        std::atomic<int> _hibernationTimeoutSecs;
+        std::mutex _hibernationMutex;
+        std::map<std::shared_ptr<WebSocket>, std::shared_ptr<ConnectionState>> _hibernatedClients;
+        std::shared_ptr<SelectInterrupt> _hibernationInterrupt;
+        std::thread _hibernationThread;
+        bool _stopHibernation;
 
         OnConnectionCallback _onConnectionCallback;
+        OnHttpRequestCallback _onHttpRequestCallback;
 
         std::mutex _clientsMutex;
-        std::set<std::shared_ptr<WebSocket>> _clients;
+        std::map<std::shared_ptr<WebSocket>, std::shared_ptr<ConnectionState>> _clients;
+
+        Metric* _handshakeFailures;
+        std::unique_ptr<MetricsByCode> _closeCodes;
 
         const static bool kDefaultEnablePong;
 
@@ -62,5 +164,23 @@ namespace ix
         virtual void handleConnection(std::shared_ptr<Socket> socket,
                                       std::shared_ptr<ConnectionState> connectionState) final;
         virtual size_t getConnectedClientsCount() final;
+
+        void handleUpgrade(std::shared_ptr<Socket> socket,
+                           std::shared_ptr<ConnectionState> connectionState,
+                           HttpRequestPtr request);
+        void runClient(std::shared_ptr<WebSocket> webSocket,
+                       std::shared_ptr<ConnectionState> connectionState);
+        void removeClient(std::shared_ptr<WebSocket> webSocket,
+                          std::shared_ptr<ConnectionState> connectionState);
+
+        // Hibernation, called with _hibernationMutex held
+        bool hibernate(std::shared_ptr<WebSocket> webSocket,
+                       std::shared_ptr<ConnectionState> connectionState);
+        void resume(std::shared_ptr<WebSocket> webSocket,
+                    std::shared_ptr<ConnectionState> connectionState);
+        void runHibernation();
+        void stopHibernation();
+
+        void collectMetrics();
     };
 } // namespace ix
@@ -0,0 +1,190 @@
+/*
+ *  IXWebSocketStats.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ */
+
+#include "IXWebSocketStats.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // Each power of two is split in 1 << kSubBucketBits buckets
+    const int kSubBucketBits = 3;
+    const uint64_t kSubBuckets = 1 << kSubBucketBits;
+
+    void updateMax(std::atomic<uint64_t>& max, uint64_t value)
+    {
+        uint64_t current = max.load(std::memory_order_relaxed);
+        while (value > current && !max.compare_exchange_weak(current, value))
+            ;
+    }
+} // namespace
+
+namespace ix
+{
+    const size_t LatencyHistogram::kBuckets;
+    const uint64_t LatencyHistogram::kMaxValue((1ULL << 32) - 1);
+
+    LatencyHistogram::LatencyHistogram()
+        : _count(0)
+        , _sum(0)
+        , _max(0)
+    {
+        for (auto&& bucket : _buckets)
+        {
+            bucket = 0;
+        }
+    }
+
+    LatencyHistogram::LatencyHistogram(const LatencyHistogram& other)
+        : LatencyHistogram()
+    {
+        merge(other);
+    }
+
+    LatencyHistogram& LatencyHistogram::operator=(const LatencyHistogram& other)
+    {
+        if (this == &other) return *this;
+
+        for (size_t i = 0; i < kBuckets; ++i)
+        {
+            _buckets[i] = other._buckets[i].load(std::memory_order_relaxed);
+        }
+        _count = other._count.load(std::memory_order_relaxed);
+        _sum = other._sum.load(std::memory_order_relaxed);
+        _max = other._max.load(std::memory_order_relaxed);
+
+        return *this;
+    }
+
+    size_t LatencyHistogram::getBucketIndex(uint64_t valueUs)
+    {
+        if (valueUs < kSubBuckets) return (size_t) valueUs;
+
+        // Position of the highest bit, then the next kSubBucketBits bits
+        int exponent = kSubBucketBits;
+        while ((valueUs >> (exponent + 1)) != 0)
+        {
+            ++exponent;
+        }
+
+        uint64_t subBucket = (valueUs >> (exponent - kSubBucketBits)) - kSubBuckets;
+        return (size_t) ((exponent - kSubBucketBits + 1) * kSubBuckets + subBucket);
+    }
+
+    uint64_t LatencyHistogram::getBucketUpperBound(size_t index)
+    {
+        if (index < kSubBuckets) return index + 1;
+
+        uint64_t exponent = index / kSubBuckets + kSubBucketBits - 1;
+        uint64_t subBucket = index % kSubBuckets;
+        return (kSubBuckets + subBucket + 1) << (exponent - kSubBucketBits);
+    }
+
+    void LatencyHistogram::record(uint64_t valueUs)
+    {
+        valueUs = std::min(valueUs, kMaxValue);
+
+        _buckets[getBucketIndex(valueUs)].fetch_add(1, std::memory_order_relaxed);
+        _count.fetch_add(1, std::memory_order_relaxed);
+        _sum.fetch_add(valueUs, std::memory_order_relaxed);
+        updateMax(_max, valueUs);
+    }
+
+    void LatencyHistogram::merge(const LatencyHistogram& other)
+    {
+        for (size_t i = 0; i < kBuckets; ++i)
+        {
+            _buckets[i].fetch_add(other._buckets[i].load(std::memory_order_relaxed),
+                                  std::memory_order_relaxed);
+        }
+        _count.fetch_add(other._count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        _sum.fetch_add(other._sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        updateMax(_max, other._max.load(std::memory_order_relaxed));
+    }
+
+    uint64_t LatencyHistogram::getCount() const
+    {
+        return _count;
+    }
+
+    uint64_t LatencyHistogram::getMax() const
+    {
+        return _max;
+    }
+
+    double LatencyHistogram::getMean() const
+    {
+        uint64_t count = _count;
+        return (count == 0) ? 0 : (double) _sum / count;
+    }
+
+    uint64_t LatencyHistogram::getBucketCount(size_t index) const
+    {
+        return (index < kBuckets) ? _buckets[index].load(std::memory_order_relaxed) : 0;
+    }
+
+    uint64_t LatencyHistogram::getPercentile(double percentile) const
+    {
+        // The buckets are summed again, _count may be ahead of them while recording
+        uint64_t total = 0;
+        for (auto&& bucket : _buckets)
+        {
+            total += bucket.load(std::memory_order_relaxed);
+        }
+        if (total == 0) return 0;
+
+        percentile = std::max(0.0, std::min(100.0, percentile));
+        uint64_t rank = std::max((uint64_t) 1, (uint64_t) std::ceil(total * percentile / 100));
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBuckets; ++i)
+        {
+            seen += _buckets[i].load(std::memory_order_relaxed);
+            if (seen >= rank)
+            {
+                return std::min(getBucketUpperBound(i), getMax());
+            }
+        }
+
+        return getMax();
+    }
+
+    WebSocketStats::WebSocketStats()
+        : messagesSent(0)
+        , messagesReceived(0)
+        , bytesSent(0)
+        , bytesReceived(0)
+        , wireBytesSent(0)
+        , wireBytesReceived(0)
+        , framesSent(0)
+        , framesReceived(0)
+        , fragmentsSent(0)
+        , fragmentsReceived(0)
+        , compressionTimeUs(0)
+        , decompressionTimeUs(0)
+    {
+        ;
+    }
+
+    void WebSocketStats::add(const WebSocketStats& other)
+    {
+        messagesSent += other.messagesSent;
+        messagesReceived += other.messagesReceived;
+        bytesSent += other.bytesSent;
+        bytesReceived += other.bytesReceived;
+        wireBytesSent += other.wireBytesSent;
+        wireBytesReceived += other.wireBytesReceived;
+        framesSent += other.framesSent;
+        framesReceived += other.framesReceived;
+        fragmentsSent += other.fragmentsSent;
+        fragmentsReceived += other.fragmentsReceived;
+        compressionTimeUs += other.compressionTimeUs;
+        decompressionTimeUs += other.decompressionTimeUs;
+        pingRtt.merge(other.pingRtt);
+        sendLatency.merge(other.sendLatency);
+    }
+} // namespace ix
@@ -0,0 +1,86 @@
+/*
+ *  IXWebSocketStats.h
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace ix
+{
+    // Log-linear histogram of durations in microseconds, in the style of
+    // HdrHistogram: each power of two is split into 8 buckets, so values are
+    // kept within 12.5%. Recording is lock free and can race with copies.
+    class LatencyHistogram
+    {
+    public:
+        LatencyHistogram();
+        LatencyHistogram(const LatencyHistogram& other);
+        LatencyHistogram& operator=(const LatencyHistogram& other);
+
+        // Values above kMaxValue are recorded as kMaxValue
+        void record(uint64_t valueUs);
+        void merge(const LatencyHistogram& other);
+
+        uint64_t getCount() const;
+        uint64_t getMax() const;
+        double getMean() const;
+
+        // Upper bound of the bucket holding that percentile (0 to 100) of the
+        // values, capped by the maximum. 0 when nothing was recorded.
+        uint64_t getPercentile(double percentile) const;
+
+        // Buckets, for export. Values of bucket i are below its upper bound
+        // and at least the upper bound of bucket i - 1.
+        static uint64_t getBucketUpperBound(size_t index);
+        uint64_t getBucketCount(size_t index) const;
+
+        const static size_t kBuckets = 240;
+        const static uint64_t kMaxValue;
+
+    private:
+        static size_t getBucketIndex(uint64_t valueUs);
+
+        std::array<std::atomic<uint64_t>, kBuckets> _buckets;
+        std::atomic<uint64_t> _count;
+        std::atomic<uint64_t> _sum;
+        std::atomic<uint64_t> _max;
+    };
+
+    // Counters of a connection. Payload bytes are the application data, wire
+    // bytes what was written to or read from the socket, so frame headers,
+    // control frames and compression make the difference.
+    struct WebSocketStats
+    {
+        WebSocketStats();
+
+        // Adds the counters and histograms of other to these
+        void add(const WebSocketStats& other);
+
+        uint64_t messagesSent;
+        uint64_t messagesReceived;
+        uint64_t bytesSent;
+        uint64_t bytesReceived;
+        uint64_t wireBytesSent;
+        uint64_t wireBytesReceived;
+
+        // Frames of all kinds, fragments are their continuation frames
+        uint64_t framesSent;
+        uint64_t framesReceived;
+        uint64_t fragmentsSent;
+        uint64_t fragmentsReceived;
+
+        uint64_t compressionTimeUs;
+        uint64_t decompressionTimeUs;
+
+        // Time from a ping to its pong, and from a text or binary message
+        // entering the send buffer, once compressed, to its last byte written
+        LatencyHistogram pingRtt;
+        LatencyHistogram sendLatency;
+    };
+} // namespace ix
@@ -34,12 +34,16 @@
 
 #include "IXWebSocketTransport.h"
 
+#include "IXBufferPool.h"
 #include "IXSocketFactory.h"
 #include "IXSocketTLSOptions.h"
+#include "IXTrace.h"
 #include "IXUrlParser.h"
 #include "IXUtf8Validator.h"
 #include "IXWebSocketHandshake.h"
 #include "IXWebSocketHttpHeaders.h"
+#include "IXWebSocketMask.h"
+#include <algorithm>
 #include <chrono>
 #include <cstdarg>
 #include <cstdlib>
@@ -48,8 +52,36 @@
 #include <string.h>
 #include <string>
 #include <thread>
+#include <utility>
 #include <vector>
 
+namespace
+{
+    int64_t getMonotonicMs()
+    {
+        auto now = std::chrono::steady_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+    }
+
+    int64_t getMonotonicUs()
+    {
+        auto now = std::chrono::steady_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+    }
+
+    uint64_t getElapsedUs(std::chrono::steady_clock::time_point start,
+                          std::chrono::steady_clock::time_point end)
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    }
+
+    // Statistics counters have a single writer at a time, which holds a lock or
+    // runs poll. Readers only need a recent value, so no atomic add is needed.
+    void addToCounter(std::atomic<uint64_t>& counter, uint64_t value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+} // namespace
 
 namespace ix
 {
@@ -58,10 +90,35 @@ namespace ix
     const bool WebSocketTransport::kDefaultEnablePong(true);
     const int WebSocketTransport::kClosingMaximumWaitingDelayInMs(300);
     constexpr size_t WebSocketTransport::kChunkSize;
+    const uint64_t WebSocketTransport::kHeartBeatTimer(1);
+    const uint64_t WebSocketTransport::kCloseTimer(2);
+    const uint64_t WebSocketTransport::kIdleTimer(4);
+    const int WebSocketTransport::kDefaultWriteCoalescingWindowUs(200);
+    const size_t WebSocketTransport::kDefaultWriteCoalescingMaxBytes(16 * 1024);
+    const size_t WebSocketTransport::kDefaultCompressionOffloadMinSize(1024 * 1024);
 
     WebSocketTransport::WebSocketTransport()
         : _useMask(true)
         , _blockingSend(false)
+        , _bufferedAmount(0)
+        , _bufferedControlAmount(0)
+        , _txbufAppendedBytes(0)
+        , _txbufSentBytes(0)
+        , _txbufAtFrameBoundary(true)
+        , _closeFrameQueued(false)
+        , _closeRequested(false)
+        , _lowWatermark(0)
+        , _highWatermark(0)
+        , _aboveHighWatermark(false)
+        , _maxBufferedAmount(0)
+        , _sendBufferPolicy(SendBufferPolicy::Block)
+        , _droppedMessages(0)
+        , _writeCoalescingWindowUs(0)
+        , _writeCoalescingMaxBytes(kDefaultWriteCoalescingMaxBytes)
+        , _writeCoalescingPending(false)
+        , _socketWouldBlock(false)
+        , _compressionOffloadMinSize(0)
+        , _offloadQueue(std::make_shared<OffloadQueue>())
         , _compressedMessage(false)
         , _readyState(ReadyState::CLOSED)
         , _closeCode(WebSocketCloseConstants::kInternalErrorCode)
@@ -70,18 +127,60 @@ namespace ix
         , _closeRemote(false)
         , _enablePerMessageDeflate(false)
         , _requestInitCancellation(false)
-        , _closingTimePoint(std::chrono::steady_clock::now())
         , _enablePong(kDefaultEnablePong)
         , _pingIntervalSecs(kDefaultPingIntervalSecs)
         , _pongReceived(false)
-        , _lastSendPingTimePoint(std::chrono::steady_clock::now())
+        , _lastSendPingTimeMs(0)
+        , _timerWheel(TimerWheel::getDefault())
+        , _expiredTimers(std::make_shared<std::atomic<uint64_t>>(0))
+        , _heartBeatTimerId(0)
+        , _closeTimerId(0)
+        , _idleTimerId(0)
+        , _idleTimeoutSecs(0)
+        , _lastActivityMs(0)
+        , _idleDisconnects(0)
+        , _messagesSent(0)
+        , _messagesReceived(0)
+        , _bytesSent(0)
+        , _bytesReceived(0)
+        , _wireBytesSent(0)
+        , _wireBytesReceived(0)
+        , _framesSent(0)
+        , _framesReceived(0)
+        , _fragmentsSent(0)
+        , _fragmentsReceived(0)
+        , _compressionTimeUs(0)
+        , _decompressionTimeUs(0)
+        , _pingSentTimeUs(0)
+        , _hibernationTimeoutSecs(0)
+        , _hibernationRequested(false)
+        , _lastPollEventMs(0)
     {
-        _readbuf.resize(kChunkSize);
+        _offloadQueue->running = false;
+        _offloadQueue->destroyed = false;
+        _offloadQueue->thread = std::thread::id();
     }
 
     WebSocketTransport::~WebSocketTransport()
     {
-        ;
+        // Offloaded sends refer to this transport. When a send callback destroys
+        // it from the worker, the sends left are dropped instead.
+        {
+            std::unique_lock<std::mutex> lock(_offloadQueue->mutex);
+            if (_offloadQueue->thread == std::this_thread::get_id())
+            {
+                _offloadQueue->sends.clear();
+                _offloadQueue->destroyed = true;
+            }
+            else
+            {
+                _offloadQueue->condition.wait(lock, [this] { return !_offloadQueue->running; });
+            }
+        }
+
+        cancelTimer(_heartBeatTimerId);
+        cancelTimer(_closeTimerId);
+        cancelTimer(_idleTimerId);
     }
 
     void WebSocketTransport::configure(
@@ -129,10 +228,16 @@ namespace ix
                                               _perMessageDeflateOptions,
                                               _enablePerMessageDeflate);
 
+        IX_TRACE2(handshake_start, this, 0);
         auto result =
             webSocketHandshake.clientHandshake(url, headers, host, path, port, timeoutSecs);
+        result.timings = webSocketHandshake.getConnectionTimings();
+        IX_TRACE4(handshake_end, this, 0, result.success, result.http_status);
+
         if (result.success)
         {
+            // The connecting thread is the one which will poll
+            _pollThreadId = std::this_thread::get_id();
             setReadyState(ReadyState::OPEN);
         }
         return result;
@@ -140,7 +245,8 @@ namespace ix
 
     // Server
     WebSocketInitResult WebSocketTransport::connectToSocket(std::shared_ptr<Socket> socket,
-                                                            int timeoutSecs)
+                                                            int timeoutSecs,
+                                                            HttpRequestPtr request)
     {
         std::lock_guard<std::mutex> lock(_socketMutex);
 
@@ -156,14 +262,186 @@ namespace ix
                                               _perMessageDeflateOptions,
                                               _enablePerMessageDeflate);
 
-        auto result = webSocketHandshake.serverHandshake(timeoutSecs);
+        IX_TRACE2(handshake_start, this, 1);
+        auto result = webSocketHandshake.serverHandshake(timeoutSecs, request);
+        IX_TRACE4(handshake_end, this, 1, result.success, result.http_status);
+
         if (result.success)
         {
+            _pollThreadId = std::this_thread::get_id();
             setReadyState(ReadyState::OPEN);
         }
         return result;
     }
 
+    void WebSocketTransport::setTimerWheel(std::shared_ptr<TimerWheel> timerWheel)
+    {
+        _timerWheel = timerWheel;
+    }
+
+    void WebSocketTransport::setIdleTimeout(int idleTimeoutSecs)
+    {
+        _idleTimeoutSecs = idleTimeoutSecs;
+
+        cancelTimer(_idleTimerId);
+        if (idleTimeoutSecs > 0 && _readyState == ReadyState::OPEN)
+        {
+            _lastActivityMs = getMonotonicMs();
+            _idleTimerId = scheduleTimer(kIdleTimer, idleTimeoutSecs * 1000);
+        }
+    }
+
+    uint64_t WebSocketTransport::getIdleDisconnectsCount() const
+    {
+        return _idleDisconnects;
+    }
+
+    void WebSocketTransport::setHibernationTimeout(int hibernationTimeoutSecs)
+    {
+        _hibernationTimeoutSecs = hibernationTimeoutSecs;
+    }
+
+    bool WebSocketTransport::isHibernationRequested() const
+    {
+        return _hibernationRequested;
+    }
+
+    bool WebSocketTransport::canHibernate() const
+    {
+        return _readyState == ReadyState::OPEN && !_requestInitCancellation &&
+               isSendBufferEmpty() && _rxbuf.empty() && _chunks.empty();
+    }
+
+    void WebSocketTransport::resumeFromHibernation()
+    {
+        _lastPollEventMs = getMonotonicMs();
+        _hibernationRequested = false;
+    }
+
+    int WebSocketTransport::getSocketFd() const
+    {
+        return _socket->getFd();
+    }
+
+    int WebSocketTransport::getInterruptFd() const
+    {
+        return _socket->getInterruptFd();
+    }
+
+    void WebSocketTransport::setBlockingSend(bool blockingSend)
+    {
+        _blockingSend = blockingSend;
+    }
+
+    void WebSocketTransport::setSendBufferWatermarks(size_t lowWatermark, size_t highWatermark)
+    {
+        _lowWatermark = lowWatermark;
+        _highWatermark = highWatermark;
+    }
+
+    void WebSocketTransport::setOnSendBufferWatermarkCallback(
+        const OnSendBufferWatermarkCallback& callback)
+    {
+        std::lock_guard<std::mutex> lock(_onSendBufferWatermarkCallbackMutex);
+        _onSendBufferWatermarkCallback = callback;
+    }
+
+    void WebSocketTransport::setMaxBufferedAmount(size_t maxBufferedAmount,
+                                                  SendBufferPolicy policy)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_txbufMutex);
+            _maxBufferedAmount = maxBufferedAmount;
+            _sendBufferPolicy = policy;
+        }
+        _txbufCondition.notify_all();
+    }
+
+    uint64_t WebSocketTransport::getDroppedMessagesCount() const
+    {
+        return _droppedMessages;
+    }
+
+    void WebSocketTransport::setWriteCoalescing(int windowUs, size_t maxBytes)
+    {
+        _writeCoalescingWindowUs = windowUs;
+        _writeCoalescingMaxBytes = maxBytes;
+    }
+
+    void WebSocketTransport::setCompressionOffload(size_t minSize,
+                                                   std::shared_ptr<WorkerPool> workerPool)
+    {
+        std::lock_guard<std::mutex> lock(_offloadQueue->mutex);
+        _workerPool = workerPool;
+        _compressionOffloadMinSize = (workerPool) ? minSize : 0;
+    }
+
+    bool WebSocketTransport::offloadSend(size_t size,
+                                         bool compress,
+                                         const std::function<void()>& send)
+    {
+        size_t minSize = _compressionOffloadMinSize;
+        if (minSize == 0) return false;
+
+        std::shared_ptr<OffloadQueue> queue = _offloadQueue;
+        std::lock_guard<std::mutex> lock(queue->mutex);
+
+        // Once a message was offloaded, the next ones wait behind it
+        if (queue->sends.empty() && !(size >= minSize && shouldCompress(size, compress)))
+        {
+            return false;
+        }
+
+        queue->sends.push_back(send);
+        if (!queue->running)
+        {
+            queue->running = true;
+            _workerPool->post([queue] { runOffloadedSends(queue); });
+        }
+        return true;
+    }
+
+    void WebSocketTransport::runOffloadedSends(std::shared_ptr<OffloadQueue> queue)
+    {
+        // Only the queue is used once a send ran, it may have destroyed the transport
+        while (true)
+        {
+            std::function<void()> send;
+            {
+                std::lock_guard<std::mutex> lock(queue->mutex);
+                if (queue->sends.empty() || queue->destroyed)
+                {
+                    queue->thread = std::thread::id();
+                    queue->running = false;
+                    queue->condition.notify_all();
+                    return;
+                }
+                queue->thread = std::this_thread::get_id();
+                send = queue->sends.front();
+            }
+
+            send();
+
+            std::lock_guard<std::mutex> lock(queue->mutex);
+            if (!queue->destroyed) queue->sends.pop_front();
+        }
+    }
+
+    int WebSocketTransport::getWriteCoalescingDelayMs()
+    {
+        std::lock_guard<std::mutex> lock(_txbufMutex);
+        if (!_writeCoalescingPending) return -1;
+
+        // poll has a millisecond resolution, round up so that we do not spin
+        auto now = std::chrono::steady_clock::now();
+        if (now >= _writeCoalescingDeadline) return 0;
+
+        auto delay = std::chrono::duration_cast<std::chrono::microseconds>(
+                         _writeCoalescingDeadline - now)
+                         .count();
+        return (int) ((delay + 999) / 1000);
+    }
+
     WebSocketTransport::ReadyState WebSocketTransport::getReadyState() const
     {
         return _readyState;
@@ -176,7 +454,13 @@ namespace ix
 
         if (readyState == ReadyState::CLOSED)
         {
+            cancelTimer(_heartBeatTimerId);
+            cancelTimer(_closeTimerId);
+            cancelTimer(_idleTimerId);
+            clearSendBuffer();
+
             std::lock_guard<std::mutex> lock(_closeDataMutex);
+            IX_TRACE3(close, this, _closeCode, _closeRemote);
             _onCloseCallback(_closeCode, _closeReason, _closeWireSize, _closeRemote);
             _closeCode = WebSocketCloseConstants::kInternalErrorCode;
             _closeReason = WebSocketCloseConstants::kInternalErrorMessage;
@@ -185,34 +469,36 @@ namespace ix
         }
         else if (readyState == ReadyState::OPEN)
         {
-            initTimePointsAfterConnect();
+            _expiredTimers->store(0);
+            _lastSendPingTimeMs = getMonotonicMs();
             _pongReceived = false;
+
+            if (_pingIntervalSecs > 0)
+            {
+                _heartBeatTimerId = scheduleTimer(kHeartBeatTimer, _pingIntervalSecs * 1000);
+            }
+
+            _lastActivityMs = _lastSendPingTimeMs.load();
+            _lastPollEventMs = _lastActivityMs;
+            if (_idleTimeoutSecs > 0)
+            {
+                _idleTimerId = scheduleTimer(kIdleTimer, _idleTimeoutSecs * 1000);
+            }
         }
 
         _readyState = readyState;
-    }
-
-    void WebSocketTransport::setOnCloseCallback(const OnCloseCallback& onCloseCallback)
-    {
-        _onCloseCallback = onCloseCallback;
-    }
 
-    void WebSocketTransport::initTimePointsAfterConnect()
-    {
+        // Senders which checked the state before it changed may have queued
+        // messages after the first clear
+        if (readyState == ReadyState::CLOSED)
         {
-            std::lock_guard<std::mutex> lock(_lastSendPingTimePointMutex);
-            _lastSendPingTimePoint = std::chrono::steady_clock::now();
+            clearSendBuffer();
         }
     }
 
-    // Only consider send PING time points for that computation.
-    bool WebSocketTransport::pingIntervalExceeded()
+    void WebSocketTransport::setOnCloseCallback(const OnCloseCallback& onCloseCallback)
     {
-        if (_pingIntervalSecs <= 0) return false;
-
-        std::lock_guard<std::mutex> lock(_lastSendPingTimePointMutex);
-        auto now = std::chrono::steady_clock::now();
-        return now - _lastSendPingTimePoint > std::chrono::seconds(_pingIntervalSecs);
+        _onCloseCallback = onCloseCallback;
     }
 
     WebSocketSendInfo WebSocketTransport::sendHeartBeat()
@@ -223,45 +509,91 @@ namespace ix
         return sendPing(ss.str());
     }
 
-    bool WebSocketTransport::closingDelayExceeded()
+    TimerWheel::TimerId WebSocketTransport::scheduleTimer(uint64_t timer, int delayMs)
     {
-        std::lock_guard<std::mutex> lock(_closingTimePointMutex);
-        auto now = std::chrono::steady_clock::now();
-        return now - _closingTimePoint > std::chrono::milliseconds(kClosingMaximumWaitingDelayInMs);
+        std::weak_ptr<Socket> socket = _socket;
+        auto expiredTimers = _expiredTimers;
+
+        return _timerWheel->schedule(delayMs, [socket, expiredTimers, timer]() {
+            expiredTimers->fetch_or(timer);
+            if (auto s = socket.lock())
+            {
+                s->wakeUpFromPoll(Socket::kTimerRequest);
+            }
+        });
     }
 
-    WebSocketTransport::PollResult WebSocketTransport::poll()
+    void WebSocketTransport::cancelTimer(std::atomic<TimerWheel::TimerId>& timerId)
     {
-        if (_readyState == ReadyState::OPEN)
+        TimerWheel::TimerId id = timerId.exchange(0);
+        if (id != 0) _timerWheel->cancel(id);
+    }
+
+    void WebSocketTransport::handleExpiredTimers()
+    {
+        uint64_t expiredTimers = _expiredTimers->exchange(0);
+
+        if ((expiredTimers & kHeartBeatTimer) && _readyState == ReadyState::OPEN &&
+            _pingIntervalSecs > 0)
         {
-            if (pingIntervalExceeded())
+            // Only consider send PING time points for that computation
+            int64_t pingIntervalMs = (int64_t) _pingIntervalSecs * 1000;
+            int64_t elapsedMs = getMonotonicMs() - _lastSendPingTimeMs;
+
+            if (elapsedMs < pingIntervalMs)
             {
-                if (!_pongReceived)
-                {
-                    // ping response (PONG) exceeds the maximum delay, close the connection
-                    close(WebSocketCloseConstants::kInternalErrorCode,
-                          WebSocketCloseConstants::kPingTimeoutMessage);
-                }
-                else
-                {
-                    sendHeartBeat();
-                }
+                _heartBeatTimerId =
+                    scheduleTimer(kHeartBeatTimer, (int) (pingIntervalMs - elapsedMs));
+            }
+            else if (!_pongReceived)
+            {
+                // ping response (PONG) exceeds the maximum delay, close the connection
+                close(WebSocketCloseConstants::kInternalErrorCode,
+                      WebSocketCloseConstants::kPingTimeoutMessage);
+            }
+            else
+            {
+                sendHeartBeat();
+                _heartBeatTimerId = scheduleTimer(kHeartBeatTimer, (int) pingIntervalMs);
             }
         }
 
-        // No timeout if state is not OPEN, otherwise computed
-        // pingIntervalOrTimeoutGCD (equals to -1 if no ping and no ping timeout are set)
-        int lastingTimeoutDelayInMs =
-            (_readyState != ReadyState::OPEN) ? 0 : _pingIntervalSecs;
+        if ((expiredTimers & kIdleTimer) && _readyState == ReadyState::OPEN &&
+            _idleTimeoutSecs > 0)
+        {
+            int64_t idleTimeoutMs = (int64_t) _idleTimeoutSecs * 1000;
+            int64_t elapsedMs = getMonotonicMs() - _lastActivityMs;
+
+            if (elapsedMs < idleTimeoutMs)
+            {
+                _idleTimerId = scheduleTimer(kIdleTimer, (int) (idleTimeoutMs - elapsedMs));
+            }
+            else
+            {
+                _idleDisconnects++;
+                close(WebSocketCloseConstants::kGoingAwayCode,
+                      WebSocketCloseConstants::kIdleTimeoutMessage);
+            }
+        }
 
-        if (_pingIntervalSecs > 0)
+        // after calling close(), if no CLOSE frame answer is received back from the remote, we
+        // should close the connexion
+        if ((expiredTimers & kCloseTimer) && _readyState == ReadyState::CLOSING)
         {
-            // compute lasting delay to wait for next ping / timeout, if at least one set
-            auto now = std::chrono::steady_clock::now();
-            lastingTimeoutDelayInMs =
-                (int) std::chrono::duration_cast<std::chrono::milliseconds>(now - _lastSendPingTimePoint)
-                    .count();
+            _rxbuf.clear();
+            // close code and reason were set when calling close()
+            closeSocket();
+            setReadyState(ReadyState::CLOSED);
         }
+    }
+
+    WebSocketTransport::PollResult WebSocketTransport::poll()
+    {
+        _pollThreadId = std::this_thread::get_id();
+
+        // Heartbeats and the close handshake deadline are timers which wake up
+        // poll when they expire, so poll does not need a timeout
+        int lastingTimeoutDelayInMs = -1;
 
 #ifdef _WIN32
         // Windows does not have select interrupt capabilities, so wait with a small timeout
@@ -278,24 +610,73 @@ namespace ix
             lastingTimeoutDelayInMs = 100;
         }
 
-        // poll the socket
-        PollResultType pollResult = _socket->isReadyToRead(lastingTimeoutDelayInMs);
+        // Wake up when the write coalescing window of held data closes
+        int writeCoalescingDelayMs = getWriteCoalescingDelayMs();
+        if (writeCoalescingDelayMs >= 0 &&
+            (lastingTimeoutDelayInMs < 0 || lastingTimeoutDelayInMs > writeCoalescingDelayMs))
+        {
+            lastingTimeoutDelayInMs = writeCoalescingDelayMs;
+        }
+
+        // Wake up when the connection has been idle for the hibernation timeout
+        int64_t hibernationTimeoutMs = (int64_t) _hibernationTimeoutSecs * 1000;
+        if (hibernationTimeoutMs > 0)
+        {
+            int64_t remainingMs = _lastPollEventMs + hibernationTimeoutMs - getMonotonicMs();
+            remainingMs = std::max(remainingMs, (int64_t) 0);
+            if (lastingTimeoutDelayInMs < 0 || lastingTimeoutDelayInMs > remainingMs)
+            {
+                lastingTimeoutDelayInMs = (int) remainingMs;
+            }
+        }
+
+        // poll the socket. When data is waiting to be sent, also wait for the
+        // socket to be writable, so that the send buffer is drained from this
+        // thread without blocking reads.
+        bool waitForWrite = !isSendBufferEmpty() && writeCoalescingDelayMs <= 0;
+        PollResultType pollResult = waitForWrite
+                                        ? _socket->isReadyToReadOrWrite(lastingTimeoutDelayInMs)
+                                        : _socket->isReadyToRead(lastingTimeoutDelayInMs);
+
+        bool idle = false;
+        if (hibernationTimeoutMs > 0)
+        {
+            int64_t now = getMonotonicMs();
+            if (pollResult != PollResultType::Timeout || writeCoalescingDelayMs >= 0)
+            {
+                _lastPollEventMs = now;
+            }
+            else
+            {
+                idle = now - _lastPollEventMs >= hibernationTimeoutMs;
+            }
+        }
 
-        // Make sure we send all the buffered data
+        // Send as much of the buffered data as the socket accepts
         // there can be a lot of it for large messages.
-        if (pollResult == PollResultType::SendRequest)
+        if (pollResult == PollResultType::SendRequest ||
+            pollResult == PollResultType::ReadyForWrite ||
+            (pollResult == PollResultType::Timeout && writeCoalescingDelayMs >= 0))
         {
-            if (!flushSendBuffer())
+            if (!sendOnSocket())
             {
                 return PollResult::CannotFlushSendBuffer;
             }
         }
-        else if (pollResult == PollResultType::ReadyForRead)
+        else if (pollResult == PollResultType::ReadyForRead ||
+                 pollResult == PollResultType::ReadyForReadAndWrite)
         {
             if (!receiveFromSocket())
             {
                 return PollResult::AbnormalClose;
             }
+
+            // A peer which keeps sending must not starve the send buffer
+            if (pollResult == PollResultType::ReadyForReadAndWrite &&
+                _readyState != ReadyState::CLOSED && !sendOnSocket())
+            {
+                return PollResult::CannotFlushSendBuffer;
+            }
         }
         else if (pollResult == PollResultType::Error)
         {
@@ -303,43 +684,352 @@ namespace ix
         }
         else if (pollResult == PollResultType::CloseRequest)
         {
-            closeSocket();
+            closeSocket();
+        }
+
+        handleExpiredTimers();
+
+        if (idle && canHibernate())
+        {
+            _hibernationRequested = true;
+        }
+
+        return PollResult::Succeeded;
+    }
+
+    bool WebSocketTransport::isSendBufferEmpty() const
+    {
+        return _bufferedAmount == 0;
+    }
+
+    bool WebSocketTransport::isControlBufferEmpty() const
+    {
+        return _bufferedControlAmount == 0;
+    }
+
+    bool WebSocketTransport::waitForSendBuffer(size_t size)
+    {
+        // The connection thread drains the buffer, it never waits for it. Nor
+        // do offload workers, the senders waited before offloading.
+        size_t maxBufferedAmount = _maxBufferedAmount;
+        if (_sendBufferPolicy != SendBufferPolicy::Block || maxBufferedAmount == 0 ||
+            _bufferedAmount + size <= maxBufferedAmount ||
+            std::this_thread::get_id() == _pollThreadId ||
+            std::this_thread::get_id() == _offloadQueue->thread)
+        {
+            return true;
+        }
+
+        // A message larger than the limit still goes through once the buffer is empty
+        std::unique_lock<std::mutex> lock(_txbufMutex);
+        _txbufCondition.wait(lock, [this, size] {
+            return _bufferedAmount == 0 || _maxBufferedAmount == 0 ||
+                   _bufferedAmount + size <= _maxBufferedAmount || _closeRequested ||
+                   (_readyState != ReadyState::OPEN && _readyState != ReadyState::CLOSING);
+        });
+
+        return !_closeRequested &&
+               (_readyState == ReadyState::OPEN || _readyState == ReadyState::CLOSING);
+    }
+
+    bool WebSocketTransport::dropBeforeCompressing(size_t size)
+    {
+        // With the compression context kept, the peer inflates each message with
+        // the ones before it. Compressed messages are never dropped, the drop newest
+        // policy is applied before compressing, based on the uncompressed size.
+        size_t maxBufferedAmount = _maxBufferedAmount;
+        if (_sendBufferPolicy != SendBufferPolicy::DropNewest || maxBufferedAmount == 0 ||
+            _bufferedAmount + size <= maxBufferedAmount ||
+            !_perMessageDeflate.keepsCompressionContext())
+        {
+            return false;
+        }
+
+        _droppedMessages++;
+        return true;
+    }
+
+    bool WebSocketTransport::reserveSendBuffer(size_t size, bool compress)
+    {
+        // The policy is applied before compressing or offloading the message,
+        // nothing waits holding the compression lock or on a shared worker
+        if (compress && dropBeforeCompressing(size)) return false;
+        if (!compress && _compressionOffloadMinSize == 0) return true;
+
+        return waitForSendBuffer(size);
+    }
+
+    bool WebSocketTransport::enqueueMessage(OutgoingMessage&& message, bool mayBlock)
+    {
+        size_t size = message.frames.size();
+
+        // Control frames are small and always queued, limits only apply to data messages
+        if (!message.control)
+        {
+            if (_closeRequested)
+            {
+                if (message.onSendCompleteCallback) message.onSendCompleteCallback(false);
+                return false;
+            }
+
+            size_t maxBufferedAmount = _maxBufferedAmount;
+            if (maxBufferedAmount != 0 && _bufferedAmount + size > maxBufferedAmount)
+            {
+                switch (_sendBufferPolicy)
+                {
+                    case SendBufferPolicy::Block:
+                    {
+                        // Compressed messages waited before taking the compression
+                        // lock, which the connection thread may need to drain the
+                        // buffer. They can go over the limit by what raced them.
+                        if (mayBlock && !waitForSendBuffer(size))
+                        {
+                            auto&& callback = message.onSendCompleteCallback;
+                            if (callback) callback(false);
+                            return false;
+                        }
+                    }
+                    break;
+
+                    case SendBufferPolicy::DropNewest:
+                    {
+                        // Compressed messages which others depend on were checked
+                        // before compression, they can go over the limit.
+                        if (!message.droppable) break;
+
+                        _droppedMessages++;
+                        if (message.onSendCompleteCallback) message.onSendCompleteCallback(false);
+                        return false;
+                    }
+
+                    case SendBufferPolicy::DropOldest:
+                    {
+                        // The thread flushing the send buffer makes room
+                    }
+                    break;
+
+                    case SendBufferPolicy::Disconnect:
+                    {
+                        // The callback is last, it may destroy the transport
+                        _droppedMessages++;
+                        close(WebSocketCloseConstants::kPolicyViolationCode,
+                              WebSocketCloseConstants::kSendBufferFullMessage);
+                        if (message.onSendCompleteCallback) message.onSendCompleteCallback(false);
+                        return false;
+                    }
+                }
+            }
+        }
+        else if (message.close)
+        {
+            _closeRequested = true;
+        }
+
+        bool control = message.control;
+        size_t bufferedAmount = _bufferedAmount.fetch_add(size) + size;
+        if (control) _bufferedControlAmount += size;
+
+        if (!control) message.queuedTime = std::chrono::steady_clock::now();
+
+        IX_TRACE3(send_enqueued, this, size, control);
+        _sendQueue.push(std::move(message));
+
+        // The connection closed while we were queueing, after its send buffer was
+        // cleared. Fail the message now rather than leave it in the queue.
+        if (_readyState == ReadyState::CLOSED)
+        {
+            clearSendBuffer();
+            return false;
+        }
+
+        size_t highWatermark = _highWatermark;
+        if (!control && highWatermark != 0 && bufferedAmount >= highWatermark &&
+            !_aboveHighWatermark.exchange(true))
+        {
+            invokeSendBufferWatermarkCallback(true, bufferedAmount);
+        }
+
+        return true;
+    }
+
+    void WebSocketTransport::drainSendQueue(std::vector<OnSendCompleteCallback>& failed)
+    {
+        OutgoingMessage message;
+        while (_sendQueue.pop(message))
+        {
+            size_t size = message.frames.size();
+
+            if (_closeFrameQueued)
+            {
+                // Nothing is sent after a close frame
+                _bufferedAmount -= size;
+                if (message.control) _bufferedControlAmount -= size;
+                if (message.onSendCompleteCallback)
+                {
+                    failed.push_back(std::move(message.onSendCompleteCallback));
+                }
+            }
+            else if (message.control)
+            {
+                // The close frame follows the data queued before it
+                std::vector<uint8_t>& buffer =
+                    (message.close && !_txbuf.empty()) ? _closeFrame : _controlBuf;
+                if (message.close) _closeFrameQueued = true;
+
+                buffer.insert(buffer.end(), message.frames.begin(), message.frames.end());
+                addToCounter(_framesSent, message.frameEnds.size());
+            }
+            else
+            {
+                uint64_t begin = _txbufAppendedBytes;
+                _txbufAppendedBytes += size;
+
+                for (auto&& frameEnd : message.frameEnds)
+                {
+                    _frameBoundaries.push_back(begin + frameEnd);
+                }
+
+                if (_txbuf.empty())
+                {
+                    _txbuf.swap(message.frames);
+                }
+                else
+                {
+                    _txbuf.insert(_txbuf.end(), message.frames.begin(), message.frames.end());
+                }
+
+                QueuedMessage queuedMessage;
+                queuedMessage.begin = begin;
+                queuedMessage.end = _txbufAppendedBytes;
+                queuedMessage.onSendCompleteCallback = std::move(message.onSendCompleteCallback);
+                queuedMessage.queuedTime = message.queuedTime;
+                queuedMessage.messages = message.messages;
+                queuedMessage.frames = message.frameEnds.size();
+                queuedMessage.payloadSize = message.payloadSize;
+                queuedMessage.droppable = message.droppable;
+                _queuedMessages.push_back(std::move(queuedMessage));
+            }
+        }
+    }
+
+    bool WebSocketTransport::dropOldestMessages(std::vector<OnSendCompleteCallback>& dropped)
+    {
+        // Messages are dropped whole, so the one being written stays.
+        // The messages to drop are picked first, then the send buffer, the
+        // frame boundaries and the queued messages are each compacted once.
+        uint64_t excess = _bufferedAmount - _maxBufferedAmount;
+        uint64_t droppedBytes = 0;
+        bool kept = false;
+        std::vector<std::pair<uint64_t, uint64_t>> ranges;
+
+        size_t count = 0;
+        for (size_t i = 0; i < _queuedMessages.size(); ++i)
+        {
+            QueuedMessage& queuedMessage = _queuedMessages[i];
+            bool started = queuedMessage.begin < _txbufSentBytes;
+            if (droppedBytes < excess && !started && queuedMessage.droppable)
+            {
+                droppedBytes += queuedMessage.end - queuedMessage.begin;
+                ranges.emplace_back(queuedMessage.begin, queuedMessage.end);
+                dropped.push_back(std::move(queuedMessage.onSendCompleteCallback));
+                continue;
+            }
+
+            kept = kept || (droppedBytes < excess && !queuedMessage.droppable);
+            queuedMessage.begin -= droppedBytes;
+            queuedMessage.end -= droppedBytes;
+            if (count != i) _queuedMessages[count] = std::move(queuedMessage);
+            ++count;
         }
+        _queuedMessages.resize(count);
 
-        if (_readyState == ReadyState::CLOSING && closingDelayExceeded())
+        if (!ranges.empty())
         {
-            _rxbuf.clear();
-            // close code and reason were set when calling close()
-            closeSocket();
-            setReadyState(ReadyState::CLOSED);
+            // Move the data kept between the dropped messages back
+            auto out = _txbuf.begin() + (size_t) (ranges.front().first - _txbufSentBytes);
+            for (size_t i = 0; i < ranges.size(); ++i)
+            {
+                uint64_t end =
+                    (i + 1 < ranges.size()) ? ranges[i + 1].first : _txbufAppendedBytes;
+                auto first = _txbuf.begin() + (size_t) (ranges[i].second - _txbufSentBytes);
+                auto last = _txbuf.begin() + (size_t) (end - _txbufSentBytes);
+                out = std::move(first, last, out);
+            }
+            _txbuf.erase(out, _txbuf.end());
+
+            // Boundaries of the dropped frames go, the others move back
+            uint64_t shift = 0;
+            size_t range = 0;
+            count = 0;
+            for (auto&& frameBoundary : _frameBoundaries)
+            {
+                while (range < ranges.size() && frameBoundary > ranges[range].second)
+                {
+                    shift += ranges[range].second - ranges[range].first;
+                    ++range;
+                }
+                if (range < ranges.size() && frameBoundary > ranges[range].first) continue;
+
+                _frameBoundaries[count++] = frameBoundary - shift;
+            }
+            _frameBoundaries.resize(count);
+
+            _txbufAppendedBytes -= droppedBytes;
+            _bufferedAmount -= (size_t) droppedBytes;
         }
 
-        return PollResult::Succeeded;
+        // Whether messages which cannot be dropped keep the buffer full
+        return kept && _bufferedAmount > _maxBufferedAmount;
     }
 
-    bool WebSocketTransport::isSendBufferEmpty() const
+    void WebSocketTransport::clearSendBuffer()
     {
-        std::lock_guard<std::mutex> lock(_txbufMutex);
-        return _txbuf.empty();
+        // Data left in the send buffer when the connection closes is lost
+        std::vector<OnSendCompleteCallback> failed;
+        {
+            std::lock_guard<std::mutex> lock(_txbufMutex);
+            drainSendQueue(failed);
+
+            for (auto&& queuedMessage : _queuedMessages)
+            {
+                failed.push_back(std::move(queuedMessage.onSendCompleteCallback));
+            }
+            _queuedMessages.clear();
+
+            _bufferedAmount -= _txbuf.size() + _controlBuf.size() + _closeFrame.size();
+            _bufferedControlAmount -= _controlBuf.size() + _closeFrame.size();
+            _txbuf.clear();
+            _txbufSentBytes = _txbufAppendedBytes;
+            _controlBuf.clear();
+            _closeFrame.clear();
+            _frameBoundaries.clear();
+            _txbufAtFrameBoundary = true;
+            _closeFrameQueued = false;
+            _closeRequested = false;
+            _aboveHighWatermark = false;
+            _writeCoalescingPending = false;
+            _socketWouldBlock = false;
+        }
+        _txbufCondition.notify_all();
+
+        for (auto&& callback : failed)
+        {
+            if (callback) callback(false);
+        }
     }
 
-    void WebSocketTransport::appendToSendBuffer(const std::vector<uint8_t>& header,
-                                                std::string::const_iterator begin,
-                                                std::string::const_iterator end,
-                                                uint64_t message_size,
-                                                uint8_t masking_key[4])
+    void WebSocketTransport::invokeSendBufferWatermarkCallback(bool aboveHighWatermark,
+                                                               size_t bufferedAmount)
     {
-        std::lock_guard<std::mutex> lock(_txbufMutex);
-
-        _txbuf.insert(_txbuf.end(), header.begin(), header.end());
-        _txbuf.insert(_txbuf.end(), begin, end);
+        OnSendBufferWatermarkCallback callback;
+        {
+            std::lock_guard<std::mutex> lock(_onSendBufferWatermarkCallbackMutex);
+            callback = _onSendBufferWatermarkCallback;
+        }
 
-        if (_useMask)
+        if (callback)
         {
-            for (size_t i = 0; i != (size_t) message_size; ++i)
-            {
-                *(_txbuf.end() - (size_t) message_size + i) ^= masking_key[i & 0x3];
-            }
+            callback(aboveHighWatermark, bufferedAmount);
         }
     }
 
@@ -347,10 +1037,7 @@ namespace ix
     {
         if (ws.mask)
         {
-            for (size_t j = 0; j != ws.N; ++j)
-            {
-                _rxbuf[j + ws.header_size] ^= ws.masking_key[j & 0x3];
-            }
+            applyWebSocketMask(_rxbuf.data() + ws.header_size, (size_t) ws.N, ws.masking_key);
         }
     }
 
@@ -477,6 +1164,10 @@ namespace ix
                 return;
             }
 
+            addToCounter(_framesReceived, 1);
+            if (ws.opcode == wsheader_type::CONTINUATION) addToCounter(_fragmentsReceived, 1);
+            IX_TRACE4(frame_received, this, (int) ws.opcode, ws.N, ws.fin);
+
             unmaskReceiveBuffer(ws);
             std::string frameData(_rxbuf.begin() + ws.header_size,
                                   _rxbuf.begin() + ws.header_size + (size_t) ws.N);
@@ -509,6 +1200,8 @@ namespace ix
                         WebSocketCloseConstants::kProtocolErrorCodeContinuationOpCodeOutOfSequence);
                 }
 
+                if (_idleTimeoutSecs > 0) _lastActivityMs = getMonotonicMs();
+
                 //
                 // Usual case. Small unfragmented messages
                 //
@@ -568,7 +1261,16 @@ namespace ix
             }
             else if (ws.opcode == wsheader_type::PONG)
             {
+                // Unsolicited pongs, and the pongs of older pings, are not timed
+                int64_t pingSentTimeUs = _pingSentTimeUs.exchange(0);
+                if (pingSentTimeUs != 0)
+                {
+                    _pingRtt.record((uint64_t) std::max(getMonotonicUs() - pingSentTimeUs,
+                                                        (int64_t) 0));
+                }
+
                 _pongReceived = true;
+                if (_idleTimeoutSecs > 0) _lastActivityMs = getMonotonicMs();
                 emitMessage(MessageKind::PONG, frameData, false, onMessageCallback);
             }
             else if (ws.opcode == wsheader_type::CLOSE)
@@ -658,6 +1360,9 @@ namespace ix
             _rxbuf.erase(_rxbuf.begin(), _rxbuf.begin() + ws.header_size + (size_t) ws.N);
         }
 
+        // Do not keep the memory of the last messages while waiting for the next ones
+        if (_rxbuf.empty()) std::vector<uint8_t>().swap(_rxbuf);
+
         // if an abnormal closure was raised in poll, and nothing else triggered a CLOSED state in
         // the received and processed data then close the connection
         if (pollResult != PollResult::Succeeded)
@@ -707,25 +1412,50 @@ namespace ix
                                          const OnMessageCallback& onMessageCallback)
     {
         size_t wireSize = message.size();
+        bool dataMessage =
+            messageKind == MessageKind::MSG_TEXT || messageKind == MessageKind::MSG_BINARY;
 
         // When the RSV1 bit is 1 it means the message is compressed
         if (compressedMessage && messageKind != MessageKind::FRAGMENT)
         {
-            std::string decompressedMessage;
-            bool success = _perMessageDeflate.decompress(message, decompressedMessage);
+            _decompressedMessage.clear();
+
+            auto start = std::chrono::steady_clock::now();
+            bool success = _perMessageDeflate.decompress(message, _decompressedMessage);
+            addToCounter(_decompressionTimeUs,
+                         getElapsedUs(start, std::chrono::steady_clock::now()));
+
+            if (dataMessage)
+            {
+                addToCounter(_messagesReceived, 1);
+                addToCounter(_bytesReceived, _decompressedMessage.size());
+            }
 
-            if (messageKind == MessageKind::MSG_TEXT && !validateUtf8(decompressedMessage))
+            if (messageKind == MessageKind::MSG_TEXT && !validateUtf8(_decompressedMessage))
             {
                 close(WebSocketCloseConstants::kInvalidFramePayloadData,
                       WebSocketCloseConstants::kInvalidFramePayloadDataMessage);
             }
             else
             {
-                onMessageCallback(decompressedMessage, wireSize, !success, messageKind);
+                IX_TRACE3(message_emitted, this, (int) messageKind, _decompressedMessage.size());
+                onMessageCallback(_decompressedMessage, wireSize, !success, messageKind);
+            }
+
+            // Do not keep a large buffer around for a connection which went quiet
+            if (_decompressedMessage.capacity() > kChunkSize)
+            {
+                std::string().swap(_decompressedMessage);
             }
         }
         else
         {
+            if (dataMessage)
+            {
+                addToCounter(_messagesReceived, 1);
+                addToCounter(_bytesReceived, message.size());
+            }
+
             if (messageKind == MessageKind::MSG_TEXT && !validateUtf8(message))
             {
                 close(WebSocketCloseConstants::kInvalidFramePayloadData,
@@ -733,6 +1463,7 @@ namespace ix
             }
             else
             {
+                IX_TRACE3(message_emitted, this, (int) messageKind, message.size());
                 onMessageCallback(message, wireSize, false, messageKind);
             }
         }
@@ -746,16 +1477,45 @@ namespace ix
         return static_cast<unsigned>(seconds);
     }
 
-    WebSocketSendInfo WebSocketTransport::sendData(wsheader_type::opcode_type type,
-                                                   const std::string& message,
-                                                   bool compress,
-                                                   const OnProgressCallback& onProgressCallback)
+    bool WebSocketTransport::shouldCompress(size_t size, bool compress) const
+    {
+        // Tiny messages are not worth a deflate call, and often get bigger
+        return compress && _enablePerMessageDeflate &&
+               size >= _perMessageDeflateOptions.getMinCompressionSize();
+    }
+
+    WebSocketSendInfo WebSocketTransport::sendData(
+        wsheader_type::opcode_type type,
+        const std::string& message,
+        bool compress,
+        const OnProgressCallback& onProgressCallback,
+        const OnSendCompleteCallback& onSendCompleteCallback,
+        bool offloaded)
     {
         if (_readyState != ReadyState::OPEN && _readyState != ReadyState::CLOSING)
         {
+            if (onSendCompleteCallback) onSendCompleteCallback(false);
+            return WebSocketSendInfo(false);
+        }
+
+        bool data = type == wsheader_type::TEXT_FRAME || type == wsheader_type::BINARY_FRAME;
+        if (data && !offloaded && !reserveSendBuffer(message.size(), compress))
+        {
+            if (onSendCompleteCallback) onSendCompleteCallback(false);
             return WebSocketSendInfo(false);
         }
 
+        if (data && !offloaded &&
+            offloadSend(message.size(), compress, [=]() {
+                sendData(
+                    type, message, compress, onProgressCallback, onSendCompleteCallback, true);
+            }))
+        {
+            bool success = true;
+            bool compressionError = false;
+            return WebSocketSendInfo(success, compressionError, message.size(), 0);
+        }
+
         size_t payloadSize = message.size();
         size_t wireSize = message.size();
         std::string compressedMessage;
@@ -764,14 +1524,25 @@ namespace ix
         std::string::const_iterator message_begin = message.begin();
         std::string::const_iterator message_end = message.end();
 
+        // Held until the message is queued, uncompressed messages do not need it
+        std::unique_lock<std::mutex> compressionLock(_compressionMutex, std::defer_lock);
+
         if (compress)
         {
-            if (!_perMessageDeflate.compress(message, compressedMessage))
+            compressionLock.lock();
+
+            auto start = std::chrono::steady_clock::now();
+            bool compressed = _perMessageDeflate.compress(message, compressedMessage);
+            addToCounter(_compressionTimeUs,
+                         getElapsedUs(start, std::chrono::steady_clock::now()));
+
+            if (!compressed)
             {
                 bool success = false;
                 compressionError = true;
                 payloadSize = 0;
                 wireSize = 0;
+                if (onSendCompleteCallback) onSendCompleteCallback(false);
                 return WebSocketSendInfo(success, compressionError, payloadSize, wireSize);
             }
             compressionError = false;
@@ -781,86 +1552,269 @@ namespace ix
             message_end = compressedMessage.end();
         }
 
+        // All the frames of a message are encoded first and queued at once,
+        // so that messages sent from different threads never interleave.
+        OutgoingMessage outgoingMessage;
+        outgoingMessage.frames.reserve(wireSize + 14 * (wireSize / kChunkSize + 1));
+
+        if (!encodeMessage(outgoingMessage,
+                           type,
+                           message_begin,
+                           message_end,
+                           compress,
+                           onProgressCallback))
         {
-            std::lock_guard<std::mutex> lock(_txbufMutex);
-            _txbuf.reserve(wireSize);
+            // A cancelled message is never queued
+            if (onSendCompleteCallback) onSendCompleteCallback(false);
+            return WebSocketSendInfo(false);
         }
 
-        bool success = true;
+        // Control frames are written ahead of pending data frames
+        outgoingMessage.control = type == wsheader_type::PING || type == wsheader_type::PONG ||
+                                  type == wsheader_type::CLOSE;
+        outgoingMessage.close = type == wsheader_type::CLOSE;
+        outgoingMessage.onSendCompleteCallback = onSendCompleteCallback;
+        outgoingMessage.messages = outgoingMessage.control ? 0 : 1;
+        outgoingMessage.payloadSize = outgoingMessage.control ? 0 : message.size();
+        outgoingMessage.droppable = !compress || !_perMessageDeflate.keepsCompressionContext();
 
-        // Common case for most message. No fragmentation required.
-        if (wireSize < kChunkSize)
+        // Workers do not wait for the message to be written
+        bool blocking = _blockingSend && !offloaded;
+        bool success = queueMessage(std::move(outgoingMessage), compressionLock, blocking);
+
+        return WebSocketSendInfo(success, compressionError, payloadSize, wireSize);
+    }
+
+    WebSocketSendInfo WebSocketTransport::sendBatch(
+        const std::vector<WebSocketBatchMessage>& messages,
+        const OnSendCompleteCallback& onSendCompleteCallback)
+    {
+        return sendBatchMessages(messages, onSendCompleteCallback, false);
+    }
+
+    WebSocketSendInfo WebSocketTransport::sendBatchMessages(
+        const std::vector<WebSocketBatchMessage>& messages,
+        const OnSendCompleteCallback& onSendCompleteCallback,
+        bool offloaded)
+    {
+        if (_readyState != ReadyState::OPEN && _readyState != ReadyState::CLOSING)
         {
-            success = sendFragment(type, true, message_begin, message_end, compress);
+            if (onSendCompleteCallback) onSendCompleteCallback(false);
+            return WebSocketSendInfo(false);
         }
-        else
+
+        bool compress = false;
+        size_t payloadSize = 0;
+        size_t wireSize = 0;
+        size_t compressedSize = 0;
+        for (auto&& message : messages)
         {
-            //
-            // Large messages need to be fragmented
-            //
-            // Rules:
-            // First message needs to specify a proper type (BINARY or TEXT)
-            // Intermediary and last messages need to be of type CONTINUATION
-            // Last message must set the fin byte.
-            //
-            auto steps = wireSize / kChunkSize;
+            payloadSize += message.data.size();
+            if (shouldCompress(message.data.size(), message.compress))
+            {
+                compress = true;
+                compressedSize += message.data.size();
+            }
+        }
 
-            std::string::const_iterator begin = message_begin;
-            std::string::const_iterator end = message_end;
+        if (!offloaded && !reserveSendBuffer(payloadSize, compress))
+        {
+            if (onSendCompleteCallback) onSendCompleteCallback(false);
+            return WebSocketSendInfo(false);
+        }
 
-            for (uint64_t i = 0; i < steps; ++i)
-            {
-                bool firstStep = i == 0;
-                bool lastStep = (i + 1) == steps;
-                bool fin = lastStep;
+        // The batch is offloaded as a whole, based on how much of it is compressed
+        if (!offloaded && offloadSend(compressedSize, compress, [=]() {
+                sendBatchMessages(messages, onSendCompleteCallback, true);
+            }))
+        {
+            bool success = true;
+            bool compressionError = false;
+            return WebSocketSendInfo(success, compressionError, payloadSize, 0);
+        }
 
-                end = begin + kChunkSize;
-                if (lastStep)
-                {
-                    end = message_end;
-                }
+        OutgoingMessage outgoingMessage;
+        outgoingMessage.control = false;
+        outgoingMessage.close = false;
+        outgoingMessage.onSendCompleteCallback = onSendCompleteCallback;
+        outgoingMessage.messages = messages.size();
+        outgoingMessage.payloadSize = payloadSize;
+        outgoingMessage.droppable = !compress || !_perMessageDeflate.keepsCompressionContext();
+        if (!compress)
+        {
+            outgoingMessage.frames.reserve(payloadSize + 14 * messages.size());
+        }
 
-                auto opcodeType = type;
-                if (!firstStep)
-                {
-                    opcodeType = wsheader_type::CONTINUATION;
-                }
+        // The messages are compressed one after the other with a single lock
+        // acquisition, and all their frames go into one buffer which is queued
+        // and written to the socket at once.
+        std::unique_lock<std::mutex> compressionLock(_compressionMutex, std::defer_lock);
+        if (compress)
+        {
+            compressionLock.lock();
+        }
 
-                // Send message
-                if (!sendFragment(opcodeType, fin, begin, end, compress))
-                {
-                    return WebSocketSendInfo(false);
-                }
+        std::string compressedMessage;
+
+        for (auto&& message : messages)
+        {
+            auto type = (message.binary) ? wsheader_type::BINARY_FRAME : wsheader_type::TEXT_FRAME;
+            std::string::const_iterator message_begin = message.data.begin();
+            std::string::const_iterator message_end = message.data.end();
+            bool compressMessage = shouldCompress(message.data.size(), message.compress);
 
-                if (onProgressCallback && !onProgressCallback((int) i, (int) steps))
+            if (compressMessage)
+            {
+                compressedMessage.clear();
+
+                auto start = std::chrono::steady_clock::now();
+                bool compressed = _perMessageDeflate.compress(message.data, compressedMessage);
+                addToCounter(_compressionTimeUs,
+                             getElapsedUs(start, std::chrono::steady_clock::now()));
+
+                if (!compressed)
                 {
-                    break;
+                    // The deflate context holds messages of the batch which never
+                    // reach the peer, whose inflater could not follow any more
+                    if (_perMessageDeflate.keepsCompressionContext())
+                    {
+                        compressionLock.unlock();
+                        close(WebSocketCloseConstants::kInternalErrorCode,
+                              WebSocketCloseConstants::kInternalErrorMessage);
+                    }
+
+                    bool success = false;
+                    bool compressionError = true;
+                    if (onSendCompleteCallback) onSendCompleteCallback(false);
+                    return WebSocketSendInfo(success, compressionError);
                 }
 
-                begin += kChunkSize;
+                message_begin = compressedMessage.begin();
+                message_end = compressedMessage.end();
             }
+
+            wireSize += message_end - message_begin;
+            encodeMessage(
+                outgoingMessage, type, message_begin, message_end, compressMessage, nullptr);
         }
 
-        // Request to flush the send buffer on the background thread if it isn't empty
-        if (!isSendBufferEmpty())
+        bool blocking = _blockingSend && !offloaded;
+        bool success = queueMessage(std::move(outgoingMessage), compressionLock, blocking);
+
+        bool compressionError = false;
+        return WebSocketSendInfo(success, compressionError, payloadSize, wireSize);
+    }
+
+    bool WebSocketTransport::encodeMessage(OutgoingMessage& outgoingMessage,
+                                           wsheader_type::opcode_type type,
+                                           std::string::const_iterator message_begin,
+                                           std::string::const_iterator message_end,
+                                           bool compress,
+                                           const OnProgressCallback& onProgressCallback)
+    {
+        std::vector<uint8_t>& frames = outgoingMessage.frames;
+        std::vector<size_t>& frameEnds = outgoingMessage.frameEnds;
+        size_t wireSize = message_end - message_begin;
+
+        // Common case for most message. No fragmentation required.
+        if (wireSize < kChunkSize)
         {
-            _socket->wakeUpFromPoll(Socket::kSendRequest);
+            encodeFragment(frames, type, true, message_begin, message_end, compress);
+            frameEnds.push_back(frames.size());
+            return true;
+        }
 
-            // FIXME: we should have a timeout when sending large messages: see #131
-            if (_blockingSend && !flushSendBuffer())
+        //
+        // Large messages need to be fragmented
+        //
+        // Rules:
+        // First message needs to specify a proper type (BINARY or TEXT)
+        // Intermediary and last messages need to be of type CONTINUATION
+        // Last message must set the fin byte.
+        //
+        auto steps = wireSize / kChunkSize;
+
+        std::string::const_iterator begin = message_begin;
+        std::string::const_iterator end = message_end;
+
+        for (uint64_t i = 0; i < steps; ++i)
+        {
+            bool firstStep = i == 0;
+            bool lastStep = (i + 1) == steps;
+            bool fin = lastStep;
+
+            end = begin + kChunkSize;
+            if (lastStep)
+            {
+                end = message_end;
+            }
+
+            auto opcodeType = type;
+            if (!firstStep)
+            {
+                opcodeType = wsheader_type::CONTINUATION;
+            }
+
+            encodeFragment(frames, opcodeType, fin, begin, end, compress);
+            frameEnds.push_back(frames.size());
+
+            if (onProgressCallback && !onProgressCallback((int) i, (int) steps))
             {
-                success = false;
+                return false;
             }
+
+            begin += kChunkSize;
         }
 
-        return WebSocketSendInfo(success, compressionError, payloadSize, wireSize);
+        return true;
+    }
+
+    bool WebSocketTransport::queueMessage(OutgoingMessage&& outgoingMessage,
+                                          std::unique_lock<std::mutex>& compressionLock,
+                                          bool blocking)
+    {
+        bool control = outgoingMessage.control;
+
+        if (!enqueueMessage(std::move(outgoingMessage), !compressionLock.owns_lock()))
+        {
+            return false;
+        }
+
+        if (compressionLock.owns_lock())
+        {
+            compressionLock.unlock();
+        }
+
+        bool success = true;
+
+        if (blocking)
+        {
+            // Wait until the message is written, helping the connection thread
+            // FIXME: we should have a timeout when sending large messages: see #131
+            bool flush = true;
+            success = sendOnSocket(flush) && flushSendBuffer(control);
+        }
+        else if (std::this_thread::get_id() == _pollThreadId)
+        {
+            // Sending from the connection thread itself, e.g. from a message callback
+            success = sendOnSocket();
+        }
+
+        // Request to flush the send buffer on the background thread if it isn't empty
+        if (success && !isSendBufferEmpty())
+        {
+            _socket->wakeUpFromPoll(Socket::kSendRequest);
+        }
+
+        return success;
     }
 
-    bool WebSocketTransport::sendFragment(wsheader_type::opcode_type type,
-                                          bool fin,
-                                          std::string::const_iterator message_begin,
-                                          std::string::const_iterator message_end,
-                                          bool compress)
+    void WebSocketTransport::encodeFragment(std::vector<uint8_t>& frames,
+                                            wsheader_type::opcode_type type,
+                                            bool fin,
+                                            std::string::const_iterator message_begin,
+                                            std::string::const_iterator message_end,
+                                            bool compress)
     {
         uint64_t message_size = static_cast<uint64_t>(message_end - message_begin);
 
@@ -937,79 +1891,244 @@ namespace ix
             }
         }
 
-        // _txbuf will keep growing until it can be transmitted over the socket:
-        appendToSendBuffer(header, message_begin, message_end, message_size, masking_key);
+        frames.insert(frames.end(), header.begin(), header.end());
+        frames.insert(frames.end(), message_begin, message_end);
 
-        // Now actually send this data
-        return sendOnSocket();
+        if (_useMask)
+        {
+            uint8_t* payload = frames.data() + frames.size() - (size_t) message_size;
+            applyWebSocketMask(payload, (size_t) message_size, masking_key);
+        }
     }
 
     WebSocketSendInfo WebSocketTransport::sendPing(const std::string& message)
     {
         bool compress = false;
+
+        // Set first, the pong can be received before sendData returns
+        _pingSentTimeUs = getMonotonicUs();
         WebSocketSendInfo info = sendData(wsheader_type::PING, message, compress);
 
         if (info.success)
         {
-            std::lock_guard<std::mutex> lck(_lastSendPingTimePointMutex);
-            _lastSendPingTimePoint = std::chrono::steady_clock::now();
+            _lastSendPingTimeMs = getMonotonicMs();
+        }
+        else
+        {
+            _pingSentTimeUs = 0;
         }
 
         return info;
     }
 
-    WebSocketSendInfo WebSocketTransport::sendBinary(const std::string& message,
-                                                     const OnProgressCallback& onProgressCallback)
+    WebSocketSendInfo WebSocketTransport::sendBinary(
+        const std::string& message,
+        const OnProgressCallback& onProgressCallback,
+        const OnSendCompleteCallback& onSendCompleteCallback,
+        bool compress)
 
     {
-        return sendData(
-            wsheader_type::BINARY_FRAME, message, _enablePerMessageDeflate, onProgressCallback);
+        return sendData(wsheader_type::BINARY_FRAME,
+                        message,
+                        shouldCompress(message.size(), compress),
+                        onProgressCallback,
+                        onSendCompleteCallback);
     }
 
-    WebSocketSendInfo WebSocketTransport::sendText(const std::string& message,
-                                                   const OnProgressCallback& onProgressCallback)
+    WebSocketSendInfo WebSocketTransport::sendText(
+        const std::string& message,
+        const OnProgressCallback& onProgressCallback,
+        const OnSendCompleteCallback& onSendCompleteCallback,
+        bool compress)
 
     {
-        return sendData(
-            wsheader_type::TEXT_FRAME, message, _enablePerMessageDeflate, onProgressCallback);
+        return sendData(wsheader_type::TEXT_FRAME,
+                        message,
+                        shouldCompress(message.size(), compress),
+                        onProgressCallback,
+                        onSendCompleteCallback);
     }
 
-    bool WebSocketTransport::sendOnSocket()
+    bool WebSocketTransport::sendOnSocket(bool flush)
     {
-        std::lock_guard<std::mutex> lock(_txbufMutex);
+        bool success = true;
+        std::vector<OnSendCompleteCallback> completed;
+        std::vector<OnSendCompleteCallback> failed;
+        std::vector<OnSendCompleteCallback> dropped;
+        bool belowLowWatermark = false;
+        bool disconnect = false;
+        size_t bufferedAmount = 0;
 
-        while (_txbuf.size())
         {
-            ssize_t ret = 0;
+            std::lock_guard<std::mutex> lock(_txbufMutex);
+
+            // Pick up the messages queued by producers
+            drainSendQueue(failed);
+
+            if (_sendBufferPolicy == SendBufferPolicy::DropOldest && _maxBufferedAmount != 0 &&
+                _bufferedAmount > _maxBufferedAmount)
             {
-                std::lock_guard<std::mutex> lock(_socketMutex);
-                ret = _socket->send((char*) &_txbuf[0], _txbuf.size());
+                disconnect = dropOldestMessages(dropped) && !_closeRequested;
             }
 
-            if (ret < 0 && Socket::isWaitNeeded())
+            // Hold small amounts of data until the coalescing window closes. When
+            // the socket is not writable the kernel buffer coalesces for us.
+            bool hold = false;
+            int windowUs = _writeCoalescingWindowUs;
+            if (windowUs > 0 && !flush && !_socketWouldBlock && _controlBuf.empty() &&
+                _closeFrame.empty() && !_txbuf.empty() && _txbuf.size() < _writeCoalescingMaxBytes)
             {
-                break;
+                auto now = std::chrono::steady_clock::now();
+                if (!_writeCoalescingPending)
+                {
+                    _writeCoalescingPending = true;
+                    _writeCoalescingDeadline = now + std::chrono::microseconds(windowUs);
+                }
+                hold = now < _writeCoalescingDeadline;
             }
-            else if (ret <= 0)
+
+            if (!hold)
             {
-                closeSocket();
-                setReadyState(ReadyState::CLOSED);
-                return false;
+                _writeCoalescingPending = false;
+                _socketWouldBlock = false;
             }
-            else
+
+            while (!hold && (!_txbuf.empty() || !_controlBuf.empty() || !_closeFrame.empty()))
+            {
+                // The data queued before the close frame is written
+                if (_txbuf.empty() && !_closeFrame.empty())
+                {
+                    _controlBuf.insert(_controlBuf.end(), _closeFrame.begin(), _closeFrame.end());
+                    _closeFrame.clear();
+                }
+
+                // Control frames can only be written between two data frames
+                bool control = !_controlBuf.empty() && _txbufAtFrameBoundary;
+                std::vector<uint8_t>& buffer = control ? _controlBuf : _txbuf;
+
+                // Stop at the end of the current data frame if control frames are waiting
+                size_t size = buffer.size();
+                if (!control && !_controlBuf.empty())
+                {
+                    size = (size_t) (_frameBoundaries.front() - _txbufSentBytes);
+                }
+
+                ssize_t ret = 0;
+                {
+                    std::lock_guard<std::mutex> lock(_socketMutex);
+                    ret = _socket->send((char*) &buffer[0], size);
+                }
+
+                if (ret < 0 && Socket::isWaitNeeded())
+                {
+                    _socketWouldBlock = true;
+                    break;
+                }
+                else if (ret <= 0)
+                {
+                    success = false;
+                    break;
+                }
+                else
+                {
+                    buffer.erase(buffer.begin(), buffer.begin() + ret);
+                    _bufferedAmount -= (size_t) ret;
+                    addToCounter(_wireBytesSent, (uint64_t) ret);
+                    IX_TRACE3(bytes_flushed, this, ret, control);
+                    if (control)
+                    {
+                        _bufferedControlAmount -= (size_t) ret;
+                        continue;
+                    }
+
+                    _txbufSentBytes += (uint64_t) ret;
+                    _txbufAtFrameBoundary = false;
+                    while (!_frameBoundaries.empty() && _frameBoundaries.front() <= _txbufSentBytes)
+                    {
+                        _txbufAtFrameBoundary = _frameBoundaries.front() == _txbufSentBytes;
+                        _frameBoundaries.pop_front();
+                    }
+                }
+            }
+
+            // A large message sent once should not stay allocated
+            if (_txbuf.empty() && _txbuf.capacity() > kChunkSize)
+            {
+                std::vector<uint8_t>().swap(_txbuf);
+            }
+
+            std::chrono::steady_clock::time_point now;
+            if (!_queuedMessages.empty() && _queuedMessages.front().end <= _txbufSentBytes)
             {
-                _txbuf.erase(_txbuf.begin(), _txbuf.begin() + ret);
+                now = std::chrono::steady_clock::now();
             }
+
+            while (!_queuedMessages.empty() && _queuedMessages.front().end <= _txbufSentBytes)
+            {
+                QueuedMessage& queuedMessage = _queuedMessages.front();
+                uint64_t latencyUs = getElapsedUs(queuedMessage.queuedTime, now);
+                _sendLatency.record(latencyUs);
+                IX_TRACE3(message_sent, this, queuedMessage.payloadSize, latencyUs);
+                addToCounter(_messagesSent, queuedMessage.messages);
+                addToCounter(_bytesSent, queuedMessage.payloadSize);
+                addToCounter(_framesSent, queuedMessage.frames);
+                addToCounter(_fragmentsSent, queuedMessage.frames - queuedMessage.messages);
+
+                auto&& callback = queuedMessage.onSendCompleteCallback;
+                if (callback) completed.push_back(std::move(callback));
+                _queuedMessages.pop_front();
+            }
+
+            bufferedAmount = _bufferedAmount;
+            belowLowWatermark = _aboveHighWatermark && bufferedAmount <= _lowWatermark &&
+                                _aboveHighWatermark.exchange(false);
         }
+        _txbufCondition.notify_all();
 
-        return true;
+        // Callbacks run without holding the send buffer lock, they are allowed to send
+        for (auto&& callback : completed)
+        {
+            callback(true);
+        }
+
+        _droppedMessages += dropped.size();
+        for (auto&& callback : dropped)
+        {
+            if (callback) callback(false);
+        }
+
+        for (auto&& callback : failed)
+        {
+            if (callback) callback(false);
+        }
+
+        if (belowLowWatermark)
+        {
+            invokeSendBufferWatermarkCallback(false, bufferedAmount);
+        }
+
+        if (!success)
+        {
+            closeSocket();
+            setReadyState(ReadyState::CLOSED);
+        }
+        else if (disconnect)
+        {
+            close(WebSocketCloseConstants::kPolicyViolationCode,
+                  WebSocketCloseConstants::kSendBufferFullMessage);
+        }
+
+        return success;
     }
 
     bool WebSocketTransport::receiveFromSocket()
     {
+        // Only held while reading, idle connections do not keep a read buffer
+        PooledBuffer readbuf = BufferPool::getDefault().acquire();
+
         while (true)
         {
-            ssize_t ret = _socket->recv((char*) &_readbuf[0], _readbuf.size());
+            ssize_t ret = _socket->recv((char*) readbuf.data(), readbuf.size());
 
             if (ret < 0 && Socket::isWaitNeeded())
             {
@@ -1026,7 +2145,8 @@ namespace ix
             }
             else
             {
-                _rxbuf.insert(_rxbuf.end(), _readbuf.begin(), _readbuf.begin() + ret);
+                _rxbuf.insert(_rxbuf.end(), readbuf.data(), readbuf.data() + ret);
+                addToCounter(_wireBytesReceived, (uint64_t) ret);
             }
         }
 
@@ -1102,10 +2222,8 @@ namespace ix
             _closeWireSize = closeWireSize;
             _closeRemote = remote;
         }
-        {
-            std::lock_guard<std::mutex> lock(_closingTimePointMutex);
-            _closingTimePoint = std::chrono::steady_clock::now();
-        }
+        cancelTimer(_closeTimerId);
+        _closeTimerId = scheduleTimer(kCloseTimer, kClosingMaximumWaitingDelayInMs);
         setReadyState(ReadyState::CLOSING);
 
         sendCloseFrame(code, reason);
@@ -1113,15 +2231,38 @@ namespace ix
         _socket->wakeUpFromPoll(Socket::kSendRequest);
     }
 
+    WebSocketStats WebSocketTransport::getStats() const
+    {
+        WebSocketStats stats;
+        stats.messagesSent = _messagesSent;
+        stats.messagesReceived = _messagesReceived;
+        stats.bytesSent = _bytesSent;
+        stats.bytesReceived = _bytesReceived;
+        stats.wireBytesSent = _wireBytesSent;
+        stats.wireBytesReceived = _wireBytesReceived;
+        stats.framesSent = _framesSent;
+        stats.framesReceived = _framesReceived;
+        stats.fragmentsSent = _fragmentsSent;
+        stats.fragmentsReceived = _fragmentsReceived;
+        stats.compressionTimeUs = _compressionTimeUs;
+        stats.decompressionTimeUs = _decompressionTimeUs;
+        stats.pingRtt = _pingRtt;
+        stats.sendLatency = _sendLatency;
+        return stats;
+    }
+
     size_t WebSocketTransport::bufferedAmount() const
     {
-        std::lock_guard<std::mutex> lock(_txbufMutex);
-        return _txbuf.size();
+        return _bufferedAmount;
     }
 
-    bool WebSocketTransport::flushSendBuffer()
+    bool WebSocketTransport::flushSendBuffer(bool controlOnly)
     {
-        while (!isSendBufferEmpty() && !_requestInitCancellation)
+        auto isFlushed = [this, controlOnly]() -> bool {
+            return controlOnly ? isControlBufferEmpty() : isSendBufferEmpty();
+        };
+
+        while (!isFlushed() && !_requestInitCancellation)
         {
             // Wait with a 10ms timeout until the socket is ready to write.
             // This way we are not busy looping
@@ -1135,7 +2276,8 @@ namespace ix
             }
             else if (result == PollResultType::ReadyForWrite)
             {
-                if (!sendOnSocket())
+                bool flush = true;
+                if (!sendOnSocket(flush))
                 {
                     return false;
                 }
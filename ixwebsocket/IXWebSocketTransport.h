@@ -11,20 +11,28 @@
 //
 
 #include "IXCancellationRequest.h"
+#include "IXMpscQueue.h"
 #include "IXProgressCallback.h"
 #include "IXSocketTLSOptions.h"
+#include "IXTimerWheel.h"
+#include "IXWebSocketBatchMessage.h"
 #include "IXWebSocketCloseConstants.h"
 #include "IXWebSocketHandshake.h"
 #include "IXWebSocketHttpHeaders.h"
 #include "IXWebSocketPerMessageDeflate.h"
 #include "IXWebSocketPerMessageDeflateOptions.h"
 #include "IXWebSocketSendInfo.h"
+#include "IXWebSocketStats.h"
+#include "IXWorkerPool.h"
 #include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <functional>
 #include <list>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace ix
@@ -38,6 +46,25 @@ namespace ix
         Ping
     };
 
+    // Invoked once a message has been fully written to the socket (success is true),
+    // or when the connection is closed before that could happen (success is false).
+    using OnSendCompleteCallback = std::function<void(bool success)>;
+
+    // Invoked when the amount of buffered data goes above the high watermark
+    // (aboveHighWatermark is true), and when it drains back to the low watermark.
+    using OnSendBufferWatermarkCallback =
+        std::function<void(bool aboveHighWatermark, size_t bufferedAmount)>;
+
+    // What to do with a text or binary message that would grow the send buffer
+    // above its maximum size
+    enum class SendBufferPolicy
+    {
+        Block,      // wait until the connection thread makes room
+        DropNewest, // reject the new message
+        DropOldest, // drop queued messages which were not started yet
+        Disconnect  // reject the message and close with code 1008
+    };
+
     class WebSocketTransport
     {
     public:
@@ -83,15 +110,77 @@ namespace ix
                                          int timeoutSecs);
 
         // Server
-        WebSocketInitResult connectToSocket(std::shared_ptr<Socket> socket, int timeoutSecs);
+        WebSocketInitResult connectToSocket(std::shared_ptr<Socket> socket,
+                                            int timeoutSecs,
+                                            HttpRequestPtr request = nullptr);
+
+        // Server connections flush the send buffer on the sending thread by default.
+        // When disabled, sends return once the message is queued and the
+        // connection thread writes it as the socket becomes writable.
+        void setBlockingSend(bool blockingSend);
+
+        // Send buffer limits. Watermarks of 0 disable the callbacks,
+        // a maximum buffered amount of 0 means unlimited.
+        void setSendBufferWatermarks(size_t lowWatermark, size_t highWatermark);
+        void setOnSendBufferWatermarkCallback(const OnSendBufferWatermarkCallback& callback);
+        void setMaxBufferedAmount(size_t maxBufferedAmount, SendBufferPolicy policy);
+        uint64_t getDroppedMessagesCount() const;
+
+        // Hold data frames for up to windowUs microseconds, or until maxBytes are
+        // buffered, so that small messages are written together. Control frames
+        // and blocking sends are written right away. A window of 0 disables it.
+        void setWriteCoalescing(int windowUs, size_t maxBytes);
+
+        static const int kDefaultWriteCoalescingWindowUs;
+        static const size_t kDefaultWriteCoalescingMaxBytes;
+
+        // Compress text and binary messages of at least minSize bytes on the
+        // worker pool. send then returns right away, with a wire size of 0, and the
+        // send complete callback reports the outcome. Data messages sent while
+        // some are being compressed wait behind them, so the order is kept.
+        // A minSize of 0 disables it.
+        void setCompressionOffload(size_t minSize, std::shared_ptr<WorkerPool> workerPool);
+
+        static const size_t kDefaultCompressionOffloadMinSize;
+
+        // Heartbeat and close handshake deadlines are scheduled on this wheel,
+        // the default one is shared by the whole process
+        void setTimerWheel(std::shared_ptr<TimerWheel> timerWheel);
+
+        // Close the connection with a going away code when no text or binary
+        // message and no pong were received for that long. 0 disables it.
+        void setIdleTimeout(int idleTimeoutSecs);
+        uint64_t getIdleDisconnectsCount() const;
+
+        // Once nothing was read, written or scheduled for that long, poll requests
+        // the connection thread to hand the socket over to a reactor, see
+        // WebSocketServer::enableHibernation. 0 disables it.
+        void setHibernationTimeout(int hibernationTimeoutSecs);
+        bool isHibernationRequested() const;
+
+        // Called by the reactor once the socket or its select interrupt is readable
+        void resumeFromHibernation();
+        int getSocketFd() const;
+        int getInterruptFd() const;
 
         PollResult poll();
-        WebSocketSendInfo sendBinary(const std::string& message,
-                                     const OnProgressCallback& onProgressCallback);
+        // compress false sends the message uncompressed even if permessage-deflate
+        // was negotiated
+        WebSocketSendInfo sendBinary(
+            const std::string& message,
+            const OnProgressCallback& onProgressCallback,
+            const OnSendCompleteCallback& onSendCompleteCallback = nullptr,
+            bool compress = true);
         WebSocketSendInfo sendText(const std::string& message,
-                                   const OnProgressCallback& onProgressCallback);
+                                   const OnProgressCallback& onProgressCallback,
+                                   const OnSendCompleteCallback& onSendCompleteCallback = nullptr,
+                                   bool compress = true);
         WebSocketSendInfo sendPing(const std::string& message);
 
+        // Encode all the messages into one buffer, queued and written at once
+        WebSocketSendInfo sendBatch(const std::vector<WebSocketBatchMessage>& messages,
+                                    const OnSendCompleteCallback& onSendCompleteCallback = nullptr);
+
         void close(uint16_t code = WebSocketCloseConstants::kNormalClosureCode,
                    const std::string& reason = WebSocketCloseConstants::kNormalClosureMessage,
                    size_t closeWireSize = 0,
@@ -105,6 +194,9 @@ namespace ix
         void dispatch(PollResult pollResult, const OnMessageCallback& onMessageCallback);
         size_t bufferedAmount() const;
 
+        // Snapshot of the counters of this connection, safe from any thread
+        WebSocketStats getStats() const;
+
         // internal
         WebSocketSendInfo sendHeartBeat();
 
@@ -141,18 +233,120 @@ namespace ix
         // saying that a send is complete. This is the mode for server code.
         std::atomic<bool> _blockingSend;
 
-        // Buffer for reading from our socket. That buffer is never resized.
-        std::vector<uint8_t> _readbuf;
-
         // Contains all messages that were fetched in the last socket read.
         // This could be a mix of control messages (Close, Ping, etc...) and
-        // data messages. That buffer
+        // data messages. That buffer is released once everything was dispatched.
         std::vector<uint8_t> _rxbuf;
 
-        // Contains all messages that are waiting to be sent
+        // Encoded messages waiting to be picked up by the thread flushing the send
+        // buffer. Producers push them without taking any lock.
+        struct OutgoingMessage
+        {
+            std::vector<uint8_t> frames;
+            std::vector<size_t> frameEnds;
+            bool control;
+            bool close;
+            OnSendCompleteCallback onSendCompleteCallback;
+
+            // Text and binary messages held, and their uncompressed size
+            size_t messages;
+            uint64_t payloadSize;
+            std::chrono::steady_clock::time_point queuedTime;
+
+            // False when compressed with the context of the previous messages
+            bool droppable;
+        };
+
+        MpscQueue<OutgoingMessage> _sendQueue;
+
+        // Bytes queued and not yet written to the socket, and how many of them
+        // belong to control frames
+        std::atomic<size_t> _bufferedAmount;
+        std::atomic<size_t> _bufferedControlAmount;
+
+        // Contains all messages that are waiting to be sent. The state below is only
+        // touched by the thread flushing the send buffer, which holds _txbufMutex.
         std::vector<uint8_t> _txbuf;
         mutable std::mutex _txbufMutex;
 
+        // Total number of bytes appended to and sent from _txbuf, and the position
+        // of each queued message within that stream. A message is complete once the
+        // bytes sent reach its end offset.
+        struct QueuedMessage
+        {
+            uint64_t begin;
+            uint64_t end;
+            OnSendCompleteCallback onSendCompleteCallback;
+            std::chrono::steady_clock::time_point queuedTime;
+            size_t messages;
+            size_t frames;
+            uint64_t payloadSize;
+            bool droppable;
+        };
+
+        uint64_t _txbufAppendedBytes;
+        uint64_t _txbufSentBytes;
+        std::deque<QueuedMessage> _queuedMessages;
+
+        // Ping and pong frames skip the data queue. Control frames are written
+        // between two data frames, so the end offset of each queued data frame is
+        // kept to know when the socket is at a frame boundary.
+        std::vector<uint8_t> _controlBuf;
+        std::deque<uint64_t> _frameBoundaries;
+        bool _txbufAtFrameBoundary;
+
+        // No data frame may follow a close frame. Producers check _closeRequested
+        // to reject data early, data queued after the close frame is discarded.
+        // Data queued before it is written first, the close frame waits here
+        // until then, and only pings and pongs go ahead of that data.
+        bool _closeFrameQueued;
+        std::vector<uint8_t> _closeFrame;
+        std::atomic<bool> _closeRequested;
+
+        // Send buffer limits
+        std::atomic<size_t> _lowWatermark;
+        std::atomic<size_t> _highWatermark;
+        std::atomic<bool> _aboveHighWatermark;
+        OnSendBufferWatermarkCallback _onSendBufferWatermarkCallback;
+        std::mutex _onSendBufferWatermarkCallbackMutex;
+        std::atomic<size_t> _maxBufferedAmount;
+        std::atomic<SendBufferPolicy> _sendBufferPolicy;
+        std::condition_variable _txbufCondition;
+        std::atomic<uint64_t> _droppedMessages;
+
+        // Write coalescing. The window opens when data is held and closes at the
+        // next write, the deadline and the flags are guarded by _txbufMutex.
+        std::atomic<int> _writeCoalescingWindowUs;
+        std::atomic<size_t> _writeCoalescingMaxBytes;
+        bool _writeCoalescingPending;
+        std::chrono::time_point<std::chrono::steady_clock> _writeCoalescingDeadline;
+        bool _socketWouldBlock;
+
+        // The deflate stream is shared by all messages, compressed messages are
+        // queued in the order in which they were compressed
+        std::mutex _compressionMutex;
+
+        // Sends waiting for the worker pool, run one at a time in order. The
+        // front one is removed once it was queued. Shared with the worker, as a
+        // send callback may destroy the transport while the worker runs it.
+        struct OffloadQueue
+        {
+            std::deque<std::function<void()>> sends;
+            bool running;
+            bool destroyed;
+            std::atomic<std::thread::id> thread;
+            std::mutex mutex;
+            std::condition_variable condition;
+        };
+
+        std::atomic<size_t> _compressionOffloadMinSize;
+        std::shared_ptr<WorkerPool> _workerPool;
+        std::shared_ptr<OffloadQueue> _offloadQueue;
+
+        // Thread running poll(). Senders on that thread never wait for room in the
+        // send buffer, as it is the one draining it.
+        std::atomic<std::thread::id> _pollThreadId;
+
         // Hold fragments for multi-fragments messages in a list. We support receiving very large
         // messages (tested messages up to 700M) and we cannot put them in a single
         // buffer that is resized, as this operation can be slow when a buffer has its
@@ -167,6 +361,10 @@ namespace ix
         // Ditto for whether a message is compressed
         bool _compressedMessage;
 
+        // Compressed messages are inflated there, the buffer is reused by the
+        // next message unless it grew past kChunkSize
+        std::string _decompressedMessage;
+
         // Fragments are 32K long
         static constexpr size_t kChunkSize = 1 << 15;
 
@@ -195,8 +393,6 @@ namespace ix
         // Used to cancel dns lookup + socket connect + http upgrade
         std::atomic<bool> _requestInitCancellation;
 
-        mutable std::mutex _closingTimePointMutex;
-        std::chrono::time_point<std::chrono::steady_clock> _closingTimePoint;
         static const int kClosingMaximumWaitingDelayInMs;
 
         // enable auto response to ping
@@ -210,17 +406,57 @@ namespace ix
         static const int kDefaultPingIntervalSecs;
         static const std::string kPingMessage;
 
-        // We record when ping are being sent so that we can know when to send the next one
-        mutable std::mutex _lastSendPingTimePointMutex;
-        std::chrono::time_point<std::chrono::steady_clock> _lastSendPingTimePoint;
-
-        // If this function returns true, it is time to send a new ping
-        bool pingIntervalExceeded();
-        void initTimePointsAfterConnect();
-
-        // after calling close(), if no CLOSE frame answer is received back from the remote, we
-        // should close the connexion
-        bool closingDelayExceeded();
+        // We record when ping are being sent so that we can know when to send the next one,
+        // in milliseconds since the steady clock epoch
+        std::atomic<int64_t> _lastSendPingTimeMs;
+
+        // Timers run on the wheel thread. Their callbacks only set a bit in
+        // _expiredTimers and wake up poll, which handles them. The bits are shared
+        // so that a late callback never touches a destroyed transport.
+        std::shared_ptr<TimerWheel> _timerWheel;
+        std::shared_ptr<std::atomic<uint64_t>> _expiredTimers;
+        std::atomic<TimerWheel::TimerId> _heartBeatTimerId;
+        std::atomic<TimerWheel::TimerId> _closeTimerId;
+        std::atomic<TimerWheel::TimerId> _idleTimerId;
+
+        static const uint64_t kHeartBeatTimer;
+        static const uint64_t kCloseTimer;
+        static const uint64_t kIdleTimer;
+
+        // Idle timeout, the last activity is in milliseconds like _lastSendPingTimeMs
+        std::atomic<int> _idleTimeoutSecs;
+        std::atomic<int64_t> _lastActivityMs;
+        std::atomic<uint64_t> _idleDisconnects;
+
+        // Connection statistics. Sent messages are counted once written.
+        std::atomic<uint64_t> _messagesSent;
+        std::atomic<uint64_t> _messagesReceived;
+        std::atomic<uint64_t> _bytesSent;
+        std::atomic<uint64_t> _bytesReceived;
+        std::atomic<uint64_t> _wireBytesSent;
+        std::atomic<uint64_t> _wireBytesReceived;
+        std::atomic<uint64_t> _framesSent;
+        std::atomic<uint64_t> _framesReceived;
+        std::atomic<uint64_t> _fragmentsSent;
+        std::atomic<uint64_t> _fragmentsReceived;
+        std::atomic<uint64_t> _compressionTimeUs;
+        std::atomic<uint64_t> _decompressionTimeUs;
+        LatencyHistogram _pingRtt;
+        LatencyHistogram _sendLatency;
+
+        // When the last ping was sent, in microseconds since the steady clock
+        // epoch, 0 once its pong was received
+        std::atomic<int64_t> _pingSentTimeUs;
+
+        // Hibernation, the time of the last poll event is only used by the connection thread
+        std::atomic<int> _hibernationTimeoutSecs;
+        std::atomic<bool> _hibernationRequested;
+        int64_t _lastPollEventMs;
+        bool canHibernate() const;
+
+        TimerWheel::TimerId scheduleTimer(uint64_t timer, int delayMs);
+        void cancelTimer(std::atomic<TimerWheel::TimerId>& timerId);
+        void handleExpiredTimers();
 
         void sendCloseFrame(uint16_t code, const std::string& reason);
 
@@ -229,20 +465,41 @@ namespace ix
                                                size_t closeWireSize,
                                                bool remote);
 
-        bool flushSendBuffer();
-        bool sendOnSocket();
+        bool flushSendBuffer(bool controlOnly);
+        bool sendOnSocket(bool flush = false);
+        int getWriteCoalescingDelayMs();
         bool receiveFromSocket();
 
+        bool shouldCompress(size_t size, bool compress) const;
+
+        // Offloaded sends run there again on a worker, with offloaded set
         WebSocketSendInfo sendData(wsheader_type::opcode_type type,
                                    const std::string& message,
                                    bool compress,
-                                   const OnProgressCallback& onProgressCallback = nullptr);
-
-        bool sendFragment(wsheader_type::opcode_type type,
-                          bool fin,
-                          std::string::const_iterator begin,
-                          std::string::const_iterator end,
-                          bool compress);
+                                   const OnProgressCallback& onProgressCallback = nullptr,
+                                   const OnSendCompleteCallback& onSendCompleteCallback = nullptr,
+                                   bool offloaded = false);
+        WebSocketSendInfo sendBatchMessages(const std::vector<WebSocketBatchMessage>& messages,
+                                            const OnSendCompleteCallback& onSendCompleteCallback,
+                                            bool offloaded);
+
+        // Returns false when the send should run now, on the caller thread
+        bool offloadSend(size_t size, bool compress, const std::function<void()>& send);
+        static void runOffloadedSends(std::shared_ptr<OffloadQueue> queue);
+
+        bool encodeMessage(OutgoingMessage& outgoingMessage,
+                           wsheader_type::opcode_type type,
+                           std::string::const_iterator message_begin,
+                           std::string::const_iterator message_end,
+                           bool compress,
+                           const OnProgressCallback& onProgressCallback);
+
+        void encodeFragment(std::vector<uint8_t>& frames,
+                            wsheader_type::opcode_type type,
+                            bool fin,
+                            std::string::const_iterator begin,
+                            std::string::const_iterator end,
+                            bool compress);
 
         void emitMessage(MessageKind messageKind,
                          const std::string& message,
@@ -250,11 +507,18 @@ namespace ix
                          const OnMessageCallback& onMessageCallback);
 
         bool isSendBufferEmpty() const;
-        void appendToSendBuffer(const std::vector<uint8_t>& header,
-                                std::string::const_iterator begin,
-                                std::string::const_iterator end,
-                                uint64_t message_size,
-                                uint8_t masking_key[4]);
+        bool isControlBufferEmpty() const;
+        bool waitForSendBuffer(size_t size);
+        bool dropBeforeCompressing(size_t size);
+        bool reserveSendBuffer(size_t size, bool compress);
+        bool enqueueMessage(OutgoingMessage&& message, bool mayBlock);
+        bool queueMessage(OutgoingMessage&& outgoingMessage,
+                          std::unique_lock<std::mutex>& compressionLock,
+                          bool blocking);
+        void drainSendQueue(std::vector<OnSendCompleteCallback>& failed);
+        bool dropOldestMessages(std::vector<OnSendCompleteCallback>& dropped);
+        void clearSendBuffer();
+        void invokeSendBufferWatermarkCallback(bool aboveHighWatermark, size_t bufferedAmount);
 
         unsigned getRandomUnsigned();
         void unmaskReceiveBuffer(const wsheader_type& ws);
@@ -0,0 +1,102 @@
+/*
+ *  IXWorkerPool.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ */
+
+#include "IXWorkerPool.h"
+
+#include "IXSetThreadName.h"
+
+namespace ix
+{
+    const int WorkerPool::kDefaultThreads(2);
+
+    WorkerPool::WorkerPool(int threads)
+        : _threadCount(threads > 0 ? threads : kDefaultThreads)
+        , _stop(false)
+    {
+        ;
+    }
+
+    WorkerPool::~WorkerPool()
+    {
+        stop();
+    }
+
+    void WorkerPool::post(const Task& task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _tasks.push_back(task);
+
+            if (_threads.empty())
+            {
+                for (size_t i = 0; i < _threadCount; ++i)
+                {
+                    _threads.emplace_back(&WorkerPool::run, this);
+                }
+            }
+        }
+        _condition.notify_one();
+    }
+
+    void WorkerPool::stop()
+    {
+        std::vector<std::thread> threads;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+            threads.swap(_threads);
+        }
+        _condition.notify_all();
+
+        for (auto&& thread : threads)
+        {
+            if (thread.get_id() == std::this_thread::get_id())
+            {
+                thread.detach();
+            }
+            else
+            {
+                thread.join();
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = false;
+    }
+
+    size_t WorkerPool::getThreadCount() const
+    {
+        return _threadCount;
+    }
+
+    void WorkerPool::run()
+    {
+        setThreadName("WorkerPool");
+
+        while (true)
+        {
+            Task task;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _condition.wait(lock, [this] { return _stop || !_tasks.empty(); });
+
+                // Drain the queue before stopping
+                if (_tasks.empty()) break;
+
+                task = std::move(_tasks.front());
+                _tasks.pop_front();
+            }
+
+            task();
+        }
+    }
+
+    std::shared_ptr<WorkerPool> WorkerPool::getDefault()
+    {
+        static std::shared_ptr<WorkerPool> workerPool = std::make_shared<WorkerPool>();
+        return workerPool;
+    }
+} // namespace ix
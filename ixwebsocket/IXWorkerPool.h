@@ -0,0 +1,58 @@
+/*
+ *  IXWorkerPool.h
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ *
+ *  Fixed size pool of threads running tasks in the order they were posted.
+ *  Tasks posted by one caller may run concurrently on different threads,
+ *  callers which need ordering chain their tasks themselves.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ix
+{
+    class WorkerPool
+    {
+    public:
+        using Task = std::function<void()>;
+
+        // Threads are started on the first post
+        WorkerPool(int threads = WorkerPool::kDefaultThreads);
+        ~WorkerPool();
+
+        WorkerPool(const WorkerPool&) = delete;
+        WorkerPool& operator=(const WorkerPool&) = delete;
+
+        void post(const Task& task);
+
+        // Runs the tasks already posted, then joins the threads
+        void stop();
+
+        size_t getThreadCount() const;
+
+        // Shared by the connections which offload compression
+        static std::shared_ptr<WorkerPool> getDefault();
+
+        const static int kDefaultThreads;
+
+    private:
+        void run();
+
+        size_t _threadCount;
+
+        std::mutex _mutex;
+        std::condition_variable _condition;
+        std::deque<Task> _tasks;
+        std::vector<std::thread> _threads;
+        bool _stop;
+    };
+} // namespace ix
@@ -0,0 +1,164 @@
+/*
+ *  IXBufferPoolTest.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone. All rights reserved.
+ */
+
+#include "IXTest.h"
+#include "catch.hpp"
+#include <atomic>
+#include <fstream>
+#include <ixwebsocket/IXBufferPool.h>
+#include <ixwebsocket/IXSocket.h>
+#include <ixwebsocket/IXSocketFactory.h>
+#include <ixwebsocket/IXWebSocketServer.h>
+#include <sstream>
+#include <vector>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+using namespace ix;
+
+namespace
+{
+    // Resident set size of this process in bytes, 0 when unknown
+    size_t getRss()
+    {
+#ifdef __linux__
+        std::ifstream statm("/proc/self/statm");
+        size_t size = 0;
+        size_t resident = 0;
+        if (!(statm >> size >> resident)) return 0;
+        return resident * (size_t) sysconf(_SC_PAGESIZE);
+#else
+        return 0;
+#endif
+    }
+
+    std::shared_ptr<Socket> connectIdleClient(int port)
+    {
+        std::string errMsg;
+        SocketTLSOptions tlsOptions;
+        auto socket = createSocket(false, -1, errMsg, tlsOptions);
+        auto isCancellationRequested = []() -> bool { return false; };
+        if (!socket->connect("127.0.0.1", port, errMsg, isCancellationRequested)) return nullptr;
+
+        socket->writeBytes("GET / HTTP/1.1\r\n"
+                           "Upgrade: websocket\r\n"
+                           "Connection: Upgrade\r\n"
+                           "Sec-WebSocket-Version: 13\r\n"
+                           "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                           "\r\n",
+                           isCancellationRequested);
+
+        while (true)
+        {
+            auto line = socket->readLine(isCancellationRequested);
+            if (!line.first) return nullptr;
+            if (line.second == "\r\n") break;
+        }
+
+        // One text message with an all zero mask, then nothing
+        socket->writeBytes(std::string("\x81\x85\0\0\0\0hello", 11), isCancellationRequested);
+        return socket;
+    }
+} // namespace
+
+TEST_CASE("BufferPool", "[buffer_pool]")
+{
+    SECTION("Released buffers are reused")
+    {
+        BufferPool pool(1024, 2);
+        size_t acquired = BufferPool::getAcquiredCount();
+
+        uint8_t* data = nullptr;
+        {
+            PooledBuffer buffer = pool.acquire();
+            REQUIRE(buffer.size() == 1024);
+            REQUIRE(BufferPool::getAcquiredCount() == acquired + 1);
+            data = buffer.data();
+        }
+        REQUIRE(BufferPool::getAcquiredCount() == acquired);
+        REQUIRE(pool.getFreeCount() == 1);
+
+        PooledBuffer buffer = pool.acquire();
+        REQUIRE(buffer.data() == data);
+        REQUIRE(pool.getFreeCount() == 0);
+
+        PooledBuffer moved(std::move(buffer));
+        REQUIRE(buffer.data() == nullptr);
+        REQUIRE(moved.data() == data);
+
+        moved.reset();
+        REQUIRE(pool.getFreeCount() == 1);
+    }
+
+    SECTION("At most maxFreeBuffers are kept")
+    {
+        BufferPool pool(1024, 2);
+        {
+            std::vector<PooledBuffer> buffers;
+            for (int i = 0; i < 5; ++i)
+            {
+                buffers.push_back(pool.acquire());
+            }
+        }
+        REQUIRE(pool.getFreeCount() == 2);
+    }
+
+    SECTION("Idle connections do not hold buffers")
+    {
+        int port = getFreePort();
+        WebSocketServer server(port, "127.0.0.1", SocketServer::kDefaultTcpBacklog, 1000);
+        std::atomic<int> received(0);
+
+        server.setOnConnectionCallback(
+            [&received](std::shared_ptr<WebSocket> webSocket,
+                        std::shared_ptr<ConnectionState> /*connectionState*/) {
+                webSocket->setOnMessageCallback([&received](const WebSocketMessagePtr& msg) {
+                    if (msg->type == WebSocketMessageType::Message) received++;
+                });
+            });
+
+        REQUIRE(server.listen().first);
+        server.start();
+
+        const int count = 200;
+        std::vector<std::shared_ptr<Socket>> sockets;
+        size_t rssBefore = getRss();
+
+        for (int i = 0; i < count; ++i)
+        {
+            auto socket = connectIdleClient(port);
+            REQUIRE(socket);
+            sockets.push_back(socket);
+        }
+
+        int attempts = 0;
+        while (received < count && attempts++ < 500)
+        {
+            ix::msleep(10);
+        }
+        REQUIRE(received == count);
+
+        size_t rssAfter = getRss();
+        if (rssBefore != 0 && rssAfter > rssBefore)
+        {
+            std::stringstream ss;
+            ss << "RSS per idle connection: " << (rssAfter - rssBefore) / count / 1024
+               << " KB, with the server thread stack and both socket ends";
+            WARN(ss.str());
+        }
+
+        // Everything was read and dispatched, no connection keeps a pooled buffer
+        REQUIRE(BufferPool::getAcquiredCount() == 0);
+
+        for (auto&& socket : sockets)
+        {
+            socket->close();
+        }
+        server.stop();
+    }
+}
@@ -0,0 +1,126 @@
+/*
+ *  IXConnectionTimingsTest.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone. All rights reserved.
+ */
+
+#include "IXTest.h"
+#include "catch.hpp"
+#include <ixwebsocket/IXConnectionTimings.h>
+#include <ixwebsocket/IXHttpClient.h>
+#include <ixwebsocket/IXHttpServer.h>
+#include <ixwebsocket/IXWebSocket.h>
+#include <ixwebsocket/IXWebSocketServer.h>
+#include <mutex>
+#include <string>
+
+using namespace ix;
+
+namespace
+{
+    // Phases of a plain text connection which went to the end
+    void checkTimings(const ConnectionTimings& timings)
+    {
+        REQUIRE(timings.startUs != 0);
+        REQUIRE(timings.dnsLookupUs >= timings.startUs);
+        REQUIRE(timings.connectUs >= timings.dnsLookupUs);
+        REQUIRE(timings.tlsHandshakeUs == 0);
+        REQUIRE(timings.requestSentUs >= timings.connectUs);
+        REQUIRE(timings.firstByteUs >= timings.requestSentUs);
+        REQUIRE(timings.doneUs >= timings.firstByteUs);
+        REQUIRE(timings.getElapsedUs(timings.doneUs) == timings.doneUs - timings.startUs);
+    }
+} // namespace
+
+TEST_CASE("ConnectionTimings", "[timings]")
+{
+    SECTION("Times are formatted like curl -w")
+    {
+        ConnectionTimings timings;
+        REQUIRE(timings.format("%{time_total}\\n") == "0.000000\n");
+
+        timings.startUs = 1000000;
+        timings.dnsLookupUs = 1000250;
+        timings.connectUs = 1001500;
+        timings.requestSentUs = 1001600;
+        timings.firstByteUs = 1002000;
+        timings.doneUs = 3500000;
+
+        REQUIRE(timings.getElapsedUs(timings.tlsHandshakeUs) == 0);
+        REQUIRE(timings.format("dns %{time_namelookup} connect %{time_connect} "
+                               "tls %{time_appconnect} total %{time_total} %{other}") ==
+                "dns 0.000250 connect 0.001500 tls 0.000000 total 2.500000 %{other}");
+        REQUIRE(timings.format("%{time_pretransfer} %{time_starttransfer}") ==
+                "0.001600 0.002000");
+    }
+
+    SECTION("WebSocket connections report their phases")
+    {
+        int port = getFreePort();
+        WebSocketServer server(port);
+        server.setOnConnectionCallback([](std::shared_ptr<WebSocket> webSocket,
+                                          std::shared_ptr<ConnectionState> /*connectionState*/) {
+            webSocket->setOnMessageCallback([](const WebSocketMessagePtr& /*msg*/) {});
+        });
+        REQUIRE(server.listen().first);
+        server.start();
+
+        std::mutex mutex;
+        bool open = false;
+        ConnectionTimings openTimings;
+
+        WebSocket webSocket;
+        webSocket.setUrl("ws://localhost:" + std::to_string(port) + "/");
+        webSocket.setOnMessageCallback(
+            [&mutex, &open, &openTimings](const WebSocketMessagePtr& msg) {
+                if (msg->type != WebSocketMessageType::Open) return;
+
+                std::lock_guard<std::mutex> lock(mutex);
+                openTimings = msg->openInfo.timings;
+                open = true;
+            });
+
+        WebSocketInitResult result = webSocket.connect(5);
+        REQUIRE(result.success);
+        checkTimings(result.timings);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            REQUIRE(open);
+            REQUIRE(openTimings.doneUs == result.timings.doneUs);
+        }
+
+        // A failed connection keeps the phases it went through
+        WebSocket refused;
+        refused.setUrl("ws://localhost:" + std::to_string(getFreePort()) + "/");
+        result = refused.connect(5);
+        REQUIRE(!result.success);
+        REQUIRE(result.timings.startUs != 0);
+        REQUIRE(result.timings.dnsLookupUs >= result.timings.startUs);
+        REQUIRE(result.timings.connectUs == 0);
+        REQUIRE(result.timings.doneUs == 0);
+
+        server.stop();
+    }
+
+    SECTION("HTTP responses report their phases")
+    {
+        int port = getFreePort();
+        HttpServer server(port, "127.0.0.1");
+        REQUIRE(server.listen().first);
+        server.start();
+
+        HttpClient httpClient;
+        std::string url = "http://127.0.0.1:" + std::to_string(port) + "/data/foo.txt";
+        auto args = httpClient.createRequest(url);
+        args->connectTimeout = 60;
+        args->transferTimeout = 60;
+
+        auto response = httpClient.get(url, args);
+
+        REQUIRE(response->errorCode == HttpErrorCode::Ok);
+        checkTimings(response->timings);
+
+        server.stop();
+    }
+}
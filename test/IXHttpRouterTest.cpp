@@ -0,0 +1,154 @@
+/*
+ *  IXHttpRouterTest.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone. All rights reserved.
+ */
+
+#include "IXGetFreePort.h"
+#include "catch.hpp"
+#include <iostream>
+#include <ixwebsocket/IXHttpClient.h>
+#include <ixwebsocket/IXHttpRouter.h>
+#include <ixwebsocket/IXHttpServer.h>
+
+using namespace ix;
+
+namespace
+{
+    HttpRouter::Handler makeHandler(const std::string& body)
+    {
+        return [body](HttpRequestPtr /*request*/,
+                      const HttpRouteParams& params,
+                      std::shared_ptr<ConnectionState> /*connectionState*/) -> HttpResponsePtr {
+            std::string content(body);
+            for (size_t i = 0; i < params.size(); ++i)
+            {
+                content += " " + params.getName(i) + "=" + params.getValue(i);
+            }
+
+            return std::make_shared<HttpResponse>(
+                200, "OK", HttpErrorCode::Ok, WebSocketHttpHeaders(), content);
+        };
+    }
+
+    HttpResponsePtr route(HttpRouter& router, const std::string& method, const std::string& uri)
+    {
+        auto request = std::make_shared<HttpRequest>(uri, method, "HTTP/1.1");
+        return router.handleRequest(request, nullptr);
+    }
+} // namespace
+
+TEST_CASE("http router", "[http_router]")
+{
+    SECTION("Static, parameters and wildcard routes")
+    {
+        HttpRouter router;
+        REQUIRE(router.addRoute("GET", "/", makeHandler("root")));
+        REQUIRE(router.addRoute("GET", "/users", makeHandler("users")));
+        REQUIRE(router.addRoute("POST", "/users", makeHandler("create")));
+        REQUIRE(router.addRoute("GET", "/users/me", makeHandler("me")));
+        REQUIRE(router.addRoute("GET", "/users/:id", makeHandler("user")));
+        REQUIRE(router.addRoute("GET", "/users/:id/files/*path", makeHandler("file")));
+        REQUIRE(router.addRoute("*", "/static/*", makeHandler("static")));
+        router.compile();
+
+        REQUIRE(router.getRoutesCount() == 7);
+
+        REQUIRE(route(router, "GET", "/")->payload == "root");
+        REQUIRE(route(router, "GET", "/users")->payload == "users");
+        REQUIRE(route(router, "POST", "/users")->payload == "create");
+        REQUIRE(route(router, "GET", "/users/me")->payload == "me");
+        REQUIRE(route(router, "GET", "/users/42")->payload == "user id=42");
+        REQUIRE(route(router, "GET", "/users/42?verbose=1")->payload == "user id=42");
+        REQUIRE(route(router, "GET", "/users/mel")->payload == "user id=mel");
+        REQUIRE(route(router, "GET", "/users/42/files/a/b.txt")->payload ==
+                "file id=42 path=a/b.txt");
+        REQUIRE(route(router, "DELETE", "/static/css/x.css")->payload == "static =css/x.css");
+
+        REQUIRE(route(router, "GET", "/users/")->statusCode == 404);
+        REQUIRE(route(router, "GET", "/unknown")->statusCode == 404);
+        REQUIRE(route(router, "PUT", "/users")->statusCode == 405);
+        REQUIRE(route(router, "PUT", "/users")->headers["Allow"] == "GET, POST");
+        REQUIRE(route(router, "PUT", "/users/me")->headers["Allow"] == "GET");
+    }
+
+    SECTION("Deep static and parameter routes")
+    {
+        // Static segments all the way down, then parameters all the way down
+        std::string statics;
+        std::string params;
+        std::string path;
+        for (size_t i = 0; i < HttpRouteParams::kMaxParams; ++i)
+        {
+            statics += "/a";
+            params += "/:p" + std::to_string(i);
+            path += "/a";
+        }
+
+        HttpRouter router;
+        REQUIRE(router.addRoute("GET", statics + "/x", makeHandler("static")));
+        REQUIRE(router.addRoute("GET", params + "/y", makeHandler("params")));
+        router.compile();
+
+        REQUIRE(route(router, "GET", path + "/x")->payload == "static");
+        REQUIRE(route(router, "GET", path + "/z")->statusCode == 404);
+
+        auto response = route(router, "GET", path + "/y");
+        REQUIRE(response->payload.find("params p0=a ") == 0);
+
+        // Deeper patterns are rejected
+        std::string deep;
+        for (size_t i = 0; i < HttpRouter::kMaxSegments; ++i)
+        {
+            deep += "/a";
+        }
+        REQUIRE(router.addRoute("GET", deep, makeHandler("deep")));
+        REQUIRE(!router.addRoute("GET", deep + "/a", makeHandler("deeper")));
+    }
+
+    SECTION("Invalid and conflicting patterns are rejected")
+    {
+        HttpRouter router;
+        REQUIRE(!router.addRoute("GET", "", makeHandler("")));
+        REQUIRE(!router.addRoute("GET", "users", makeHandler("")));
+        REQUIRE(!router.addRoute("GET", "/users/:", makeHandler("")));
+        REQUIRE(!router.addRoute("GET", "/files/*path/more", makeHandler("")));
+
+        REQUIRE(router.addRoute("GET", "/users/:id", makeHandler("")));
+        REQUIRE(!router.addRoute("GET", "/users/:name", makeHandler("")));
+        REQUIRE(!router.addRoute("GET", "/users/:id", makeHandler("")));
+        REQUIRE(router.addRoute("POST", "/users/:id", makeHandler("")));
+    }
+
+    SECTION("Routes served by an HttpServer")
+    {
+        int port = getFreePort();
+        ix::HttpServer server(port, "127.0.0.1");
+
+        auto router = std::make_shared<HttpRouter>();
+        router->addRoute("GET", "/hello/:name", makeHandler("hello"));
+        server.setRouter(router);
+
+        auto res = server.listen();
+        REQUIRE(res.first);
+        server.start();
+
+        HttpClient httpClient;
+        std::string url("http://127.0.0.1:");
+        url += std::to_string(port);
+
+        auto args = httpClient.createRequest(url + "/hello/world");
+        args->connectTimeout = 60;
+        args->transferTimeout = 60;
+
+        auto response = httpClient.get(url + "/hello/world", args);
+        REQUIRE(response->errorCode == HttpErrorCode::Ok);
+        REQUIRE(response->statusCode == 200);
+        REQUIRE(response->payload == "hello name=world");
+
+        response = httpClient.get(url + "/nope", args);
+        REQUIRE(response->statusCode == 404);
+
+        server.stop();
+    }
+}
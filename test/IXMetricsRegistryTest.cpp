@@ -0,0 +1,199 @@
+/*
+ *  IXMetricsRegistryTest.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone. All rights reserved.
+ */
+
+#include "IXTest.h"
+#include "catch.hpp"
+#include <ixwebsocket/IXHttpClient.h>
+#include <ixwebsocket/IXHttpServer.h>
+#include <ixwebsocket/IXMetricsRegistry.h>
+#include <ixwebsocket/IXWebSocket.h>
+#include <ixwebsocket/IXWebSocketServer.h>
+#include <mutex>
+#include <string>
+
+using namespace ix;
+
+namespace
+{
+    HttpResponsePtr get(const std::string& url)
+    {
+        HttpClient httpClient;
+        auto args = httpClient.createRequest(url);
+        args->connectTimeout = 60;
+        args->transferTimeout = 60;
+        return httpClient.get(url, args);
+    }
+
+    bool contains(const std::string& text, const std::string& line)
+    {
+        return text.find(line + "\n") != std::string::npos;
+    }
+} // namespace
+
+TEST_CASE("MetricsRegistry", "[metrics]")
+{
+    SECTION("Metrics are serialized in the Prometheus text format")
+    {
+        MetricsRegistry registry;
+        registry.counter("requests_total", "Requests\nserved", "code=\"200\"").increment(3);
+        registry.counter("requests_total", "Ignored", "code=\"404\"").increment();
+        registry.gauge("queue_bytes", "Queued bytes").set(-12);
+
+        // The same labels give the same metric
+        Metric& counter = registry.counter("requests_total", "", "code=\"200\"");
+        REQUIRE(counter.get() == 3);
+
+        int collected = 0;
+        registry.setCollector(&collected, [&registry, &collected]() {
+            registry.gauge("collected", "Collector runs").set(++collected);
+        });
+
+        std::string text = registry.serialize();
+        REQUIRE(text == "# HELP collected Collector runs\n"
+                        "# TYPE collected gauge\n"
+                        "collected 1\n"
+                        "# HELP queue_bytes Queued bytes\n"
+                        "# TYPE queue_bytes gauge\n"
+                        "queue_bytes -12\n"
+                        "# HELP requests_total Requests\\nserved\n"
+                        "# TYPE requests_total counter\n"
+                        "requests_total{code=\"200\"} 3\n"
+                        "requests_total{code=\"404\"} 1\n");
+
+        registry.removeCollector(&collected);
+        registry.serialize();
+        REQUIRE(collected == 1);
+
+        auto response = registry.createHttpResponse();
+        REQUIRE(response->statusCode == 200);
+        REQUIRE(response->headers["Content-Type"] == MetricsRegistry::kContentType);
+    }
+
+    SECTION("Metrics by code are found once and shared with the registry")
+    {
+        MetricsRegistry registry;
+        MetricsByCode requests(registry, "requests_total", "Requests", "port=\"80\"", 100, 600);
+
+        Metric& ok = requests.counter(200);
+        ok.increment();
+        REQUIRE(&requests.counter(200) == &ok);
+        REQUIRE(&registry.counter("requests_total", "", "port=\"80\",code=\"200\"") == &ok);
+
+        // Codes out of the cached range still count
+        requests.counter(42).increment(2);
+        requests.counter(42).increment();
+
+        REQUIRE(registry.serialize() == "# HELP requests_total Requests\n"
+                                        "# TYPE requests_total counter\n"
+                                        "requests_total{port=\"80\",code=\"200\"} 1\n"
+                                        "requests_total{port=\"80\",code=\"42\"} 3\n");
+    }
+
+    SECTION("A WebSocket server serves its metrics on its own port")
+    {
+        int port = getFreePort();
+        WebSocketServer server(port);
+        auto registry = std::make_shared<MetricsRegistry>();
+        server.setMetricsRegistry(registry);
+        server.setMetricsPath("/metrics");
+
+        std::mutex mutex;
+        int received = 0;
+        server.setOnConnectionCallback(
+            [&mutex, &received](std::shared_ptr<WebSocket> webSocket,
+                                std::shared_ptr<ConnectionState> /*connectionState*/) {
+                webSocket->setOnMessageCallback([&mutex, &received](
+                                                    const WebSocketMessagePtr& msg) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (msg->type == WebSocketMessageType::Message) received++;
+                });
+            });
+
+        REQUIRE(server.listen().first);
+        server.start();
+
+        WebSocket client;
+        client.setUrl("ws://127.0.0.1:" + std::to_string(port) + "/");
+        client.setOnMessageCallback([](const WebSocketMessagePtr& /*msg*/) {});
+        REQUIRE(client.connect(5).success);
+        client.sendText("hello");
+        client.sendText("world");
+
+        for (int i = 0; i < 300; ++i)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (received == 2) break;
+            }
+            ix::msleep(10);
+        }
+
+        std::string base = "http://127.0.0.1:" + std::to_string(port);
+        std::string labels = "{port=\"" + std::to_string(port) + "\"";
+
+        auto response = get(base + "/metrics");
+        REQUIRE(response->statusCode == 200);
+        std::string text = response->payload;
+
+        REQUIRE(contains(text, "ixwebsocket_server_connections_accepted_total" + labels + "} 2"));
+        REQUIRE(contains(text, "ixwebsocket_server_active_connections" + labels + "} 1"));
+        REQUIRE(contains(text,
+                         "ixwebsocket_server_messages_total" + labels +
+                             ",direction=\"received\"} 2"));
+        REQUIRE(contains(text,
+                         "ixwebsocket_server_bytes_total" + labels +
+                             ",direction=\"received\"} 10"));
+        REQUIRE(contains(text, "ixwebsocket_server_send_queue_bytes" + labels + "} 0"));
+
+        // Without an HTTP callback, other requests fail the handshake
+        REQUIRE(get(base + "/other")->statusCode == 400);
+
+        client.close();
+        for (int i = 0; i < 300 && server.getStats(false).connectedClients != 0; ++i)
+        {
+            ix::msleep(10);
+        }
+
+        text = registry->serialize();
+        REQUIRE(contains(text,
+                         "ixwebsocket_server_close_codes_total" + labels + ",code=\"1000\"} 1"));
+        REQUIRE(contains(text, "ixwebsocket_server_handshake_failures_total" + labels + "} 1"));
+        REQUIRE(contains(text, "ixwebsocket_server_active_connections" + labels + "} 0"));
+
+        server.stop();
+    }
+
+    SECTION("An HTTP server serves the metrics of other servers")
+    {
+        auto registry = std::make_shared<MetricsRegistry>();
+
+        int port = getFreePort();
+        HttpServer server(port, "127.0.0.1");
+        server.setMetricsRegistry(registry);
+        server.setMetricsPath("/metrics");
+        REQUIRE(server.listen().first);
+        server.start();
+
+        registry->counter("other_server_total", "Another server").increment(7);
+
+        std::string base = "http://127.0.0.1:" + std::to_string(port);
+        REQUIRE(get(base + "/missing.txt")->statusCode == 404);
+
+        auto response = get(base + "/metrics?format=text");
+        REQUIRE(response->statusCode == 200);
+        REQUIRE(response->headers["Content-Type"] == MetricsRegistry::kContentType);
+
+        std::string text = response->payload;
+        std::string labels = "{port=\"" + std::to_string(port) + "\"";
+        REQUIRE(contains(text, "other_server_total 7"));
+        REQUIRE(contains(text, "ixwebsocket_server_connections_accepted_total" + labels + "} 2"));
+        REQUIRE(contains(text,
+                         "ixwebsocket_http_server_requests_total" + labels + ",code=\"404\"} 1"));
+        REQUIRE(contains(text, "ixwebsocket_http_server_active_connections" + labels + "} 1"));
+
+        server.stop();
+    }
+}
@@ -0,0 +1,92 @@
+/*
+ *  IXMpscQueueTest.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone. All rights reserved.
+ */
+
+#include "catch.hpp"
+#include <ixwebsocket/IXMpscQueue.h>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace ix;
+
+TEST_CASE("MpscQueue", "[mpsc_queue]")
+{
+    SECTION("Values are popped in the order they were pushed")
+    {
+        MpscQueue<int> queue;
+        int value = 0;
+        REQUIRE(!queue.pop(value));
+
+        for (int i = 0; i < 10; ++i)
+        {
+            queue.push(std::move(i));
+        }
+
+        for (int i = 0; i < 10; ++i)
+        {
+            REQUIRE(queue.pop(value));
+            REQUIRE(value == i);
+        }
+        REQUIRE(!queue.pop(value));
+    }
+
+    SECTION("Move only values left in the queue are released")
+    {
+        auto shared = std::make_shared<int>(42);
+        {
+            MpscQueue<std::shared_ptr<int>> queue;
+            queue.push(std::shared_ptr<int>(shared));
+            queue.push(std::shared_ptr<int>(shared));
+            REQUIRE(shared.use_count() == 3);
+        }
+        REQUIRE(shared.use_count() == 1);
+    }
+
+    SECTION("Each producer order is preserved with concurrent producers")
+    {
+        const int producers = 8;
+        const int count = 20000;
+
+        MpscQueue<std::pair<int, int>> queue;
+        std::vector<std::thread> threads;
+
+        for (int p = 0; p < producers; ++p)
+        {
+            threads.emplace_back([&queue, p, count]() {
+                for (int i = 0; i < count; ++i)
+                {
+                    queue.push(std::make_pair(p, i));
+                }
+            });
+        }
+
+        std::vector<int> next(producers, 0);
+        int popped = 0;
+        bool ordered = true;
+        std::pair<int, int> value;
+
+        while (popped < producers * count)
+        {
+            if (!queue.pop(value))
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            ordered = ordered && value.second == next[value.first];
+            next[value.first] = value.second + 1;
+            popped++;
+        }
+
+        for (auto&& thread : threads)
+        {
+            thread.join();
+        }
+
+        REQUIRE(ordered);
+        REQUIRE(!queue.pop(value));
+    }
+}
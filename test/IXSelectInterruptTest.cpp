@@ -0,0 +1,51 @@
+/*
+ *  IXSelectInterruptTest.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone. All rights reserved.
+ */
+
+#include "catch.hpp"
+#include <ixwebsocket/IXSelectInterrupt.h>
+#include <ixwebsocket/IXSelectInterruptFactory.h>
+#include <ixwebsocket/IXSocket.h>
+
+using namespace ix;
+
+TEST_CASE("SelectInterrupt", "[select_interrupt]")
+{
+    auto selectInterrupt = createSelectInterrupt();
+    std::string errorMsg;
+    REQUIRE(selectInterrupt->init(errorMsg));
+
+    // Windows has no select interrupt fd
+    if (selectInterrupt->getFd() == -1) return;
+
+    SECTION("Notifications are coalesced until the next read")
+    {
+        for (int i = 0; i < 100; ++i)
+        {
+            REQUIRE(selectInterrupt->notify(Socket::kSendRequest));
+        }
+
+        REQUIRE(selectInterrupt->read() == Socket::kSendRequest);
+
+        // Only one write reached the fd
+        REQUIRE(selectInterrupt->read() == 0);
+
+        // The next notify after a read wakes up poll again
+        REQUIRE(selectInterrupt->notify(Socket::kSendRequest));
+        auto pollResult = Socket::poll(true, 0, -1, selectInterrupt);
+        REQUIRE(pollResult == PollResultType::SendRequest);
+    }
+
+    SECTION("A close request is not lost behind a send request")
+    {
+        REQUIRE(selectInterrupt->notify(Socket::kSendRequest));
+        REQUIRE(selectInterrupt->notify(Socket::kCloseRequest));
+        REQUIRE(selectInterrupt->notify(Socket::kSendRequest));
+
+        auto pollResult = Socket::poll(true, 0, -1, selectInterrupt);
+        REQUIRE(pollResult == PollResultType::CloseRequest);
+        REQUIRE(selectInterrupt->read() == 0);
+    }
+}
@@ -77,6 +77,28 @@ TEST_CASE("socket", "[socket]")
         testSocket(host, port, request, socket, expectedStatus, timeoutSecs);
     }
 
+    SECTION("A socket which is both readable and writable reports both")
+    {
+        int port = getFreePort();
+        ix::WebSocketServer server(port);
+        REQUIRE(startWebSocketEchoServer(server));
+
+        std::string errMsg;
+        bool tls = false;
+        SocketTLSOptions tlsOptions;
+        std::shared_ptr<Socket> socket = createSocket(tls, -1, errMsg, tlsOptions);
+        auto isCancellationRequested = []() -> bool { return false; };
+        REQUIRE(socket->connect("127.0.0.1", port, errMsg, isCancellationRequested));
+
+        // The server answers 400 to a request without headers
+        REQUIRE(socket->writeBytes("GET / HTTP/1.1\r\n\r\n", isCancellationRequested));
+        REQUIRE(socket->isReadyToRead(3000) == PollResultType::ReadyForRead);
+        REQUIRE(socket->isReadyToReadOrWrite(0) == PollResultType::ReadyForReadAndWrite);
+
+        socket->close();
+        server.stop();
+    }
+
 #if defined(IXWEBSOCKET_USE_TLS)
     SECTION("Connect to google HTTPS server over port 443. Send GET request without header. Should "
             "return 200")
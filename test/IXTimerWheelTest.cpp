@@ -0,0 +1,331 @@
+/*
+ *  IXTimerWheelTest.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone. All rights reserved.
+ */
+
+#include "IXTest.h"
+#include "catch.hpp"
+#include <atomic>
+#include <ixwebsocket/IXSocket.h>
+#include <ixwebsocket/IXSocketFactory.h>
+#include <ixwebsocket/IXTimerWheel.h>
+#include <ixwebsocket/IXWebSocket.h>
+#include <ixwebsocket/IXWebSocketServer.h>
+#include <mutex>
+#include <vector>
+
+using namespace ix;
+
+TEST_CASE("TimerWheel", "[timer_wheel]")
+{
+    const int tickMs = 10;
+    bool background = false;
+
+    SECTION("Timers fire once, after their delay, in order")
+    {
+        TimerWheel timerWheel(tickMs, background);
+        std::vector<int> fired;
+
+        // Spread over the first three levels of the wheel
+        std::vector<int> delays = {10, 30, 640, 650, 5000, 41000, 50000};
+        for (auto delay : delays)
+        {
+            timerWheel.schedule(delay, [&fired, delay]() { fired.push_back(delay); });
+        }
+        REQUIRE(timerWheel.size() == delays.size());
+
+        for (size_t i = 0; i < delays.size(); ++i)
+        {
+            // One tick early nothing fires, then exactly that timer fires
+            uint64_t ticks = (uint64_t) delays[i] / tickMs;
+            uint64_t previous = (i == 0) ? 0 : (uint64_t) delays[i - 1] / tickMs + 1;
+            timerWheel.advance(ticks - previous);
+            REQUIRE(fired.size() == i);
+
+            timerWheel.advance(1);
+            REQUIRE(fired.size() == i + 1);
+            REQUIRE(fired.back() == delays[i]);
+        }
+
+        REQUIRE(timerWheel.size() == 0);
+        timerWheel.advance(100000);
+        REQUIRE(fired.size() == delays.size());
+    }
+
+    SECTION("Cancelled timers do not fire")
+    {
+        TimerWheel timerWheel(tickMs, background);
+        int fired = 0;
+
+        auto first = timerWheel.schedule(100, [&fired]() { fired++; });
+        auto second = timerWheel.schedule(100000, [&fired]() { fired++; });
+        timerWheel.schedule(100, [&fired]() { fired += 10; });
+
+        REQUIRE(timerWheel.cancel(first));
+        REQUIRE(!timerWheel.cancel(first));
+        REQUIRE(timerWheel.cancel(second));
+
+        timerWheel.advance(100000);
+        REQUIRE(fired == 10);
+        REQUIRE(timerWheel.size() == 0);
+    }
+
+    SECTION("Timers beyond the range of the wheel fire on time")
+    {
+        TimerWheel timerWheel(1, background);
+        bool fired = false;
+
+        // The wheel covers 64^4 ticks
+        uint64_t delay = (1 << 24) + 1000;
+        timerWheel.schedule((int) delay, [&fired]() { fired = true; });
+
+        timerWheel.advance(delay);
+        REQUIRE(!fired);
+        timerWheel.advance(1);
+        REQUIRE(fired);
+    }
+
+    SECTION("Callbacks can schedule timers")
+    {
+        TimerWheel timerWheel(tickMs, background);
+        int fired = 0;
+
+        std::function<void()> callback;
+        callback = [&]() {
+            if (++fired < 5) timerWheel.schedule(tickMs, callback);
+        };
+        timerWheel.schedule(tickMs, callback);
+
+        timerWheel.advance(100);
+        REQUIRE(fired == 5);
+    }
+
+    SECTION("The background thread fires timers in real time")
+    {
+        TimerWheel timerWheel(tickMs);
+        std::atomic<int> fired(0);
+
+        for (int i = 0; i < 100; ++i)
+        {
+            timerWheel.schedule(20 + i, [&fired]() { fired++; });
+        }
+
+        int attempts = 0;
+        while (fired < 100 && attempts++ < 500)
+        {
+            ix::msleep(10);
+        }
+        REQUIRE(fired == 100);
+        REQUIRE(timerWheel.size() == 0);
+    }
+
+    SECTION("The background thread starts again after stop")
+    {
+        TimerWheel timerWheel(tickMs);
+        std::atomic<int> fired(0);
+
+        timerWheel.schedule(10, [&fired]() { fired++; });
+        timerWheel.stop();
+
+        timerWheel.schedule(10, [&fired]() { fired++; });
+
+        int attempts = 0;
+        while (fired < 2 && attempts++ < 100)
+        {
+            ix::msleep(10);
+        }
+        REQUIRE(fired == 2);
+    }
+
+    SECTION("A callback can release the last reference to the wheel")
+    {
+        auto timerWheel = std::make_shared<TimerWheel>(tickMs);
+        std::shared_ptr<TimerWheel> owner = timerWheel;
+        std::atomic<bool> released(false);
+
+        timerWheel->schedule(10, [&owner, &released]() {
+            owner.reset();
+            released = true;
+        });
+        timerWheel->schedule(10, []() {});
+        timerWheel.reset();
+
+        int attempts = 0;
+        while (!released && attempts++ < 100)
+        {
+            ix::msleep(10);
+        }
+        REQUIRE(released);
+    }
+}
+
+TEST_CASE("Websocket_timers", "[websocket_timers]")
+{
+    SECTION("Heartbeats are sent every ping interval")
+    {
+        int port = getFreePort();
+        ix::WebSocketServer server(port);
+        std::atomic<int> pings(0);
+
+        server.setOnConnectionCallback(
+            [&pings](std::shared_ptr<ix::WebSocket> webSocket,
+                     std::shared_ptr<ConnectionState> /*connectionState*/) {
+                webSocket->setOnMessageCallback([&pings](const ix::WebSocketMessagePtr& msg) {
+                    if (msg->type == ix::WebSocketMessageType::Ping) pings++;
+                });
+            });
+
+        REQUIRE(server.listen().first);
+        server.start();
+
+        ix::WebSocket webSocket;
+        webSocket.setUrl("ws://127.0.0.1:" + std::to_string(port));
+        webSocket.disableAutomaticReconnection();
+        webSocket.setPingInterval(1);
+        webSocket.setOnMessageCallback([](const ix::WebSocketMessagePtr&) {});
+        webSocket.start();
+
+        // One heartbeat right away, then one per second
+        ix::msleep(2500);
+        REQUIRE(pings >= 2);
+        REQUIRE(pings <= 4);
+        REQUIRE(webSocket.getReadyState() == ReadyState::Open);
+
+        webSocket.stop();
+        server.stop();
+    }
+
+    SECTION("A close which is not answered times out")
+    {
+        int port = getFreePort();
+        ix::WebSocketServer server(port);
+        std::atomic<bool> closed(false);
+        std::shared_ptr<ix::WebSocket> connection;
+        std::mutex mutex;
+
+        server.setOnConnectionCallback(
+            [&](std::shared_ptr<ix::WebSocket> webSocket,
+                std::shared_ptr<ConnectionState> /*connectionState*/) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    connection = webSocket;
+                }
+                webSocket->setOnMessageCallback([&closed](const ix::WebSocketMessagePtr& msg) {
+                    if (msg->type == ix::WebSocketMessageType::Close) closed = true;
+                });
+            });
+
+        REQUIRE(server.listen().first);
+        server.start();
+
+        // A raw client which never answers the close frame
+        std::string errMsg;
+        SocketTLSOptions tlsOptions;
+        auto socket = createSocket(false, -1, errMsg, tlsOptions);
+        auto isCancellationRequested = []() -> bool { return false; };
+        REQUIRE(socket->connect("127.0.0.1", port, errMsg, isCancellationRequested));
+        socket->writeBytes("GET / HTTP/1.1\r\n"
+                           "Upgrade: websocket\r\n"
+                           "Connection: Upgrade\r\n"
+                           "Sec-WebSocket-Version: 13\r\n"
+                           "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                           "\r\n",
+                           isCancellationRequested);
+
+        int attempts = 0;
+        while (attempts++ < 500)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (connection && connection->getReadyState() == ReadyState::Open) break;
+            }
+            ix::msleep(10);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            REQUIRE(connection);
+            connection->close();
+        }
+
+        // The close handshake deadline is 300ms
+        attempts = 0;
+        while (!closed && attempts++ < 100)
+        {
+            ix::msleep(10);
+        }
+        REQUIRE(closed);
+
+        socket->close();
+        server.stop();
+    }
+
+    SECTION("Idle clients are closed with a going away code")
+    {
+        int port = getFreePort();
+        ix::WebSocketServer server(port);
+        server.setIdleTimeout(1);
+        std::atomic<bool> closed(false);
+
+        server.setOnConnectionCallback(
+            [&closed](std::shared_ptr<ix::WebSocket> webSocket,
+                      std::shared_ptr<ConnectionState> /*connectionState*/) {
+                webSocket->setOnMessageCallback([&closed](const ix::WebSocketMessagePtr& msg) {
+                    if (msg->type == ix::WebSocketMessageType::Close) closed = true;
+                });
+            });
+
+        REQUIRE(server.listen().first);
+        server.start();
+
+        // A raw client which never sends anything after the handshake
+        std::string errMsg;
+        SocketTLSOptions tlsOptions;
+        auto socket = createSocket(false, -1, errMsg, tlsOptions);
+        auto isCancellationRequested = []() -> bool { return false; };
+        REQUIRE(socket->connect("127.0.0.1", port, errMsg, isCancellationRequested));
+        socket->writeBytes("GET / HTTP/1.1\r\n"
+                           "Upgrade: websocket\r\n"
+                           "Connection: Upgrade\r\n"
+                           "Sec-WebSocket-Version: 13\r\n"
+                           "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                           "\r\n",
+                           isCancellationRequested);
+
+        while (true)
+        {
+            auto line = socket->readLine(isCancellationRequested);
+            REQUIRE(line.first);
+            if (line.second == "\r\n") break;
+        }
+
+        // Close frame header, then the 1001 code
+        std::string frame;
+        int attempts = 0;
+        while (frame.size() < 4 && attempts++ < 300)
+        {
+            char c;
+            if (socket->recv(&c, 1) == 1)
+            {
+                frame += c;
+                continue;
+            }
+            ix::msleep(10);
+        }
+        REQUIRE(frame.size() == 4);
+        REQUIRE((uint8_t) frame[0] == 0x88);
+        REQUIRE((((uint8_t) frame[2] << 8) | (uint8_t) frame[3]) == 1001);
+
+        attempts = 0;
+        while (!closed && attempts++ < 100)
+        {
+            ix::msleep(10);
+        }
+        REQUIRE(closed);
+        REQUIRE(server.getStats().idleDisconnects == 1);
+
+        socket->close();
+        server.stop();
+    }
+}
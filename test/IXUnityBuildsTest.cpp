@@ -5,12 +5,17 @@
  */
 
 #include "catch.hpp"
+#include <ixwebsocket/IXBufferPool.h>
 #include <ixwebsocket/IXCancellationRequest.h>
 #include <ixwebsocket/IXConnectionState.h>
+#include <ixwebsocket/IXConnectionTimings.h>
 #include <ixwebsocket/IXDNSLookup.h>
 #include <ixwebsocket/IXHttp.h>
 #include <ixwebsocket/IXHttpClient.h>
+#include <ixwebsocket/IXHttpRouter.h>
 #include <ixwebsocket/IXHttpServer.h>
+#include <ixwebsocket/IXMetricsRegistry.h>
+#include <ixwebsocket/IXMpscQueue.h>
 #include <ixwebsocket/IXNetSystem.h>
 #include <ixwebsocket/IXProgressCallback.h>
 #include <ixwebsocket/IXSelectInterrupt.h>
@@ -20,23 +25,30 @@
 #include <ixwebsocket/IXSocketConnect.h>
 #include <ixwebsocket/IXSocketFactory.h>
 #include <ixwebsocket/IXSocketServer.h>
+#include <ixwebsocket/IXTimerWheel.h>
+#include <ixwebsocket/IXTrace.h>
 #include <ixwebsocket/IXUrlParser.h>
 #include <ixwebsocket/IXWebSocket.h>
+#include <ixwebsocket/IXWebSocketBatchMessage.h>
 #include <ixwebsocket/IXWebSocketCloseConstants.h>
 #include <ixwebsocket/IXWebSocketCloseInfo.h>
 #include <ixwebsocket/IXWebSocketErrorInfo.h>
 #include <ixwebsocket/IXWebSocketHandshake.h>
 #include <ixwebsocket/IXWebSocketHttpHeaders.h>
+#include <ixwebsocket/IXWebSocketMask.h>
 #include <ixwebsocket/IXWebSocketMessage.h>
 #include <ixwebsocket/IXWebSocketMessageQueue.h>
 #include <ixwebsocket/IXWebSocketMessageType.h>
 #include <ixwebsocket/IXWebSocketOpenInfo.h>
 #include <ixwebsocket/IXWebSocketPerMessageDeflate.h>
 #include <ixwebsocket/IXWebSocketPerMessageDeflateCodec.h>
+#include <ixwebsocket/IXWebSocketPerMessageDeflateFastCodec.h>
 #include <ixwebsocket/IXWebSocketPerMessageDeflateOptions.h>
 #include <ixwebsocket/IXWebSocketSendInfo.h>
 #include <ixwebsocket/IXWebSocketServer.h>
+#include <ixwebsocket/IXWebSocketStats.h>
 #include <ixwebsocket/IXWebSocketTransport.h>
+#include <ixwebsocket/IXWorkerPool.h>
 #include <ixwebsocket/LUrlParser.h>
 #include <ixwebsocket/libwshandshake.hpp>
 
@@ -0,0 +1,210 @@
+/*
+ *  IXWebSocketHibernationTest.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone. All rights reserved.
+ */
+
+#include "IXTest.h"
+#include "catch.hpp"
+#include <atomic>
+#include <ixwebsocket/IXWebSocket.h>
+#include <ixwebsocket/IXWebSocketServer.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace ix;
+
+namespace
+{
+    class EchoClient
+    {
+    public:
+        EchoClient(int port)
+            : _open(false)
+        {
+            std::string url = "ws://127.0.0.1:" + std::to_string(port) + "/";
+            _webSocket.setUrl(url);
+            _webSocket.disableAutomaticReconnection();
+
+            // No context is kept between messages, so the server can release its streams
+            _webSocket.setPerMessageDeflateOptions(WebSocketPerMessageDeflateOptions(true, true));
+
+            _webSocket.setOnMessageCallback([this](const WebSocketMessagePtr& msg) {
+                if (msg->type == WebSocketMessageType::Open)
+                {
+                    _open = true;
+                }
+                else if (msg->type == WebSocketMessageType::Close)
+                {
+                    _open = false;
+                }
+                else if (msg->type == WebSocketMessageType::Message)
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _messages.push_back(msg->str);
+                }
+            });
+        }
+
+        bool start()
+        {
+            _webSocket.start();
+
+            int attempts = 0;
+            while (!_open && attempts++ < 500)
+            {
+                ix::msleep(10);
+            }
+            return _open;
+        }
+
+        void stop()
+        {
+            _webSocket.stop();
+        }
+
+        void send(const std::string& text)
+        {
+            _webSocket.sendText(text);
+        }
+
+        bool isOpen() const
+        {
+            return _open;
+        }
+
+        // Wait until the given message was received
+        bool waitFor(const std::string& text)
+        {
+            for (int attempts = 0; attempts < 500; ++attempts)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    for (auto&& message : _messages)
+                    {
+                        if (message == text) return true;
+                    }
+                }
+                ix::msleep(10);
+            }
+            return false;
+        }
+
+    private:
+        WebSocket _webSocket;
+        std::atomic<bool> _open;
+        std::mutex _mutex;
+        std::vector<std::string> _messages;
+    };
+
+    bool waitForHibernatedClients(WebSocketServer& server, size_t count)
+    {
+        for (int attempts = 0; attempts < 500; ++attempts)
+        {
+            if (server.getStats().hibernatedClients == count) return true;
+            ix::msleep(10);
+        }
+        return false;
+    }
+} // namespace
+
+TEST_CASE("Websocket_hibernation", "[websocket_hibernation]")
+{
+    SECTION("Idle clients hibernate and resume on incoming data, sends and close")
+    {
+        int port = getFreePort();
+        WebSocketServer server(port);
+        server.enableHibernation(1);
+
+        std::mutex mutex;
+        std::shared_ptr<WebSocket> connection;
+
+        server.setOnConnectionCallback(
+            [&mutex, &connection](std::shared_ptr<WebSocket> webSocket,
+                                  std::shared_ptr<ConnectionState> /*connectionState*/) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    connection = webSocket;
+                }
+
+                std::weak_ptr<WebSocket> weakWebSocket(webSocket);
+                webSocket->setOnMessageCallback(
+                    [weakWebSocket](const WebSocketMessagePtr& msg) {
+                        auto webSocket = weakWebSocket.lock();
+                        if (webSocket && msg->type == WebSocketMessageType::Message)
+                        {
+                            webSocket->sendText("echo " + msg->str);
+                        }
+                    });
+            });
+
+        REQUIRE(server.listen().first);
+        server.start();
+
+        EchoClient client(port);
+        REQUIRE(client.start());
+
+        client.send("1");
+        REQUIRE(client.waitFor("echo 1"));
+        REQUIRE(server.getStats().hibernatedClients == 0);
+
+        // Incoming data gives the connection a thread again
+        REQUIRE(waitForHibernatedClients(server, 1));
+        std::string large(4096, 'a');
+        client.send(large);
+        REQUIRE(client.waitFor("echo " + large));
+
+        // So do sends from another thread
+        REQUIRE(waitForHibernatedClients(server, 1));
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            connection->sendText("push");
+        }
+        REQUIRE(client.waitFor("push"));
+
+        // And the peer going away
+        REQUIRE(waitForHibernatedClients(server, 1));
+        client.stop();
+
+        int attempts = 0;
+        while (server.getStats().connectedClients != 0 && attempts++ < 500)
+        {
+            ix::msleep(10);
+        }
+        REQUIRE(server.getStats().connectedClients == 0);
+        REQUIRE(server.getStats().hibernatedClients == 0);
+
+        server.stop();
+    }
+
+    SECTION("Stopping the server closes hibernated clients")
+    {
+        int port = getFreePort();
+        WebSocketServer server(port);
+        server.enableHibernation(1);
+
+        server.setOnConnectionCallback([](std::shared_ptr<WebSocket> webSocket,
+                                          std::shared_ptr<ConnectionState> /*connectionState*/) {
+            webSocket->setOnMessageCallback([](const WebSocketMessagePtr&) {});
+        });
+
+        REQUIRE(server.listen().first);
+        server.start();
+
+        EchoClient client(port);
+        REQUIRE(client.start());
+        REQUIRE(waitForHibernatedClients(server, 1));
+
+        server.stop();
+        REQUIRE(server.getStats().connectedClients == 0);
+
+        int attempts = 0;
+        while (client.isOpen() && attempts++ < 500)
+        {
+            ix::msleep(10);
+        }
+        REQUIRE(!client.isOpen());
+        client.stop();
+    }
+}
@@ -0,0 +1,456 @@
+/*
+ *  IXWebSocketPerMessageDeflateTest.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone. All rights reserved.
+ */
+
+#include "IXTest.h"
+#include "catch.hpp"
+#include <ixwebsocket/IXWebSocket.h>
+#include <ixwebsocket/IXWebSocketPerMessageDeflate.h>
+#include <ixwebsocket/IXWebSocketPerMessageDeflateOptions.h>
+#include <ixwebsocket/IXWebSocketServer.h>
+#include <mutex>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+using namespace ix;
+
+namespace
+{
+    std::string makeMessage(const std::string& word)
+    {
+        std::string message;
+        for (int i = 0; i < 500; ++i)
+        {
+            message += word + std::to_string(i % 10) + " ";
+        }
+        return message;
+    }
+
+    bool roundTrip(WebSocketPerMessageDeflate& sender,
+                   WebSocketPerMessageDeflate& receiver,
+                   const std::string& message)
+    {
+        std::string compressed;
+        std::string decompressed;
+        return sender.compress(message, compressed) &&
+               receiver.decompress(compressed, decompressed) && decompressed == message;
+    }
+
+    bool waitFor(std::mutex& mutex,
+                 std::vector<std::pair<std::string, size_t>>& received,
+                 size_t count)
+    {
+        for (int i = 0; i < 300; ++i)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (received.size() >= count) return true;
+            }
+            ix::msleep(10);
+        }
+        return false;
+    }
+} // namespace
+
+TEST_CASE("PerMessageDeflate", "[permessage_deflate]")
+{
+    SECTION("Compression settings are local and not sent in the header")
+    {
+        WebSocketPerMessageDeflateOptions options(true, true);
+        std::string header = options.generateHeader();
+
+        REQUIRE(options.getCompressionLevel() ==
+                WebSocketPerMessageDeflateOptions::kDefaultCompressionLevel);
+        REQUIRE(options.getMemLevel() == WebSocketPerMessageDeflateOptions::kDefaultMemLevel);
+        REQUIRE(options.getStrategy() == WebSocketPerMessageDeflateOptions::kDefaultStrategy);
+
+        options.setCompressionLevel(9);
+        options.setMemLevel(8);
+        options.setStrategy(Z_FILTERED);
+        REQUIRE(options.getCompressionLevel() == 9);
+        REQUIRE(options.getMemLevel() == 8);
+        REQUIRE(options.getStrategy() == Z_FILTERED);
+        REQUIRE(options.generateHeader() == header);
+
+        WebSocketPerMessageDeflateOptions parsed(header);
+        REQUIRE(parsed.getCompressionLevel() ==
+                WebSocketPerMessageDeflateOptions::kDefaultCompressionLevel);
+    }
+
+    SECTION("The compression level is applied")
+    {
+        std::string message = makeMessage("hello");
+        std::string stored;
+        std::string best;
+
+        WebSocketPerMessageDeflateOptions options(true, true);
+        options.setCompressionLevel(0);
+        WebSocketPerMessageDeflate storing;
+        REQUIRE(storing.init(options, false));
+        REQUIRE(storing.compress(message, stored));
+
+        options.setCompressionLevel(9);
+        options.setMemLevel(9);
+        WebSocketPerMessageDeflate compressing;
+        REQUIRE(compressing.init(options, false));
+        REQUIRE(compressing.compress(message, best));
+
+        REQUIRE(stored.size() > message.size());
+        REQUIRE(best.size() < message.size() / 10);
+
+        WebSocketPerMessageDeflate receiver;
+        REQUIRE(receiver.init(options, true));
+        REQUIRE(roundTrip(storing, receiver, message));
+        REQUIRE(roundTrip(compressing, receiver, message));
+
+        options.setMemLevel(10);
+        WebSocketPerMessageDeflate invalid;
+        REQUIRE(!invalid.init(options, false));
+    }
+
+    SECTION("Connections without context takeover share streams")
+    {
+        WebSocketPerMessageDeflateOptions options(true, true);
+        options.setStrategy(Z_HUFFMAN_ONLY);
+
+        WebSocketPerMessageDeflate clientA;
+        WebSocketPerMessageDeflate clientB;
+        WebSocketPerMessageDeflate serverA;
+        WebSocketPerMessageDeflate serverB;
+        REQUIRE(clientA.init(options, false));
+        REQUIRE(clientB.init(options, false));
+        REQUIRE(serverA.init(options, true));
+        REQUIRE(serverB.init(options, true));
+
+        for (int i = 0; i < 10; ++i)
+        {
+            REQUIRE(roundTrip(clientA, serverA, makeMessage("a" + std::to_string(i))));
+            REQUIRE(roundTrip(clientB, serverB, makeMessage("b" + std::to_string(i))));
+            REQUIRE(roundTrip(serverB, clientB, makeMessage("c" + std::to_string(i))));
+        }
+    }
+
+    SECTION("Connections with context takeover keep their own streams")
+    {
+        WebSocketPerMessageDeflateOptions options(true);
+
+        WebSocketPerMessageDeflate clientA;
+        WebSocketPerMessageDeflate clientB;
+        WebSocketPerMessageDeflate serverA;
+        WebSocketPerMessageDeflate serverB;
+        REQUIRE(clientA.init(options, false));
+        REQUIRE(clientB.init(options, false));
+        REQUIRE(serverA.init(options, true));
+        REQUIRE(serverB.init(options, true));
+
+        std::string message = makeMessage("context");
+        std::string first;
+        std::string second;
+        REQUIRE(clientA.compress(message, first));
+        REQUIRE(clientA.compress(message, second));
+        REQUIRE(second.size() < first.size());
+
+        std::string decompressed;
+        REQUIRE(serverA.decompress(first, decompressed));
+        REQUIRE(roundTrip(clientB, serverB, makeMessage("other")));
+
+        decompressed.clear();
+        REQUIRE(serverA.decompress(second, decompressed));
+        REQUIRE(decompressed == message);
+    }
+
+    SECTION("Messages are inflated at the end of the output whatever their ratio")
+    {
+        WebSocketPerMessageDeflateOptions options(true);
+        WebSocketPerMessageDeflate sender;
+        WebSocketPerMessageDeflate receiver;
+        REQUIRE(sender.init(options, false));
+        REQUIRE(receiver.init(options, true));
+
+        std::string noise;
+        unsigned seed = 42;
+        for (int i = 0; i < 100000; ++i)
+        {
+            seed = seed * 1103515245 + 12345;
+            noise += (char) (seed >> 16);
+        }
+
+        std::vector<std::string> messages = {
+            std::string(1 << 20, 'a'), noise, "", makeMessage("small"), std::string(1 << 20, 'b')};
+
+        for (auto&& message : messages)
+        {
+            std::string compressed;
+            REQUIRE(sender.compress(message, compressed));
+
+            std::string out("prefix");
+            REQUIRE(receiver.decompress(compressed, out));
+            REQUIRE(out == "prefix" + message);
+        }
+    }
+
+    SECTION("A very compressible message does not oversize the next output buffer")
+    {
+        WebSocketPerMessageDeflateOptions options(true);
+        WebSocketPerMessageDeflate sender;
+        WebSocketPerMessageDeflate receiver;
+        REQUIRE(sender.init(options, false));
+        REQUIRE(receiver.init(options, true));
+
+        std::string noise;
+        unsigned seed = 7;
+        for (int i = 0; i < (1 << 21); ++i)
+        {
+            seed = seed * 1103515245 + 12345;
+            noise += (char) (seed >> 16);
+        }
+
+        std::string compressed;
+        std::string out;
+        REQUIRE(sender.compress(std::string(4 << 20, '\0'), compressed));
+        REQUIRE(receiver.decompress(compressed, out));
+
+        compressed.clear();
+        std::string next;
+        REQUIRE(sender.compress(noise, compressed));
+        REQUIRE(receiver.decompress(compressed, next));
+        REQUIRE(next == noise);
+        REQUIRE(next.capacity() < 8 * noise.size());
+    }
+
+    SECTION("A final deflate block ends the message")
+    {
+        WebSocketPerMessageDeflate receiver;
+        REQUIRE(receiver.init(WebSocketPerMessageDeflateOptions(true), true));
+
+        for (int i = 0; i < 2; ++i)
+        {
+            std::string message = makeMessage("final");
+            std::string compressed(compressBound((uLong) message.size()), '\0');
+
+            z_stream stream;
+            memset(&stream, 0, sizeof(stream));
+            REQUIRE(deflateInit2(&stream, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+            stream.next_in = (Bytef*) message.data();
+            stream.avail_in = (uInt) message.size();
+            stream.next_out = (Bytef*) &compressed[0];
+            stream.avail_out = (uInt) compressed.size();
+            REQUIRE(deflate(&stream, Z_FINISH) == Z_STREAM_END);
+            compressed.resize(stream.total_out);
+            deflateEnd(&stream);
+
+            std::string out;
+            REQUIRE(receiver.decompress(compressed, out));
+            REQUIRE(out == message);
+        }
+    }
+
+    SECTION("A shared stream does not leak the previous messages")
+    {
+        // The sender keeps its context although it negotiated not to
+        WebSocketPerMessageDeflate sender;
+        REQUIRE(sender.init(WebSocketPerMessageDeflateOptions(true), false));
+
+        WebSocketPerMessageDeflate receiver;
+        REQUIRE(receiver.init(WebSocketPerMessageDeflateOptions(true, true), true));
+
+        std::string message = makeMessage("secret");
+        std::string first;
+        std::string second;
+        REQUIRE(sender.compress(message, first));
+        REQUIRE(sender.compress(message, second));
+
+        std::string decompressed;
+        REQUIRE(receiver.decompress(first, decompressed));
+        REQUIRE(decompressed == message);
+
+        decompressed.clear();
+        REQUIRE(!receiver.decompress(second, decompressed));
+        REQUIRE(decompressed.find("secret") == std::string::npos);
+    }
+
+    SECTION("The fast codec is inflated by zlib")
+    {
+        WebSocketPerMessageDeflateOptions options(true, true);
+        options.setCodec(PerMessageDeflateCodec::Fast);
+
+        WebSocketPerMessageDeflate sender;
+        WebSocketPerMessageDeflate receiver;
+        REQUIRE(sender.init(options, false));
+        REQUIRE(receiver.init(WebSocketPerMessageDeflateOptions(true, true), true));
+
+        std::string noise;
+        unsigned seed = 7;
+        for (int i = 0; i < 200000; ++i)
+        {
+            seed = seed * 1103515245 + 12345;
+            noise += (char) (seed >> 16);
+        }
+
+        std::string repeated;
+        for (int i = 0; i < 20000; ++i)
+        {
+            repeated += (char) (i % 251) + std::string(i % 7, 'x');
+        }
+
+        // Distances up to the window and lengths up to 258 are reached
+        std::vector<std::string> messages = {"",
+                                             "a",
+                                             "abc",
+                                             makeMessage("fast"),
+                                             std::string(1 << 20, 'z'),
+                                             noise,
+                                             noise.substr(0, 40000) + noise.substr(0, 40000),
+                                             repeated};
+
+        for (auto&& message : messages)
+        {
+            std::string compressed;
+            REQUIRE(sender.compress(message, compressed));
+
+            // Stored blocks at worst, 5 bytes of headers per 64K
+            REQUIRE(compressed.size() <= message.size() + 5 * (message.size() / 65535 + 1) + 1);
+
+            std::string decompressed;
+            REQUIRE(receiver.decompress(compressed, decompressed));
+            REQUIRE(decompressed == message);
+        }
+
+        std::string compressed;
+        REQUIRE(sender.compress(makeMessage("fast"), compressed));
+        REQUIRE(compressed.size() < makeMessage("fast").size() / 10);
+
+        // Each message is compressed on its own, whatever was sent before
+        std::string again;
+        REQUIRE(sender.compress(makeMessage("fast"), again));
+        REQUIRE(again == compressed);
+    }
+
+    SECTION("The fast codec honors a smaller window")
+    {
+        WebSocketPerMessageDeflateOptions options(true, true, false, 9, 9);
+        options.setCodec(PerMessageDeflateCodec::Fast);
+
+        WebSocketPerMessageDeflate sender;
+        WebSocketPerMessageDeflate receiver;
+        REQUIRE(sender.init(options, false));
+        REQUIRE(receiver.init(options, true));
+
+        // Repeats 1000 bytes apart, out of a 512 bytes window
+        std::string block;
+        unsigned seed = 3;
+        for (int i = 0; i < 1000; ++i)
+        {
+            seed = seed * 1103515245 + 12345;
+            block += (char) ('a' + (seed >> 16) % 26);
+        }
+
+        std::string message = block + block + block;
+        REQUIRE(roundTrip(sender, receiver, message));
+    }
+
+    SECTION("The codec is ignored when the context is kept")
+    {
+        WebSocketPerMessageDeflateOptions options(true);
+        options.setCodec(PerMessageDeflateCodec::Fast);
+
+        WebSocketPerMessageDeflate sender;
+        WebSocketPerMessageDeflate receiver;
+        REQUIRE(sender.init(options, false));
+        REQUIRE(receiver.init(options, true));
+
+        std::string message = makeMessage("zlib");
+        std::string first;
+        std::string second;
+        REQUIRE(sender.compress(message, first));
+        REQUIRE(sender.compress(message, second));
+        REQUIRE(second.size() < first.size());
+
+        std::string decompressed;
+        REQUIRE(receiver.decompress(first, decompressed));
+        REQUIRE(receiver.decompress(second, decompressed));
+        REQUIRE(decompressed == message + message);
+    }
+
+    SECTION("Small messages and messages sent with compress cleared are not compressed")
+    {
+        int port = getFreePort();
+        WebSocketServer server(port);
+
+        std::mutex mutex;
+        std::shared_ptr<WebSocket> connection;
+
+        server.setOnConnectionCallback(
+            [&mutex, &connection](std::shared_ptr<WebSocket> webSocket,
+                                  std::shared_ptr<ConnectionState> /*connectionState*/) {
+                WebSocketPerMessageDeflateOptions options(true);
+                options.setMinCompressionSize(64);
+                webSocket->setPerMessageDeflateOptions(options);
+                webSocket->setOnMessageCallback([](const WebSocketMessagePtr&) {});
+
+                std::lock_guard<std::mutex> lock(mutex);
+                connection = webSocket;
+            });
+
+        REQUIRE(server.listen().first);
+        server.start();
+
+        // Message and wire size of what the client received
+        std::vector<std::pair<std::string, size_t>> received;
+        bool open = false;
+
+        WebSocket client;
+        client.setUrl("ws://127.0.0.1:" + std::to_string(port) + "/");
+        client.setPerMessageDeflateOptions(WebSocketPerMessageDeflateOptions(true));
+        client.setOnMessageCallback([&mutex, &received, &open](const WebSocketMessagePtr& msg) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (msg->type == WebSocketMessageType::Open) open = true;
+            if (msg->type == WebSocketMessageType::Message)
+            {
+                received.emplace_back(msg->str, msg->wireSize);
+            }
+        });
+        client.start();
+
+        for (int i = 0; i < 300; ++i)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (open && connection) break;
+            }
+            ix::msleep(10);
+        }
+
+        std::string small(40, 'a');
+        std::string large(4096, 'b');
+
+        REQUIRE(connection->sendText(small).wireSize == small.size());
+        REQUIRE(connection->sendText(large).wireSize < large.size() / 10);
+        REQUIRE(connection->sendBinary(large, nullptr, nullptr, false).wireSize == large.size());
+        REQUIRE(connection->send(large, false, nullptr, nullptr, false).wireSize == large.size());
+
+        std::vector<WebSocketBatchMessage> batch = {
+            {small, false}, {large, true, false}, {large, true}};
+        REQUIRE(connection->sendBatch(batch).wireSize < small.size() + large.size() + 100);
+
+        REQUIRE(waitFor(mutex, received, 7));
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::vector<std::string> messages = {small, large, large, large, small, large, large};
+            std::vector<bool> compressed = {false, true, false, false, false, false, true};
+
+            for (size_t i = 0; i < messages.size(); ++i)
+            {
+                REQUIRE(received[i].first == messages[i]);
+                REQUIRE((received[i].second < messages[i].size()) == compressed[i]);
+            }
+        }
+
+        client.stop();
+        server.stop();
+    }
+}
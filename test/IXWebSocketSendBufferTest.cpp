@@ -0,0 +1,991 @@
+/*
+ *  IXWebSocketSendBufferTest.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone. All rights reserved.
+ */
+
+#include "IXTest.h"
+#include "catch.hpp"
+#include <atomic>
+#include <ixwebsocket/IXSocket.h>
+#include <ixwebsocket/IXSocketFactory.h>
+#include <ixwebsocket/IXWebSocket.h>
+#include <ixwebsocket/IXWebSocketServer.h>
+#include <ixwebsocket/IXWorkerPool.h>
+#include <mutex>
+#include <random>
+#include <thread>
+
+using namespace ix;
+
+namespace
+{
+    const int kMessagesCount = 32;
+    const size_t kMessageSize = 1 << 20;
+    const size_t kMaxBufferedAmount = 4 << 20;
+
+    // A client which completes the handshake and then does not read anything,
+    // so that the server send buffer fills up
+    std::shared_ptr<Socket> connectSlowClient(int port, bool deflate = false)
+    {
+        std::string errMsg;
+        bool tls = false;
+        SocketTLSOptions tlsOptions;
+        std::shared_ptr<Socket> socket = createSocket(tls, -1, errMsg, tlsOptions);
+        auto isCancellationRequested = []() -> bool { return false; };
+
+        if (!socket->connect("127.0.0.1", port, errMsg, isCancellationRequested))
+        {
+            return nullptr;
+        }
+
+        socket->writeBytes("GET / HTTP/1.1\r\n"
+                           "Upgrade: websocket\r\n"
+                           "Connection: Upgrade\r\n"
+                           "Sec-WebSocket-Version: 13\r\n"
+                           "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n",
+                           isCancellationRequested);
+        if (deflate)
+        {
+            socket->writeBytes("Sec-WebSocket-Extensions: permessage-deflate\r\n",
+                               isCancellationRequested);
+        }
+        socket->writeBytes("\r\n", isCancellationRequested);
+
+        // Skip the handshake response headers
+        while (true)
+        {
+            auto lineResult = socket->readLine(isCancellationRequested);
+            if (!lineResult.first) return nullptr;
+            if (lineResult.second == "\r\n") break;
+        }
+
+        return socket;
+    }
+
+    // Read whatever the server sent so far
+    size_t drain(std::shared_ptr<Socket> socket)
+    {
+        size_t total = 0;
+        std::vector<char> buffer(1 << 16);
+
+        while (true)
+        {
+            ssize_t ret = socket->recv(&buffer[0], buffer.size());
+            if (ret <= 0) break;
+            total += (size_t) ret;
+        }
+
+        return total;
+    }
+
+    // Random payloads which each start with the end of the previous one, so that
+    // with the compression context kept each message refers to the one before
+    std::vector<std::string> makeChainedPayloads(int count, size_t size)
+    {
+        std::mt19937 random(count);
+        std::vector<std::string> payloads;
+        std::string payload;
+
+        for (int i = 0; i < count; ++i)
+        {
+            std::string tail = (payload.empty()) ? "" : payload.substr(size - size / 4);
+            payload = tail;
+            while (payload.size() < size)
+            {
+                payload.push_back((char) random());
+            }
+            payloads.push_back(payload);
+        }
+
+        return payloads;
+    }
+
+    struct Delivery
+    {
+        int received;
+        int failed;
+        int closeCode;
+
+        // Whether the client received exactly the messages which did not fail
+        bool intact;
+    };
+
+    // Send chained payloads, half of them while the client does not read so
+    // that the send buffer fills up, the other half once it read everything.
+    Delivery sendToSlowClient(SendBufferPolicy policy, bool deflate)
+    {
+        const int count = 256;
+        const size_t maxBufferedAmount = 1 << 20;
+        auto payloads = makeChainedPayloads(count, 64 * 1024);
+
+        int port = getFreePort();
+        ix::WebSocketServer server(port);
+        server.disableBlockingSend();
+
+        std::mutex mutex;
+        std::shared_ptr<ix::WebSocket> connection;
+
+        server.setOnConnectionCallback(
+            [&](std::shared_ptr<ix::WebSocket> webSocket,
+                std::shared_ptr<ConnectionState> /*connectionState*/) {
+                webSocket->setMaxBufferedAmount(maxBufferedAmount, policy);
+
+                std::weak_ptr<ix::WebSocket> weakWebSocket(webSocket);
+                webSocket->setOnMessageCallback([&mutex, &connection, weakWebSocket](
+                                                    const ix::WebSocketMessagePtr& msg) {
+                    if (msg->type == ix::WebSocketMessageType::Open)
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        connection = weakWebSocket.lock();
+                    }
+                });
+            });
+
+        Delivery delivery;
+        delivery.received = 0;
+        delivery.failed = 0;
+        delivery.closeCode = 0;
+        delivery.intact = false;
+
+        if (!server.listen().first) return delivery;
+        server.start();
+
+        std::atomic<bool> reading(false);
+        std::vector<bool> failed(count, false);
+        std::vector<int> received;
+        size_t next = 0;
+
+        ix::WebSocket webSocket;
+        webSocket.setUrl("ws://127.0.0.1:" + std::to_string(port));
+        webSocket.disableAutomaticReconnection();
+        if (deflate)
+            webSocket.enablePerMessageDeflate();
+        else
+            webSocket.disablePerMessageDeflate();
+        webSocket.setOnMessageCallback([&](const ix::WebSocketMessagePtr& msg) {
+            for (int i = 0; i < 1000 && !reading; ++i)
+            {
+                ix::msleep(10);
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (msg->type == ix::WebSocketMessageType::Message)
+            {
+                while (next < payloads.size() && payloads[next] != msg->str)
+                {
+                    ++next;
+                }
+                received.push_back((next == payloads.size()) ? -1 : (int) next++);
+                delivery.received++;
+            }
+            else if (msg->type == ix::WebSocketMessageType::Close)
+            {
+                delivery.closeCode = msg->closeInfo.code;
+            }
+            else if (msg->type == ix::WebSocketMessageType::Error)
+            {
+                received.push_back(-1);
+            }
+        });
+        webSocket.start();
+
+        std::shared_ptr<ix::WebSocket> sender;
+        for (int i = 0; i < 500 && !sender; ++i)
+        {
+            ix::msleep(10);
+            std::lock_guard<std::mutex> lock(mutex);
+            sender = connection;
+        }
+        if (!sender) return delivery;
+
+        for (int i = 0; i < count; ++i)
+        {
+            if (i == count / 2)
+            {
+                reading = true;
+                for (int j = 0; j < 1000 && sender->bufferedAmount() != 0; ++j)
+                {
+                    ix::msleep(10);
+                }
+            }
+
+            sender->sendBinary(payloads[i], nullptr, [&mutex, &failed, &delivery, i](bool success) {
+                std::lock_guard<std::mutex> lock(mutex);
+                failed[i] = !success;
+                if (!success) delivery.failed++;
+            });
+        }
+        reading = true;
+
+        for (int i = 0; i < 1000; ++i)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (delivery.received + delivery.failed == count) break;
+                if (delivery.closeCode != 0) break;
+            }
+            ix::msleep(10);
+        }
+
+        Delivery result;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::vector<int> expected;
+            for (int i = 0; i < count; ++i)
+            {
+                if (!failed[i]) expected.push_back(i);
+            }
+
+            result = delivery;
+            result.intact = received == expected;
+        }
+
+        sender.reset();
+        connection.reset();
+        webSocket.stop();
+        server.stop();
+        return result;
+    }
+} // namespace
+
+TEST_CASE("Websocket_send_buffer", "[websocket_send_buffer]")
+{
+    SECTION("Messages above the cap are dropped with the drop newest policy")
+    {
+        int port = getFreePort();
+        ix::WebSocketServer server(port);
+        server.disableBlockingSend();
+        server.disablePerMessageDeflate();
+
+        std::atomic<int> failed(0);
+        std::atomic<int> aboveHighWatermark(0);
+        std::atomic<int> belowLowWatermark(0);
+        std::atomic<bool> sent(false);
+
+        server.setOnConnectionCallback(
+            [&](std::shared_ptr<ix::WebSocket> webSocket,
+                std::shared_ptr<ConnectionState> /*connectionState*/) {
+                webSocket->setMaxBufferedAmount(kMaxBufferedAmount, SendBufferPolicy::DropNewest);
+                webSocket->setSendBufferWatermarks(kMessageSize, 2 * kMessageSize);
+                webSocket->setOnSendBufferWatermarkCallback(
+                    [&](bool above, size_t /*bufferedAmount*/) {
+                        if (above)
+                            aboveHighWatermark++;
+                        else
+                            belowLowWatermark++;
+                    });
+
+                std::weak_ptr<ix::WebSocket> weakWebSocket(webSocket);
+                webSocket->setOnMessageCallback(
+                    [weakWebSocket, &failed, &sent](const ix::WebSocketMessagePtr& msg) {
+                        auto webSocket = weakWebSocket.lock();
+                        if (webSocket && msg->type == ix::WebSocketMessageType::Open)
+                        {
+                            std::string payload(kMessageSize, 'a');
+                            for (int i = 0; i < kMessagesCount; ++i)
+                            {
+                                webSocket->sendBinary(payload, nullptr, [&failed](bool success) {
+                                    if (!success) failed++;
+                                });
+                            }
+                            sent = true;
+                        }
+                    });
+            });
+
+        REQUIRE(server.listen().first);
+        server.start();
+
+        auto socket = connectSlowClient(port);
+        REQUIRE(socket != nullptr);
+
+        int attempts = 0;
+        while (!sent && attempts++ < 500)
+        {
+            ix::msleep(10);
+        }
+        REQUIRE(sent);
+
+        // The send buffer never grows past the cap
+        auto stats = server.getStats();
+        REQUIRE(stats.connectedClients == 1);
+        REQUIRE(stats.connections.size() == 1);
+        REQUIRE(stats.connections[0].bufferedAmount > 0);
+        REQUIRE(stats.connections[0].bufferedAmount <= kMaxBufferedAmount);
+        REQUIRE(stats.connections[0].droppedMessages > 0);
+        REQUIRE(stats.connections[0].droppedMessages == (uint64_t) failed);
+        REQUIRE(aboveHighWatermark == 1);
+
+        // Once the client reads, the buffer drains to the low watermark
+        attempts = 0;
+        while (belowLowWatermark == 0 && attempts++ < 500)
+        {
+            drain(socket);
+            ix::msleep(10);
+        }
+        REQUIRE(belowLowWatermark == 1);
+
+        socket->close();
+        server.stop();
+        REQUIRE(server.getClients().size() == 0);
+    }
+
+    SECTION("Oldest messages are dropped with the drop oldest policy")
+    {
+        int port = getFreePort();
+        ix::WebSocketServer server(port);
+        server.disableBlockingSend();
+        server.disablePerMessageDeflate();
+
+        std::atomic<int> failed(0);
+        std::atomic<bool> lastMessageQueued(false);
+
+        server.setOnConnectionCallback(
+            [&](std::shared_ptr<ix::WebSocket> webSocket,
+                std::shared_ptr<ConnectionState> /*connectionState*/) {
+                webSocket->setMaxBufferedAmount(kMaxBufferedAmount, SendBufferPolicy::DropOldest);
+
+                std::weak_ptr<ix::WebSocket> weakWebSocket(webSocket);
+                webSocket->setOnMessageCallback(
+                    [weakWebSocket, &failed, &lastMessageQueued](
+                        const ix::WebSocketMessagePtr& msg) {
+                        auto webSocket = weakWebSocket.lock();
+                        if (webSocket && msg->type == ix::WebSocketMessageType::Open)
+                        {
+                            std::string payload(kMessageSize, 'a');
+                            for (int i = 0; i < kMessagesCount; ++i)
+                            {
+                                webSocket->sendBinary(payload, nullptr, [&failed](bool success) {
+                                    if (!success) failed++;
+                                });
+                            }
+                            lastMessageQueued = webSocket->getDroppedMessagesCount() > 0 &&
+                                                webSocket->bufferedAmount() > 0;
+                        }
+                    });
+            });
+
+        REQUIRE(server.listen().first);
+        server.start();
+
+        auto socket = connectSlowClient(port);
+        REQUIRE(socket != nullptr);
+
+        int attempts = 0;
+        while (!lastMessageQueued && attempts++ < 500)
+        {
+            ix::msleep(10);
+        }
+        REQUIRE(lastMessageQueued);
+
+        auto stats = server.getStats();
+        REQUIRE(stats.connections.size() == 1);
+        REQUIRE(stats.connections[0].bufferedAmount <= kMaxBufferedAmount);
+        REQUIRE(stats.connections[0].droppedMessages == (uint64_t) failed);
+
+        socket->close();
+        server.stop();
+    }
+
+    SECTION("A slow client is disconnected with the disconnect policy")
+    {
+        int port = getFreePort();
+        ix::WebSocketServer server(port);
+        server.disableBlockingSend();
+        server.disablePerMessageDeflate();
+
+        std::atomic<int> closeCode(0);
+
+        server.setOnConnectionCallback(
+            [&closeCode](std::shared_ptr<ix::WebSocket> webSocket,
+                         std::shared_ptr<ConnectionState> /*connectionState*/) {
+                webSocket->setMaxBufferedAmount(kMaxBufferedAmount, SendBufferPolicy::Disconnect);
+
+                std::weak_ptr<ix::WebSocket> weakWebSocket(webSocket);
+                webSocket->setOnMessageCallback(
+                    [weakWebSocket, &closeCode](const ix::WebSocketMessagePtr& msg) {
+                        auto webSocket = weakWebSocket.lock();
+                        if (webSocket && msg->type == ix::WebSocketMessageType::Open)
+                        {
+                            std::string payload(kMessageSize, 'a');
+                            for (int i = 0; i < kMessagesCount; ++i)
+                            {
+                                if (!webSocket->sendBinary(payload).success) break;
+                            }
+                        }
+                        else if (msg->type == ix::WebSocketMessageType::Close)
+                        {
+                            closeCode = msg->closeInfo.code;
+                        }
+                    });
+            });
+
+        REQUIRE(server.listen().first);
+        server.start();
+
+        auto socket = connectSlowClient(port);
+        REQUIRE(socket != nullptr);
+
+        int attempts = 0;
+        while (closeCode == 0 && attempts++ < 500)
+        {
+            ix::msleep(10);
+        }
+        REQUIRE(closeCode == WebSocketCloseConstants::kPolicyViolationCode);
+
+        socket->close();
+        server.stop();
+        REQUIRE(server.getClients().size() == 0);
+    }
+
+    SECTION("Compressed messages are dropped before compression with the drop newest policy")
+    {
+        auto delivery = sendToSlowClient(SendBufferPolicy::DropNewest, true);
+        REQUIRE(delivery.intact);
+        REQUIRE(delivery.failed > 0);
+        REQUIRE(delivery.received + delivery.failed == 256);
+        REQUIRE(delivery.closeCode == 0);
+    }
+
+    SECTION("Compressed messages are not dropped with the drop oldest policy")
+    {
+        // The messages depend on each other, the client is disconnected instead
+        auto delivery = sendToSlowClient(SendBufferPolicy::DropOldest, true);
+        REQUIRE(delivery.intact);
+        REQUIRE(delivery.received + delivery.failed == 256);
+        REQUIRE(delivery.closeCode == WebSocketCloseConstants::kPolicyViolationCode);
+    }
+
+    SECTION("Compressed messages sent before a disconnect are received intact")
+    {
+        auto delivery = sendToSlowClient(SendBufferPolicy::Disconnect, true);
+        REQUIRE(delivery.intact);
+        REQUIRE(delivery.received > 0);
+        REQUIRE(delivery.closeCode == WebSocketCloseConstants::kPolicyViolationCode);
+    }
+
+    SECTION("Messages dropped with the drop oldest policy leave the others intact")
+    {
+        auto delivery = sendToSlowClient(SendBufferPolicy::DropOldest, false);
+        REQUIRE(delivery.intact);
+        REQUIRE(delivery.failed > 0);
+        REQUIRE(delivery.received + delivery.failed == 256);
+        REQUIRE(delivery.closeCode == 0);
+    }
+
+    SECTION("Control frames are written between the fragments of a large message")
+    {
+        int port = getFreePort();
+        ix::WebSocketServer server(port);
+        server.disableBlockingSend();
+        server.disablePerMessageDeflate();
+
+        server.setOnConnectionCallback(
+            [](std::shared_ptr<ix::WebSocket> webSocket,
+               std::shared_ptr<ConnectionState> /*connectionState*/) {
+                std::weak_ptr<ix::WebSocket> weakWebSocket(webSocket);
+                webSocket->setOnMessageCallback(
+                    [weakWebSocket](const ix::WebSocketMessagePtr& msg) {
+                        auto webSocket = weakWebSocket.lock();
+                        if (webSocket && msg->type == ix::WebSocketMessageType::Open)
+                        {
+                            // The ping does not wait behind the data still buffered
+                            std::string payload(16 * kMessageSize, 'a');
+                            webSocket->sendBinary(payload);
+                            webSocket->ping("hi");
+                        }
+                    });
+            });
+
+        REQUIRE(server.listen().first);
+        server.start();
+
+        std::mutex mutex;
+        std::vector<ix::WebSocketMessageType> received;
+
+        ix::WebSocket webSocket;
+        webSocket.setUrl("ws://127.0.0.1:" + std::to_string(port));
+        webSocket.disableAutomaticReconnection();
+        webSocket.disablePerMessageDeflate();
+        webSocket.setOnMessageCallback([&mutex, &received](const ix::WebSocketMessagePtr& msg) {
+            if (msg->type == ix::WebSocketMessageType::Message ||
+                msg->type == ix::WebSocketMessageType::Ping)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                received.push_back(msg->type);
+            }
+        });
+        webSocket.start();
+
+        int attempts = 0;
+        while (attempts++ < 1000)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (received.size() == 2) break;
+            }
+            ix::msleep(10);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            REQUIRE(received.size() == 2);
+            REQUIRE(received[0] == ix::WebSocketMessageType::Ping);
+            REQUIRE(received[1] == ix::WebSocketMessageType::Message);
+        }
+
+        webSocket.stop();
+        server.stop();
+    }
+
+    SECTION("Messages sent before close are written before the close frame")
+    {
+        int port = getFreePort();
+        ix::WebSocketServer server(port);
+        server.disablePerMessageDeflate();
+
+        std::atomic<int> received(0);
+        std::atomic<bool> closed(false);
+
+        server.setOnConnectionCallback(
+            [&received, &closed](std::shared_ptr<ix::WebSocket> webSocket,
+                                 std::shared_ptr<ConnectionState> /*connectionState*/) {
+                webSocket->setOnMessageCallback(
+                    [&received, &closed](const ix::WebSocketMessagePtr& msg) {
+                        if (msg->type == ix::WebSocketMessageType::Message)
+                        {
+                            received++;
+                        }
+                        else if (msg->type == ix::WebSocketMessageType::Close)
+                        {
+                            closed = true;
+                        }
+                    });
+            });
+
+        REQUIRE(server.listen().first);
+        server.start();
+
+        std::atomic<bool> open(false);
+
+        ix::WebSocket webSocket;
+        webSocket.setUrl("ws://127.0.0.1:" + std::to_string(port));
+        webSocket.disableAutomaticReconnection();
+        webSocket.disableBlockingSend();
+        webSocket.disablePerMessageDeflate();
+        webSocket.setOnMessageCallback([&open](const ix::WebSocketMessagePtr& msg) {
+            if (msg->type == ix::WebSocketMessageType::Open) open = true;
+        });
+        webSocket.start();
+
+        int attempts = 0;
+        while (!open && attempts++ < 500)
+        {
+            ix::msleep(10);
+        }
+        REQUIRE(open);
+
+        for (int i = 0; i < 5; ++i)
+        {
+            for (int j = 0; j < kMessagesCount; ++j)
+            {
+                REQUIRE(webSocket.sendText("hello").success);
+            }
+            webSocket.close();
+
+            attempts = 0;
+            while (!closed && attempts++ < 500)
+            {
+                ix::msleep(10);
+            }
+            REQUIRE(closed);
+            REQUIRE(received == (i + 1) * kMessagesCount);
+
+            // Reconnect for the next round
+            closed = false;
+            open = false;
+            webSocket.stop();
+            webSocket.start();
+
+            attempts = 0;
+            while (!open && attempts++ < 500)
+            {
+                ix::msleep(10);
+            }
+            REQUIRE(open);
+        }
+
+        webSocket.stop();
+        server.stop();
+    }
+
+    SECTION("A batch is received as separate messages, in order")
+    {
+        int port = getFreePort();
+        ix::WebSocketServer server(port);
+
+        std::atomic<bool> batchSent(false);
+
+        server.setOnConnectionCallback(
+            [&batchSent](std::shared_ptr<ix::WebSocket> webSocket,
+                         std::shared_ptr<ConnectionState> /*connectionState*/) {
+                std::weak_ptr<ix::WebSocket> weakWebSocket(webSocket);
+                webSocket->setOnMessageCallback(
+                    [weakWebSocket, &batchSent](const ix::WebSocketMessagePtr& msg) {
+                        auto webSocket = weakWebSocket.lock();
+                        if (webSocket && msg->type == ix::WebSocketMessageType::Open)
+                        {
+                            std::vector<ix::WebSocketBatchMessage> batch;
+                            for (int i = 0; i < kMessagesCount; ++i)
+                            {
+                                bool binary = i % 2 == 1;
+                                batch.emplace_back(std::to_string(i), binary);
+                            }
+
+                            // Large enough to be fragmented
+                            batch.emplace_back(std::string(kMessageSize, 'a'), true);
+
+                            webSocket->sendBatch(batch, [&batchSent](bool success) {
+                                batchSent = success;
+                            });
+                        }
+                    });
+            });
+
+        REQUIRE(server.listen().first);
+        server.start();
+
+        std::mutex mutex;
+        std::vector<std::pair<std::string, bool>> received;
+
+        ix::WebSocket webSocket;
+        webSocket.setUrl("ws://127.0.0.1:" + std::to_string(port));
+        webSocket.disableAutomaticReconnection();
+        webSocket.setOnMessageCallback([&mutex, &received](const ix::WebSocketMessagePtr& msg) {
+            if (msg->type == ix::WebSocketMessageType::Message)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                received.emplace_back(msg->str, msg->binary);
+            }
+        });
+        webSocket.start();
+
+        int attempts = 0;
+        while (attempts++ < 500)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (received.size() == kMessagesCount + 1) break;
+            }
+            ix::msleep(10);
+        }
+
+        REQUIRE(batchSent);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            REQUIRE(received.size() == kMessagesCount + 1);
+            for (int i = 0; i < kMessagesCount; ++i)
+            {
+                REQUIRE(received[i].first == std::to_string(i));
+                REQUIRE(received[i].second == (i % 2 == 1));
+            }
+            REQUIRE(received.back().first == std::string(kMessageSize, 'a'));
+        }
+
+        webSocket.stop();
+        server.stop();
+    }
+
+    SECTION("Small messages are held until the write coalescing window closes")
+    {
+        int port = getFreePort();
+        ix::WebSocketServer server(port);
+        server.disableBlockingSend();
+        server.disablePerMessageDeflate();
+        server.enableWriteCoalescing(200 * 1000);
+
+        std::atomic<bool> sent(false);
+
+        server.setOnConnectionCallback(
+            [&sent](std::shared_ptr<ix::WebSocket> webSocket,
+                    std::shared_ptr<ConnectionState> /*connectionState*/) {
+                std::weak_ptr<ix::WebSocket> weakWebSocket(webSocket);
+                webSocket->setOnMessageCallback(
+                    [weakWebSocket, &sent](const ix::WebSocketMessagePtr& msg) {
+                        auto webSocket = weakWebSocket.lock();
+                        if (webSocket && msg->type == ix::WebSocketMessageType::Open)
+                        {
+                            for (int i = 0; i < kMessagesCount; ++i)
+                            {
+                                webSocket->sendBinary("0123456789");
+                            }
+                            sent = true;
+                        }
+                    });
+            });
+
+        REQUIRE(server.listen().first);
+        server.start();
+
+        auto socket = connectSlowClient(port);
+        REQUIRE(socket != nullptr);
+
+        int attempts = 0;
+        while (!sent && attempts++ < 500)
+        {
+            ix::msleep(1);
+        }
+        REQUIRE(sent);
+
+        // Nothing is written before the window closes, then everything at once
+        REQUIRE(drain(socket) == 0);
+
+        size_t expected = kMessagesCount * (2 + 10);
+        size_t received = 0;
+        attempts = 0;
+        while (received < expected && attempts++ < 500)
+        {
+            ix::msleep(10);
+            received += drain(socket);
+        }
+        REQUIRE(received == expected);
+
+        socket->close();
+        server.stop();
+    }
+
+    SECTION("A compressed reply from the message callback does not wait on a blocked sender")
+    {
+        int port = getFreePort();
+        ix::WebSocketServer server(port);
+
+        server.setOnConnectionCallback(
+            [](std::shared_ptr<ix::WebSocket> webSocket,
+               std::shared_ptr<ConnectionState> /*connectionState*/) {
+                std::weak_ptr<ix::WebSocket> weakWebSocket(webSocket);
+                webSocket->setOnMessageCallback(
+                    [weakWebSocket](const ix::WebSocketMessagePtr& msg) {
+                        auto webSocket = weakWebSocket.lock();
+                        if (webSocket && msg->type == ix::WebSocketMessageType::Message)
+                        {
+                            // Reads slowly, so that the client socket buffer fills up
+                            ix::msleep(5);
+                            webSocket->sendText("ack");
+                        }
+                    });
+            });
+
+        REQUIRE(server.listen().first);
+        server.start();
+
+        // Each ack gets a compressed reply, sent by the client connection thread
+        // while another thread is blocked on the full buffer
+        ix::WebSocket webSocket;
+        webSocket.setUrl("ws://127.0.0.1:" + std::to_string(port));
+        webSocket.disableAutomaticReconnection();
+        webSocket.disableBlockingSend();
+        webSocket.enablePerMessageDeflate();
+        webSocket.setMaxBufferedAmount(64 * 1024, SendBufferPolicy::Block);
+        webSocket.setOnMessageCallback([&webSocket](const ix::WebSocketMessagePtr& msg) {
+            if (msg->type == ix::WebSocketMessageType::Message)
+            {
+                webSocket.sendText(std::string(8 * 1024, 'r'));
+            }
+        });
+        webSocket.start();
+
+        int attempts = 0;
+        while (webSocket.getReadyState() != ReadyState::Open && attempts++ < 500)
+        {
+            ix::msleep(10);
+        }
+        REQUIRE(webSocket.getReadyState() == ReadyState::Open);
+
+        // Does not compress much, so that the buffer fills up
+        std::string payload;
+        unsigned seed = 42;
+        for (int i = 0; i < 200 * 1024; ++i)
+        {
+            seed = seed * 1103515245 + 12345;
+            payload += (char) ('a' + (seed >> 16) % 26);
+        }
+
+        std::atomic<int> sent(0);
+        std::thread sender([&webSocket, &payload, &sent]() {
+            for (int i = 0; i < 100; ++i)
+            {
+                if (!webSocket.sendText(payload).success) break;
+                sent++;
+            }
+        });
+
+        attempts = 0;
+        while (sent < 100 && attempts++ < 2000)
+        {
+            ix::msleep(10);
+        }
+        REQUIRE(sent == 100);
+
+        sender.join();
+        webSocket.stop();
+        server.stop();
+    }
+
+    SECTION("Offloaded sends wait for room on the sending thread, not on the worker")
+    {
+        int port = getFreePort();
+        ix::WebSocketServer server(port);
+        server.disableBlockingSend();
+        server.enableCompressionOffload(16 * 1024, std::make_shared<WorkerPool>(1));
+
+        std::mutex mutex;
+        std::vector<std::shared_ptr<ix::WebSocket>> connections;
+
+        server.setOnConnectionCallback(
+            [&mutex, &connections](std::shared_ptr<ix::WebSocket> webSocket,
+                                   std::shared_ptr<ConnectionState> /*connectionState*/) {
+                webSocket->setMaxBufferedAmount(1 << 20, SendBufferPolicy::Block);
+                webSocket->setOnMessageCallback([](const ix::WebSocketMessagePtr&) {});
+
+                std::lock_guard<std::mutex> lock(mutex);
+                connections.push_back(webSocket);
+            });
+
+        REQUIRE(server.listen().first);
+        server.start();
+
+        auto socket = connectSlowClient(port, true);
+        REQUIRE(socket != nullptr);
+
+        std::atomic<bool> received(false);
+        ix::WebSocket webSocket;
+        webSocket.setUrl("ws://127.0.0.1:" + std::to_string(port));
+        webSocket.disableAutomaticReconnection();
+        webSocket.enablePerMessageDeflate();
+        webSocket.setOnMessageCallback([&received](const ix::WebSocketMessagePtr& msg) {
+            if (msg->type == ix::WebSocketMessageType::Message) received = true;
+        });
+        webSocket.start();
+
+        int attempts = 0;
+        while (attempts++ < 500)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (connections.size() == 2) break;
+            }
+            ix::msleep(10);
+        }
+        REQUIRE(connections.size() == 2);
+
+        // Fills the buffer of the slow client, the sender ends up waiting
+        auto payloads = makeChainedPayloads(64, 256 * 1024);
+        std::shared_ptr<ix::WebSocket> slow = connections[0];
+        std::thread sender([slow, &payloads]() {
+            for (auto&& payload : payloads)
+            {
+                if (!slow->sendBinary(payload).success) break;
+            }
+        });
+
+        attempts = 0;
+        while (slow->bufferedAmount() < (1 << 20) && attempts++ < 500)
+        {
+            ix::msleep(10);
+        }
+
+        // The shared worker still compresses for the other connection
+        connections[1]->sendText(std::string(64 * 1024, 'b'));
+        attempts = 0;
+        while (!received && attempts++ < 500)
+        {
+            ix::msleep(10);
+        }
+        REQUIRE(received);
+
+        webSocket.stop();
+        server.stop();
+        sender.join();
+        socket->close();
+    }
+
+    SECTION("Sends are not starved by a peer which keeps sending")
+    {
+        int port = getFreePort();
+        ix::WebSocketServer server(port);
+        server.disableBlockingSend();
+        server.disablePerMessageDeflate();
+
+        std::mutex mutex;
+        std::shared_ptr<ix::WebSocket> connection;
+        std::atomic<size_t> received(0);
+
+        server.setOnConnectionCallback(
+            [&mutex, &connection, &received](std::shared_ptr<ix::WebSocket> webSocket,
+                                             std::shared_ptr<ConnectionState> /*connectionState*/) {
+                webSocket->setMaxBufferedAmount(1 << 20, SendBufferPolicy::Block);
+                webSocket->setOnMessageCallback([&received](const ix::WebSocketMessagePtr& msg) {
+                    if (msg->type == ix::WebSocketMessageType::Message)
+                    {
+                        received = msg->str.size();
+                    }
+                });
+
+                std::lock_guard<std::mutex> lock(mutex);
+                connection = webSocket;
+            });
+
+        REQUIRE(server.listen().first);
+        server.start();
+
+        ix::WebSocket webSocket;
+        webSocket.setUrl("ws://127.0.0.1:" + std::to_string(port));
+        webSocket.disableAutomaticReconnection();
+        webSocket.disableBlockingSend();
+        webSocket.disablePerMessageDeflate();
+        webSocket.setOnMessageCallback([](const ix::WebSocketMessagePtr& msg) {
+            // Reads slower than the server sends
+            if (msg->type == ix::WebSocketMessageType::Message) ix::msleep(2);
+        });
+        webSocket.start();
+
+        std::shared_ptr<ix::WebSocket> flooding;
+        for (int i = 0; i < 500 && !flooding; ++i)
+        {
+            ix::msleep(10);
+            std::lock_guard<std::mutex> lock(mutex);
+            flooding = connection;
+        }
+        REQUIRE(flooding);
+
+        // The client socket is always readable while the server floods it. The
+        // flood is paced so that each read returns quickly.
+        std::atomic<bool> stop(false);
+        std::thread flood([flooding, &stop]() {
+            std::string payload(64 * 1024, 'f');
+            while (!stop && flooding->sendBinary(payload).success)
+            {
+                ix::msleep(1);
+            }
+        });
+        ix::msleep(100);
+
+        // Written from the client connection thread
+        webSocket.sendBinary(std::string(16 * kMessageSize, 'c'));
+
+        int attempts = 0;
+        while (received == 0 && attempts++ < 1000)
+        {
+            ix::msleep(10);
+        }
+        size_t result = received;
+
+        stop = true;
+        webSocket.stop();
+        server.stop();
+        flood.join();
+
+        REQUIRE(result == 16 * kMessageSize);
+    }
+}
@@ -194,4 +194,160 @@ TEST_CASE("Websocket_server", "[websocket_server]")
         REQUIRE(connectionId == "foobarConnectionId");
         REQUIRE(server.getClients().size() == 0);
     }
+
+    SECTION("Serve plain HTTP requests and WebSocket upgrades on the same port")
+    {
+        int port = getFreePort();
+        ix::WebSocketServer server(port);
+        std::string connectionId;
+
+        server.setOnHttpRequestCallback(
+            [](HttpRequestPtr request,
+               std::shared_ptr<ConnectionState> /*connectionState*/) -> HttpResponsePtr {
+                return std::make_shared<HttpResponse>(
+                    200, "OK", HttpErrorCode::Ok, WebSocketHttpHeaders(), request->uri);
+            });
+        REQUIRE(startServer(server, connectionId));
+
+        std::string errMsg;
+        bool tls = false;
+        SocketTLSOptions tlsOptions;
+        std::string host("127.0.0.1");
+        auto isCancellationRequested = []() -> bool { return false; };
+
+        // Plain HTTP request
+        std::shared_ptr<Socket> socket = createSocket(tls, -1, errMsg, tlsOptions);
+        REQUIRE(socket->connect(host, port, errMsg, isCancellationRequested));
+
+        socket->writeBytes("GET /plain HTTP/1.1\r\n"
+                           "Host: 127.0.0.1\r\n"
+                           "\r\n",
+                           isCancellationRequested);
+
+        auto lineResult = socket->readLine(isCancellationRequested);
+        REQUIRE(lineResult.first);
+
+        int status = -1;
+        REQUIRE(sscanf(lineResult.second.c_str(), "HTTP/1.1 %d", &status) == 1);
+        REQUIRE(status == 200);
+
+        // WebSocket upgrade on the same port
+        socket = createSocket(tls, -1, errMsg, tlsOptions);
+        REQUIRE(socket->connect(host, port, errMsg, isCancellationRequested));
+
+        socket->writeBytes("GET / HTTP/1.1\r\n"
+                           "Upgrade: websocket\r\n"
+                           "Sec-WebSocket-Version: 13\r\n"
+                           "Sec-WebSocket-Key: foobar\r\n"
+                           "\r\n",
+                           isCancellationRequested);
+
+        lineResult = socket->readLine(isCancellationRequested);
+        REQUIRE(lineResult.first);
+
+        status = -1;
+        REQUIRE(sscanf(lineResult.second.c_str(), "HTTP/1.1 %d", &status) == 1);
+        REQUIRE(status == 101);
+
+        // Any other upgrade goes to the HTTP callback, whatever its bytes
+        socket = createSocket(tls, -1, errMsg, tlsOptions);
+        REQUIRE(socket->connect(host, port, errMsg, isCancellationRequested));
+
+        socket->writeBytes("GET /other HTTP/1.1\r\n"
+                           "Upgrade: \xc3\x89" "bsocket\r\n"
+                           "\r\n",
+                           isCancellationRequested);
+
+        lineResult = socket->readLine(isCancellationRequested);
+        REQUIRE(lineResult.first);
+
+        status = -1;
+        REQUIRE(sscanf(lineResult.second.c_str(), "HTTP/1.1 %d", &status) == 1);
+        REQUIRE(status == 200);
+
+        // Invalid request, answered like on a WebSocket only server
+        socket = createSocket(tls, -1, errMsg, tlsOptions);
+        REQUIRE(socket->connect(host, port, errMsg, isCancellationRequested));
+
+        socket->writeBytes("GET /\r\n", isCancellationRequested);
+
+        lineResult = socket->readLine(isCancellationRequested);
+        REQUIRE(lineResult.first);
+
+        status = -1;
+        REQUIRE(sscanf(lineResult.second.c_str(), "HTTP/1.1 %d", &status) == 1);
+        REQUIRE(status == 400);
+
+        // Give us 500ms for the server to notice that clients went away
+        ix::msleep(500);
+
+        server.stop();
+        REQUIRE(connectionId == "foobarConnectionId");
+        REQUIRE(server.getClients().size() == 0);
+    }
+
+    SECTION("Non blocking send reports completion through a callback")
+    {
+        int port = getFreePort();
+        ix::WebSocketServer server(port);
+        server.disableBlockingSend();
+
+        std::atomic<int> completed(0);
+        std::atomic<int> failed(0);
+
+        server.setOnConnectionCallback(
+            [&completed, &failed](std::shared_ptr<ix::WebSocket> webSocket,
+                                  std::shared_ptr<ConnectionState> /*connectionState*/) {
+                std::weak_ptr<ix::WebSocket> weakWebSocket(webSocket);
+                webSocket->setOnMessageCallback(
+                    [weakWebSocket, &completed, &failed](const ix::WebSocketMessagePtr& msg) {
+                        auto webSocket = weakWebSocket.lock();
+                        if (webSocket && msg->type == ix::WebSocketMessageType::Open)
+                        {
+                            // A large message, written in many steps by the connection thread
+                            std::string payload(1 << 20, 'a');
+                            webSocket->sendBinary(
+                                payload, nullptr, [&completed, &failed](bool success) {
+                                    if (success)
+                                        completed++;
+                                    else
+                                        failed++;
+                                });
+                        }
+                    });
+            });
+
+        REQUIRE(server.listen().first);
+        server.start();
+
+        std::atomic<size_t> receivedBytes(0);
+        ix::WebSocket webSocket;
+        webSocket.setUrl("ws://127.0.0.1:" + std::to_string(port));
+        webSocket.disableAutomaticReconnection();
+        webSocket.setOnMessageCallback([&receivedBytes](const ix::WebSocketMessagePtr& msg) {
+            if (msg->type == ix::WebSocketMessageType::Message)
+            {
+                receivedBytes += msg->str.size();
+            }
+        });
+        webSocket.start();
+
+        int attempts = 0;
+        while (receivedBytes != (1 << 20) && attempts++ < 500)
+        {
+            ix::msleep(10);
+        }
+
+        REQUIRE(receivedBytes == (1 << 20));
+        REQUIRE(completed == 1);
+        REQUIRE(failed == 0);
+
+        webSocket.stop();
+
+        // Give us 500ms for the server to notice that clients went away
+        ix::msleep(500);
+
+        server.stop();
+        REQUIRE(server.getClients().size() == 0);
+    }
 }
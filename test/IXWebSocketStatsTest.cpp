@@ -0,0 +1,166 @@
+/*
+ *  IXWebSocketStatsTest.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone. All rights reserved.
+ */
+
+#include "IXTest.h"
+#include "catch.hpp"
+#include <ixwebsocket/IXWebSocket.h>
+#include <ixwebsocket/IXWebSocketServer.h>
+#include <ixwebsocket/IXWebSocketStats.h>
+#include <mutex>
+#include <string>
+
+using namespace ix;
+
+TEST_CASE("WebSocketStats", "[stats]")
+{
+    SECTION("Histogram percentiles are within the bucket precision")
+    {
+        LatencyHistogram histogram;
+        REQUIRE(histogram.getPercentile(50) == 0);
+
+        for (uint64_t value = 1; value <= 10000; ++value)
+        {
+            histogram.record(value);
+        }
+
+        REQUIRE(histogram.getCount() == 10000);
+        REQUIRE(histogram.getMax() == 10000);
+        REQUIRE(histogram.getMean() == Approx(5000.5));
+        REQUIRE(histogram.getPercentile(100) == 10000);
+
+        for (double percentile : {1.0, 50.0, 90.0, 99.0, 99.9})
+        {
+            double exact = percentile * 100;
+            REQUIRE(histogram.getPercentile(percentile) >= exact);
+            REQUIRE(histogram.getPercentile(percentile) <= exact * 1.125 + 1);
+        }
+
+        // Bucket bounds grow and cover the whole range
+        for (size_t i = 1; i < LatencyHistogram::kBuckets; ++i)
+        {
+            REQUIRE(LatencyHistogram::getBucketUpperBound(i) >
+                    LatencyHistogram::getBucketUpperBound(i - 1));
+        }
+        REQUIRE(LatencyHistogram::getBucketUpperBound(LatencyHistogram::kBuckets - 1) >
+                LatencyHistogram::kMaxValue);
+
+        LatencyHistogram copy(histogram);
+        copy.record(UINT64_MAX);
+        copy.merge(histogram);
+        REQUIRE(copy.getCount() == 20001);
+        REQUIRE(copy.getMax() == LatencyHistogram::kMaxValue);
+        REQUIRE(copy.getBucketCount(LatencyHistogram::kBuckets - 1) == 1);
+        REQUIRE(histogram.getCount() == 10000);
+    }
+
+    SECTION("Connections count their messages, frames and latencies")
+    {
+        int port = getFreePort();
+        WebSocketServer server(port);
+
+        std::mutex mutex;
+        std::shared_ptr<WebSocket> connection;
+        int serverReceived = 0;
+
+        server.setOnConnectionCallback(
+            [&mutex, &connection, &serverReceived](
+                std::shared_ptr<WebSocket> webSocket,
+                std::shared_ptr<ConnectionState> /*connectionState*/) {
+                webSocket->setOnMessageCallback([&mutex, &serverReceived](
+                                                    const WebSocketMessagePtr& msg) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (msg->type == WebSocketMessageType::Message) serverReceived++;
+                });
+
+                std::lock_guard<std::mutex> lock(mutex);
+                connection = webSocket;
+            });
+
+        REQUIRE(server.listen().first);
+        server.start();
+
+        bool open = false;
+        bool pong = false;
+
+        WebSocket client;
+        client.setUrl("ws://127.0.0.1:" + std::to_string(port) + "/");
+        client.setPerMessageDeflateOptions(WebSocketPerMessageDeflateOptions(true));
+        client.setOnMessageCallback([&mutex, &open, &pong](const WebSocketMessagePtr& msg) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (msg->type == WebSocketMessageType::Open) open = true;
+            if (msg->type == WebSocketMessageType::Pong) pong = true;
+        });
+        client.start();
+
+        for (int i = 0; i < 300; ++i)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (open && connection) break;
+            }
+            ix::msleep(10);
+        }
+
+        // 3 small messages, and one sent uncompressed in 4 frames
+        std::string small(1000, 'a');
+        std::string large(4 * 32 * 1024 + 100, 'b');
+        REQUIRE(client.sendText(small).success);
+        REQUIRE(client.sendBinary(small).success);
+        REQUIRE(client.sendText(small).success);
+        REQUIRE(client.sendBinary(large, nullptr, nullptr, false).success);
+        REQUIRE(client.ping("rtt").success);
+
+        for (int i = 0; i < 300; ++i)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (serverReceived == 4 && pong) break;
+            }
+            ix::msleep(10);
+        }
+
+        WebSocketStats clientStats = client.getStats();
+        REQUIRE(clientStats.messagesSent == 4);
+        REQUIRE(clientStats.bytesSent == 3 * small.size() + large.size());
+        REQUIRE(clientStats.framesSent == 8);
+        REQUIRE(clientStats.fragmentsSent == 3);
+        REQUIRE(clientStats.wireBytesSent > large.size());
+        REQUIRE(clientStats.wireBytesSent < clientStats.bytesSent);
+        REQUIRE(clientStats.pingRtt.getCount() == 1);
+        REQUIRE(clientStats.sendLatency.getCount() == 4);
+        REQUIRE(clientStats.framesReceived == 1);
+        REQUIRE(clientStats.messagesReceived == 0);
+
+        WebSocketServerStats serverStats = server.getStats();
+        REQUIRE(serverStats.connections.size() == 1);
+
+        WebSocketStats& stats = serverStats.connections[0].stats;
+        REQUIRE(stats.messagesReceived == 4);
+        REQUIRE(stats.bytesReceived == clientStats.bytesSent);
+        REQUIRE(stats.wireBytesReceived == clientStats.wireBytesSent);
+        REQUIRE(stats.framesReceived == 8);
+        REQUIRE(stats.fragmentsReceived == 3);
+        REQUIRE(stats.framesSent == 1);
+        REQUIRE(serverStats.totals.messagesReceived == 4);
+
+        REQUIRE(server.getStats(false).connections.empty());
+        REQUIRE(server.getStats(false).totals.bytesReceived == stats.bytesReceived);
+
+        client.stop();
+
+        // The stats of the clients which are gone stay in the totals
+        for (int i = 0; i < 300 && server.getStats().connectedClients != 0; ++i)
+        {
+            ix::msleep(10);
+        }
+        serverStats = server.getStats();
+        REQUIRE(serverStats.connectedClients == 0);
+        REQUIRE(serverStats.totals.messagesReceived == 4);
+        REQUIRE(serverStats.totals.framesReceived == 9);
+
+        server.stop();
+    }
+}
@@ -0,0 +1,283 @@
+/*
+ *  IXWorkerPoolTest.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone. All rights reserved.
+ */
+
+#include "IXTest.h"
+#include "catch.hpp"
+#include <atomic>
+#include <ixwebsocket/IXWebSocket.h>
+#include <ixwebsocket/IXWebSocketServer.h>
+#include <ixwebsocket/IXWorkerPool.h>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace ix;
+
+TEST_CASE("WorkerPool", "[worker_pool]")
+{
+    SECTION("Posted tasks all run, on the pool threads")
+    {
+        std::atomic<int> count(0);
+        std::mutex mutex;
+        std::set<std::thread::id> threads;
+
+        WorkerPool workerPool(3);
+        REQUIRE(workerPool.getThreadCount() == 3);
+
+        for (int i = 0; i < 100; ++i)
+        {
+            workerPool.post([&count, &mutex, &threads]() {
+                count++;
+                std::lock_guard<std::mutex> lock(mutex);
+                threads.insert(std::this_thread::get_id());
+            });
+        }
+
+        // Queued tasks run before the threads are joined
+        workerPool.stop();
+        REQUIRE(count == 100);
+        REQUIRE(threads.size() <= 3);
+        REQUIRE(threads.count(std::this_thread::get_id()) == 0);
+
+        // The pool can be used again
+        workerPool.post([&count]() { count++; });
+        workerPool.stop();
+        REQUIRE(count == 101);
+    }
+
+    SECTION("Offloaded compression keeps the order of messages")
+    {
+        int port = getFreePort();
+        WebSocketServer server(port);
+        server.disableBlockingSend();
+        server.enableCompressionOffload(16 * 1024, std::make_shared<WorkerPool>(2));
+
+        std::mutex mutex;
+        std::shared_ptr<WebSocket> connection;
+
+        server.setOnConnectionCallback(
+            [&mutex, &connection](std::shared_ptr<WebSocket> webSocket,
+                                  std::shared_ptr<ConnectionState> /*connectionState*/) {
+                webSocket->setOnMessageCallback([](const WebSocketMessagePtr&) {});
+
+                std::lock_guard<std::mutex> lock(mutex);
+                connection = webSocket;
+            });
+
+        REQUIRE(server.listen().first);
+        server.start();
+
+        std::vector<std::string> received;
+        bool open = false;
+
+        // Context takeover, so messages would not inflate if they were reordered
+        WebSocket client;
+        client.setUrl("ws://127.0.0.1:" + std::to_string(port) + "/");
+        client.setPerMessageDeflateOptions(WebSocketPerMessageDeflateOptions(true));
+        client.setOnMessageCallback([&mutex, &received, &open](const WebSocketMessagePtr& msg) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (msg->type == WebSocketMessageType::Open) open = true;
+            if (msg->type == WebSocketMessageType::Message) received.push_back(msg->str);
+        });
+        client.start();
+
+        for (int i = 0; i < 300; ++i)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (open && connection) break;
+            }
+            ix::msleep(10);
+        }
+
+        std::vector<std::string> sent;
+        std::atomic<int> completed(0);
+        auto onSendComplete = [&completed](bool success) {
+            if (success) completed++;
+        };
+
+        for (int i = 0; i < 20; ++i)
+        {
+            std::string message = (i % 4 == 0) ? std::string(256 * 1024, 'a' + i % 26)
+                                               : "small message " + std::to_string(i);
+            sent.push_back(message);
+
+            auto info = connection->sendText(message, nullptr, onSendComplete);
+            REQUIRE(info.success);
+
+            // Large messages are offloaded, the others only while some are pending
+            if (message.size() > 16 * 1024) REQUIRE(info.wireSize == 0);
+        }
+
+        std::vector<WebSocketBatchMessage> batch = {{"batch 1"}, {std::string(1024, 'b')}};
+        REQUIRE(connection->sendBatch(batch, onSendComplete).success);
+        sent.push_back(batch[0].data);
+        sent.push_back(batch[1].data);
+
+        for (int i = 0; i < 500; ++i)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (received.size() >= sent.size()) break;
+            }
+            ix::msleep(10);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            REQUIRE(received == sent);
+        }
+        REQUIRE(completed == 21);
+
+        client.stop();
+        server.stop();
+    }
+
+    SECTION("Offloaded sends fail once the connection is closed")
+    {
+        int port = getFreePort();
+        WebSocketServer server(port);
+        server.enableCompressionOffload(1024);
+
+        std::mutex mutex;
+        std::shared_ptr<WebSocket> connection;
+
+        server.setOnConnectionCallback(
+            [&mutex, &connection](std::shared_ptr<WebSocket> webSocket,
+                                  std::shared_ptr<ConnectionState> /*connectionState*/) {
+                webSocket->setOnMessageCallback([](const WebSocketMessagePtr&) {});
+
+                std::lock_guard<std::mutex> lock(mutex);
+                connection = webSocket;
+            });
+
+        REQUIRE(server.listen().first);
+        server.start();
+
+        std::atomic<bool> open(false);
+        WebSocket client;
+        client.setUrl("ws://127.0.0.1:" + std::to_string(port) + "/");
+        client.setPerMessageDeflateOptions(WebSocketPerMessageDeflateOptions(true));
+        client.setOnMessageCallback([&open](const WebSocketMessagePtr& msg) {
+            if (msg->type == WebSocketMessageType::Open) open = true;
+        });
+        client.start();
+
+        std::shared_ptr<WebSocket> webSocket;
+        for (int i = 0; i < 300 && !webSocket; ++i)
+        {
+            ix::msleep(10);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (open) webSocket = connection;
+        }
+        REQUIRE(webSocket);
+
+        std::atomic<int> succeeded(0);
+        std::atomic<int> failed(0);
+        for (int i = 0; i < 10; ++i)
+        {
+            webSocket->sendText(std::string(1024 * 1024, 'x'), nullptr, [&](bool success) {
+                if (success)
+                    succeeded++;
+                else
+                    failed++;
+            });
+        }
+        webSocket->stop();
+
+        // Every callback fired once the offloaded sends were drained
+        for (int i = 0; i < 500 && succeeded + failed < 10; ++i)
+        {
+            ix::msleep(10);
+        }
+        REQUIRE(succeeded + failed == 10);
+
+        client.stop();
+        server.stop();
+    }
+
+    SECTION("A send callback on the worker may destroy its connection")
+    {
+        int port = getFreePort();
+        WebSocketServer server(port);
+
+        std::mutex mutex;
+        std::shared_ptr<WebSocket> connection;
+
+        server.setOnConnectionCallback(
+            [&mutex, &connection](std::shared_ptr<WebSocket> webSocket,
+                                  std::shared_ptr<ConnectionState> /*connectionState*/) {
+                webSocket->setOnMessageCallback([](const WebSocketMessagePtr&) {});
+
+                std::lock_guard<std::mutex> lock(mutex);
+                connection = webSocket;
+            });
+
+        REQUIRE(server.listen().first);
+        server.start();
+
+        // Holds the worker until the connection is closed
+        auto workerPool = std::make_shared<WorkerPool>(1);
+        std::atomic<bool> open(false);
+        std::atomic<bool> closed(false);
+        workerPool->post([&closed]() {
+            for (int i = 0; i < 500 && !closed; ++i)
+            {
+                ix::msleep(10);
+            }
+        });
+
+        auto client = std::make_shared<WebSocket>();
+        client->setUrl("ws://127.0.0.1:" + std::to_string(port) + "/");
+        client->disableAutomaticReconnection();
+        client->setPerMessageDeflateOptions(WebSocketPerMessageDeflateOptions(true));
+        client->enableCompressionOffload(1024, workerPool);
+        client->setOnMessageCallback([&open, &closed](const WebSocketMessagePtr& msg) {
+            if (msg->type == WebSocketMessageType::Open) open = true;
+            if (msg->type == WebSocketMessageType::Close) closed = true;
+        });
+        client->start();
+
+        std::shared_ptr<WebSocket> webSocket;
+        for (int i = 0; i < 300 && !webSocket; ++i)
+        {
+            ix::msleep(10);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (open) webSocket = connection;
+        }
+        REQUIRE(webSocket);
+
+        // The offloaded sends fail on the worker, where the first callback drops
+        // the last reference to the client
+        std::atomic<bool> destroyed(false);
+        std::shared_ptr<WebSocket> holder = client;
+        client.reset();
+        for (int i = 0; i < 5; ++i)
+        {
+            holder->sendText(std::string(64 * 1024, 'x'), nullptr, [&](bool /*success*/) {
+                std::shared_ptr<WebSocket> last;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    last.swap(holder);
+                }
+                if (!last) return;
+
+                last.reset();
+                destroyed = true;
+            });
+        }
+
+        webSocket->close();
+        for (int i = 0; i < 500 && !destroyed; ++i)
+        {
+            ix::msleep(10);
+        }
+        REQUIRE(destroyed);
+
+        server.stop();
+    }
+}
@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+'''Compare two ixwebsocket_bench --json reports.
+
+Prints the time per iteration of each benchmark found in both reports, and
+the change from the baseline. Exits with 1 when one got slower by more than
+the threshold, so it can gate a CI job.
+
+    tools/bench_compare.py baseline.json current.json [--threshold 10]
+'''
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        report = json.load(f)
+    return {b['name']: b for b in report['benchmarks']}
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Compare two benchmark reports')
+    parser.add_argument('baseline')
+    parser.add_argument('current')
+    parser.add_argument('--threshold', type=float, default=10.0,
+                        help='slowdown in percent reported as a regression')
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+
+    regressions = 0
+    print('{:<45} {:>14} {:>14} {:>9}'.format('Benchmark', 'Baseline ns', 'Current ns', 'Change'))
+
+    for name in sorted(set(baseline) & set(current)):
+        before = baseline[name]['ns_per_iteration']
+        after = current[name]['ns_per_iteration']
+        change = (after - before) * 100.0 / before if before > 0 else 0.0
+
+        mark = ''
+        if change > args.threshold:
+            mark = '  slower'
+            regressions += 1
+
+        print('{:<45} {:>14.1f} {:>14.1f} {:>+8.1f}%{}'.format(name, before, after, change, mark))
+
+    for name in sorted(set(baseline) ^ set(current)):
+        print('{:<45} only in {}'.format(name, 'baseline' if name in baseline else 'current'))
+
+    return 1 if regressions else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -17,6 +17,7 @@
 #include <ixsentry/IXSentryClient.h>
 #include <ixwebsocket/IXNetSystem.h>
 #include <ixwebsocket/IXSocket.h>
+#include <ixwebsocket/IXSocketServer.h>
 #include <ixwebsocket/IXUserAgent.h>
 #include <spdlog/spdlog.h>
 #include <sstream>
@@ -75,6 +76,8 @@ int main(int argc, char** argv)
     std::string redisPassword;
     std::string appsConfigPath("appsConfig.json");
     std::string subprotocol;
+    std::string writeOut;
+    std::string jsonPath;
     std::string remoteHost;
     std::string minidump;
     std::string metadata;
@@ -110,6 +113,12 @@ int main(int argc, char** argv)
     int maxRedirects = 5;
     int delayMs = -1;
     int count = 1;
+    int connections = 10;
+    int rampUpMs = 0;
+    int messageSize = 1024;
+    int rate = 0;
+    int durationSecs = 10;
+    size_t maxConnections = ix::SocketServer::kDefaultMaxConnections;
     uint32_t maxWaitBetweenReconnectionRetries;
     size_t maxQueueSize = 100;
     int pingIntervalSecs = 30;
@@ -175,6 +184,7 @@ int main(int argc, char** argv)
                            pingIntervalSecs,
                            "Interval between sending pings");
     connectApp->add_option("--subprotocol", subprotocol, "Subprotocol");
+    connectApp->add_option("-w", writeOut, "Print connection times, curl -w style");
     addTLSOptions(connectApp);
 
     CLI::App* chatApp = app.add_subcommand("chat", "Group chat");
@@ -188,6 +198,8 @@ int main(int argc, char** argv)
     echoServerApp->add_flag("-6", ipv6, "IpV6");
     echoServerApp->add_flag("-x", disablePerMessageDeflate, "Disable per message deflate");
     echoServerApp->add_flag("-p", disablePong, "Disable sending PONG in response to PING");
+    echoServerApp->add_flag("-q", quiet, "Do not log each message");
+    echoServerApp->add_option("--max_connections", maxConnections, "Max connections");
     addTLSOptions(echoServerApp);
 
     CLI::App* broadcastServerApp = app.add_subcommand("broadcast_server", "Broadcasting server");
@@ -195,6 +207,17 @@ int main(int argc, char** argv)
     broadcastServerApp->add_option("--host", hostname, "Hostname");
     addTLSOptions(broadcastServerApp);
 
+    CLI::App* benchApp = app.add_subcommand("bench", "Load an echo server and measure latency");
+    benchApp->add_option("url", url, "Connection url")->required();
+    benchApp->add_option("-n", connections, "Number of connections");
+    benchApp->add_option("--ramp_up", rampUpMs, "Time (ms) over which connections are opened");
+    benchApp->add_option("-s", messageSize, "Message size in bytes (at least 20)");
+    benchApp->add_option("-r", rate, "Messages per second per connection, 0 for one in flight");
+    benchApp->add_option("--duration", durationSecs, "Measurement duration in seconds");
+    benchApp->add_option("--json", jsonPath, "Also write the results to that JSON file");
+    benchApp->add_flag("-x", disablePerMessageDeflate, "Disable per message deflate");
+    addTLSOptions(benchApp);
+
     CLI::App* pingPongApp = app.add_subcommand("ping", "Ping pong");
     pingPongApp->add_option("url", url, "Connection url")->required();
     addTLSOptions(pingPongApp);
@@ -213,6 +236,7 @@ int main(int argc, char** argv)
     httpClientApp->add_flag("--compress", compress, "Enable gzip compression");
     httpClientApp->add_option("--connect-timeout", connectTimeOut, "Connection timeout");
     httpClientApp->add_option("--transfer-timeout", transferTimeout, "Transfer timeout");
+    httpClientApp->add_option("-w", writeOut, "Print connection times, curl -w style");
     addTLSOptions(httpClientApp);
 
     CLI::App* redisPublishApp = app.add_subcommand("redis_publish", "Redis publisher");
@@ -395,7 +419,8 @@ int main(int argc, char** argv)
                                   maxWaitBetweenReconnectionRetries,
                                   tlsOptions,
                                   subprotocol,
-                                  pingIntervalSecs);
+                                  pingIntervalSecs,
+                                  writeOut);
     }
     else if (app.got_subcommand("chat"))
     {
@@ -403,13 +428,32 @@ int main(int argc, char** argv)
     }
     else if (app.got_subcommand("echo_server"))
     {
-        ret = ix::ws_echo_server_main(
-            port, greetings, hostname, tlsOptions, ipv6, disablePerMessageDeflate, disablePong);
+        ret = ix::ws_echo_server_main(port,
+                                      greetings,
+                                      hostname,
+                                      tlsOptions,
+                                      ipv6,
+                                      disablePerMessageDeflate,
+                                      disablePong,
+                                      quiet,
+                                      maxConnections);
     }
     else if (app.got_subcommand("broadcast_server"))
     {
         ret = ix::ws_broadcast_server_main(port, hostname, tlsOptions);
     }
+    else if (app.got_subcommand("bench"))
+    {
+        ret = ix::ws_bench_main(url,
+                                disablePerMessageDeflate,
+                                tlsOptions,
+                                connections,
+                                rampUpMs,
+                                messageSize,
+                                rate,
+                                durationSecs,
+                                jsonPath);
+    }
     else if (app.got_subcommand("ping"))
     {
         ret = ix::ws_ping_pong_main(url, tlsOptions);
@@ -428,7 +472,8 @@ int main(int argc, char** argv)
                                       save,
                                       output,
                                       compress,
-                                      tlsOptions);
+                                      tlsOptions,
+                                      writeOut);
     }
     else if (app.got_subcommand("redis_publish"))
     {
@@ -23,7 +23,8 @@ namespace ix
                             bool save,
                             const std::string& output,
                             bool compress,
-                            const ix::SocketTLSOptions& tlsOptions);
+                            const ix::SocketTLSOptions& tlsOptions,
+                            const std::string& writeOut);
 
     int ws_ping_pong_main(const std::string& url, const ix::SocketTLSOptions& tlsOptions);
 
@@ -33,7 +34,9 @@ namespace ix
                             const ix::SocketTLSOptions& tlsOptions,
                             bool ipv6,
                             bool disablePerMessageDeflate,
-                            bool disablePong);
+                            bool disablePong,
+                            bool quiet,
+                            size_t maxConnections);
 
     int ws_broadcast_server_main(int port,
                                  const std::string& hostname,
@@ -52,7 +55,8 @@ namespace ix
                         uint32_t maxWaitBetweenReconnectionRetries,
                         const ix::SocketTLSOptions& tlsOptions,
                         const std::string& subprotocol,
-                        int pingIntervalSecs);
+                        int pingIntervalSecs,
+                        const std::string& writeOut);
 
     int ws_receive_main(const std::string& url,
                         bool enablePerMessageDeflate,
@@ -118,6 +122,16 @@ namespace ix
 
     int ws_autobahn_main(const std::string& url, bool quiet);
 
+    int ws_bench_main(const std::string& url,
+                      bool disablePerMessageDeflate,
+                      const ix::SocketTLSOptions& tlsOptions,
+                      int connections,
+                      int rampUpMs,
+                      int messageSize,
+                      int rate,
+                      int durationSecs,
+                      const std::string& jsonPath);
+
     int ws_redis_server_main(int port, const std::string& hostname);
 
     int ws_proxy_server_main(int port,
@@ -0,0 +1,376 @@
+/*
+ *  ws_bench.cpp
+ *  Author: Benjamin Sergeant
+ *  Copyright (c) 2020 Machine Zone, Inc. All rights reserved.
+ */
+
+//
+// Load generator for an echo server, such as ws echo_server. Each message
+// starts with the time it was due to be sent (in microseconds, 20 digits),
+// so its round trip time is known when the echo comes back. With a rate,
+// messages are sent on schedule whether or not echoes came back, and
+// latencies include the time spent waiting to be sent. Without a rate, each
+// connection sends its next message once the previous one came back.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <ixwebsocket/IXSocketTLSOptions.h>
+#include <ixwebsocket/IXWebSocket.h>
+#include <ixwebsocket/IXWebSocketStats.h>
+#include <jsoncpp/json/json.h>
+#include <memory>
+#include <random>
+#include <spdlog/spdlog.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    const size_t kTimestampSize = 20;
+
+    uint64_t getNowUs()
+    {
+        auto now = std::chrono::steady_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+    }
+} // namespace
+
+namespace ix
+{
+    class WebSocketBench
+    {
+    public:
+        WebSocketBench(const std::string& url,
+                       bool disablePerMessageDeflate,
+                       const ix::SocketTLSOptions& tlsOptions,
+                       int connections,
+                       int messageSize,
+                       int rate);
+
+        void run(int rampUpMs, int durationSecs);
+
+        // False when no echo came back
+        bool report(const std::string& jsonPath);
+
+    private:
+        struct Connection
+        {
+            ix::WebSocket webSocket;
+            std::atomic<bool> open;
+            uint64_t sent;
+
+            Connection()
+                : open(false)
+                , sent(0)
+            {
+                ;
+            }
+        };
+
+        void startConnection(Connection& connection);
+        void send(Connection& connection, uint64_t dueUs);
+        void onEcho(const std::string& str);
+        void writeJson(const std::string& jsonPath,
+                       double seconds,
+                       double messagesPerSec,
+                       double megabytesPerSec);
+        int getOpenConnections() const;
+
+        std::string _url;
+        bool _disablePerMessageDeflate;
+        ix::SocketTLSOptions _tlsOptions;
+        int _messageSize;
+        int _rate;
+        std::string _payload;
+        std::vector<std::unique_ptr<Connection>> _connections;
+
+        // Echoes are counted when they come back inside the measurement window
+        std::atomic<bool> _running;
+        std::atomic<uint64_t> _measureStartUs;
+        std::atomic<uint64_t> _measureEndUs;
+        uint64_t _elapsedUs;
+
+        ix::LatencyHistogram _latency;
+        std::atomic<uint64_t> _messagesSent;
+        std::atomic<uint64_t> _messagesReceived;
+        std::atomic<uint64_t> _bytesReceived;
+        std::atomic<uint64_t> _errors;
+    };
+
+    WebSocketBench::WebSocketBench(const std::string& url,
+                                   bool disablePerMessageDeflate,
+                                   const ix::SocketTLSOptions& tlsOptions,
+                                   int connections,
+                                   int messageSize,
+                                   int rate)
+        : _url(url)
+        , _disablePerMessageDeflate(disablePerMessageDeflate)
+        , _tlsOptions(tlsOptions)
+        , _messageSize(std::max(messageSize, (int) kTimestampSize))
+        , _rate(rate)
+        , _running(true)
+        , _measureStartUs(UINT64_MAX)
+        , _measureEndUs(UINT64_MAX)
+        , _elapsedUs(0)
+        , _messagesSent(0)
+        , _messagesReceived(0)
+        , _bytesReceived(0)
+        , _errors(0)
+    {
+        // Random letters and digits, which deflate about as well as text
+        const std::string alphabet("abcdefghijklmnopqrstuvwxyz0123456789");
+        std::mt19937 generator(0);
+        std::uniform_int_distribution<size_t> distribution(0, alphabet.size() - 1);
+
+        _payload.resize((size_t) _messageSize);
+        for (auto&& c : _payload)
+        {
+            c = alphabet[distribution(generator)];
+        }
+
+        for (int i = 0; i < connections; ++i)
+        {
+            _connections.emplace_back(new Connection());
+        }
+    }
+
+    void WebSocketBench::send(Connection& connection, uint64_t dueUs)
+    {
+        std::string message(_payload);
+        char timestamp[kTimestampSize + 1];
+        snprintf(timestamp, sizeof(timestamp), "%020llu", (unsigned long long) dueUs);
+        message.replace(0, kTimestampSize, timestamp);
+
+        if (connection.webSocket.sendText(message).success) _messagesSent++;
+        connection.sent++;
+    }
+
+    void WebSocketBench::onEcho(const std::string& str)
+    {
+        uint64_t nowUs = getNowUs();
+        if (str.size() < kTimestampSize) return;
+        if (nowUs < _measureStartUs || nowUs > _measureEndUs) return;
+
+        uint64_t dueUs = strtoull(str.substr(0, kTimestampSize).c_str(), nullptr, 10);
+        _latency.record(nowUs >= dueUs ? nowUs - dueUs : 0);
+        _messagesReceived++;
+        _bytesReceived += str.size();
+    }
+
+    void WebSocketBench::startConnection(Connection& connection)
+    {
+        connection.webSocket.setUrl(_url);
+        connection.webSocket.setTLSOptions(_tlsOptions);
+        connection.webSocket.disableAutomaticReconnection();
+        if (!_disablePerMessageDeflate)
+        {
+            connection.webSocket.setPerMessageDeflateOptions(
+                ix::WebSocketPerMessageDeflateOptions(true));
+        }
+
+        connection.webSocket.setOnMessageCallback([this, &connection](
+                                                      const ix::WebSocketMessagePtr& msg) {
+            if (msg->type == ix::WebSocketMessageType::Open)
+            {
+                connection.open = true;
+
+                // Without a rate, each connection keeps one message in flight
+                if (_rate == 0) send(connection, getNowUs());
+            }
+            else if (msg->type == ix::WebSocketMessageType::Message)
+            {
+                onEcho(msg->str);
+                if (_rate == 0 && _running) send(connection, getNowUs());
+            }
+            else if (msg->type == ix::WebSocketMessageType::Close)
+            {
+                connection.open = false;
+                if (_running) _errors++;
+            }
+            else if (msg->type == ix::WebSocketMessageType::Error)
+            {
+                spdlog::error("Connection error: {}", msg->errorInfo.reason);
+                _errors++;
+            }
+        });
+
+        connection.webSocket.start();
+    }
+
+    int WebSocketBench::getOpenConnections() const
+    {
+        int open = 0;
+        for (auto&& connection : _connections)
+        {
+            if (connection->open) open++;
+        }
+        return open;
+    }
+
+    void WebSocketBench::run(int rampUpMs, int durationSecs)
+    {
+        spdlog::info("Opening {} connections to {}", _connections.size(), _url);
+
+        uint64_t startUs = getNowUs();
+        uint64_t connectDeadlineUs = startUs + (uint64_t) rampUpMs * 1000 + 10 * 1000 * 1000;
+        size_t started = 0;
+        std::vector<uint64_t> openUs(_connections.size(), 0);
+
+        while (_running)
+        {
+            uint64_t nowUs = getNowUs();
+
+            // Connections are spread over the ramp up time
+            while (started < _connections.size() &&
+                   (rampUpMs <= 0 ||
+                    nowUs - startUs >= (uint64_t) rampUpMs * 1000 * started / _connections.size()))
+            {
+                startConnection(*_connections[started++]);
+            }
+
+            // The measurement starts once every connection is open, or gave up
+            if (_measureStartUs == UINT64_MAX && started == _connections.size() &&
+                (getOpenConnections() == (int) _connections.size() || nowUs > connectDeadlineUs))
+            {
+                spdlog::info("{} connections open, running for {} seconds",
+                             getOpenConnections(),
+                             durationSecs);
+                _measureEndUs = nowUs + (uint64_t) durationSecs * 1000 * 1000;
+                _measureStartUs = nowUs;
+
+                if (getOpenConnections() == 0)
+                {
+                    spdlog::error("No connection could be opened");
+                    _measureEndUs = nowUs;
+                    break;
+                }
+            }
+
+            if (nowUs > _measureEndUs) break;
+
+            // With a rate, messages are due at fixed times from the connection
+            // open, and the loop sleeps until the next one is due
+            uint64_t sleepUs = 1000;
+            if (_rate > 0)
+            {
+                for (size_t i = 0; i < _connections.size(); ++i)
+                {
+                    Connection& connection = *_connections[i];
+                    if (!connection.open) continue;
+                    if (openUs[i] == 0) openUs[i] = nowUs;
+
+                    uint64_t due = (nowUs - openUs[i]) * _rate / (1000 * 1000) + 1;
+                    while (connection.sent < due)
+                    {
+                        send(connection, openUs[i] + connection.sent * 1000 * 1000 / _rate);
+                    }
+
+                    uint64_t nextDueUs = openUs[i] + connection.sent * 1000 * 1000 / _rate;
+                    uint64_t afterUs = getNowUs();
+                    sleepUs = std::min(sleepUs, nextDueUs > afterUs ? nextDueUs - afterUs : 0);
+                }
+            }
+
+            std::this_thread::sleep_for(std::chrono::microseconds(sleepUs));
+        }
+
+        _running = false;
+        _elapsedUs = _measureEndUs - _measureStartUs;
+
+        for (auto&& connection : _connections)
+        {
+            connection->webSocket.close();
+        }
+        for (auto&& connection : _connections)
+        {
+            connection->webSocket.stop();
+        }
+    }
+
+    bool WebSocketBench::report(const std::string& jsonPath)
+    {
+        double seconds = _elapsedUs / 1e6;
+        double messagesPerSec = seconds > 0 ? _messagesReceived / seconds : 0;
+        double megabytesPerSec = seconds > 0 ? _bytesReceived / 1e6 / seconds : 0;
+
+        spdlog::info("connections: {}, message size: {} bytes, rate: {}, compression: {}",
+                     _connections.size(),
+                     _messageSize,
+                     _rate > 0 ? std::to_string(_rate) + " msgs/s per connection" : "unlimited",
+                     _disablePerMessageDeflate ? "off" : "on");
+        spdlog::info("sent {} messages, received {} echoes in {:.2f} s",
+                     _messagesSent.load(),
+                     _messagesReceived.load(),
+                     seconds);
+        spdlog::info("throughput: {:.1f} msgs/s, {:.2f} MB/s", messagesPerSec, megabytesPerSec);
+        spdlog::info("latency (us): p50 {} p99 {} p999 {} max {} mean {:.1f}",
+                     _latency.getPercentile(50),
+                     _latency.getPercentile(99),
+                     _latency.getPercentile(99.9),
+                     _latency.getMax(),
+                     _latency.getMean());
+        spdlog::info("errors: {}", _errors.load());
+
+        if (!jsonPath.empty())
+        {
+            writeJson(jsonPath, seconds, messagesPerSec, megabytesPerSec);
+        }
+
+        return _messagesReceived != 0;
+    }
+
+    void WebSocketBench::writeJson(const std::string& jsonPath,
+                                   double seconds,
+                                   double messagesPerSec,
+                                   double megabytesPerSec)
+    {
+
+        Json::Value result;
+        result["url"] = _url;
+        result["connections"] = (Json::UInt64) _connections.size();
+        result["message_size"] = _messageSize;
+        result["rate"] = _rate;
+        result["compression"] = !_disablePerMessageDeflate;
+        result["duration_secs"] = seconds;
+        result["messages_sent"] = (Json::UInt64) _messagesSent;
+        result["messages_received"] = (Json::UInt64) _messagesReceived;
+        result["messages_per_sec"] = messagesPerSec;
+        result["megabytes_per_sec"] = megabytesPerSec;
+        result["errors"] = (Json::UInt64) _errors;
+
+        Json::Value latency;
+        latency["p50"] = (Json::UInt64) _latency.getPercentile(50);
+        latency["p99"] = (Json::UInt64) _latency.getPercentile(99);
+        latency["p999"] = (Json::UInt64) _latency.getPercentile(99.9);
+        latency["max"] = (Json::UInt64) _latency.getMax();
+        latency["mean"] = _latency.getMean();
+        result["latency_us"] = latency;
+
+        std::ofstream out(jsonPath);
+        Json::StreamWriterBuilder builder;
+        out << Json::writeString(builder, result) << std::endl;
+        spdlog::info("Wrote {}", jsonPath);
+    }
+
+    int ws_bench_main(const std::string& url,
+                      bool disablePerMessageDeflate,
+                      const ix::SocketTLSOptions& tlsOptions,
+                      int connections,
+                      int rampUpMs,
+                      int messageSize,
+                      int rate,
+                      int durationSecs,
+                      const std::string& jsonPath)
+    {
+        WebSocketBench bench(
+            url, disablePerMessageDeflate, tlsOptions, connections, messageSize, rate);
+        bench.run(rampUpMs, durationSecs);
+
+        return bench.report(jsonPath) ? 0 : 1;
+    }
+} // namespace ix
@@ -19,6 +19,7 @@ namespace ix
 
         ix::WebSocketServer server(port, hostname);
         server.setTLSOptions(tlsOptions);
+        server.disableBlockingSend();
 
         server.setOnConnectionCallback([&server](std::shared_ptr<WebSocket> webSocket,
                                                  std::shared_ptr<ConnectionState> connectionState) {
@@ -62,19 +63,17 @@ namespace ix
                     {
                         if (client != webSocket)
                         {
-                            client->send(msg->str, msg->binary, [](int current, int total) -> bool {
-                                spdlog::info("Step {} out of {}", current, total);
-                                return true;
-                            });
-
-                            do
-                            {
-                                size_t bufferedAmount = client->bufferedAmount();
-                                spdlog::info("{} bytes left to be sent", bufferedAmount);
-
-                                std::chrono::duration<double, std::milli> duration(500);
-                                std::this_thread::sleep_for(duration);
-                            } while (client->bufferedAmount() != 0);
+                            // Sends do not block, a slow client does not hold back the others
+                            client->send(
+                                msg->str,
+                                msg->binary,
+                                [](int current, int total) -> bool {
+                                    spdlog::info("Step {} out of {}", current, total);
+                                    return true;
+                                },
+                                [](bool success) {
+                                    spdlog::info("Message {}", success ? "sent" : "not sent");
+                                });
                         }
                     }
                 }
@@ -25,7 +25,8 @@ namespace ix
                          uint32_t maxWaitBetweenReconnectionRetries,
                          const ix::SocketTLSOptions& tlsOptions,
                          const std::string& subprotocol,
-                         int pingIntervalSecs);
+                         int pingIntervalSecs,
+                         const std::string& writeOut);
 
         void subscribe(const std::string& channel);
         void start();
@@ -48,6 +49,7 @@ namespace ix
         ix::WebSocket _webSocket;
         bool _disablePerMessageDeflate;
         bool _binaryMode;
+        std::string _writeOut;
         std::atomic<int> _receivedBytes;
         std::atomic<int> _sentBytes;
 
@@ -63,10 +65,12 @@ namespace ix
                                        uint32_t maxWaitBetweenReconnectionRetries,
                                        const ix::SocketTLSOptions& tlsOptions,
                                        const std::string& subprotocol,
-                                       int pingIntervalSecs)
+                                       int pingIntervalSecs,
+                                       const std::string& writeOut)
         : _url(url)
         , _disablePerMessageDeflate(disablePerMessageDeflate)
         , _binaryMode(binaryMode)
+        , _writeOut(writeOut)
         , _receivedBytes(0)
         , _sentBytes(0)
     {
@@ -162,6 +166,7 @@ namespace ix
                 {
                     spdlog::info("{}: {}", it.first, it.second);
                 }
+                std::cout << msg->openInfo.timings.format(_writeOut);
             }
             else if (msg->type == ix::WebSocketMessageType::Close)
             {
@@ -227,7 +232,8 @@ namespace ix
                         uint32_t maxWaitBetweenReconnectionRetries,
                         const ix::SocketTLSOptions& tlsOptions,
                         const std::string& subprotocol,
-                        int pingIntervalSecs)
+                        int pingIntervalSecs,
+                        const std::string& writeOut)
     {
         std::cout << "Type Ctrl-D to exit prompt..." << std::endl;
         WebSocketConnect webSocketChat(url,
@@ -238,7 +244,8 @@ namespace ix
                                        maxWaitBetweenReconnectionRetries,
                                        tlsOptions,
                                        subprotocol,
-                                       pingIntervalSecs);
+                                       pingIntervalSecs,
+                                       writeOut);
         webSocketChat.start();
 
         while (true)
@@ -17,14 +17,16 @@ namespace ix
                             const ix::SocketTLSOptions& tlsOptions,
                             bool ipv6,
                             bool disablePerMessageDeflate,
-                            bool disablePong)
+                            bool disablePong,
+                            bool quiet,
+                            size_t maxConnections)
     {
         spdlog::info("Listening on {}:{}", hostname, port);
 
         ix::WebSocketServer server(port,
                                    hostname,
                                    SocketServer::kDefaultTcpBacklog,
-                                   SocketServer::kDefaultMaxConnections,
+                                   maxConnections,
                                    WebSocketServer::kDefaultHandShakeTimeoutSecs,
                                    (ipv6) ? AF_INET6 : AF_INET);
 
@@ -43,10 +45,10 @@ namespace ix
         }
 
         server.setOnConnectionCallback(
-            [greetings](std::shared_ptr<ix::WebSocket> webSocket,
-                        std::shared_ptr<ConnectionState> connectionState) {
+            [greetings, quiet](std::shared_ptr<ix::WebSocket> webSocket,
+                               std::shared_ptr<ConnectionState> connectionState) {
                 webSocket->setOnMessageCallback(
-                    [webSocket, connectionState, greetings](const WebSocketMessagePtr& msg) {
+                    [webSocket, connectionState, greetings, quiet](const WebSocketMessagePtr& msg) {
                         if (msg->type == ix::WebSocketMessageType::Open)
                         {
                             spdlog::info("New connection");
@@ -79,7 +81,7 @@ namespace ix
                         }
                         else if (msg->type == ix::WebSocketMessageType::Message)
                         {
-                            spdlog::info("Received {} bytes", msg->wireSize);
+                            if (!quiet) spdlog::info("Received {} bytes", msg->wireSize);
                             webSocket->send(msg->str, msg->binary);
                         }
                     });
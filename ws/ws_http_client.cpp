@@ -5,6 +5,7 @@
  */
 
 #include <fstream>
+#include <iostream>
 #include <ixwebsocket/IXHttpClient.h>
 #include <ixwebsocket/IXSocketTLSOptions.h>
 #include <ixwebsocket/IXWebSocketHttpHeaders.h>
@@ -95,7 +96,8 @@ namespace ix
                             bool save,
                             const std::string& output,
                             bool compress,
-                            const ix::SocketTLSOptions& tlsOptions)
+                            const ix::SocketTLSOptions& tlsOptions,
+                            const std::string& writeOut)
     {
         HttpClient httpClient;
         httpClient.setTLSOptions(tlsOptions);
@@ -177,6 +179,8 @@ namespace ix
             }
         }
 
+        std::cout << response->timings.format(writeOut);
+
         return 0;
     }
 } // namespace ix